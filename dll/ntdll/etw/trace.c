@@ -5,13 +5,251 @@
 #include <ntdll.h>
 
 #include <wmistr.h>
+#include <initguid.h>
 #include <evntrace.h>
+#include <wmiioctl.h>
 
 #define NDEBUG
 #include <debug.h>
 
 #define FIXME DPRINT1
 
+/* The kernel takes the properties as they are */
+C_ASSERT(sizeof(WMI_LOGGER_INFORMATION) == sizeof(EVENT_TRACE_PROPERTIES));
+C_ASSERT(FIELD_OFFSET(WMI_LOGGER_INFORMATION, LoggerNameOffset) ==
+         FIELD_OFFSET(EVENT_TRACE_PROPERTIES, LoggerNameOffset));
+
+/* Room for the names the kernel returns when querying */
+#define ETWP_NAME_LENGTH (MAX_PATH + 4)
+
+static
+BOOLEAN
+EtwpIsKernelLogger(
+    TRACEHANDLE SessionHandle,
+    PCWSTR SessionName,
+    PEVENT_TRACE_PROPERTIES Properties)
+{
+    if (SessionHandle == WMI_KERNEL_LOGGER_ID)
+        return TRUE;
+
+    if ((SessionName) && !_wcsicmp(SessionName, KERNEL_LOGGER_NAMEW))
+        return TRUE;
+
+    return IsEqualGUID(&Properties->Wnode.Guid, &SystemTraceControlGuid);
+}
+
+static
+ULONG
+EtwpSendLoggerControl(
+    ULONG IoControlCode,
+    PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    UNICODE_STRING DeviceName = RTL_CONSTANT_STRING(L"\\Device\\WMIDataDevice");
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    HANDLE DeviceHandle;
+    BOOLEAN WasEnabled;
+    NTSTATUS Status, PrivilegeStatus;
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &DeviceName,
+                               OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+    Status = NtOpenFile(&DeviceHandle,
+                        FILE_READ_DATA | FILE_WRITE_DATA | SYNCHRONIZE,
+                        &ObjectAttributes,
+                        &IoStatusBlock,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE,
+                        FILE_SYNCHRONOUS_IO_NONALERT);
+    if (!NT_SUCCESS(Status))
+        return RtlNtStatusToDosError(Status);
+
+    /* Controlling the logger needs the profiling privilege, querying doesn't */
+    PrivilegeStatus = RtlAdjustPrivilege(SE_SYSTEM_PROFILE_PRIVILEGE, TRUE, FALSE, &WasEnabled);
+
+    Status = NtDeviceIoControlFile(DeviceHandle,
+                                   NULL,
+                                   NULL,
+                                   NULL,
+                                   &IoStatusBlock,
+                                   IoControlCode,
+                                   LoggerInfo,
+                                   LoggerInfo->Wnode.BufferSize,
+                                   LoggerInfo,
+                                   LoggerInfo->Wnode.BufferSize);
+
+    if (NT_SUCCESS(PrivilegeStatus) && !WasEnabled)
+        RtlAdjustPrivilege(SE_SYSTEM_PROFILE_PRIVILEGE, FALSE, FALSE, &WasEnabled);
+
+    NtClose(DeviceHandle);
+    return RtlNtStatusToDosError(Status);
+}
+
+static
+VOID
+EtwpReturnName(
+    PEVENT_TRACE_PROPERTIES Properties,
+    ULONG Offset,
+    PCWSTR Name,
+    BOOLEAN Ansi)
+{
+    ULONG Available, Length = (ULONG)wcslen(Name) * sizeof(WCHAR);
+
+    /* Only where the caller asked for it and has room */
+    if ((Offset < sizeof(EVENT_TRACE_PROPERTIES)) || (Offset >= Properties->Wnode.BufferSize))
+        return;
+    Available = Properties->Wnode.BufferSize - Offset;
+
+    if (Ansi)
+    {
+        RtlUnicodeToMultiByteN((PCHAR)Properties + Offset, Available - 1, &Length, Name, Length);
+        ((PCHAR)Properties)[Offset + Length] = ANSI_NULL;
+    }
+    else if (Length + sizeof(WCHAR) <= Available)
+    {
+        RtlCopyMemory((PUCHAR)Properties + Offset, Name, Length + sizeof(WCHAR));
+    }
+}
+
+static
+VOID
+EtwpReturnProperties(
+    PEVENT_TRACE_PROPERTIES Properties,
+    PWMI_LOGGER_INFORMATION LoggerInfo,
+    BOOLEAN Ansi)
+{
+    ULONG BufferSize = Properties->Wnode.BufferSize;
+    ULONG LogFileNameOffset = Properties->LogFileNameOffset;
+    ULONG LoggerNameOffset = Properties->LoggerNameOffset;
+
+    /* Copy the statistics, but keep the caller's layout */
+    RtlCopyMemory(Properties, LoggerInfo, sizeof(EVENT_TRACE_PROPERTIES));
+    Properties->Wnode.BufferSize = BufferSize;
+    Properties->LogFileNameOffset = LogFileNameOffset;
+    Properties->LoggerNameOffset = LoggerNameOffset;
+
+    EtwpReturnName(Properties,
+                   LoggerNameOffset,
+                   (PCWSTR)((PUCHAR)LoggerInfo + LoggerInfo->LoggerNameOffset),
+                   Ansi);
+    if (LoggerInfo->LogFileNameOffset)
+    {
+        EtwpReturnName(Properties,
+                       LogFileNameOffset,
+                       (PCWSTR)((PUCHAR)LoggerInfo + LoggerInfo->LogFileNameOffset),
+                       Ansi);
+    }
+}
+
+static
+ULONG
+EtwpStartKernelLogger(
+    PTRACEHANDLE SessionHandle,
+    PEVENT_TRACE_PROPERTIES Properties,
+    PCWSTR LogFileName,
+    BOOLEAN Ansi)
+{
+    PWMI_LOGGER_INFORMATION LoggerInfo;
+    UNICODE_STRING NtFileName;
+    ULONG Size, Error;
+
+    /* The kernel logger only writes to files */
+    if (!(LogFileName) || !(LogFileName[0]))
+        return ERROR_BAD_PATHNAME;
+    if (!RtlDosPathNameToNtPathName_U(LogFileName, &NtFileName, NULL, NULL))
+        return ERROR_BAD_PATHNAME;
+
+    Size = sizeof(WMI_LOGGER_INFORMATION) + sizeof(KERNEL_LOGGER_NAMEW) +
+           NtFileName.Length + sizeof(WCHAR);
+    LoggerInfo = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, Size);
+    if (!LoggerInfo)
+    {
+        RtlFreeUnicodeString(&NtFileName);
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    /* Build the request with both names behind the properties */
+    RtlCopyMemory(LoggerInfo, Properties, sizeof(EVENT_TRACE_PROPERTIES));
+    LoggerInfo->Wnode.BufferSize = Size;
+    LoggerInfo->Wnode.Guid = SystemTraceControlGuid;
+    LoggerInfo->Wnode.HistoricalContext = WMI_KERNEL_LOGGER_ID;
+    LoggerInfo->LoggerNameOffset = sizeof(WMI_LOGGER_INFORMATION);
+    LoggerInfo->LogFileNameOffset = sizeof(WMI_LOGGER_INFORMATION) + sizeof(KERNEL_LOGGER_NAMEW);
+    RtlCopyMemory((PUCHAR)LoggerInfo + LoggerInfo->LoggerNameOffset,
+                  KERNEL_LOGGER_NAMEW,
+                  sizeof(KERNEL_LOGGER_NAMEW));
+    RtlCopyMemory((PUCHAR)LoggerInfo + LoggerInfo->LogFileNameOffset,
+                  NtFileName.Buffer,
+                  NtFileName.Length);
+    RtlFreeUnicodeString(&NtFileName);
+
+    Error = EtwpSendLoggerControl(IOCTL_WMI_START_LOGGER, LoggerInfo);
+    if (Error == ERROR_SUCCESS)
+    {
+        /* The caller gets the adjusted parameters back */
+        LoggerInfo->LogFileNameOffset = 0;
+        EtwpReturnProperties(Properties, LoggerInfo, Ansi);
+        *SessionHandle = WMI_KERNEL_LOGGER_ID;
+    }
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, LoggerInfo);
+    return Error;
+}
+
+static
+ULONG
+EtwpControlKernelLogger(
+    PEVENT_TRACE_PROPERTIES Properties,
+    ULONG Control,
+    BOOLEAN Ansi)
+{
+    PWMI_LOGGER_INFORMATION LoggerInfo;
+    ULONG IoControlCode, Size, Error;
+
+    switch (Control)
+    {
+        case EVENT_TRACE_CONTROL_QUERY:
+            IoControlCode = IOCTL_WMI_QUERY_LOGGER;
+            break;
+
+        case EVENT_TRACE_CONTROL_STOP:
+            IoControlCode = IOCTL_WMI_STOP_LOGGER;
+            break;
+
+        case EVENT_TRACE_CONTROL_UPDATE:
+            IoControlCode = IOCTL_WMI_UPDATE_LOGGER;
+            break;
+
+        case EVENT_TRACE_CONTROL_FLUSH:
+            IoControlCode = IOCTL_WMI_FLUSH_LOGGER;
+            break;
+
+        default:
+            return ERROR_INVALID_PARAMETER;
+    }
+
+    /* Leave room for the kernel to return both names */
+    Size = sizeof(WMI_LOGGER_INFORMATION) + 2 * ETWP_NAME_LENGTH * sizeof(WCHAR);
+    LoggerInfo = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, Size);
+    if (!LoggerInfo)
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    RtlCopyMemory(LoggerInfo, Properties, sizeof(EVENT_TRACE_PROPERTIES));
+    LoggerInfo->Wnode.BufferSize = Size;
+    LoggerInfo->Wnode.Guid = SystemTraceControlGuid;
+    LoggerInfo->Wnode.HistoricalContext = WMI_KERNEL_LOGGER_ID;
+    LoggerInfo->LoggerNameOffset = sizeof(WMI_LOGGER_INFORMATION);
+    LoggerInfo->LogFileNameOffset = sizeof(WMI_LOGGER_INFORMATION) + ETWP_NAME_LENGTH * sizeof(WCHAR);
+
+    Error = EtwpSendLoggerControl(IoControlCode, LoggerInfo);
+    if (Error == ERROR_SUCCESS)
+        EtwpReturnProperties(Properties, LoggerInfo, Ansi);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, LoggerInfo);
+    return Error;
+}
+
 /*
  * @unimplemented
  */
@@ -128,16 +366,60 @@ EtwRegisterTraceGuidsW(
 
 ULONG WINAPI EtwStartTraceW( PTRACEHANDLE pSessionHandle, LPCWSTR SessionName, PEVENT_TRACE_PROPERTIES Properties )
 {
-    FIXME("(%p, %s, %p) stub\n", pSessionHandle, SessionName, Properties);
-    if (pSessionHandle) *pSessionHandle = 0xcafe4242;
+    if (!pSessionHandle || !SessionName || !Properties)
+        return ERROR_INVALID_PARAMETER;
+    if (Properties->Wnode.BufferSize < sizeof(EVENT_TRACE_PROPERTIES))
+        return ERROR_BAD_LENGTH;
+
+    if (EtwpIsKernelLogger(0, SessionName, Properties))
+    {
+        return EtwpStartKernelLogger(pSessionHandle,
+                                     Properties,
+                                     Properties->LogFileNameOffset ?
+                                     (PCWSTR)((PUCHAR)Properties + Properties->LogFileNameOffset) : NULL,
+                                     FALSE);
+    }
+
+    FIXME("(%p, %S, %p) stub\n", pSessionHandle, SessionName, Properties);
+    *pSessionHandle = 0xcafe4242;
     return ERROR_SUCCESS;
 }
 
 ULONG WINAPI EtwStartTraceA( PTRACEHANDLE pSessionHandle, LPCSTR SessionName, PEVENT_TRACE_PROPERTIES Properties )
 {
-    FIXME("(%p, %s, %p) stub\n", pSessionHandle, SessionName, Properties);
-    if (pSessionHandle) *pSessionHandle = 0xcafe4242;
-    return ERROR_SUCCESS;
+    UNICODE_STRING SessionNameW, LogFileNameW = {0};
+    ULONG Error;
+
+    if (!pSessionHandle || !SessionName || !Properties)
+        return ERROR_INVALID_PARAMETER;
+    if (Properties->Wnode.BufferSize < sizeof(EVENT_TRACE_PROPERTIES))
+        return ERROR_BAD_LENGTH;
+
+    if (!RtlCreateUnicodeStringFromAsciiz(&SessionNameW, SessionName))
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    if (EtwpIsKernelLogger(0, SessionNameW.Buffer, Properties))
+    {
+        if (Properties->LogFileNameOffset &&
+            !RtlCreateUnicodeStringFromAsciiz(&LogFileNameW,
+                                              (PCSTR)Properties + Properties->LogFileNameOffset))
+        {
+            RtlFreeUnicodeString(&SessionNameW);
+            return ERROR_NOT_ENOUGH_MEMORY;
+        }
+
+        Error = EtwpStartKernelLogger(pSessionHandle, Properties, LogFileNameW.Buffer, TRUE);
+        RtlFreeUnicodeString(&LogFileNameW);
+    }
+    else
+    {
+        FIXME("(%p, %s, %p) stub\n", pSessionHandle, SessionName, Properties);
+        *pSessionHandle = 0xcafe4242;
+        Error = ERROR_SUCCESS;
+    }
+
+    RtlFreeUnicodeString(&SessionNameW);
+    return Error;
 }
 
 /******************************************************************************
@@ -148,7 +430,15 @@ ULONG WINAPI EtwStartTraceA( PTRACEHANDLE pSessionHandle, LPCSTR SessionName, PE
  */
 ULONG WINAPI EtwControlTraceW( TRACEHANDLE hSession, LPCWSTR SessionName, PEVENT_TRACE_PROPERTIES Properties, ULONG control )
 {
-    FIXME("(%I64x, %s, %p, %d) stub\n", hSession, SessionName, Properties, control);
+    if (!Properties)
+        return ERROR_INVALID_PARAMETER;
+    if (Properties->Wnode.BufferSize < sizeof(EVENT_TRACE_PROPERTIES))
+        return ERROR_BAD_LENGTH;
+
+    if (EtwpIsKernelLogger(hSession, SessionName, Properties))
+        return EtwpControlKernelLogger(Properties, control, FALSE);
+
+    FIXME("(%I64x, %S, %p, %d) stub\n", hSession, SessionName, Properties, control);
     return ERROR_SUCCESS;
 }
 
@@ -160,8 +450,29 @@ ULONG WINAPI EtwControlTraceW( TRACEHANDLE hSession, LPCWSTR SessionName, PEVENT
  */
 ULONG WINAPI EtwControlTraceA( TRACEHANDLE hSession, LPCSTR SessionName, PEVENT_TRACE_PROPERTIES Properties, ULONG control )
 {
-    FIXME("(%I64x, %s, %p, %d) stub\n", hSession, SessionName, Properties, control);
-    return ERROR_SUCCESS;
+    UNICODE_STRING SessionNameW = {0};
+    ULONG Error;
+
+    if (!Properties)
+        return ERROR_INVALID_PARAMETER;
+    if (Properties->Wnode.BufferSize < sizeof(EVENT_TRACE_PROPERTIES))
+        return ERROR_BAD_LENGTH;
+
+    if (SessionName && !RtlCreateUnicodeStringFromAsciiz(&SessionNameW, SessionName))
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    if (EtwpIsKernelLogger(hSession, SessionNameW.Buffer, Properties))
+    {
+        Error = EtwpControlKernelLogger(Properties, control, TRUE);
+    }
+    else
+    {
+        FIXME("(%I64x, %s, %p, %d) stub\n", hSession, SessionName, Properties, control);
+        Error = ERROR_SUCCESS;
+    }
+
+    RtlFreeUnicodeString(&SessionNameW);
+    return Error;
 }
 
 /******************************************************************************
@@ -1,33 +1,405 @@
 /*
  * PROJECT:     ReactOS system libraries
  * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
- * PURPOSE:     advapi32.dll Event tracing stubs
+ * PURPOSE:     advapi32.dll Event tracing consumer
  * COPYRIGHT:   Copyright 2017 Mark Jansen (mark.jansen@reactos.org)
  */
 
 #include <advapi32.h>
 #include <wmistr.h>
+#include <initguid.h>
 #include <evntrace.h>
+#include <wmilog.h>
+#include <pseh/pseh2.h>
 
 WINE_DEFAULT_DEBUG_CHANNEL(advapi);
 
+#define TRACE_CONSUMER_MAGIC 'nsCT'
+
+/* A log file opened by OpenTrace, the TRACEHANDLE points to it */
+typedef struct _TRACE_CONSUMER
+{
+    ULONG Magic;
+    HANDLE FileHandle;
+    PEVENT_TRACE_LOGFILEW Logfile;
+    PUCHAR HeaderBuffer;
+    ULONG BufferSize;
+    ULONG BufferCount;
+    ULONG ProcessorCount;
+    LONGLONG StartClock;
+    LONGLONG ClockFrequency;
+} TRACE_CONSUMER, *PTRACE_CONSUMER;
+
+/* The events of one processor, read buffer after buffer */
+typedef struct _TRACE_STREAM
+{
+    PTRACE_CONSUMER Consumer;
+    ULONG Processor;
+    ULONG NextBuffer;
+    ULONG Offset;
+    PWMI_TRACE_BUFFER_HEADER Buffer;
+    PEVENT_TRACE_HEADER Event;
+    LONGLONG Time;
+} TRACE_STREAM, *PTRACE_STREAM;
+
+static
+BOOL
+TrcReadBuffer(PTRACE_CONSUMER Consumer,
+              ULONG Index,
+              PVOID Buffer,
+              ULONG Length)
+{
+    OVERLAPPED Overlapped;
+    ULONGLONG Offset;
+    DWORD Read;
+
+    Offset = (ULONGLONG)Index * Consumer->BufferSize;
+
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    Overlapped.Offset = (DWORD)Offset;
+    Overlapped.OffsetHigh = (DWORD)(Offset >> 32);
+
+    if (!ReadFile(Consumer->FileHandle, Buffer, Length, &Read, &Overlapped))
+        return FALSE;
+
+    /* The file is shorter than its buffers say */
+    if (Read != Length)
+    {
+        SetLastError(ERROR_HANDLE_EOF);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+LONGLONG
+TrcConvertTimeStamp(PTRACE_CONSUMER Consumer,
+                    LONGLONG TimeStamp)
+{
+    LONGLONG Delta, Frequency = Consumer->ClockFrequency;
+
+    /* System time stamps need no conversion */
+    if (!Frequency)
+        return TimeStamp;
+
+    /* Split the division so that long sessions don't overflow */
+    Delta = TimeStamp - Consumer->StartClock;
+    return Consumer->Logfile->LogfileHeader.StartTime.QuadPart +
+           (Delta / Frequency) * 10000000 +
+           ((Delta % Frequency) * 10000000) / Frequency;
+}
+
+static
+TRACEHANDLE
+TrcOpenTrace(PEVENT_TRACE_LOGFILEW Logfile,
+             PCWSTR LogFileName)
+{
+    PTRACE_CONSUMER Consumer;
+    PWMI_TRACE_BUFFER_HEADER BufferHeader;
+    PEVENT_TRACE_HEADER Event;
+    PTRACE_LOGFILE_HEADER LogfileHeader;
+    WMI_TRACE_BUFFER_HEADER FirstHeader;
+    LARGE_INTEGER FileSize;
+    PWCHAR Name, End;
+    DWORD Error;
+
+    /* Only log files written by the kernel logger can be read */
+    if (!LogFileName || (Logfile->LogFileMode & EVENT_TRACE_REAL_TIME_MODE))
+    {
+        FIXME("Real time consumers are not supported\n");
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return INVALID_PROCESSTRACE_HANDLE;
+    }
+
+    Consumer = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Consumer));
+    if (!Consumer)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return INVALID_PROCESSTRACE_HANDLE;
+    }
+    Consumer->Logfile = Logfile;
+
+    /* The logger may still be writing to it */
+    Consumer->FileHandle = CreateFileW(LogFileName,
+                                       GENERIC_READ,
+                                       FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                       NULL,
+                                       OPEN_EXISTING,
+                                       FILE_FLAG_SEQUENTIAL_SCAN,
+                                       NULL);
+    if (Consumer->FileHandle == INVALID_HANDLE_VALUE)
+    {
+        Error = GetLastError();
+        goto Cleanup;
+    }
+
+    /* The first buffer tells how large all of them are */
+    if (!TrcReadBuffer(Consumer, 0, &FirstHeader, sizeof(FirstHeader)) ||
+        !(FirstHeader.Flags & WMI_TRACE_BUFFER_FLAG_LOGFILE_HEADER) ||
+        (FirstHeader.BufferSize < sizeof(FirstHeader) + sizeof(EVENT_TRACE_HEADER) + sizeof(TRACE_LOGFILE_HEADER)) ||
+        (FirstHeader.SavedOffset > FirstHeader.BufferSize) ||
+        !GetFileSizeEx(Consumer->FileHandle, &FileSize))
+    {
+        Error = ERROR_BAD_FORMAT;
+        goto Cleanup;
+    }
+
+    Consumer->HeaderBuffer = HeapAlloc(GetProcessHeap(), 0, FirstHeader.BufferSize);
+    if (!Consumer->HeaderBuffer)
+    {
+        Error = ERROR_NOT_ENOUGH_MEMORY;
+        goto Cleanup;
+    }
+
+    Consumer->BufferSize = FirstHeader.BufferSize;
+    if (!TrcReadBuffer(Consumer, 0, Consumer->HeaderBuffer, FirstHeader.BufferSize))
+    {
+        Error = ERROR_BAD_FORMAT;
+        goto Cleanup;
+    }
+
+    BufferHeader = (PWMI_TRACE_BUFFER_HEADER)Consumer->HeaderBuffer;
+    Event = (PEVENT_TRACE_HEADER)(BufferHeader + 1);
+    LogfileHeader = (PTRACE_LOGFILE_HEADER)(Event + 1);
+    if (!IsEqualGUID(&Event->Guid, &EventTraceGuid) ||
+        (BufferHeader->SavedOffset < sizeof(WMI_TRACE_BUFFER_HEADER)) ||
+        (BufferHeader->SavedOffset > FirstHeader.BufferSize) ||
+        (Event->Size < sizeof(EVENT_TRACE_HEADER) + sizeof(TRACE_LOGFILE_HEADER)) ||
+        (Event->Size > BufferHeader->SavedOffset - sizeof(WMI_TRACE_BUFFER_HEADER)) ||
+        (LogfileHeader->BufferSize != FirstHeader.BufferSize) ||
+        (LogfileHeader->NumberOfProcessors == 0) ||
+        (LogfileHeader->NumberOfProcessors > MAXIMUM_PROCESSORS))
+    {
+        Error = ERROR_BAD_FORMAT;
+        goto Cleanup;
+    }
+
+    /* Both names follow the header, make sure they are terminated */
+    Name = (PWCHAR)(LogfileHeader + 1);
+    End = (PWCHAR)((PUCHAR)Event + Event->Size);
+    LogfileHeader->LoggerName = Name;
+    while ((Name < End) && *Name) Name++;
+    LogfileHeader->LogFileName = ++Name;
+    while ((Name < End) && *Name) Name++;
+    if (Name >= End)
+    {
+        Error = ERROR_BAD_FORMAT;
+        goto Cleanup;
+    }
+
+    /* Events are stamped with the clock the logger was started with */
+    Consumer->StartClock = Event->TimeStamp.QuadPart;
+    switch (LogfileHeader->ReservedFlags)
+    {
+        case WMI_TRACE_CLOCK_SYSTEMTIME:
+            Consumer->ClockFrequency = 0;
+            break;
+
+        case WMI_TRACE_CLOCK_CPUCYCLE:
+            Consumer->ClockFrequency = (LONGLONG)LogfileHeader->CpuSpeedInMHz * 1000000;
+            break;
+
+        default:
+            Consumer->ClockFrequency = LogfileHeader->PerfFreq.QuadPart;
+            break;
+    }
+    if ((Consumer->ClockFrequency < 0) ||
+        ((LogfileHeader->ReservedFlags != WMI_TRACE_CLOCK_SYSTEMTIME) && !Consumer->ClockFrequency))
+    {
+        Error = ERROR_BAD_FORMAT;
+        goto Cleanup;
+    }
+
+    Consumer->BufferCount = (ULONG)(FileSize.QuadPart / FirstHeader.BufferSize);
+    Consumer->ProcessorCount = LogfileHeader->NumberOfProcessors;
+    Consumer->Magic = TRACE_CONSUMER_MAGIC;
+
+    Logfile->LogfileHeader = *LogfileHeader;
+    Logfile->IsKernelTrace = !_wcsicmp(LogfileHeader->LoggerName, KERNEL_LOGGER_NAMEW);
+    Logfile->EventsLost = LogfileHeader->EventsLost;
+    Logfile->BuffersRead = 0;
+    Logfile->CurrentTime = LogfileHeader->StartTime.QuadPart;
+    return (TRACEHANDLE)(ULONG_PTR)Consumer;
+
+Cleanup:
+    if (Consumer->FileHandle && (Consumer->FileHandle != INVALID_HANDLE_VALUE))
+        CloseHandle(Consumer->FileHandle);
+    if (Consumer->HeaderBuffer)
+        HeapFree(GetProcessHeap(), 0, Consumer->HeaderBuffer);
+    HeapFree(GetProcessHeap(), 0, Consumer);
+    ZeroMemory(&Logfile->LogfileHeader, sizeof(Logfile->LogfileHeader));
+    SetLastError(Error);
+    return INVALID_PROCESSTRACE_HANDLE;
+}
+
+static
+PTRACE_CONSUMER
+TrcReferenceHandle(TRACEHANDLE Handle)
+{
+    PTRACE_CONSUMER Consumer = (PTRACE_CONSUMER)(ULONG_PTR)Handle;
+
+    if ((Handle == 0) || (Handle == INVALID_PROCESSTRACE_HANDLE))
+        return NULL;
+
+    _SEH2_TRY
+    {
+        if (Consumer->Magic != TRACE_CONSUMER_MAGIC)
+            Consumer = NULL;
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        Consumer = NULL;
+    }
+    _SEH2_END;
+
+    return Consumer;
+}
+
+static
+VOID
+TrcDeliverEvent(PTRACE_CONSUMER Consumer,
+                PEVENT_TRACE_HEADER Header,
+                LONGLONG Time,
+                ULONG Processor)
+{
+    PEVENT_TRACE_LOGFILEW Logfile = Consumer->Logfile;
+    EVENT_TRACE Event;
+
+    ZeroMemory(&Event, sizeof(Event));
+    Event.Header = *Header;
+    Event.Header.TimeStamp.QuadPart = Time;
+    Event.MofData = Header + 1;
+    Event.MofLength = Header->Size - sizeof(EVENT_TRACE_HEADER);
+    Event.BufferContext.ProcessorNumber = (UCHAR)Processor;
+
+    Logfile->CurrentTime = Time;
+    Logfile->CurrentEvent = Event;
+
+    if (Logfile->EventCallback)
+        Logfile->EventCallback(&Event);
+}
+
+static
+PEVENT_TRACE_HEADER
+TrcNextEvent(PTRACE_STREAM Stream)
+{
+    PWMI_TRACE_BUFFER_HEADER Buffer = Stream->Buffer;
+    PEVENT_TRACE_HEADER Event;
+
+    /* Records end at the saved offset or at the first empty one */
+    if (Stream->Offset + sizeof(EVENT_TRACE_HEADER) > Buffer->SavedOffset)
+        return NULL;
+
+    Event = (PEVENT_TRACE_HEADER)((PUCHAR)Buffer + Stream->Offset);
+    if ((Event->Size < sizeof(EVENT_TRACE_HEADER)) ||
+        (Event->Size > Buffer->SavedOffset - Stream->Offset))
+    {
+        return NULL;
+    }
+
+    Stream->Offset += ALIGN_UP_BY(Event->Size, WMI_TRACE_ALIGNMENT);
+    return Event;
+}
+
+static
+ULONG
+TrcAdvanceStream(PTRACE_STREAM Stream)
+{
+    PTRACE_CONSUMER Consumer = Stream->Consumer;
+    PEVENT_TRACE_LOGFILEW Logfile = Consumer->Logfile;
+    ULONG BufferSize = Consumer->BufferSize;
+    WMI_TRACE_BUFFER_HEADER Header;
+
+    for (;;)
+    {
+        if (Stream->Offset)
+        {
+            Stream->Event = TrcNextEvent(Stream);
+            if (Stream->Event)
+            {
+                Stream->Time = TrcConvertTimeStamp(Consumer, Stream->Event->TimeStamp.QuadPart);
+                return ERROR_SUCCESS;
+            }
+
+            /* This buffer is done, tell the consumer */
+            Logfile->BuffersRead++;
+            Logfile->Filled = Stream->Buffer->SavedOffset;
+            Logfile->BufferSize = BufferSize;
+            if (Logfile->BufferCallback && !Logfile->BufferCallback(Logfile))
+                return ERROR_CANCELLED;
+            Stream->Offset = 0;
+        }
+
+        /* Find the next buffer written by this processor */
+        for (;;)
+        {
+            if (Stream->NextBuffer >= Consumer->BufferCount)
+            {
+                Stream->Event = NULL;
+                return ERROR_SUCCESS;
+            }
+
+            if (!TrcReadBuffer(Consumer, Stream->NextBuffer++, &Header, sizeof(Header)))
+                return GetLastError();
+
+            if (!(Header.Flags & WMI_TRACE_BUFFER_FLAG_LOGFILE_HEADER) &&
+                (Header.ProcessorNumber == Stream->Processor) &&
+                (Header.BufferSize == BufferSize) &&
+                (Header.SavedOffset <= BufferSize))
+            {
+                break;
+            }
+        }
+
+        if (!TrcReadBuffer(Consumer, Stream->NextBuffer - 1, Stream->Buffer, BufferSize))
+            return GetLastError();
+
+        /* Only use the header we checked, the logger may still be writing */
+        *Stream->Buffer = Header;
+        Stream->Offset = sizeof(WMI_TRACE_BUFFER_HEADER);
+    }
+}
 
 TRACEHANDLE
 WINAPI
 OpenTraceA(IN PEVENT_TRACE_LOGFILEA Logfile)
 {
-    UNIMPLEMENTED;
-    SetLastError(ERROR_ACCESS_DENIED);
-    return INVALID_PROCESSTRACE_HANDLE;
+    UNICODE_STRING LogFileName;
+    TRACEHANDLE Handle;
+
+    if (!Logfile)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return INVALID_PROCESSTRACE_HANDLE;
+    }
+
+    if (!Logfile->LogFileName)
+        return TrcOpenTrace((PEVENT_TRACE_LOGFILEW)Logfile, NULL);
+
+    if (!RtlCreateUnicodeStringFromAsciiz(&LogFileName, Logfile->LogFileName))
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return INVALID_PROCESSTRACE_HANDLE;
+    }
+
+    /* Both structures only differ in the type of the names */
+    Handle = TrcOpenTrace((PEVENT_TRACE_LOGFILEW)Logfile, LogFileName.Buffer);
+    RtlFreeUnicodeString(&LogFileName);
+    return Handle;
 }
 
 TRACEHANDLE
 WINAPI
 OpenTraceW(IN PEVENT_TRACE_LOGFILEW Logfile)
 {
-    UNIMPLEMENTED;
-    SetLastError(ERROR_ACCESS_DENIED);
-    return INVALID_PROCESSTRACE_HANDLE;
+    if (!Logfile)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return INVALID_PROCESSTRACE_HANDLE;
+    }
+
+    return TrcOpenTrace(Logfile, Logfile->LogFileName);
 }
 
 ULONG
@@ -37,7 +409,115 @@ ProcessTrace(IN PTRACEHANDLE HandleArray,
              IN LPFILETIME StartTime,
              IN LPFILETIME EndTime)
 {
-    UNIMPLEMENTED;
-    return ERROR_NOACCESS;
+    PTRACE_CONSUMER Consumer;
+    PTRACE_STREAM Streams, Stream, Next;
+    ULONG StreamCount, i, j, Error = ERROR_SUCCESS;
+    LONGLONG Start = 0, End = MAXLONGLONG;
+    PEVENT_TRACE_HEADER Event;
+
+    if (!HandleArray || !HandleCount || (HandleCount > MAXIMUM_LOGGERS))
+        return ERROR_INVALID_PARAMETER;
+
+    if (StartTime)
+        Start = ((LONGLONG)StartTime->dwHighDateTime << 32) | StartTime->dwLowDateTime;
+    if (EndTime)
+        End = ((LONGLONG)EndTime->dwHighDateTime << 32) | EndTime->dwLowDateTime;
+
+    /* Each processor of each log file is one ordered stream */
+    StreamCount = 0;
+    for (i = 0; i < HandleCount; i++)
+    {
+        Consumer = TrcReferenceHandle(HandleArray[i]);
+        if (!Consumer)
+            return ERROR_INVALID_HANDLE;
+        StreamCount += Consumer->ProcessorCount;
+    }
+
+    if (StreamCount > MAXULONG / sizeof(TRACE_STREAM))
+        return ERROR_ARITHMETIC_OVERFLOW;
+
+    Streams = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, StreamCount * sizeof(TRACE_STREAM));
+    if (!Streams)
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    Stream = Streams;
+    for (i = 0; i < HandleCount; i++)
+    {
+        Consumer = (PTRACE_CONSUMER)(ULONG_PTR)HandleArray[i];
+
+        /* Consumers see the logfile header event first */
+        Event = (PEVENT_TRACE_HEADER)((PWMI_TRACE_BUFFER_HEADER)Consumer->HeaderBuffer + 1);
+        TrcDeliverEvent(Consumer,
+                        Event,
+                        Consumer->Logfile->LogfileHeader.StartTime.QuadPart,
+                        0);
+
+        /* Don't trust the header in Logfile, the callbacks can change it */
+        for (j = 0; j < Consumer->ProcessorCount; j++, Stream++)
+        {
+            Stream->Consumer = Consumer;
+            Stream->Processor = j;
+            Stream->NextBuffer = 1;
+            Stream->Buffer = HeapAlloc(GetProcessHeap(), 0, Consumer->BufferSize);
+            if (!Stream->Buffer)
+            {
+                Error = ERROR_NOT_ENOUGH_MEMORY;
+                goto Cleanup;
+            }
+
+            Error = TrcAdvanceStream(Stream);
+            if (Error != ERROR_SUCCESS)
+                goto Cleanup;
+        }
+    }
+
+    /* Merge the streams in time stamp order */
+    for (;;)
+    {
+        Next = NULL;
+        for (i = 0; i < StreamCount; i++)
+        {
+            if (Streams[i].Event && (!Next || (Streams[i].Time < Next->Time)))
+                Next = &Streams[i];
+        }
+
+        /* Everything that is left is past the end time */
+        if (!Next || (Next->Time > End))
+            break;
+
+        if (Next->Time >= Start)
+            TrcDeliverEvent(Next->Consumer, Next->Event, Next->Time, Next->Processor);
+
+        Error = TrcAdvanceStream(Next);
+        if (Error != ERROR_SUCCESS)
+            break;
+    }
+
+Cleanup:
+    for (i = 0; i < StreamCount; i++)
+    {
+        if (Streams[i].Buffer)
+            HeapFree(GetProcessHeap(), 0, Streams[i].Buffer);
+    }
+    HeapFree(GetProcessHeap(), 0, Streams);
+
+    return Error;
 }
 
+ULONG
+WINAPI
+CloseTrace(IN TRACEHANDLE TraceHandle)
+{
+    PTRACE_CONSUMER Consumer;
+
+    Consumer = TrcReferenceHandle(TraceHandle);
+    if (!Consumer)
+        return ERROR_INVALID_HANDLE;
+
+    Consumer->Magic = 0;
+    CloseHandle(Consumer->FileHandle);
+    HeapFree(GetProcessHeap(), 0, Consumer->HeaderBuffer);
+    HeapFree(GetProcessHeap(), 0, Consumer);
+
+    return ERROR_SUCCESS;
+}
@@ -0,0 +1,146 @@
+
+#include "k32_vista.h"
+
+/* The native API fills the caller's array in place */
+C_ASSERT(sizeof(OVERLAPPED_ENTRY) == sizeof(FILE_IO_COMPLETION_INFORMATION));
+C_ASSERT(FIELD_OFFSET(OVERLAPPED_ENTRY, lpCompletionKey) == FIELD_OFFSET(FILE_IO_COMPLETION_INFORMATION, KeyContext));
+C_ASSERT(FIELD_OFFSET(OVERLAPPED_ENTRY, lpOverlapped) == FIELD_OFFSET(FILE_IO_COMPLETION_INFORMATION, ApcContext));
+C_ASSERT(FIELD_OFFSET(OVERLAPPED_ENTRY, Internal) == FIELD_OFFSET(FILE_IO_COMPLETION_INFORMATION, IoStatusBlock));
+
+typedef NTSTATUS
+(NTAPI *PNT_REMOVE_IO_COMPLETION_EX)(HANDLE IoCompletionHandle,
+                                     PFILE_IO_COMPLETION_INFORMATION IoCompletionInformation,
+                                     ULONG Count,
+                                     PULONG NumEntriesRemoved,
+                                     PLARGE_INTEGER Timeout,
+                                     BOOLEAN Alertable);
+
+/* ntdll only exports NtRemoveIoCompletionEx when it is built for NT6 */
+static PNT_REMOVE_IO_COMPLETION_EX pNtRemoveIoCompletionEx;
+static BOOL NtRemoveIoCompletionExChecked;
+
+/*
+ * Removes the entries one by one with NtRemoveIoCompletion, for an ntdll
+ * without NtRemoveIoCompletionEx. An alertable wait is done on the port
+ * itself, which is signaled while it has entries queued.
+ */
+static
+NTSTATUS
+BasepRemoveIoCompletionEntries(IN HANDLE CompletionPort,
+                               OUT PFILE_IO_COMPLETION_INFORMATION Entries,
+                               IN ULONG Count,
+                               OUT PULONG Removed,
+                               IN PLARGE_INTEGER Timeout,
+                               IN BOOLEAN Alertable)
+{
+    LARGE_INTEGER NoWait = {{0, 0}};
+    NTSTATUS Status;
+    ULONG i;
+
+    for (;;)
+    {
+        /* Wait for the first entry, unless we must be woken up by APCs */
+        for (i = 0; i < Count; i++)
+        {
+            Status = NtRemoveIoCompletion(CompletionPort,
+                                          &Entries[i].KeyContext,
+                                          &Entries[i].ApcContext,
+                                          &Entries[i].IoStatusBlock,
+                                          (i || Alertable) ? &NoWait : Timeout);
+            if (!NT_SUCCESS(Status) || (Status == STATUS_TIMEOUT)) break;
+        }
+
+        /* Only the first entry decides how this went */
+        *Removed = i;
+        if (i) return STATUS_SUCCESS;
+        if (!NT_SUCCESS(Status) || !Alertable) return Status;
+
+        /* Nothing there yet, wait for an entry or an APC */
+        Status = NtWaitForSingleObject(CompletionPort, TRUE, Timeout);
+        if (!NT_SUCCESS(Status) || (Status != STATUS_SUCCESS)) return Status;
+
+        /* Somebody else may get the entry first, in which case we wait again */
+    }
+}
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+GetQueuedCompletionStatusEx(IN HANDLE CompletionPort,
+                            OUT LPOVERLAPPED_ENTRY lpCompletionPortEntries,
+                            IN ULONG ulCount,
+                            OUT PULONG ulNumEntriesRemoved,
+                            IN DWORD dwMilliseconds,
+                            IN BOOL fAlertable)
+{
+    NTSTATUS Status;
+    LARGE_INTEGER Time;
+    PLARGE_INTEGER TimePtr;
+
+    /* We need room for at least one entry */
+    if (!lpCompletionPortEntries || !ulCount)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    /* Look up the native API the first time */
+    if (!NtRemoveIoCompletionExChecked)
+    {
+        pNtRemoveIoCompletionEx = (PNT_REMOVE_IO_COMPLETION_EX)GetProcAddress(GetModuleHandleW(L"ntdll.dll"),
+                                                                             "NtRemoveIoCompletionEx");
+        NtRemoveIoCompletionExChecked = TRUE;
+    }
+
+    /* Convert the timeout and then call the native API */
+    TimePtr = BaseFormatTimeOut(&Time, dwMilliseconds);
+    if (pNtRemoveIoCompletionEx)
+    {
+        Status = pNtRemoveIoCompletionEx(CompletionPort,
+                                         (PFILE_IO_COMPLETION_INFORMATION)lpCompletionPortEntries,
+                                         ulCount,
+                                         ulNumEntriesRemoved,
+                                         TimePtr,
+                                         fAlertable ? TRUE : FALSE);
+    }
+    else
+    {
+        Status = BasepRemoveIoCompletionEntries(CompletionPort,
+                                                (PFILE_IO_COMPLETION_INFORMATION)lpCompletionPortEntries,
+                                                ulCount,
+                                                ulNumEntriesRemoved,
+                                                TimePtr,
+                                                fAlertable ? TRUE : FALSE);
+    }
+    if (!(NT_SUCCESS(Status)) || (Status == STATUS_TIMEOUT) ||
+        (Status == STATUS_USER_APC) || (Status == STATUS_ALERTED))
+    {
+        /* Nothing was removed */
+        *ulNumEntriesRemoved = 0;
+
+        /* Check what kind of error we got */
+        if (Status == STATUS_TIMEOUT)
+        {
+            /* Timeout error is set directly since there's no conversion */
+            SetLastError(WAIT_TIMEOUT);
+        }
+        else if ((Status == STATUS_USER_APC) || (Status == STATUS_ALERTED))
+        {
+            /* The wait was interrupted to run APCs */
+            SetLastError(WAIT_IO_COMPLETION);
+        }
+        else
+        {
+            /* Any other error gets converted */
+            BaseSetLastNTError(Status);
+        }
+
+        /* This is a failure case */
+        return FALSE;
+    }
+
+    /* Return success, the status of each packet is left in Internal */
+    return TRUE;
+}
@@ -168,6 +168,7 @@ FAT12GetNextCluster(
     return STATUS_SUCCESS;
 }
 
+
 /*
  * FUNCTION: Finds the first available cluster in a FAT16 table
  */
@@ -376,11 +377,11 @@ FAT32FindAndMarkAvailableCluster(
 }
 
 /*
- * FUNCTION: Counts free cluster in a FAT12 table
+ * FUNCTION: Builds the free cluster bitmap of a FAT12 table
  */
 static
 NTSTATUS
-FAT12CountAvailableClusters(
+FAT12BuildFreeClusterBitmap(
     PDEVICE_EXTENSION DeviceExt)
 {
     ULONG Entry;
@@ -391,6 +392,12 @@ FAT12CountAvailableClusters(
     LARGE_INTEGER Offset;
     PVOID Context;
     PUSHORT CBlock;
+    BOOLEAN HasBitmap;
+
+    /* Everything is in use until found free in the FAT */
+    HasBitmap = (DeviceExt->FreeClusterBitmap.Buffer != NULL);
+    if (HasBitmap)
+        RtlSetAllBits(&DeviceExt->FreeClusterBitmap);
 
     Offset.QuadPart = 0;
     _SEH2_TRY
@@ -418,7 +425,11 @@ FAT12CountAvailableClusters(
         }
 
         if (Entry == 0)
+        {
+            if (HasBitmap)
+                RtlClearBit(&DeviceExt->FreeClusterBitmap, i);
             ulCount++;
+        }
     }
 
     CcUnpinData(Context);
@@ -430,11 +441,11 @@ FAT12CountAvailableClusters(
 
 
 /*
- * FUNCTION: Counts free clusters in a FAT16 table
+ * FUNCTION: Builds the free cluster bitmap of a FAT16 table
  */
 static
 NTSTATUS
-FAT16CountAvailableClusters(
+FAT16BuildFreeClusterBitmap(
     PDEVICE_EXTENSION DeviceExt)
 {
     PUSHORT Block;
@@ -446,6 +457,12 @@ FAT16CountAvailableClusters(
     PVOID Context = NULL;
     LARGE_INTEGER Offset;
     ULONG FatLength;
+    BOOLEAN HasBitmap;
+
+    /* Everything is in use until found free in the FAT */
+    HasBitmap = (DeviceExt->FreeClusterBitmap.Buffer != NULL);
+    if (HasBitmap)
+        RtlSetAllBits(&DeviceExt->FreeClusterBitmap);
 
     ChunkSize = CACHEPAGESIZE(DeviceExt);
     FatLength = (DeviceExt->FatInfo.NumberOfClusters + 2);
@@ -469,7 +486,11 @@ FAT16CountAvailableClusters(
         while (Block < BlockEnd && i < FatLength)
         {
             if (*Block == 0)
+            {
+                if (HasBitmap)
+                    RtlClearBit(&DeviceExt->FreeClusterBitmap, i);
                 ulCount++;
+            }
             Block++;
             i++;
         }
@@ -485,11 +506,11 @@ FAT16CountAvailableClusters(
 
 
 /*
- * FUNCTION: Counts free clusters in a FAT32 table
+ * FUNCTION: Builds the free cluster bitmap of a FAT32 table
  */
 static
 NTSTATUS
-FAT32CountAvailableClusters(
+FAT32BuildFreeClusterBitmap(
     PDEVICE_EXTENSION DeviceExt)
 {
     PULONG Block;
@@ -501,6 +522,12 @@ FAT32CountAvailableClusters(
     PVOID Context = NULL;
     LARGE_INTEGER Offset;
     ULONG FatLength;
+    BOOLEAN HasBitmap;
+
+    /* Everything is in use until found free in the FAT */
+    HasBitmap = (DeviceExt->FreeClusterBitmap.Buffer != NULL);
+    if (HasBitmap)
+        RtlSetAllBits(&DeviceExt->FreeClusterBitmap);
 
     ChunkSize = CACHEPAGESIZE(DeviceExt);
     FatLength = (DeviceExt->FatInfo.NumberOfClusters + 2);
@@ -525,7 +552,11 @@ FAT32CountAvailableClusters(
         while (Block < BlockEnd && i < FatLength)
         {
             if ((*Block & 0x0fffffff) == 0)
+            {
+                if (HasBitmap)
+                    RtlClearBit(&DeviceExt->FreeClusterBitmap, i);
                 ulCount++;
+            }
             Block++;
             i++;
         }
@@ -539,6 +570,46 @@ FAT32CountAvailableClusters(
     return STATUS_SUCCESS;
 }
 
+/*
+ * FUNCTION: Allocates the free cluster bitmap and fills it from the FAT.
+ *           The bitmap is optional: without it, clusters are allocated by
+ *           scanning the FAT.
+ */
+NTSTATUS
+InitializeFreeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    ULONG BitmapSize;
+    PULONG Buffer;
+
+    BitmapSize = DeviceExt->FatInfo.NumberOfClusters + 2;
+    Buffer = ExAllocatePoolWithTag(PagedPool,
+                                   ROUND_UP(BitmapSize, 32) / 8,
+                                   TAG_BITMAP);
+    if (Buffer == NULL)
+    {
+        DPRINT1("No memory for the free cluster bitmap (%u clusters), scanning the FAT instead\n", BitmapSize);
+        BitmapSize = 0;
+    }
+
+    RtlInitializeBitMap(&DeviceExt->FreeClusterBitmap, Buffer, BitmapSize);
+    DeviceExt->AvailableClustersValid = FALSE;
+
+    return CountAvailableClusters(DeviceExt, NULL);
+}
+
+VOID
+UninitializeFreeClusterBitmap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    if (DeviceExt->FreeClusterBitmap.Buffer != NULL)
+    {
+        ExFreePoolWithTag(DeviceExt->FreeClusterBitmap.Buffer, TAG_BITMAP);
+        DeviceExt->FreeClusterBitmap.Buffer = NULL;
+    }
+    DeviceExt->AvailableClustersValid = FALSE;
+}
+
 NTSTATUS
 CountAvailableClusters(
     PDEVICE_EXTENSION DeviceExt,
@@ -549,11 +620,11 @@ CountAvailableClusters(
     if (!DeviceExt->AvailableClustersValid)
     {
         if (DeviceExt->FatInfo.FatType == FAT12)
-            Status = FAT12CountAvailableClusters(DeviceExt);
+            Status = FAT12BuildFreeClusterBitmap(DeviceExt);
         else if (DeviceExt->FatInfo.FatType == FAT16 || DeviceExt->FatInfo.FatType == FATX16)
-            Status = FAT16CountAvailableClusters(DeviceExt);
+            Status = FAT16BuildFreeClusterBitmap(DeviceExt);
         else
-            Status = FAT32CountAvailableClusters(DeviceExt);
+            Status = FAT32BuildFreeClusterBitmap(DeviceExt);
     }
     if (Clusters != NULL)
     {
@@ -717,14 +788,254 @@ WriteCluster(
     if (DeviceExt->AvailableClustersValid)
     {
         if (OldValue && NewValue == 0)
+        {
+            if (DeviceExt->FreeClusterBitmap.Buffer != NULL)
+                RtlClearBit(&DeviceExt->FreeClusterBitmap, ClusterToWrite);
             InterlockedIncrement((PLONG)&DeviceExt->AvailableClusters);
+        }
         else if (OldValue == 0 && NewValue)
+        {
+            if (DeviceExt->FreeClusterBitmap.Buffer != NULL)
+                RtlSetBit(&DeviceExt->FreeClusterBitmap, ClusterToWrite);
             InterlockedDecrement((PLONG)&DeviceExt->AvailableClusters);
+        }
     }
     ExReleaseResourceLite(&DeviceExt->FatResource);
     return Status;
 }
 
+/*
+ * FUNCTION: Finds a run of up to ClusterCount free clusters in the free
+ *           cluster bitmap and marks it as used. A run large enough for
+ *           the whole request is preferred, otherwise the longest one is
+ *           taken. Without a bitmap, the FAT is scanned for one cluster.
+ *           The caller holds the FAT resource exclusively.
+ */
+static
+NTSTATUS
+FindAndMarkAvailableClusters(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG ClusterCount,
+    PULONG Cluster,
+    PULONG RunLength)
+{
+    ULONG Index;
+    ULONG Length;
+    NTSTATUS Status;
+
+    if (DeviceExt->FreeClusterBitmap.Buffer == NULL)
+    {
+        Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, Cluster);
+        if (NT_SUCCESS(Status))
+            *RunLength = 1;
+        return Status;
+    }
+
+    ASSERT(DeviceExt->AvailableClustersValid);
+
+    Index = RtlFindClearBitsAndSet(&DeviceExt->FreeClusterBitmap,
+                                   ClusterCount,
+                                   DeviceExt->LastAvailableCluster);
+    if (Index != 0xffffffff)
+    {
+        Length = ClusterCount;
+    }
+    else
+    {
+        Length = RtlFindLongestRunClear(&DeviceExt->FreeClusterBitmap, &Index);
+        if (Length == 0)
+        {
+            return STATUS_DISK_FULL;
+        }
+
+        Length = min(Length, ClusterCount);
+        RtlSetBits(&DeviceExt->FreeClusterBitmap, Index, Length);
+    }
+
+    DPRINT("Found %u available clusters at 0x%x\n", Length, Index);
+    DeviceExt->LastAvailableCluster = Index + Length;
+    if (DeviceExt->LastAvailableCluster >= DeviceExt->FatInfo.NumberOfClusters + 2)
+        DeviceExt->LastAvailableCluster = 2;
+    InterlockedExchangeAdd((PLONG)&DeviceExt->AvailableClusters, -(LONG)Length);
+
+    *Cluster = Index;
+    *RunLength = Length;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * FUNCTION: Chains a run of clusters together in the FAT, the last one
+ *           getting LastValue. The FAT is updated a cache page at a time.
+ */
+static
+NTSTATUS
+WriteClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG StartCluster,
+    ULONG ClusterCount,
+    ULONG LastValue)
+{
+    ULONG Cluster, EndCluster, Value, OldValue;
+    ULONG EntrySize;
+    ULONG ChunkSize;
+    PVOID BaseAddress;
+    PVOID Context;
+    LARGE_INTEGER Offset;
+    PUCHAR Block;
+    PUCHAR BlockEnd;
+    NTSTATUS Status;
+
+    Cluster = StartCluster;
+    EndCluster = StartCluster + ClusterCount;
+
+    if (DeviceExt->FatInfo.FatType == FAT12)
+    {
+        /* The whole FAT12 table is pinned for each entry anyway */
+        for (; Cluster < EndCluster; Cluster++)
+        {
+            Value = (Cluster + 1 < EndCluster) ? Cluster + 1 : LastValue;
+            Status = DeviceExt->WriteCluster(DeviceExt, Cluster, Value, &OldValue);
+            if (!NT_SUCCESS(Status))
+                return Status;
+        }
+        return STATUS_SUCCESS;
+    }
+
+    if (DeviceExt->FatInfo.FatType == FAT16 || DeviceExt->FatInfo.FatType == FATX16)
+        EntrySize = sizeof(USHORT);
+    else
+        EntrySize = sizeof(ULONG);
+    ChunkSize = CACHEPAGESIZE(DeviceExt);
+
+    while (Cluster < EndCluster)
+    {
+        Offset.QuadPart = ROUND_DOWN(Cluster * EntrySize, ChunkSize);
+        _SEH2_TRY
+        {
+            CcPinRead(DeviceExt->FATFileObject, &Offset, ChunkSize, PIN_WAIT, &Context, &BaseAddress);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            DPRINT1("CcPinRead(Offset %x, Length %u) failed\n", (ULONG)Offset.QuadPart, ChunkSize);
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+
+        Block = (PUCHAR)BaseAddress + (Cluster * EntrySize) % ChunkSize;
+        BlockEnd = (PUCHAR)BaseAddress + ChunkSize;
+
+        /* Now process the whole block */
+        while (Block < BlockEnd && Cluster < EndCluster)
+        {
+            Value = (Cluster + 1 < EndCluster) ? Cluster + 1 : LastValue;
+            if (EntrySize == sizeof(USHORT))
+                *(PUSHORT)Block = (USHORT)Value;
+            else
+                *(PULONG)Block = (*(PULONG)Block & 0xf0000000) | (Value & 0x0fffffff);
+
+            Block += EntrySize;
+            Cluster++;
+        }
+
+        CcSetDirtyPinnedData(Context, NULL);
+        CcUnpinData(Context);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * FUNCTION: Appends ClusterCount new clusters to the chain ending with
+ *           LastCluster, or makes a new chain if LastCluster is 0. The
+ *           clusters are allocated in as few contiguous runs as possible.
+ *           On failure, the chain is left as it was.
+ */
+NTSTATUS
+ExtendClusterChain(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG LastCluster,
+    ULONG ClusterCount,
+    PULONG FirstNewCluster)
+{
+    ULONG PreviousCluster, RunStart, RunLength, Allocated;
+    ULONG Cluster, NextCluster, OldValue;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    DPRINT("ExtendClusterChain(DeviceExt %p, LastCluster %x, ClusterCount %u)\n",
+           DeviceExt, LastCluster, ClusterCount);
+
+    *FirstNewCluster = 0xffffffff;
+    if (ClusterCount == 0)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
+
+    if (LastCluster != 0)
+    {
+        Status = DeviceExt->GetNextCluster(DeviceExt, LastCluster, &NextCluster);
+        if (NT_SUCCESS(Status) && NextCluster != 0xffffffff)
+        {
+            DPRINT1("Cluster 0x%x isn't the end of its chain\n", LastCluster);
+            Status = STATUS_FILE_CORRUPT_ERROR;
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            ExReleaseResourceLite(&DeviceExt->FatResource);
+            return Status;
+        }
+    }
+
+    PreviousCluster = LastCluster;
+    for (Allocated = 0; Allocated < ClusterCount; Allocated += RunLength)
+    {
+        Status = FindAndMarkAvailableClusters(DeviceExt, ClusterCount - Allocated,
+                                              &RunStart, &RunLength);
+        if (!NT_SUCCESS(Status))
+            break;
+
+        Status = WriteClusterRun(DeviceExt, RunStart, RunLength, 0xffffffff);
+        if (NT_SUCCESS(Status) && PreviousCluster != 0)
+            Status = DeviceExt->WriteCluster(DeviceExt, PreviousCluster, RunStart, &OldValue);
+        if (!NT_SUCCESS(Status))
+        {
+            /* This run can't be reached from the chain, give it back */
+            for (Cluster = RunStart; Cluster < RunStart + RunLength; Cluster++)
+                DeviceExt->WriteCluster(DeviceExt, Cluster, 0, &OldValue);
+            if (DeviceExt->FreeClusterBitmap.Buffer != NULL)
+                RtlClearBits(&DeviceExt->FreeClusterBitmap, RunStart, RunLength);
+            if (DeviceExt->AvailableClustersValid)
+                InterlockedExchangeAdd((PLONG)&DeviceExt->AvailableClusters, RunLength);
+            break;
+        }
+
+        if (*FirstNewCluster == 0xffffffff)
+            *FirstNewCluster = RunStart;
+        PreviousCluster = RunStart + RunLength - 1;
+    }
+
+    if (!NT_SUCCESS(Status) && *FirstNewCluster != 0xffffffff)
+    {
+        /* Cut the chain where it was, and free what was added */
+        if (LastCluster != 0)
+            DeviceExt->WriteCluster(DeviceExt, LastCluster, 0xffffffff, &OldValue);
+
+        Cluster = *FirstNewCluster;
+        while (Cluster != 0xffffffff && Cluster > 1)
+        {
+            if (!NT_SUCCESS(DeviceExt->GetNextCluster(DeviceExt, Cluster, &NextCluster)))
+                NextCluster = 0xffffffff;
+            WriteCluster(DeviceExt, Cluster, 0);
+            Cluster = NextCluster;
+        }
+        *FirstNewCluster = 0xffffffff;
+    }
+
+    ExReleaseResourceLite(&DeviceExt->FatResource);
+    return Status;
+}
+
 /*
  * FUNCTION: Converts the cluster number to a sector number for this physical
  *           device
@@ -777,49 +1088,27 @@ GetNextClusterExtend(
     ULONG CurrentCluster,
     PULONG NextCluster)
 {
-    ULONG NewCluster;
     NTSTATUS Status;
 
     DPRINT("GetNextClusterExtend(DeviceExt %p, CurrentCluster %x)\n",
            DeviceExt, CurrentCluster);
 
-    ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
     /*
      * If the file hasn't any clusters allocated then we need special
      * handling
      */
     if (CurrentCluster == 0)
     {
-        Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
-        if (!NT_SUCCESS(Status))
-        {
-            ExReleaseResourceLite(&DeviceExt->FatResource);
-            return Status;
-        }
-
-        *NextCluster = NewCluster;
-        ExReleaseResourceLite(&DeviceExt->FatResource);
-        return STATUS_SUCCESS;
+        return ExtendClusterChain(DeviceExt, 0, 1, NextCluster);
     }
 
+    ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
     Status = DeviceExt->GetNextCluster(DeviceExt, CurrentCluster, NextCluster);
 
-    if ((*NextCluster) == 0xFFFFFFFF)
+    if (NT_SUCCESS(Status) && (*NextCluster) == 0xFFFFFFFF)
     {
         /* We are after last existing cluster, we must add one to file */
-        /* Firstly, find the next available open allocation unit and
-           mark it as end of file */
-        Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
-        if (!NT_SUCCESS(Status))
-        {
-            ExReleaseResourceLite(&DeviceExt->FatResource);
-            return Status;
-        }
-
-        /* Now, write the AU of the LastCluster with the value of the newly
-           found AU */
-        WriteCluster(DeviceExt, CurrentCluster, NewCluster);
-        *NextCluster = NewCluster;
+        Status = ExtendClusterChain(DeviceExt, CurrentCluster, 1, NextCluster);
     }
 
     ExReleaseResourceLite(&DeviceExt->FatResource);
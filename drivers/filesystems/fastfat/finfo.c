@@ -1209,8 +1209,9 @@ UpdateFileSize(
     CcSetFileSizes(FileObject, (PCC_FILE_SIZES)&Fcb->RFCB.AllocationSize);
 }
 
+static
 NTSTATUS
-VfatSetAllocationSizeInformation(
+VfatSetAllocationSize(
     PFILE_OBJECT FileObject,
     PVFATFCB Fcb,
     PDEVICE_EXTENSION DeviceExt,
@@ -1222,7 +1223,7 @@ VfatSetAllocationSizeInformation(
 
     ULONG ClusterSize = DeviceExt->FatInfo.BytesPerCluster;
     ULONG NewSize = AllocationSize->u.LowPart;
-    ULONG NCluster;
+    ULONG NCluster, ClusterCount;
     BOOLEAN AllocSizeChanged = FALSE, IsFatX = vfatVolumeIsFatX(DeviceExt);
 
     DPRINT("VfatSetAllocationSizeInformation(File <%wZ>, AllocationSize %d %u)\n",
@@ -1250,36 +1251,16 @@ VfatSetAllocationSizeInformation(
         AllocSizeChanged = TRUE;
         if (FirstCluster == 0)
         {
-            Fcb->LastCluster = Fcb->LastOffset = 0;
-            Status = NextCluster(DeviceExt, FirstCluster, &FirstCluster, TRUE);
+            FsRtlResetLargeMcb(&Fcb->Mcb, FALSE);
+            Status = ExtendClusterChain(DeviceExt, 0,
+                                        ROUND_DOWN(NewSize - 1, ClusterSize) / ClusterSize + 1,
+                                        &FirstCluster);
             if (!NT_SUCCESS(Status))
             {
-                DPRINT1("NextCluster failed. Status = %x\n", Status);
+                DPRINT1("ExtendClusterChain failed. Status = %x\n", Status);
                 return Status;
             }
 
-            if (FirstCluster == 0xffffffff)
-            {
-                return STATUS_DISK_FULL;
-            }
-
-            Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                     ROUND_DOWN(NewSize - 1, ClusterSize),
-                                     &NCluster, TRUE);
-            if (NCluster == 0xffffffff || !NT_SUCCESS(Status))
-            {
-                /* disk is full */
-                NCluster = Cluster = FirstCluster;
-                Status = STATUS_SUCCESS;
-                while (NT_SUCCESS(Status) && Cluster != 0xffffffff && Cluster > 1)
-                {
-                    Status = NextCluster(DeviceExt, FirstCluster, &NCluster, FALSE);
-                    WriteCluster(DeviceExt, Cluster, 0);
-                    Cluster = NCluster;
-                }
-                return STATUS_DISK_FULL;
-            }
-
             if (IsFatX)
             {
                 Fcb->entry.FatX.FirstCluster = FirstCluster;
@@ -1300,54 +1281,32 @@ VfatSetAllocationSizeInformation(
         }
         else
         {
-            if (Fcb->LastCluster > 0)
-            {
-                if (Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize == Fcb->LastOffset)
-                {
-                    Cluster = Fcb->LastCluster;
-                    Status = STATUS_SUCCESS;
-                }
-                else
-                {
-                    Status = OffsetToCluster(DeviceExt, Fcb->LastCluster,
-                                             Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize - Fcb->LastOffset,
-                                             &Cluster, FALSE);
-                }
-            }
-            else
-            {
-                Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                         Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize,
-                                         &Cluster, FALSE);
-            }
+            /* Don't trust anything mapped past the current allocation */
+            FsRtlTruncateLargeMcb(&Fcb->Mcb, Fcb->RFCB.AllocationSize.u.LowPart / ClusterSize);
 
+            Status = OffsetToClusterRun(DeviceExt, Fcb,
+                                        Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize,
+                                        &Cluster, &ClusterCount);
             if (!NT_SUCCESS(Status))
             {
                 return Status;
             }
 
-            Fcb->LastCluster = Cluster;
-            Fcb->LastOffset = Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize;
+            if (Cluster == 0xffffffff)
+            {
+                /* The chain is shorter than the allocation size */
+                return STATUS_FILE_CORRUPT_ERROR;
+            }
 
-            /* FIXME: Check status */
             /* Cluster points now to the last cluster within the chain */
-            Status = OffsetToCluster(DeviceExt, Cluster,
-                                     ROUND_DOWN(NewSize - 1, ClusterSize) - Fcb->LastOffset,
-                                     &NCluster, TRUE);
-            if (NCluster == 0xffffffff || !NT_SUCCESS(Status))
+            Status = ExtendClusterChain(DeviceExt, Cluster,
+                                        (ROUND_DOWN(NewSize - 1, ClusterSize) -
+                                         (Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize)) / ClusterSize,
+                                        &NCluster);
+            if (!NT_SUCCESS(Status))
             {
-                /* disk is full */
-                NCluster = Cluster;
-                Status = NextCluster(DeviceExt, FirstCluster, &NCluster, FALSE);
-                WriteCluster(DeviceExt, Cluster, 0xffffffff);
-                Cluster = NCluster;
-                while (NT_SUCCESS(Status) && Cluster != 0xffffffff && Cluster > 1)
-                {
-                    Status = NextCluster(DeviceExt, FirstCluster, &NCluster, FALSE);
-                    WriteCluster(DeviceExt, Cluster, 0);
-                    Cluster = NCluster;
-                }
-                return STATUS_DISK_FULL;
+                DPRINT1("ExtendClusterChain failed. Status = %x\n", Status);
+                return Status;
             }
         }
         UpdateFileSize(FileObject, Fcb, NewSize, ClusterSize, vfatVolumeIsFatX(DeviceExt));
@@ -1364,14 +1323,12 @@ VfatSetAllocationSizeInformation(
         DPRINT("Can set file size\n");
 
         AllocSizeChanged = TRUE;
-        /* FIXME: Use the cached cluster/offset better way. */
-        Fcb->LastCluster = Fcb->LastOffset = 0;
         UpdateFileSize(FileObject, Fcb, NewSize, ClusterSize, vfatVolumeIsFatX(DeviceExt));
         if (NewSize > 0)
         {
-            Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                     ROUND_DOWN(NewSize - 1, ClusterSize),
-                                     &Cluster, FALSE);
+            Status = OffsetToClusterRun(DeviceExt, Fcb,
+                                        ROUND_DOWN(NewSize - 1, ClusterSize),
+                                        &Cluster, &ClusterCount);
 
             NCluster = Cluster;
             Status = NextCluster(DeviceExt, FirstCluster, &NCluster, FALSE);
@@ -1401,6 +1358,9 @@ VfatSetAllocationSizeInformation(
             Status = STATUS_SUCCESS;
         }
 
+        /* Forget the runs of the clusters being freed */
+        FsRtlTruncateLargeMcb(&Fcb->Mcb, ROUND_UP(NewSize, ClusterSize) / ClusterSize);
+
         while (NT_SUCCESS(Status) && 0xffffffff != Cluster && Cluster > 1)
         {
             Status = NextCluster(DeviceExt, FirstCluster, &NCluster, FALSE);
@@ -1429,6 +1389,27 @@ VfatSetAllocationSizeInformation(
     return STATUS_SUCCESS;
 }
 
+NTSTATUS
+VfatSetAllocationSizeInformation(
+    PFILE_OBJECT FileObject,
+    PVFATFCB Fcb,
+    PDEVICE_EXTENSION DeviceExt,
+    PLARGE_INTEGER AllocationSize)
+{
+    NTSTATUS Status;
+
+    /*
+     * Paging I/O adds runs to the cluster map under the paging resource only.
+     * Keep it out while the chain and the map are truncated or rebuilt, so
+     * that it can't map clusters which are being freed.
+     */
+    ExAcquireResourceExclusiveLite(&Fcb->PagingIoResource, TRUE);
+    Status = VfatSetAllocationSize(FileObject, Fcb, DeviceExt, AllocationSize);
+    ExReleaseResourceLite(&Fcb->PagingIoResource);
+
+    return Status;
+}
+
 /*
  * FUNCTION: Retrieve the specified file information
  */
@@ -738,8 +738,13 @@ VfatMount(
     _SEH2_END;
 
     DeviceExt->LastAvailableCluster = 2;
-    CountAvailableClusters(DeviceExt, NULL);
     ExInitializeResourceLite(&DeviceExt->FatResource);
+    Status = InitializeFreeClusterBitmap(DeviceExt);
+    if (!NT_SUCCESS(Status))
+    {
+        ExDeleteResourceLite(&DeviceExt->FatResource);
+        goto ByeBye;
+    }
 
     InitializeListHead(&DeviceExt->FcbListHead);
 
@@ -830,6 +835,8 @@ ByeBye:
             ExFreePoolWithTag(DeviceExt->SpareVPB, TAG_VPB);
         if (DeviceExt && DeviceExt->Statistics)
             ExFreePoolWithTag(DeviceExt->Statistics, TAG_STATS);
+        if (DeviceExt)
+            UninitializeFreeClusterBitmap(DeviceExt);
         if (DeviceObject)
             IoDeleteDevice(DeviceObject);
     }
@@ -957,9 +964,8 @@ VfatGetRetrievalPointers(
     ULONG MaxExtentCount;
     PVFATFCB Fcb;
     PDEVICE_EXTENSION DeviceExt;
-    ULONG FirstCluster;
     ULONG CurrentCluster;
-    ULONG LastCluster;
+    ULONG ClusterCount;
     NTSTATUS Status;
 
     DPRINT("VfatGetRetrievalPointers(IrpContext %p)\n", IrpContext);
@@ -994,40 +1000,36 @@ VfatGetRetrievalPointers(
         goto ByeBye;
     }
 
-    CurrentCluster = FirstCluster = vfatDirEntryGetFirstCluster(DeviceExt, &Fcb->entry);
-    Status = OffsetToCluster(DeviceExt, FirstCluster,
-                             Vcn.u.LowPart * DeviceExt->FatInfo.BytesPerCluster,
-                             &CurrentCluster, FALSE);
-    if (!NT_SUCCESS(Status))
+    /* The FAT12/16 root directory isn't made of clusters */
+    if (vfatDirEntryGetFirstCluster(DeviceExt, &Fcb->entry) == 1)
     {
+        Status = STATUS_INVALID_PARAMETER;
         goto ByeBye;
     }
 
     RetrievalPointers->StartingVcn = Vcn;
     RetrievalPointers->ExtentCount = 0;
-    RetrievalPointers->Extents[0].Lcn.u.HighPart = 0;
-    RetrievalPointers->Extents[0].Lcn.u.LowPart = CurrentCluster - 2;
-    LastCluster = 0;
-    while (CurrentCluster != 0xffffffff && RetrievalPointers->ExtentCount < MaxExtentCount)
+    while (RetrievalPointers->ExtentCount < MaxExtentCount &&
+           Vcn.QuadPart < Fcb->RFCB.AllocationSize.QuadPart / DeviceExt->FatInfo.BytesPerCluster)
     {
-        LastCluster = CurrentCluster;
-        Status = NextCluster(DeviceExt, CurrentCluster, &CurrentCluster, FALSE);
-        Vcn.QuadPart++;
+        Status = OffsetToClusterRun(DeviceExt, Fcb,
+                                    Vcn.u.LowPart * DeviceExt->FatInfo.BytesPerCluster,
+                                    &CurrentCluster, &ClusterCount);
         if (!NT_SUCCESS(Status))
         {
             goto ByeBye;
         }
 
-        if (LastCluster + 1 != CurrentCluster)
+        if (CurrentCluster == 0xffffffff)
         {
-            RetrievalPointers->Extents[RetrievalPointers->ExtentCount].NextVcn = Vcn;
-            RetrievalPointers->ExtentCount++;
-            if (RetrievalPointers->ExtentCount < MaxExtentCount)
-            {
-                RetrievalPointers->Extents[RetrievalPointers->ExtentCount].Lcn.u.HighPart = 0;
-                RetrievalPointers->Extents[RetrievalPointers->ExtentCount].Lcn.u.LowPart = CurrentCluster - 2;
-            }
+            break;
         }
+
+        Vcn.QuadPart += ClusterCount;
+        RetrievalPointers->Extents[RetrievalPointers->ExtentCount].NextVcn = Vcn;
+        RetrievalPointers->Extents[RetrievalPointers->ExtentCount].Lcn.u.HighPart = 0;
+        RetrievalPointers->Extents[RetrievalPointers->ExtentCount].Lcn.u.LowPart = CurrentCluster - 2;
+        RetrievalPointers->ExtentCount++;
     }
 
     IrpContext->Irp->IoStatus.Information = sizeof(RETRIEVAL_POINTERS_BUFFER) + (sizeof(RetrievalPointers->Extents[0]) * (RetrievalPointers->ExtentCount - 1));
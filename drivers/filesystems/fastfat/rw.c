@@ -16,7 +16,7 @@
 #include <debug.h>
 
 /*
- * Uncomment to enable strict verification of cluster/offset pair
+ * Uncomment to enable strict verification of cluster run
  * caching. If this option is enabled you lose all the benefits of
  * the caching and the read/write operations will actually be
  * slower. It's meant only for debugging!!!
@@ -113,6 +113,89 @@ OffsetToCluster(
    }
 }
 
+/*
+ * Return the cluster holding the given file offset and the number of
+ * clusters which follow it contiguously on the disk. The FAT chain is only
+ * walked past the runs already recorded in the FCB cluster map.
+ */
+NTSTATUS
+OffsetToClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb,
+    ULONG FileOffset,
+    PULONG Cluster,
+    PULONG ClusterCount)
+{
+    LONGLONG Vcn, Lcn, Count;
+    LONGLONG RunVcn, RunLength;
+    ULONG CurrentCluster;
+    ULONG RunStart;
+    NTSTATUS Status;
+
+    Vcn = FileOffset / DeviceExt->FatInfo.BytesPerCluster;
+
+    if (FsRtlLookupLargeMcbEntry(&Fcb->Mcb, Vcn, &Lcn, &Count, NULL, NULL, NULL) &&
+        Lcn != -1)
+    {
+        *Cluster = (ULONG)Lcn;
+        *ClusterCount = (ULONG)Count;
+        return STATUS_SUCCESS;
+    }
+
+    /* Resume the walk right after the last mapped cluster */
+    if (FsRtlLookupLastLargeMcbEntry(&Fcb->Mcb, &RunVcn, &Lcn))
+    {
+        RunVcn++;
+        Status = GetNextCluster(DeviceExt, (ULONG)Lcn, &CurrentCluster);
+        if (!NT_SUCCESS(Status))
+            return Status;
+    }
+    else
+    {
+        RunVcn = 0;
+        CurrentCluster = vfatDirEntryGetFirstCluster(DeviceExt, &Fcb->entry);
+    }
+
+    if (CurrentCluster == 0 || CurrentCluster == 1)
+    {
+        DbgPrint("OffsetToClusterRun found invalid cluster %u in the chain!\n", CurrentCluster);
+        ASSERT(FALSE);
+        return STATUS_FILE_CORRUPT_ERROR;
+    }
+
+    while (CurrentCluster != 0xffffffff)
+    {
+        RunStart = CurrentCluster;
+        RunLength = 0;
+        do
+        {
+            RunLength++;
+            Status = GetNextCluster(DeviceExt, CurrentCluster, &CurrentCluster);
+            if (!NT_SUCCESS(Status))
+                return Status;
+        }
+        while (CurrentCluster == RunStart + RunLength);
+
+        if (!FsRtlAddLargeMcbEntry(&Fcb->Mcb, RunVcn, RunStart, RunLength))
+        {
+            DPRINT1("Failed to map VCN %I64d to cluster %x for '%wZ'\n", RunVcn, RunStart, &Fcb->PathNameU);
+        }
+
+        if (Vcn < RunVcn + RunLength)
+        {
+            *Cluster = RunStart + (ULONG)(Vcn - RunVcn);
+            *ClusterCount = (ULONG)(RunVcn + RunLength - Vcn);
+            return STATUS_SUCCESS;
+        }
+        RunVcn += RunLength;
+    }
+
+    /* The offset is past the end of the chain */
+    *Cluster = 0xffffffff;
+    *ClusterCount = 0;
+    return STATUS_SUCCESS;
+}
+
 /*
  * FUNCTION: Reads data from a file
  */
@@ -124,20 +207,16 @@ VfatReadFileData(
     LARGE_INTEGER ReadOffset,
     PULONG LengthRead)
 {
-    ULONG CurrentCluster;
     ULONG FirstCluster;
     ULONG StartCluster;
     ULONG ClusterCount;
     LARGE_INTEGER StartOffset;
     PDEVICE_EXTENSION DeviceExt;
-    BOOLEAN First = TRUE;
     PVFATFCB Fcb;
     NTSTATUS Status;
     ULONG BytesDone;
     ULONG BytesPerSector;
     ULONG BytesPerCluster;
-    ULONG LastCluster;
-    ULONG LastOffset;
 
     /* PRECONDITION */
     ASSERT(IrpContext);
@@ -194,8 +273,7 @@ VfatReadFileData(
     }
 
     /* Find the first cluster */
-    FirstCluster =
-    CurrentCluster = vfatDirEntryGetFirstCluster (DeviceExt, &Fcb->entry);
+    FirstCluster = vfatDirEntryGetFirstCluster (DeviceExt, &Fcb->entry);
 
     if (FirstCluster == 1)
     {
@@ -215,18 +293,19 @@ VfatReadFileData(
         return Status;
     }
 
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    LastCluster = Fcb->LastCluster;
-    LastOffset = Fcb->LastOffset;
-    ExReleaseFastMutex(&Fcb->LastMutex);
+    KeInitializeEvent(&IrpContext->Event, NotificationEvent, FALSE);
+    IrpContext->RefCount = 1;
+    Status = STATUS_SUCCESS;
 
-    /* Find the cluster to start the read from */
-    if (LastCluster > 0 && ReadOffset.u.LowPart >= LastOffset)
+    while (Length > 0)
     {
-        Status = OffsetToCluster(DeviceExt, LastCluster,
-                                 ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster) -
-                                 LastOffset,
-                                 &CurrentCluster, FALSE);
+        /* Find the run of contiguous clusters to start from */
+        Status = OffsetToClusterRun(DeviceExt, Fcb, ReadOffset.u.LowPart,
+                                    &StartCluster, &ClusterCount);
+        if (!NT_SUCCESS(Status) || StartCluster == 0xffffffff)
+        {
+            break;
+        }
 #ifdef DEBUG_VERIFY_OFFSET_CACHING
         /* DEBUG VERIFICATION */
         {
@@ -234,68 +313,23 @@ VfatReadFileData(
             OffsetToCluster(DeviceExt, FirstCluster,
                             ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster),
                             &CorrectCluster, FALSE);
-            if (CorrectCluster != CurrentCluster)
+            if (CorrectCluster != StartCluster)
                 KeBugCheck(FAT_FILE_SYSTEM);
         }
 #endif
-    }
-    else
-    {
-        Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                 ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster),
-                                 &CurrentCluster, FALSE);
-    }
 
-    if (!NT_SUCCESS(Status))
-    {
-        return Status;
-    }
-
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    Fcb->LastCluster = CurrentCluster;
-    Fcb->LastOffset = ROUND_DOWN (ReadOffset.u.LowPart, BytesPerCluster);
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
-    KeInitializeEvent(&IrpContext->Event, NotificationEvent, FALSE);
-    IrpContext->RefCount = 1;
-
-    while (Length > 0 && CurrentCluster != 0xffffffff)
-    {
-        StartCluster = CurrentCluster;
-        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector;
-        BytesDone = 0;
-        ClusterCount = 0;
-
-        do
+        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector +
+                               ReadOffset.u.LowPart % BytesPerCluster;
+        if (ClusterCount > (Length - 1 + ReadOffset.u.LowPart % BytesPerCluster) / BytesPerCluster)
         {
-            ClusterCount++;
-            if (First)
-            {
-                BytesDone =  min (Length, BytesPerCluster - (ReadOffset.u.LowPart % BytesPerCluster));
-                StartOffset.QuadPart += ReadOffset.u.LowPart % BytesPerCluster;
-                First = FALSE;
-            }
-            else
-            {
-                if (Length - BytesDone > BytesPerCluster)
-                {
-                    BytesDone += BytesPerCluster;
-                }
-                else
-                {
-                    BytesDone = Length;
-                }
-            }
-            Status = NextCluster(DeviceExt, FirstCluster, &CurrentCluster, FALSE);
+            BytesDone = Length;
         }
-        while (StartCluster + ClusterCount == CurrentCluster && NT_SUCCESS(Status) && Length > BytesDone);
-        DPRINT("start %08x, next %08x, count %u\n",
-               StartCluster, CurrentCluster, ClusterCount);
-
-        ExAcquireFastMutex(&Fcb->LastMutex);
-        Fcb->LastCluster = StartCluster + (ClusterCount - 1);
-        Fcb->LastOffset = ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster) + (ClusterCount - 1) * BytesPerCluster;
-        ExReleaseFastMutex(&Fcb->LastMutex);
+        else
+        {
+            BytesDone = ClusterCount * BytesPerCluster - ReadOffset.u.LowPart % BytesPerCluster;
+        }
+        DPRINT("start %08x, count %u, bytes %u\n",
+               StartCluster, ClusterCount, BytesDone);
 
         /* Fire up the read command */
         Status = VfatReadDiskPartial (IrpContext, &StartOffset, BytesDone, *LengthRead, FALSE);
@@ -339,18 +373,14 @@ VfatWriteFileData(
     PVFATFCB Fcb;
     ULONG Count;
     ULONG FirstCluster;
-    ULONG CurrentCluster;
     ULONG BytesDone;
     ULONG StartCluster;
     ULONG ClusterCount;
     NTSTATUS Status = STATUS_SUCCESS;
-    BOOLEAN First = TRUE;
     ULONG BytesPerSector;
     ULONG BytesPerCluster;
     LARGE_INTEGER StartOffset;
     ULONG BufferOffset;
-    ULONG LastCluster;
-    ULONG LastOffset;
 
     /* PRECONDITION */
     ASSERT(IrpContext);
@@ -415,8 +445,7 @@ VfatWriteFileData(
     /*
      * Find the first cluster
      */
-    FirstCluster =
-    CurrentCluster = vfatDirEntryGetFirstCluster (DeviceExt, &Fcb->entry);
+    FirstCluster = vfatDirEntryGetFirstCluster (DeviceExt, &Fcb->entry);
 
     if (FirstCluster == 1)
     {
@@ -428,20 +457,19 @@ VfatWriteFileData(
         return Status;
     }
 
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    LastCluster = Fcb->LastCluster;
-    LastOffset = Fcb->LastOffset;
-    ExReleaseFastMutex(&Fcb->LastMutex);
+    IrpContext->RefCount = 1;
+    BufferOffset = 0;
+    Status = STATUS_SUCCESS;
 
-    /*
-     * Find the cluster to start the write from
-     */
-    if (LastCluster > 0 && WriteOffset.u.LowPart >= LastOffset)
+    while (Length > 0)
     {
-        Status = OffsetToCluster(DeviceExt, LastCluster,
-                                 ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster) -
-                                 LastOffset,
-                                 &CurrentCluster, FALSE);
+        /* Find the run of contiguous clusters to start from */
+        Status = OffsetToClusterRun(DeviceExt, Fcb, WriteOffset.u.LowPart,
+                                    &StartCluster, &ClusterCount);
+        if (!NT_SUCCESS(Status) || StartCluster == 0xffffffff)
+        {
+            break;
+        }
 #ifdef DEBUG_VERIFY_OFFSET_CACHING
         /* DEBUG VERIFICATION */
         {
@@ -449,68 +477,23 @@ VfatWriteFileData(
             OffsetToCluster(DeviceExt, FirstCluster,
                             ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster),
                             &CorrectCluster, FALSE);
-            if (CorrectCluster != CurrentCluster)
+            if (CorrectCluster != StartCluster)
                 KeBugCheck(FAT_FILE_SYSTEM);
         }
 #endif
-    }
-    else
-    {
-        Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                 ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster),
-                                 &CurrentCluster, FALSE);
-    }
 
-    if (!NT_SUCCESS(Status))
-    {
-        return Status;
-    }
-
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    Fcb->LastCluster = CurrentCluster;
-    Fcb->LastOffset = ROUND_DOWN (WriteOffset.u.LowPart, BytesPerCluster);
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
-    IrpContext->RefCount = 1;
-    BufferOffset = 0;
-
-    while (Length > 0 && CurrentCluster != 0xffffffff)
-    {
-        StartCluster = CurrentCluster;
-        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector;
-        BytesDone = 0;
-        ClusterCount = 0;
-
-        do
+        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector +
+                               WriteOffset.u.LowPart % BytesPerCluster;
+        if (ClusterCount > (Length - 1 + WriteOffset.u.LowPart % BytesPerCluster) / BytesPerCluster)
         {
-            ClusterCount++;
-            if (First)
-            {
-                BytesDone =  min (Length, BytesPerCluster - (WriteOffset.u.LowPart % BytesPerCluster));
-                StartOffset.QuadPart += WriteOffset.u.LowPart % BytesPerCluster;
-                First = FALSE;
-            }
-            else
-            {
-                if (Length - BytesDone > BytesPerCluster)
-                {
-                    BytesDone += BytesPerCluster;
-                }
-                else
-                {
-                    BytesDone = Length;
-                }
-            }
-            Status = NextCluster(DeviceExt, FirstCluster, &CurrentCluster, FALSE);
+            BytesDone = Length;
+        }
+        else
+        {
+            BytesDone = ClusterCount * BytesPerCluster - WriteOffset.u.LowPart % BytesPerCluster;
         }
-        while (StartCluster + ClusterCount == CurrentCluster && NT_SUCCESS(Status) && Length > BytesDone);
-        DPRINT("start %08x, next %08x, count %u\n",
-               StartCluster, CurrentCluster, ClusterCount);
-
-        ExAcquireFastMutex(&Fcb->LastMutex);
-        Fcb->LastCluster = StartCluster + (ClusterCount - 1);
-        Fcb->LastOffset = ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster) + (ClusterCount - 1) * BytesPerCluster;
-        ExReleaseFastMutex(&Fcb->LastMutex);
+        DPRINT("start %08x, count %u, bytes %u\n",
+               StartCluster, ClusterCount, BytesDone);
 
         // Fire up the write command
         Status = VfatWriteDiskPartial (IrpContext, &StartOffset, BytesDone, BufferOffset, FALSE);
@@ -324,7 +324,7 @@ PAFD_HANDLE LockHandles( PAFD_HANDLE HandleArray, UINT HandleCount ) {
                 Status = ObReferenceObjectByHandle
                     ( (PVOID)HandleArray[i].Handle,
                       FILE_ALL_ACCESS,
-                      NULL,
+                      *IoFileObjectType,
                        KernelMode,
                        (PVOID*)&FileObjects[i].Handle,
                        NULL );
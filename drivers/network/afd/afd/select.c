@@ -68,6 +68,8 @@ VOID SignalSocket(
     {
         KeCancelTimer( &Poll->Timer );
         RemoveEntryList( &Poll->ListEntry );
+        for( i = 0; i < Poll->WaitBlockCount; i++ )
+            RemoveEntryList( &Poll->WaitBlocks[i].ListEntry );
         ExFreePoolWithTag(Poll, TAG_AFD_ACTIVE_POLL);
     }
 
@@ -92,6 +94,20 @@ VOID SignalSocket(
     AFD_DbgPrint(MID_TRACE,("Done\n"));
 }
 
+/* A select listing a socket more than once has consecutive wait blocks on it,
+ * skip all of them so the entry we return survives signalling the poll */
+static PLIST_ENTRY NextPollWaitBlock( PAFD_FCB FCB, PLIST_ENTRY ListEntry ) {
+    PAFD_ACTIVE_POLL Poll =
+        CONTAINING_RECORD(ListEntry, AFD_POLL_WAIT_BLOCK, ListEntry)->Poll;
+
+    do {
+        ListEntry = ListEntry->Flink;
+    } while( ListEntry != &FCB->PollWaitListHead &&
+             CONTAINING_RECORD(ListEntry, AFD_POLL_WAIT_BLOCK, ListEntry)->Poll == Poll );
+
+    return ListEntry;
+}
+
 static KDEFERRED_ROUTINE SelectTimeout;
 static VOID NTAPI SelectTimeout( PKDPC Dpc,
                            PVOID DeferredContext,
@@ -128,32 +144,25 @@ VOID KillSelectsForFCB( PAFD_DEVICE_EXTENSION DeviceExt,
     KIRQL OldIrql;
     PLIST_ENTRY ListEntry;
     PAFD_ACTIVE_POLL Poll;
-    PIRP Irp;
     PAFD_POLL_INFO PollReq;
-    PAFD_HANDLE HandleArray;
-    UINT i;
+    PAFD_FCB FCB = FileObject->FsContext;
 
     AFD_DbgPrint(MID_TRACE,("Killing selects that refer to %p\n", FileObject));
 
+    if( !FCB ) return;
+
     KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
 
-    ListEntry = DeviceExt->Polls.Flink;
-    while ( ListEntry != &DeviceExt->Polls ) {
-        Poll = CONTAINING_RECORD(ListEntry, AFD_ACTIVE_POLL, ListEntry);
-        ListEntry = ListEntry->Flink;
-        Irp = Poll->Irp;
-        PollReq = Irp->AssociatedIrp.SystemBuffer;
-        HandleArray = AFD_HANDLES(PollReq);
+    ListEntry = FCB->PollWaitListHead.Flink;
+    while ( ListEntry != &FCB->PollWaitListHead ) {
+        Poll = CONTAINING_RECORD(ListEntry, AFD_POLL_WAIT_BLOCK, ListEntry)->Poll;
+        ListEntry = NextPollWaitBlock( FCB, ListEntry );
 
-        for( i = 0; i < PollReq->HandleCount; i++ ) {
-            AFD_DbgPrint(MAX_TRACE,("Req: %u, This %p\n",
-                                    HandleArray[i].Handle, FileObject));
-            if( (PVOID)HandleArray[i].Handle == FileObject &&
-                (!OnlyExclusive || (OnlyExclusive && Poll->Exclusive)) ) {
-                ZeroEvents( PollReq->Handles, PollReq->HandleCount );
-                SignalSocket( Poll, NULL, PollReq, STATUS_CANCELLED );
-            }
-        }
+        if( OnlyExclusive && !Poll->Exclusive ) continue;
+
+        PollReq = Poll->Irp->AssociatedIrp.SystemBuffer;
+        ZeroEvents( PollReq->Handles, PollReq->HandleCount );
+        SignalSocket( Poll, NULL, PollReq, STATUS_CANCELLED );
     }
 
     KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
@@ -189,6 +198,21 @@ AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
         return STATUS_NO_MEMORY;
     }
 
+    /* Only our own sockets can be selected on */
+    for( i = 0; i < PollReq->HandleCount; i++ ) {
+        FileObject = (PFILE_OBJECT)AFD_HANDLES(PollReq)[i].Handle;
+        if( !FileObject ) continue;
+
+        if( FileObject->DeviceObject != DeviceObject || !FileObject->FsContext ) {
+            AFD_DbgPrint(MIN_TRACE,("Handle %u is not a socket\n", i));
+            UnlockHandles( AFD_HANDLES(PollReq), PollReq->HandleCount );
+            Irp->IoStatus.Status = STATUS_INVALID_HANDLE;
+            Irp->IoStatus.Information = 0;
+            IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+            return STATUS_INVALID_HANDLE;
+        }
+    }
+
     if( Exclusive ) {
         for( i = 0; i < PollReq->HandleCount; i++ ) {
             if( !AFD_HANDLES(PollReq)[i].Handle ) continue;
@@ -229,13 +253,30 @@ AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
        PAFD_ACTIVE_POLL Poll = NULL;
 
        Poll = ExAllocatePoolWithTag(NonPagedPool,
-                                    sizeof(AFD_ACTIVE_POLL),
+                                    FIELD_OFFSET(AFD_ACTIVE_POLL, WaitBlocks) +
+                                    PollReq->HandleCount * sizeof(AFD_POLL_WAIT_BLOCK),
                                     TAG_AFD_ACTIVE_POLL);
 
        if (Poll){
           Poll->Irp = Irp;
           Poll->DeviceExt = DeviceExt;
           Poll->Exclusive = Exclusive;
+          Poll->WaitBlockCount = PollReq->HandleCount;
+
+          /* Queue the poll on each of its sockets, so that their events
+           * only have to look at the selects that are interested */
+          for( i = 0; i < PollReq->HandleCount; i++ ) {
+              Poll->WaitBlocks[i].Poll = Poll;
+
+              if( !AFD_HANDLES(PollReq)[i].Handle ) {
+                  InitializeListHead( &Poll->WaitBlocks[i].ListEntry );
+                  continue;
+              }
+
+              FileObject = (PFILE_OBJECT)AFD_HANDLES(PollReq)[i].Handle;
+              FCB = FileObject->FsContext;
+              InsertTailList( &FCB->PollWaitListHead, &Poll->WaitBlocks[i].ListEntry );
+          }
 
           KeInitializeTimerEx( &Poll->Timer, NotificationTimer );
 
@@ -378,6 +419,395 @@ AfdEnumEvents( PDEVICE_OBJECT DeviceObject, PIRP Irp,
     return UnlockAndMaybeComplete( FCB, STATUS_SUCCESS, Irp, 0 );
 }
 
+/* * * NOTE ALWAYS CALLED AT DISPATCH_LEVEL * * */
+static ULONG PollSetHarvest( PAFD_POLL_SET Set,
+                             PAFD_POLL_SET_EVENT Events,
+                             ULONG MaxEvents ) {
+    LIST_ENTRY Requeue;
+    PLIST_ENTRY ListEntry;
+    PAFD_POLL_SET_MEMBER Member;
+    PAFD_FCB FCB;
+    ULONG Count = 0, Ready;
+
+    InitializeListHead( &Requeue );
+
+    while( Count < MaxEvents && !IsListEmpty( &Set->ReadyListHead ) ) {
+        ListEntry = RemoveHeadList( &Set->ReadyListHead );
+        Member = CONTAINING_RECORD( ListEntry, AFD_POLL_SET_MEMBER, ReadyLink );
+        FCB = Member->FileObject->FsContext;
+
+        /* Level triggered, drop the ones that were drained meanwhile */
+        Ready = Member->Events & FCB->PollState;
+        if( !Ready ) {
+            Member->Ready = FALSE;
+            continue;
+        }
+
+        Events[Count].Context = Member->Context;
+        Events[Count].Events = Ready;
+        Count++;
+
+        if( Member->Flags & AFD_POLL_SET_ONESHOT ) {
+            /* Quiet until it is rearmed by AFD_POLL_SET_MODIFY */
+            Member->Ready = FALSE;
+            Member->Disabled = TRUE;
+        } else {
+            InsertTailList( &Requeue, &Member->ReadyLink );
+        }
+    }
+
+    /* Still ready ones go behind those we didn't get to */
+    while( !IsListEmpty( &Requeue ) ) {
+        ListEntry = RemoveHeadList( &Requeue );
+        InsertTailList( &Set->ReadyListHead, ListEntry );
+    }
+
+    return Count;
+}
+
+static ULONG PollSetMaxEvents( PIO_STACK_LOCATION IrpSp ) {
+    ULONG Length = IrpSp->Parameters.DeviceIoControl.OutputBufferLength;
+
+    if( Length < FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Events) ) return 0;
+
+    return (Length - FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Events)) /
+           sizeof(AFD_POLL_SET_EVENT);
+}
+
+/* Must be called with DeviceExt->Lock held. Unless called from the cancel
+ * routine, a wait IRP being cancelled is left for the cancel routine to
+ * complete */
+static VOID PollSetCompleteWait( PAFD_POLL_SET Set, NTSTATUS Status,
+                                 BOOLEAN Cancelling ) {
+    PIRP Irp = Set->WaitIrp;
+    PAFD_POLL_SET_WAIT_INFO WaitInfo = Irp->AssociatedIrp.SystemBuffer;
+    ULONG Count = 0;
+
+    if( !Cancelling && !IoSetCancelRoutine( Irp, NULL ) ) {
+        AFD_DbgPrint(MID_TRACE,("Poll set wait %p is being cancelled\n", Irp));
+        return;
+    }
+
+    Set->WaitIrp = NULL;
+    KeCancelTimer( &Set->Timer );
+
+    if( Status == STATUS_SUCCESS )
+        Count = PollSetHarvest( Set, WaitInfo->Events,
+                                PollSetMaxEvents( IoGetCurrentIrpStackLocation( Irp ) ) );
+
+    AFD_DbgPrint(MID_TRACE,("Completing poll set wait %p (Status %x Count %u)\n",
+                            Irp, Status, Count));
+
+    WaitInfo->EventCount = Count;
+    Irp->IoStatus.Status = Status;
+    Irp->IoStatus.Information =
+        FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Events) + sizeof(AFD_POLL_SET_EVENT) * Count;
+    IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+}
+
+/* * * NOTE ALWAYS CALLED AT DISPATCH_LEVEL * * */
+static VOID PollSetQueueMember( PAFD_POLL_SET_MEMBER Member ) {
+    PAFD_FCB FCB = Member->FileObject->FsContext;
+    PAFD_POLL_SET Set = Member->Set;
+
+    if( Member->Ready || Member->Disabled ||
+        !(Member->Events & FCB->PollState) ) return;
+
+    InsertTailList( &Set->ReadyListHead, &Member->ReadyLink );
+    Member->Ready = TRUE;
+
+    if( Set->WaitIrp ) PollSetCompleteWait( Set, STATUS_SUCCESS, FALSE );
+}
+
+static PAFD_POLL_SET_MEMBER PollSetFindMember( PAFD_POLL_SET Set,
+                                               PAFD_FCB FCB ) {
+    PLIST_ENTRY ListEntry;
+    PAFD_POLL_SET_MEMBER Member;
+
+    for( ListEntry = FCB->PollSetListHead.Flink;
+         ListEntry != &FCB->PollSetListHead;
+         ListEntry = ListEntry->Flink ) {
+        Member = CONTAINING_RECORD( ListEntry, AFD_POLL_SET_MEMBER, SocketLink );
+        if( Member->Set == Set ) return Member;
+    }
+
+    return NULL;
+}
+
+static KDEFERRED_ROUTINE PollSetTimeout;
+static VOID NTAPI PollSetTimeout( PKDPC Dpc,
+                                  PVOID DeferredContext,
+                                  PVOID SystemArgument1,
+                                  PVOID SystemArgument2 ) {
+    PAFD_POLL_SET Set = DeferredContext;
+    KIRQL OldIrql;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    KeAcquireSpinLock( &Set->DeviceExt->Lock, &OldIrql );
+    if( Set->WaitIrp ) PollSetCompleteWait( Set, STATUS_TIMEOUT, FALSE );
+    KeReleaseSpinLock( &Set->DeviceExt->Lock, OldIrql );
+}
+
+static PAFD_POLL_SET GetPollSet( PAFD_FCB FCB ) {
+    PAFD_POLL_SET Set = FCB->PollSet;
+
+    if( Set ) return Set;
+
+    Set = ExAllocatePoolWithTag( NonPagedPool,
+                                 sizeof(AFD_POLL_SET),
+                                 TAG_AFD_POLL_SET );
+    if( !Set ) return NULL;
+
+    Set->DeviceExt = FCB->DeviceExt;
+    Set->WaitIrp = NULL;
+    InitializeListHead( &Set->MemberListHead );
+    InitializeListHead( &Set->ReadyListHead );
+    KeInitializeTimerEx( &Set->Timer, NotificationTimer );
+    KeInitializeDpc( &Set->TimeoutDpc, PollSetTimeout, Set );
+
+    FCB->PollSet = Set;
+
+    return Set;
+}
+
+static NTSTATUS PollSetApply( PDEVICE_OBJECT DeviceObject,
+                              PAFD_POLL_SET Set,
+                              PAFD_POLL_SET_ENTRY Entry,
+                              KPROCESSOR_MODE AccessMode ) {
+    PAFD_POLL_SET_MEMBER Member, NewMember = NULL, OldMember = NULL;
+    PFILE_OBJECT TargetObject;
+    PAFD_FCB TargetFCB;
+    NTSTATUS Status;
+    KIRQL OldIrql;
+
+    if( Entry->Operation < AFD_POLL_SET_ADD ||
+        Entry->Operation > AFD_POLL_SET_REMOVE )
+        return STATUS_INVALID_PARAMETER;
+
+    Status = ObReferenceObjectByHandle( (HANDLE)Entry->Handle,
+                                        0,
+                                        *IoFileObjectType,
+                                        AccessMode,
+                                        (PVOID *)&TargetObject,
+                                        NULL );
+    if( !NT_SUCCESS(Status) ) {
+        AFD_DbgPrint(MIN_TRACE,("Failed to reference handle (0x%x)\n", Status));
+        return Status;
+    }
+
+    TargetFCB = TargetObject->FsContext;
+    if( TargetObject->DeviceObject != DeviceObject || !TargetFCB ) {
+        ObDereferenceObject( TargetObject );
+        return STATUS_INVALID_HANDLE;
+    }
+
+    if( Entry->Operation == AFD_POLL_SET_ADD ) {
+        NewMember = ExAllocatePoolWithTag( NonPagedPool,
+                                           sizeof(AFD_POLL_SET_MEMBER),
+                                           TAG_AFD_POLL_SET_MEMBER );
+        if( !NewMember ) {
+            ObDereferenceObject( TargetObject );
+            return STATUS_NO_MEMORY;
+        }
+    }
+
+    KeAcquireSpinLock( &Set->DeviceExt->Lock, &OldIrql );
+
+    Member = PollSetFindMember( Set, TargetFCB );
+
+    if( Entry->Operation == AFD_POLL_SET_ADD ) {
+        if( Member ) {
+            Status = STATUS_OBJECT_NAME_COLLISION;
+        } else {
+            /* The member keeps our reference on the socket */
+            Member = NewMember;
+            NewMember = NULL;
+            Member->Set = Set;
+            Member->FileObject = TargetObject;
+            Member->Ready = FALSE;
+            TargetObject = NULL;
+            InsertTailList( &Set->MemberListHead, &Member->SetLink );
+            InsertTailList( &TargetFCB->PollSetListHead, &Member->SocketLink );
+        }
+    } else if( !Member ) {
+        Status = STATUS_NOT_FOUND;
+    } else if( Entry->Operation == AFD_POLL_SET_REMOVE ) {
+        RemoveEntryList( &Member->SetLink );
+        RemoveEntryList( &Member->SocketLink );
+        if( Member->Ready ) RemoveEntryList( &Member->ReadyLink );
+        OldMember = Member;
+        Member = NULL;
+    }
+
+    if( NT_SUCCESS(Status) && Member ) {
+        Member->Events = Entry->Events;
+        Member->Flags = Entry->Flags;
+        Member->Context = Entry->Context;
+        Member->Disabled = FALSE;
+        PollSetQueueMember( Member );
+    }
+
+    KeReleaseSpinLock( &Set->DeviceExt->Lock, OldIrql );
+
+    if( NewMember ) ExFreePoolWithTag( NewMember, TAG_AFD_POLL_SET_MEMBER );
+    if( OldMember ) {
+        ObDereferenceObject( OldMember->FileObject );
+        ExFreePoolWithTag( OldMember, TAG_AFD_POLL_SET_MEMBER );
+    }
+    if( TargetObject ) ObDereferenceObject( TargetObject );
+
+    return Status;
+}
+
+NTSTATUS NTAPI
+AfdPollSetUpdate( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                  PIO_STACK_LOCATION IrpSp ) {
+    PFILE_OBJECT FileObject = IrpSp->FileObject;
+    PAFD_FCB FCB = FileObject->FsContext;
+    PAFD_POLL_SET_UPDATE_INFO UpdateInfo = Irp->AssociatedIrp.SystemBuffer;
+    ULONG InputLength = IrpSp->Parameters.DeviceIoControl.InputBufferLength;
+    PAFD_POLL_SET Set;
+    NTSTATUS Status = STATUS_SUCCESS;
+    ULONG i;
+
+    if( !SocketAcquireStateLock( FCB ) ) return LostSocket( Irp );
+
+    if( InputLength < FIELD_OFFSET(AFD_POLL_SET_UPDATE_INFO, Entries) ||
+        UpdateInfo->EntryCount >
+        (InputLength - FIELD_OFFSET(AFD_POLL_SET_UPDATE_INFO, Entries)) /
+        sizeof(AFD_POLL_SET_ENTRY) ) {
+        AFD_DbgPrint(MIN_TRACE,("Buffer too small\n"));
+        return UnlockAndMaybeComplete( FCB, STATUS_BUFFER_TOO_SMALL, Irp, 0 );
+    }
+
+    Set = GetPollSet( FCB );
+    if( !Set ) return UnlockAndMaybeComplete( FCB, STATUS_NO_MEMORY, Irp, 0 );
+
+    AFD_DbgPrint(MID_TRACE,("Called (Set %p EntryCount %u)\n",
+                            Set, UpdateInfo->EntryCount));
+
+    /* Entries are applied in order, the first one failing ends the update */
+    for( i = 0; i < UpdateInfo->EntryCount && NT_SUCCESS(Status); i++ )
+        Status = PollSetApply( DeviceObject, Set, &UpdateInfo->Entries[i],
+                               Irp->RequestorMode );
+
+    return UnlockAndMaybeComplete( FCB, Status, Irp, 0 );
+}
+
+NTSTATUS NTAPI
+AfdPollSetWait( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                PIO_STACK_LOCATION IrpSp ) {
+    PFILE_OBJECT FileObject = IrpSp->FileObject;
+    PAFD_FCB FCB = FileObject->FsContext;
+    PAFD_POLL_SET_WAIT_INFO WaitInfo = Irp->AssociatedIrp.SystemBuffer;
+    ULONG MaxEvents = PollSetMaxEvents( IrpSp );
+    PAFD_POLL_SET Set;
+    KIRQL OldIrql;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    if( !SocketAcquireStateLock( FCB ) ) return LostSocket( Irp );
+
+    if( IrpSp->Parameters.DeviceIoControl.InputBufferLength <
+        FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Events) || !MaxEvents ) {
+        AFD_DbgPrint(MIN_TRACE,("Buffer too small\n"));
+        return UnlockAndMaybeComplete( FCB, STATUS_BUFFER_TOO_SMALL, Irp, 0 );
+    }
+
+    Set = GetPollSet( FCB );
+    if( !Set ) return UnlockAndMaybeComplete( FCB, STATUS_NO_MEMORY, Irp, 0 );
+
+    KeAcquireSpinLock( &Set->DeviceExt->Lock, &OldIrql );
+
+    if( Set->WaitIrp ) {
+        KeReleaseSpinLock( &Set->DeviceExt->Lock, OldIrql );
+        AFD_DbgPrint(MIN_TRACE,("Poll set %p already has a waiter\n", Set));
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_DEVICE_STATE, Irp, 0 );
+    }
+
+    WaitInfo->EventCount = PollSetHarvest( Set, WaitInfo->Events, MaxEvents );
+
+    if( WaitInfo->EventCount || !WaitInfo->Timeout.QuadPart ) {
+        KeReleaseSpinLock( &Set->DeviceExt->Lock, OldIrql );
+        return UnlockAndMaybeComplete( FCB,
+                                       WaitInfo->EventCount ? STATUS_SUCCESS : STATUS_TIMEOUT,
+                                       Irp,
+                                       FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Events) +
+                                       sizeof(AFD_POLL_SET_EVENT) * WaitInfo->EventCount );
+    }
+
+    Set->WaitIrp = Irp;
+    IoMarkIrpPending( Irp );
+    (void)IoSetCancelRoutine( Irp, AfdCancelHandler );
+    KeSetTimer( &Set->Timer, WaitInfo->Timeout, &Set->TimeoutDpc );
+
+    KeReleaseSpinLock( &Set->DeviceExt->Lock, OldIrql );
+
+    SocketStateUnlock( FCB );
+
+    return STATUS_PENDING;
+}
+
+VOID CancelPollSetWait( PAFD_FCB FCB, PIRP Irp ) {
+    PAFD_POLL_SET Set = FCB->PollSet;
+    KIRQL OldIrql;
+
+    if( !Set ) return;
+
+    /* If it isn't there anymore it was completed meanwhile */
+    KeAcquireSpinLock( &Set->DeviceExt->Lock, &OldIrql );
+    if( Set->WaitIrp == Irp ) PollSetCompleteWait( Set, STATUS_CANCELLED, TRUE );
+    KeReleaseSpinLock( &Set->DeviceExt->Lock, OldIrql );
+}
+
+VOID KillPollSetsForFCB( PAFD_FCB FCB ) {
+    PAFD_DEVICE_EXTENSION DeviceExt = FCB->DeviceExt;
+    PAFD_POLL_SET Set = FCB->PollSet;
+    PAFD_POLL_SET_MEMBER Member;
+    PLIST_ENTRY ListEntry;
+    LIST_ENTRY FreeList;
+    KIRQL OldIrql;
+
+    InitializeListHead( &FreeList );
+
+    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+
+    /* Take the socket out of the poll sets watching it */
+    while( !IsListEmpty( &FCB->PollSetListHead ) ) {
+        ListEntry = RemoveHeadList( &FCB->PollSetListHead );
+        Member = CONTAINING_RECORD( ListEntry, AFD_POLL_SET_MEMBER, SocketLink );
+        RemoveEntryList( &Member->SetLink );
+        if( Member->Ready ) RemoveEntryList( &Member->ReadyLink );
+        InsertTailList( &FreeList, &Member->SetLink );
+    }
+
+    /* And empty its own poll set */
+    if( Set ) {
+        if( Set->WaitIrp ) PollSetCompleteWait( Set, STATUS_CANCELLED, FALSE );
+
+        while( !IsListEmpty( &Set->MemberListHead ) ) {
+            ListEntry = RemoveHeadList( &Set->MemberListHead );
+            Member = CONTAINING_RECORD( ListEntry, AFD_POLL_SET_MEMBER, SetLink );
+            RemoveEntryList( &Member->SocketLink );
+            if( Member->Ready ) RemoveEntryList( &Member->ReadyLink );
+            InsertTailList( &FreeList, &Member->SetLink );
+        }
+    }
+
+    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+
+    /* Drop the socket references outside of the lock */
+    while( !IsListEmpty( &FreeList ) ) {
+        ListEntry = RemoveHeadList( &FreeList );
+        Member = CONTAINING_RECORD( ListEntry, AFD_POLL_SET_MEMBER, SetLink );
+        ObDereferenceObject( Member->FileObject );
+        ExFreePoolWithTag( Member, TAG_AFD_POLL_SET_MEMBER );
+    }
+}
+
 /* * * NOTE ALWAYS CALLED AT DISPATCH_LEVEL * * */
 static BOOLEAN UpdatePollWithFCB( PAFD_ACTIVE_POLL Poll, PFILE_OBJECT FileObject ) {
     UINT i;
@@ -407,6 +837,7 @@ static BOOLEAN UpdatePollWithFCB( PAFD_ACTIVE_POLL Poll, PFILE_OBJECT FileObject
 VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceExt, PFILE_OBJECT FileObject ) {
     PAFD_ACTIVE_POLL Poll = NULL;
     PLIST_ENTRY ThePollEnt = NULL;
+    PAFD_POLL_SET_MEMBER Member;
     PAFD_FCB FCB;
     KIRQL OldIrql;
     PAFD_POLL_INFO PollReq;
@@ -424,20 +855,28 @@ VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceExt, PFILE_OBJECT FileObject ) {
         return;
     }
 
-    /* Now signal normal select irps */
-    ThePollEnt = DeviceExt->Polls.Flink;
+    /* Now signal the normal select irps waiting on this socket */
+    ThePollEnt = FCB->PollWaitListHead.Flink;
 
-    while( ThePollEnt != &DeviceExt->Polls ) {
-        Poll = CONTAINING_RECORD( ThePollEnt, AFD_ACTIVE_POLL, ListEntry );
+    while( ThePollEnt != &FCB->PollWaitListHead ) {
+        Poll = CONTAINING_RECORD( ThePollEnt, AFD_POLL_WAIT_BLOCK, ListEntry )->Poll;
         PollReq = Poll->Irp->AssociatedIrp.SystemBuffer;
+        ThePollEnt = NextPollWaitBlock( FCB, ThePollEnt );
         AFD_DbgPrint(MID_TRACE,("Checking poll %p\n", Poll));
 
         if( UpdatePollWithFCB( Poll, FileObject ) ) {
-            ThePollEnt = ThePollEnt->Flink;
             AFD_DbgPrint(MID_TRACE,("Signalling socket\n"));
             SignalSocket( Poll, NULL, PollReq, STATUS_SUCCESS );
-        } else
-            ThePollEnt = ThePollEnt->Flink;
+        }
+    }
+
+    /* And the poll sets watching it */
+    ThePollEnt = FCB->PollSetListHead.Flink;
+
+    while( ThePollEnt != &FCB->PollSetListHead ) {
+        Member = CONTAINING_RECORD( ThePollEnt, AFD_POLL_SET_MEMBER, SocketLink );
+        ThePollEnt = ThePollEnt->Flink;
+        PollSetQueueMember( Member );
     }
 
     KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
@@ -47,6 +47,8 @@
 #define TAG_AFD_POLL_HANDLE                'hpfA'
 #define TAG_AFD_FCB                        'cffA'
 #define TAG_AFD_ACTIVE_POLL                'pafA'
+#define TAG_AFD_POLL_SET                   'spfA'
+#define TAG_AFD_POLL_SET_MEMBER            'mpfA'
 #define TAG_AFD_EA_INFO                    'aefA'
 #define TAG_AFD_STORED_DATAGRAM            'gsfA'
 #define TAG_AFD_SNMP_ADDRESS_INFO          'asfA'
@@ -113,6 +115,12 @@ typedef struct _AFD_DEVICE_EXTENSION {
     KSPIN_LOCK Lock;
 } AFD_DEVICE_EXTENSION, *PAFD_DEVICE_EXTENSION;
 
+/* Links a pending select into the wait list of one of its sockets */
+typedef struct _AFD_POLL_WAIT_BLOCK {
+    LIST_ENTRY ListEntry;
+    struct _AFD_ACTIVE_POLL *Poll;
+} AFD_POLL_WAIT_BLOCK, *PAFD_POLL_WAIT_BLOCK;
+
 typedef struct _AFD_ACTIVE_POLL {
     LIST_ENTRY ListEntry;
     PIRP Irp;
@@ -121,8 +129,33 @@ typedef struct _AFD_ACTIVE_POLL {
     KTIMER Timer;
     PKEVENT EventObject;
     BOOLEAN Exclusive;
+    UINT WaitBlockCount;
+    AFD_POLL_WAIT_BLOCK WaitBlocks[1];
 } AFD_ACTIVE_POLL, *PAFD_ACTIVE_POLL;
 
+/* A persistent poll set, owned by the socket the poll set IOCTLs are sent to */
+typedef struct _AFD_POLL_SET {
+    PAFD_DEVICE_EXTENSION DeviceExt;
+    LIST_ENTRY MemberListHead;
+    LIST_ENTRY ReadyListHead;
+    PIRP WaitIrp;
+    KDPC TimeoutDpc;
+    KTIMER Timer;
+} AFD_POLL_SET, *PAFD_POLL_SET;
+
+typedef struct _AFD_POLL_SET_MEMBER {
+    LIST_ENTRY SetLink;
+    LIST_ENTRY SocketLink;
+    LIST_ENTRY ReadyLink;
+    PAFD_POLL_SET Set;
+    PFILE_OBJECT FileObject;
+    PVOID Context;
+    ULONG Events;
+    ULONG Flags;
+    BOOLEAN Ready;
+    BOOLEAN Disabled;
+} AFD_POLL_SET_MEMBER, *PAFD_POLL_SET_MEMBER;
+
 typedef struct _IRP_LIST {
     LIST_ENTRY ListEntry;
     PIRP Irp;
@@ -201,6 +234,9 @@ typedef struct _AFD_FCB {
     LIST_ENTRY PendingIrpList[MAX_FUNCTIONS];
     LIST_ENTRY DatagramList;
     LIST_ENTRY PendingConnections;
+    LIST_ENTRY PollWaitListHead;
+    LIST_ENTRY PollSetListHead;
+    PAFD_POLL_SET PollSet;
 } AFD_FCB, *PAFD_FCB;
 
 /* bind.c */
@@ -331,6 +367,14 @@ AfdEnumEvents( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceObject, PFILE_OBJECT FileObject );
 VOID KillSelectsForFCB( PAFD_DEVICE_EXTENSION DeviceExt,
                         PFILE_OBJECT FileObject, BOOLEAN ExclusiveOnly );
+NTSTATUS NTAPI
+AfdPollSetUpdate( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+		  PIO_STACK_LOCATION IrpSp );
+NTSTATUS NTAPI
+AfdPollSetWait( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+		PIO_STACK_LOCATION IrpSp );
+VOID CancelPollSetWait( PAFD_FCB FCB, PIRP Irp );
+VOID KillPollSetsForFCB( PAFD_FCB FCB );
 VOID ZeroEvents( PAFD_HANDLE HandleArray,
 		 UINT HandleCount );
 VOID SignalSocket(
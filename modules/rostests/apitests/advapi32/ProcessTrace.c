@@ -0,0 +1,227 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Tests for OpenTrace/ProcessTrace with damaged log files
+ */
+
+#include "precomp.h"
+
+#include <wmistr.h>
+#include <initguid.h>
+#include <evntrace.h>
+#include <wmilog.h>
+
+#define TEST_BUFFER_SIZE    1024
+#define TEST_EVENT_COUNT    3
+
+static const GUID TestGuid = {0x5b0d0e35, 0x4c1a, 0x4e8e, {0x9e, 0x23, 0x52, 0x0f, 0x40, 0x6c, 0x11, 0x7a}};
+
+static ULONG EventCount;
+static ULONG HeaderCount;
+
+static
+VOID
+WINAPI
+EventCallback(PEVENT_TRACE Event)
+{
+    if (IsEqualGUID(&Event->Header.Guid, &EventTraceGuid))
+    {
+        HeaderCount++;
+        return;
+    }
+
+    ok(IsEqualGUID(&Event->Header.Guid, &TestGuid), "Unexpected event GUID\n");
+    ok(Event->MofLength == sizeof(ULONG), "MofLength = %lu\n", Event->MofLength);
+    if (Event->MofLength == sizeof(ULONG))
+    {
+        ok(*(PULONG)Event->MofData == EventCount, "Event %lu has data %lu\n",
+           EventCount, *(PULONG)Event->MofData);
+    }
+    EventCount++;
+}
+
+/* A logfile header buffer and one buffer of processor 0 holding TEST_EVENT_COUNT events */
+static
+VOID
+BuildLog(PUCHAR Log, ULONG NumberOfProcessors)
+{
+    static const WCHAR Names[] = KERNEL_LOGGER_NAMEW L"\0test.etl";
+    PWMI_TRACE_BUFFER_HEADER Buffer;
+    PEVENT_TRACE_HEADER Event;
+    PTRACE_LOGFILE_HEADER LogfileHeader;
+    ULONG i, Offset;
+
+    ZeroMemory(Log, 2 * TEST_BUFFER_SIZE);
+
+    Buffer = (PWMI_TRACE_BUFFER_HEADER)Log;
+    Event = (PEVENT_TRACE_HEADER)(Buffer + 1);
+    LogfileHeader = (PTRACE_LOGFILE_HEADER)(Event + 1);
+    Buffer->BufferSize = TEST_BUFFER_SIZE;
+    Buffer->Flags = WMI_TRACE_BUFFER_FLAG_LOGFILE_HEADER;
+    Event->Size = sizeof(*Event) + sizeof(*LogfileHeader) + sizeof(Names);
+    Event->Class.Type = EVENT_TRACE_TYPE_INFO;
+    Event->Guid = EventTraceGuid;
+    Event->TimeStamp.QuadPart = 1000;
+    LogfileHeader->BufferSize = TEST_BUFFER_SIZE;
+    LogfileHeader->NumberOfProcessors = NumberOfProcessors;
+    LogfileHeader->StartTime.QuadPart = 1000;
+    LogfileHeader->ReservedFlags = WMI_TRACE_CLOCK_SYSTEMTIME;
+    CopyMemory(LogfileHeader + 1, Names, sizeof(Names));
+    Buffer->SavedOffset = sizeof(*Buffer) + ALIGN_UP_BY(Event->Size, WMI_TRACE_ALIGNMENT);
+
+    Buffer = (PWMI_TRACE_BUFFER_HEADER)(Log + TEST_BUFFER_SIZE);
+    Buffer->BufferSize = TEST_BUFFER_SIZE;
+    Offset = sizeof(*Buffer);
+    for (i = 0; i < TEST_EVENT_COUNT; i++)
+    {
+        Event = (PEVENT_TRACE_HEADER)((PUCHAR)Buffer + Offset);
+        Event->Size = sizeof(*Event) + sizeof(ULONG);
+        Event->Guid = TestGuid;
+        Event->TimeStamp.QuadPart = 2000 + i;
+        *(PULONG)(Event + 1) = i;
+        Offset += ALIGN_UP_BY(Event->Size, WMI_TRACE_ALIGNMENT);
+    }
+    Buffer->SavedOffset = Offset;
+}
+
+static
+VOID
+WriteLog(PCWSTR FileName, PUCHAR Log, ULONG Length)
+{
+    HANDLE hFile;
+    DWORD Written;
+
+    hFile = CreateFileW(FileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    ok(hFile != INVALID_HANDLE_VALUE, "CreateFileW failed: %lu\n", GetLastError());
+    if (hFile == INVALID_HANDLE_VALUE)
+        return;
+
+    ok(WriteFile(hFile, Log, Length, &Written, NULL) && (Written == Length),
+       "WriteFile failed: %lu\n", GetLastError());
+    CloseHandle(hFile);
+}
+
+/* Opens and processes the log, returns the OpenTrace error or the ProcessTrace result */
+static
+ULONG
+ReadLog(PWSTR FileName)
+{
+    EVENT_TRACE_LOGFILEW Logfile;
+    TRACEHANDLE Handle;
+    ULONG Error;
+
+    ZeroMemory(&Logfile, sizeof(Logfile));
+    Logfile.LogFileName = FileName;
+    Logfile.EventCallback = EventCallback;
+    EventCount = 0;
+    HeaderCount = 0;
+
+    Handle = OpenTraceW(&Logfile);
+    if (Handle == INVALID_PROCESSTRACE_HANDLE)
+        return GetLastError();
+
+    Error = ProcessTrace(&Handle, 1, NULL, NULL);
+    ok(CloseTrace(Handle) == ERROR_SUCCESS, "CloseTrace failed\n");
+    return Error;
+}
+
+START_TEST(ProcessTrace)
+{
+    WCHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    PUCHAR Log;
+    PWMI_TRACE_BUFFER_HEADER Buffer;
+    PEVENT_TRACE_HEADER Event;
+    ULONG Error;
+
+    if (!GetTempPathW(_countof(TempPath), TempPath) ||
+        !GetTempFileNameW(TempPath, L"etl", 0, FileName))
+    {
+        skip("No temporary file available\n");
+        return;
+    }
+
+    Log = HeapAlloc(GetProcessHeap(), 0, 2 * TEST_BUFFER_SIZE);
+    if (!Log)
+    {
+        skip("Out of memory\n");
+        DeleteFileW(FileName);
+        return;
+    }
+
+    /* An intact log gives the header and all the events */
+    BuildLog(Log, 1);
+    WriteLog(FileName, Log, 2 * TEST_BUFFER_SIZE);
+    Error = ReadLog(FileName);
+    if (Error != ERROR_SUCCESS)
+    {
+        /* Windows writes and expects another format */
+        skip("Log file format not supported (%lu)\n", Error);
+        goto Cleanup;
+    }
+    ok(HeaderCount == 1, "HeaderCount = %lu\n", HeaderCount);
+    ok(EventCount == TEST_EVENT_COUNT, "EventCount = %lu\n", EventCount);
+
+    /* The logger was stopped in the middle of a buffer: it is ignored */
+    WriteLog(FileName, Log, TEST_BUFFER_SIZE + TEST_BUFFER_SIZE / 2);
+    Error = ReadLog(FileName);
+    ok(Error == ERROR_SUCCESS, "Error = %lu\n", Error);
+    ok(HeaderCount == 1, "HeaderCount = %lu\n", HeaderCount);
+    ok(EventCount == 0, "EventCount = %lu\n", EventCount);
+
+    /* Not even the header buffer is complete */
+    WriteLog(FileName, Log, TEST_BUFFER_SIZE / 2);
+    Error = ReadLog(FileName);
+    ok(Error == ERROR_BAD_FORMAT, "Error = %lu\n", Error);
+
+    /* Header buffer ending before its own header */
+    Buffer = (PWMI_TRACE_BUFFER_HEADER)Log;
+    Buffer->SavedOffset = sizeof(*Buffer) / 2;
+    WriteLog(FileName, Log, 2 * TEST_BUFFER_SIZE);
+    Error = ReadLog(FileName);
+    ok(Error == ERROR_BAD_FORMAT, "Error = %lu\n", Error);
+
+    /* Header buffer ending past its end */
+    Buffer->SavedOffset = TEST_BUFFER_SIZE + 1;
+    WriteLog(FileName, Log, 2 * TEST_BUFFER_SIZE);
+    Error = ReadLog(FileName);
+    ok(Error == ERROR_BAD_FORMAT, "Error = %lu\n", Error);
+
+    /* Processor counts that can't be right */
+    BuildLog(Log, 0);
+    WriteLog(FileName, Log, 2 * TEST_BUFFER_SIZE);
+    Error = ReadLog(FileName);
+    ok(Error == ERROR_BAD_FORMAT, "Error = %lu\n", Error);
+
+    BuildLog(Log, MAXIMUM_PROCESSORS + 1);
+    WriteLog(FileName, Log, 2 * TEST_BUFFER_SIZE);
+    Error = ReadLog(FileName);
+    ok(Error == ERROR_BAD_FORMAT, "Error = %lu\n", Error);
+
+    BuildLog(Log, MAXULONG);
+    WriteLog(FileName, Log, 2 * TEST_BUFFER_SIZE);
+    Error = ReadLog(FileName);
+    ok(Error == ERROR_BAD_FORMAT, "Error = %lu\n", Error);
+
+    /* An event running past the end of the data stops that buffer */
+    BuildLog(Log, 1);
+    Event = (PEVENT_TRACE_HEADER)(Log + TEST_BUFFER_SIZE + sizeof(WMI_TRACE_BUFFER_HEADER));
+    Event = (PEVENT_TRACE_HEADER)((PUCHAR)Event + ALIGN_UP_BY(Event->Size, WMI_TRACE_ALIGNMENT));
+    Event->Size = TEST_BUFFER_SIZE;
+    WriteLog(FileName, Log, 2 * TEST_BUFFER_SIZE);
+    Error = ReadLog(FileName);
+    ok(Error == ERROR_SUCCESS, "Error = %lu\n", Error);
+    ok(EventCount == 1, "EventCount = %lu\n", EventCount);
+
+    /* A data buffer claiming more data than it holds is skipped */
+    BuildLog(Log, 1);
+    Buffer = (PWMI_TRACE_BUFFER_HEADER)(Log + TEST_BUFFER_SIZE);
+    Buffer->SavedOffset = TEST_BUFFER_SIZE + 1;
+    WriteLog(FileName, Log, 2 * TEST_BUFFER_SIZE);
+    Error = ReadLog(FileName);
+    ok(Error == ERROR_SUCCESS, "Error = %lu\n", Error);
+    ok(EventCount == 0, "EventCount = %lu\n", EventCount);
+
+Cleanup:
+    HeapFree(GetProcessHeap(), 0, Log);
+    DeleteFileW(FileName);
+}
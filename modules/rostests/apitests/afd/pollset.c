@@ -0,0 +1,185 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1+ (https://spdx.org/licenses/LGPL-2.1+)
+ * PURPOSE:     Test for IOCTL_AFD_POLL_SET_UPDATE/IOCTL_AFD_POLL_SET_WAIT
+ */
+
+#include "precomp.h"
+
+#define TEST_CONTEXT ((PVOID)(ULONG_PTR)0x1234)
+
+static
+NTSTATUS
+PollSetUpdate(
+    _In_ HANDLE SetHandle,
+    _In_ HANDLE SocketHandle,
+    _In_ ULONG Operation,
+    _In_ ULONG Events,
+    _In_ ULONG Flags)
+{
+    NTSTATUS Status;
+    IO_STATUS_BLOCK IoStatus;
+    AFD_POLL_SET_UPDATE_INFO UpdateInfo;
+    HANDLE Event;
+
+    Status = NtCreateEvent(&Event,
+                           EVENT_ALL_ACCESS,
+                           NULL,
+                           NotificationEvent,
+                           FALSE);
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    UpdateInfo.EntryCount = 1;
+    UpdateInfo.Entries[0].Handle = (SOCKET)SocketHandle;
+    UpdateInfo.Entries[0].Operation = Operation;
+    UpdateInfo.Entries[0].Events = Events;
+    UpdateInfo.Entries[0].Flags = Flags;
+    UpdateInfo.Entries[0].Context = TEST_CONTEXT;
+
+    Status = NtDeviceIoControlFile(SetHandle,
+                                   Event,
+                                   NULL,
+                                   NULL,
+                                   &IoStatus,
+                                   IOCTL_AFD_POLL_SET_UPDATE,
+                                   &UpdateInfo,
+                                   sizeof(UpdateInfo),
+                                   NULL,
+                                   0);
+    if (Status == STATUS_PENDING)
+    {
+        NtWaitForSingleObject(Event, FALSE, NULL);
+        Status = IoStatus.Status;
+    }
+
+    NtClose(Event);
+
+    return Status;
+}
+
+static
+NTSTATUS
+PollSetWait(
+    _In_ HANDLE SetHandle,
+    _In_ LONGLONG Timeout,
+    _Out_ PAFD_POLL_SET_WAIT_INFO WaitInfo)
+{
+    NTSTATUS Status;
+    IO_STATUS_BLOCK IoStatus;
+    HANDLE Event;
+
+    Status = NtCreateEvent(&Event,
+                           EVENT_ALL_ACCESS,
+                           NULL,
+                           NotificationEvent,
+                           FALSE);
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    RtlZeroMemory(WaitInfo, sizeof(*WaitInfo));
+    WaitInfo->Timeout.QuadPart = Timeout;
+
+    Status = NtDeviceIoControlFile(SetHandle,
+                                   Event,
+                                   NULL,
+                                   NULL,
+                                   &IoStatus,
+                                   IOCTL_AFD_POLL_SET_WAIT,
+                                   WaitInfo,
+                                   sizeof(*WaitInfo),
+                                   WaitInfo,
+                                   sizeof(*WaitInfo));
+    if (Status == STATUS_PENDING)
+    {
+        NtWaitForSingleObject(Event, FALSE, NULL);
+        Status = IoStatus.Status;
+    }
+
+    NtClose(Event);
+
+    return Status;
+}
+
+static
+void
+TestPollSet(void)
+{
+    NTSTATUS Status;
+    HANDLE SetHandle, SocketHandle;
+    AFD_POLL_SET_WAIT_INFO WaitInfo;
+
+    Status = AfdCreateSocket(&SetHandle, AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ok(Status == STATUS_SUCCESS, "AfdCreateSocket failed with %lx\n", Status);
+    Status = AfdCreateSocket(&SocketHandle, AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ok(Status == STATUS_SUCCESS, "AfdCreateSocket failed with %lx\n", Status);
+
+    /* Nothing registered yet */
+    Status = PollSetWait(SetHandle, 0, &WaitInfo);
+    ok(Status == STATUS_TIMEOUT, "PollSetWait failed with %lx\n", Status);
+    ok(WaitInfo.EventCount == 0, "Got %lu events\n", WaitInfo.EventCount);
+
+    Status = PollSetUpdate(SetHandle, SocketHandle, AFD_POLL_SET_MODIFY, AFD_EVENT_SEND, 0);
+    ok(Status == STATUS_NOT_FOUND, "PollSetUpdate failed with %lx\n", Status);
+
+    /* A datagram socket is always sendable */
+    Status = PollSetUpdate(SetHandle, SocketHandle, AFD_POLL_SET_ADD, AFD_EVENT_SEND, 0);
+    ok(Status == STATUS_SUCCESS, "PollSetUpdate failed with %lx\n", Status);
+    Status = PollSetUpdate(SetHandle, SocketHandle, AFD_POLL_SET_ADD, AFD_EVENT_SEND, 0);
+    ok(Status == STATUS_OBJECT_NAME_COLLISION, "PollSetUpdate failed with %lx\n", Status);
+
+    /* Level triggered, reported as long as it stays ready */
+    Status = PollSetWait(SetHandle, -10000000LL, &WaitInfo);
+    ok(Status == STATUS_SUCCESS, "PollSetWait failed with %lx\n", Status);
+    ok(WaitInfo.EventCount == 1, "Got %lu events\n", WaitInfo.EventCount);
+    ok(WaitInfo.Events[0].Context == TEST_CONTEXT, "Got context %p\n", WaitInfo.Events[0].Context);
+    ok(WaitInfo.Events[0].Events == AFD_EVENT_SEND, "Got events %lx\n", WaitInfo.Events[0].Events);
+    Status = PollSetWait(SetHandle, 0, &WaitInfo);
+    ok(Status == STATUS_SUCCESS, "PollSetWait failed with %lx\n", Status);
+    ok(WaitInfo.EventCount == 1, "Got %lu events\n", WaitInfo.EventCount);
+
+    /* One shot, until it is rearmed */
+    Status = PollSetUpdate(SetHandle, SocketHandle, AFD_POLL_SET_MODIFY, AFD_EVENT_SEND, AFD_POLL_SET_ONESHOT);
+    ok(Status == STATUS_SUCCESS, "PollSetUpdate failed with %lx\n", Status);
+    Status = PollSetWait(SetHandle, 0, &WaitInfo);
+    ok(Status == STATUS_SUCCESS, "PollSetWait failed with %lx\n", Status);
+    ok(WaitInfo.EventCount == 1, "Got %lu events\n", WaitInfo.EventCount);
+    Status = PollSetWait(SetHandle, -1000000LL, &WaitInfo);
+    ok(Status == STATUS_TIMEOUT, "PollSetWait failed with %lx\n", Status);
+    ok(WaitInfo.EventCount == 0, "Got %lu events\n", WaitInfo.EventCount);
+    Status = PollSetUpdate(SetHandle, SocketHandle, AFD_POLL_SET_MODIFY, AFD_EVENT_SEND, AFD_POLL_SET_ONESHOT);
+    ok(Status == STATUS_SUCCESS, "PollSetUpdate failed with %lx\n", Status);
+    Status = PollSetWait(SetHandle, 0, &WaitInfo);
+    ok(Status == STATUS_SUCCESS, "PollSetWait failed with %lx\n", Status);
+    ok(WaitInfo.EventCount == 1, "Got %lu events\n", WaitInfo.EventCount);
+
+    /* Events it isn't interested in */
+    Status = PollSetUpdate(SetHandle, SocketHandle, AFD_POLL_SET_MODIFY, AFD_EVENT_RECEIVE, 0);
+    ok(Status == STATUS_SUCCESS, "PollSetUpdate failed with %lx\n", Status);
+    Status = PollSetWait(SetHandle, 0, &WaitInfo);
+    ok(Status == STATUS_TIMEOUT, "PollSetWait failed with %lx\n", Status);
+
+    Status = PollSetUpdate(SetHandle, SocketHandle, AFD_POLL_SET_REMOVE, 0, 0);
+    ok(Status == STATUS_SUCCESS, "PollSetUpdate failed with %lx\n", Status);
+    Status = PollSetUpdate(SetHandle, SocketHandle, AFD_POLL_SET_REMOVE, 0, 0);
+    ok(Status == STATUS_NOT_FOUND, "PollSetUpdate failed with %lx\n", Status);
+
+    /* Closing a socket takes it out of the set */
+    Status = PollSetUpdate(SetHandle, SocketHandle, AFD_POLL_SET_ADD, AFD_EVENT_SEND, 0);
+    ok(Status == STATUS_SUCCESS, "PollSetUpdate failed with %lx\n", Status);
+    NtClose(SocketHandle);
+    Status = PollSetWait(SetHandle, 0, &WaitInfo);
+    ok(Status == STATUS_TIMEOUT, "PollSetWait failed with %lx\n", Status);
+    ok(WaitInfo.EventCount == 0, "Got %lu events\n", WaitInfo.EventCount);
+
+    NtClose(SetHandle);
+}
+
+START_TEST(pollset)
+{
+    TestPollSet();
+}
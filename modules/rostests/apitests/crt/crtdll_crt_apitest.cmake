@@ -426,11 +426,11 @@ list(APPEND SOURCE_CRTDLL
 #    mblen.c
     mbstowcs.c
     mbtowc.c
-#    memchr.c
-#    memcmp.c
+    memchr.c
+    memcmp.c
 #    memcpy.c
-#    memmove.c
-#    memset.c
+    memmove.c
+    memset.c
 #    mktime.c
 #    modf.c
 #    perror.c
@@ -0,0 +1,44 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for memchr over alignments and sizes
+ */
+
+#include <apitest.h>
+
+#include <stdio.h>
+#include <string.h>
+
+START_TEST(memchr)
+{
+    static unsigned char Buffer[300 + 16];
+    size_t Size, Position;
+    unsigned Align;
+    unsigned char *Start;
+
+    for (Align = 0; Align < 16; Align++)
+    {
+        Start = Buffer + Align;
+        for (Size = 0; Size < 300; Size += (Size < 40) ? 1 : 13)
+        {
+            memset(Buffer, 'a', sizeof(Buffer));
+            ok_ptr(memchr(Start, 'b', Size), NULL);
+
+            for (Position = 0; Position < Size; Position++)
+            {
+                /* The first match wins, the value is converted to unsigned char */
+                memset(Buffer, 'a', sizeof(Buffer));
+                Start[Position] = 0xE9;
+                if (Position + 1 < Size)
+                    Start[Position + 1] = 0xE9;
+                ok_ptr(memchr(Start, 0xE9, Size), Start + Position);
+                ok_ptr(memchr(Start, 0x1E9, Size), Start + Position);
+            }
+
+            /* Nothing is found past the end */
+            memset(Buffer, 'a', sizeof(Buffer));
+            Start[Size] = 'b';
+            ok_ptr(memchr(Start, 'b', Size), NULL);
+        }
+    }
+}
@@ -0,0 +1,108 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for memcmp over alignments and sizes
+ */
+
+#include <apitest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIGN(x) (((x) > 0) - ((x) < 0))
+
+static const size_t TestSizes[] =
+{
+    1, 2, 3, 7, 8, 9, 15, 16, 17, 31, 32, 33, 64, 255, 256, 257, 1000
+};
+
+/* Throughput of comparing equal buffers, which must be read completely */
+static
+void
+Test_Speed(void)
+{
+    static const size_t SpeedSizes[] = { 16, 64, 256, 4096, 65536, 1024 * 1024 };
+    int (__cdecl * volatile pmemcmp)(const void*, const void*, size_t) = memcmp;
+    LARGE_INTEGER Frequency, Start, End;
+    unsigned char *Buffer1, *Buffer2;
+    size_t Size, Count, i, j;
+    int Result = 0;
+    double Seconds;
+
+    Buffer1 = malloc(1024 * 1024 + 1);
+    Buffer2 = malloc(1024 * 1024 + 1);
+    if (!Buffer1 || !Buffer2)
+    {
+        skip("Out of memory\n");
+        free(Buffer1);
+        free(Buffer2);
+        return;
+    }
+    memset(Buffer1, 'a', 1024 * 1024 + 1);
+    memset(Buffer2, 'a', 1024 * 1024 + 1);
+
+    QueryPerformanceFrequency(&Frequency);
+    for (i = 0; i < _countof(SpeedSizes); i++)
+    {
+        /* Compare the same amount of data for every size */
+        Size = SpeedSizes[i];
+        Count = (64 * 1024 * 1024) / Size;
+
+        QueryPerformanceCounter(&Start);
+        for (j = 0; j < Count; j++)
+            Result |= pmemcmp(Buffer1, Buffer2 + (j & 1), Size);
+        QueryPerformanceCounter(&End);
+
+        Seconds = (double)(End.QuadPart - Start.QuadPart) / (double)Frequency.QuadPart;
+        if (Seconds > 0)
+        {
+            trace("memcmp: %7Iu bytes: %.3f s, %.0f MB/s\n",
+                  Size, Seconds, (double)(Size * Count) / (1024 * 1024) / Seconds);
+        }
+    }
+    ok_int(Result, 0);
+
+    free(Buffer1);
+    free(Buffer2);
+}
+
+START_TEST(memcmp)
+{
+    static unsigned char Buffer1[1000 + 16], Buffer2[1000 + 16];
+    size_t Size, Diff, i;
+    unsigned Align1, Align2;
+    int Result;
+
+    /* Nothing to compare */
+    ok_int(memcmp(Buffer1, Buffer2 + 1, 0), 0);
+
+    for (i = 0; i < _countof(TestSizes); i++)
+    {
+        Size = TestSizes[i];
+        for (Align1 = 0; Align1 < 8; Align1++)
+        {
+            for (Align2 = 0; Align2 < 8; Align2++)
+            {
+                for (Diff = 0; Diff < Size; Diff += (Size / 5) + 1)
+                {
+                    memset(Buffer1 + Align1, 'a', Size);
+                    memset(Buffer2 + Align2, 'a', Size);
+                    ok_int(memcmp(Buffer1 + Align1, Buffer2 + Align2, Size), 0);
+
+                    /* Only the first difference counts, as unsigned bytes */
+                    Buffer1[Align1 + Diff] = 0x80;
+                    Buffer2[Align2 + Size - 1] = 0x7F;
+                    Result = memcmp(Buffer1 + Align1, Buffer2 + Align2, Size);
+                    ok(SIGN(Result) == 1,
+                       "Size %Iu (%u, %u) diff at %Iu: got %d\n", Size, Align1, Align2, Diff, Result);
+                    Result = memcmp(Buffer2 + Align2, Buffer1 + Align1, Size);
+                    ok(SIGN(Result) == -1,
+                       "Size %Iu (%u, %u) diff at %Iu: got %d\n", Size, Align1, Align2, Diff, Result);
+                }
+            }
+        }
+    }
+
+    Test_Speed();
+}
@@ -0,0 +1,179 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for memmove and memcpy over alignments and sizes
+ */
+
+#include <apitest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GUARD_SIZE 32
+
+/* Sizes around the small, unrolled, string instruction and streaming paths */
+static const size_t TestSizes[] =
+{
+    0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65,
+    255, 256, 257, 1000, 4096, 4097, 1024 * 1024 - 3, 1024 * 1024 + 77
+};
+
+typedef void* (__cdecl *PFN_MEMMOVE)(void*, const void*, size_t);
+
+static unsigned char *Source, *Buffer, *Expected;
+
+static
+void
+ReferenceMove(unsigned char *dest, const unsigned char *src, size_t count)
+{
+    size_t i;
+
+    if (dest < src)
+    {
+        for (i = 0; i < count; i++)
+            dest[i] = src[i];
+    }
+    else
+    {
+        for (i = count; i > 0; i--)
+            dest[i - 1] = src[i - 1];
+    }
+}
+
+static
+void
+FillRandom(unsigned char *buffer, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        buffer[i] = (unsigned char)rand();
+}
+
+static
+void
+Test_Copy(PFN_MEMMOVE pmemmove, const char *name)
+{
+    size_t Size, i;
+    unsigned DestAlign, SrcAlign;
+    void *Result;
+
+    for (i = 0; i < _countof(TestSizes); i++)
+    {
+        Size = TestSizes[i];
+        for (DestAlign = 0; DestAlign < 16; DestAlign++)
+        {
+            for (SrcAlign = 0; SrcAlign < 16; SrcAlign++)
+            {
+                /* Large sizes take too long for every combination */
+                if ((Size > 4097) && (DestAlign % 5 || SrcAlign % 7))
+                    continue;
+
+                FillRandom(Source, Size + GUARD_SIZE);
+                memset(Buffer, 0xCC, Size + 2 * GUARD_SIZE);
+                memset(Expected, 0xCC, Size + 2 * GUARD_SIZE);
+                ReferenceMove(Expected + DestAlign, Source + SrcAlign, Size);
+
+                Result = pmemmove(Buffer + DestAlign, Source + SrcAlign, Size);
+                ok(Result == Buffer + DestAlign, "%s: wrong return value\n", name);
+                ok(!memcmp(Buffer, Expected, Size + 2 * GUARD_SIZE),
+                   "%s: copy of %Iu bytes (%u, %u) failed\n", name, Size, DestAlign, SrcAlign);
+            }
+        }
+    }
+}
+
+static
+void
+Test_Overlap(PFN_MEMMOVE pmemmove, const char *name)
+{
+    size_t Size, i;
+    unsigned Shift;
+
+    for (i = 0; i < _countof(TestSizes); i++)
+    {
+        Size = TestSizes[i];
+        if (Size > 4097)
+            continue;
+
+        for (Shift = 0; Shift < 2 * GUARD_SIZE; Shift++)
+        {
+            FillRandom(Buffer, Size + 2 * GUARD_SIZE);
+            memcpy(Expected, Buffer, Size + 2 * GUARD_SIZE);
+
+            /* Destination above the source */
+            ReferenceMove(Expected + Shift, Expected, Size);
+            pmemmove(Buffer + Shift, Buffer, Size);
+            ok(!memcmp(Buffer, Expected, Size + 2 * GUARD_SIZE),
+               "%s: move of %Iu bytes up by %u failed\n", name, Size, Shift);
+
+            /* Destination below the source */
+            ReferenceMove(Expected, Expected + Shift, Size);
+            pmemmove(Buffer, Buffer + Shift, Size);
+            ok(!memcmp(Buffer, Expected, Size + 2 * GUARD_SIZE),
+               "%s: move of %Iu bytes down by %u failed\n", name, Size, Shift);
+        }
+    }
+}
+
+/* Copy throughput over the sizes the different paths handle */
+static
+void
+Test_Speed(PFN_MEMMOVE pmemmove, const char *name)
+{
+    static const size_t SpeedSizes[] = { 16, 64, 256, 4096, 65536, 1024 * 1024 };
+    volatile PFN_MEMMOVE pfn = pmemmove;
+    LARGE_INTEGER Frequency, Start, End;
+    size_t Size, Count, i, j;
+    double Seconds;
+
+    QueryPerformanceFrequency(&Frequency);
+    for (i = 0; i < _countof(SpeedSizes); i++)
+    {
+        /* Move the same amount of data for every size */
+        Size = SpeedSizes[i];
+        Count = (64 * 1024 * 1024) / Size;
+
+        QueryPerformanceCounter(&Start);
+        for (j = 0; j < Count; j++)
+            pfn(Buffer + (j & 1), Source, Size);
+        QueryPerformanceCounter(&End);
+
+        Seconds = (double)(End.QuadPart - Start.QuadPart) / (double)Frequency.QuadPart;
+        if (Seconds > 0)
+        {
+            trace("%s: %7Iu bytes: %.3f s, %.0f MB/s\n",
+                  name, Size, Seconds, (double)(Size * Count) / (1024 * 1024) / Seconds);
+        }
+    }
+}
+
+START_TEST(memmove)
+{
+    size_t Size = 1024 * 1024 + 77 + 2 * GUARD_SIZE;
+
+    Source = malloc(Size);
+    Buffer = malloc(Size);
+    Expected = malloc(Size);
+    if (!Source || !Buffer || !Expected)
+    {
+        skip("Out of memory\n");
+        free(Source);
+        free(Buffer);
+        free(Expected);
+        return;
+    }
+
+    srand(0x5eed);
+
+    Test_Copy(memmove, "memmove");
+    Test_Copy(memcpy, "memcpy");
+    Test_Overlap(memmove, "memmove");
+    Test_Speed(memmove, "memmove");
+    Test_Speed(memcpy, "memcpy");
+
+    free(Source);
+    free(Buffer);
+    free(Expected);
+}
@@ -0,0 +1,106 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for memset over alignments and sizes
+ */
+
+#include <apitest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GUARD_SIZE 32
+
+/* Sizes around the small, unrolled, string instruction and streaming paths */
+static const size_t TestSizes[] =
+{
+    0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65,
+    255, 256, 257, 1000, 4096, 4097, 1024 * 1024 - 3, 1024 * 1024 + 77
+};
+
+static
+BOOL
+CheckBytes(const unsigned char *buffer, size_t count, unsigned char value)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (buffer[i] != value)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Fill throughput over the sizes the different paths handle */
+static
+void
+Test_Speed(unsigned char *Buffer)
+{
+    static const size_t SpeedSizes[] = { 16, 64, 256, 4096, 65536, 1024 * 1024 };
+    void* (__cdecl * volatile pmemset)(void*, int, size_t) = memset;
+    LARGE_INTEGER Frequency, Start, End;
+    size_t Size, Count, i, j;
+    double Seconds;
+
+    QueryPerformanceFrequency(&Frequency);
+    for (i = 0; i < _countof(SpeedSizes); i++)
+    {
+        /* Fill the same amount of memory for every size */
+        Size = SpeedSizes[i];
+        Count = (64 * 1024 * 1024) / Size;
+
+        QueryPerformanceCounter(&Start);
+        for (j = 0; j < Count; j++)
+            pmemset(Buffer + (j & 1), (int)j, Size);
+        QueryPerformanceCounter(&End);
+
+        Seconds = (double)(End.QuadPart - Start.QuadPart) / (double)Frequency.QuadPart;
+        if (Seconds > 0)
+        {
+            trace("memset: %7Iu bytes: %.3f s, %.0f MB/s\n",
+                  Size, Seconds, (double)(Size * Count) / (1024 * 1024) / Seconds);
+        }
+    }
+}
+
+START_TEST(memset)
+{
+    unsigned char *Buffer;
+    size_t Size, i;
+    unsigned Align;
+    int Value;
+    void *Result;
+
+    Buffer = malloc(1024 * 1024 + 77 + 2 * GUARD_SIZE);
+    if (!Buffer)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    for (i = 0; i < _countof(TestSizes); i++)
+    {
+        Size = TestSizes[i];
+        for (Align = 0; Align < 16; Align++)
+        {
+            /* Only the low byte of the value is used */
+            Value = 0x1200 | (Align * 17 + 1);
+
+            memset(Buffer, 0xCC, Size + 2 * GUARD_SIZE);
+            Result = memset(Buffer + Align, Value, Size);
+            ok(Result == Buffer + Align, "Wrong return value\n");
+            ok(CheckBytes(Buffer + Align, Size, (unsigned char)Value),
+               "Fill of %Iu bytes at %u failed\n", Size, Align);
+            ok(CheckBytes(Buffer, Align, 0xCC) &&
+               CheckBytes(Buffer + Align + Size, GUARD_SIZE, 0xCC),
+               "Fill of %Iu bytes at %u overran the buffer\n", Size, Align);
+        }
+    }
+
+    Test_Speed(Buffer);
+
+    free(Buffer);
+}
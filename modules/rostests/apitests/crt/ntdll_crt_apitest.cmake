@@ -73,11 +73,11 @@ list(APPEND SOURCE_NTDLL
 #    log.c
     mbstowcs.c
     mbtowc.c
-#    memchr.c
-#    memcmp.c
+    memchr.c
+    memcmp.c
     # memcpy == memmove
-#    memmove.c
-#    memset.c
+    memmove.c
+    memset.c
 #    pow.c
 #    qsort.c
 #    sin.c
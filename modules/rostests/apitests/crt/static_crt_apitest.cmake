@@ -9,6 +9,10 @@ list(APPEND SOURCE_STATIC
     atexit.c
     mbstowcs.c
     mbtowc.c
+    memchr.c
+    memcmp.c
+    memmove.c
+    memset.c
     sprintf.c
     strcpy.c
     strlen.c
@@ -26,6 +26,10 @@ extern void func__vsnprintf(void);
 extern void func__vsnwprintf(void);
 extern void func_mbstowcs(void);
 extern void func_mbtowc(void);
+extern void func_memchr(void);
+extern void func_memcmp(void);
+extern void func_memmove(void);
+extern void func_memset(void);
 extern void func_sprintf(void);
 extern void func_strcpy(void);
 extern void func_strlen(void);
@@ -47,6 +51,10 @@ const struct test winetest_testlist[] =
     { "_vsnwprintf", func__vsnwprintf },
     { "mbstowcs", func_mbstowcs },
     { "mbtowc", func_mbtowc },
+    { "memchr", func_memchr },
+    { "memcmp", func_memcmp },
+    { "memmove", func_memmove },
+    { "memset", func_memset },
     { "_snprintf", func__snprintf },
     { "_snwprintf", func__snwprintf },
     { "sprintf", func_sprintf },
@@ -0,0 +1,128 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Benchmark for random reads in a large cached file
+ */
+
+#include "precomp.h"
+
+#define TEST_FILE_SIZE      (128 * 1024 * 1024)
+#define TEST_CHUNK_SIZE     (1024 * 1024)
+#define TEST_READ_SIZE      4096
+#define TEST_READ_COUNT     20000
+
+static ULONG Seed = 0x12345678;
+
+static
+ULONG
+NextRandom(VOID)
+{
+    /* Simple LCG, we only want reproducible offsets */
+    Seed = Seed * 1103515245 + 12345;
+    return Seed >> 8;
+}
+
+static
+VOID
+FillPattern(PULONG Buffer, ULONG Length, ULONGLONG Offset)
+{
+    ULONG i;
+
+    /* Each ULONG contains its own offset in the file */
+    for (i = 0; i < Length / sizeof(ULONG); i++)
+    {
+        Buffer[i] = (ULONG)(Offset + i * sizeof(ULONG));
+    }
+}
+
+START_TEST(CachedRandomRead)
+{
+    CHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    HANDLE hFile;
+    PULONG Buffer;
+    ULONGLONG Offset;
+    LARGE_INTEGER Position, Frequency, Start, End;
+    DWORD Done, i, Mismatches;
+    double Seconds;
+
+    if (!GetTempPathA(sizeof(TempPath), TempPath) ||
+        !GetTempFileNameA(TempPath, "ccr", 0, FileName))
+    {
+        skip("No temporary file available\n");
+        return;
+    }
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, TEST_CHUNK_SIZE);
+    if (!Buffer)
+    {
+        skip("Out of memory\n");
+        DeleteFileA(FileName);
+        return;
+    }
+
+    hFile = CreateFileA(FileName,
+                        GENERIC_READ | GENERIC_WRITE,
+                        0,
+                        NULL,
+                        CREATE_ALWAYS,
+                        FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+                        NULL);
+    ok(hFile != INVALID_HANDLE_VALUE, "CreateFile failed: %lu\n", GetLastError());
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        HeapFree(GetProcessHeap(), 0, Buffer);
+        DeleteFileA(FileName);
+        return;
+    }
+
+    /* Write the whole file through the cache */
+    for (Offset = 0; Offset < TEST_FILE_SIZE; Offset += TEST_CHUNK_SIZE)
+    {
+        FillPattern(Buffer, TEST_CHUNK_SIZE, Offset);
+        if (!WriteFile(hFile, Buffer, TEST_CHUNK_SIZE, &Done, NULL) || Done != TEST_CHUNK_SIZE)
+        {
+            skip("Not enough space for the test file (%lu)\n", GetLastError());
+            goto Cleanup;
+        }
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+
+    /* Read the file back at random offsets */
+    Mismatches = 0;
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < TEST_READ_COUNT; i++)
+    {
+        Position.QuadPart = (NextRandom() % (TEST_FILE_SIZE / TEST_READ_SIZE)) * (ULONGLONG)TEST_READ_SIZE;
+        if (!SetFilePointerEx(hFile, Position, NULL, FILE_BEGIN) ||
+            !ReadFile(hFile, Buffer, TEST_READ_SIZE, &Done, NULL) ||
+            Done != TEST_READ_SIZE)
+        {
+            ok(0, "Read %lu at 0x%I64x failed: %lu\n", i, Position.QuadPart, GetLastError());
+            break;
+        }
+
+        /* Only check the edges, we don't want to benchmark memcmp */
+        if (Buffer[0] != (ULONG)Position.QuadPart ||
+            Buffer[TEST_READ_SIZE / sizeof(ULONG) - 1] != (ULONG)(Position.QuadPart + TEST_READ_SIZE - sizeof(ULONG)))
+        {
+            Mismatches++;
+        }
+    }
+    QueryPerformanceCounter(&End);
+
+    ok(i == TEST_READ_COUNT, "Only %lu reads out of %u succeeded\n", i, TEST_READ_COUNT);
+    ok(Mismatches == 0, "%lu reads returned wrong data\n", Mismatches);
+
+    Seconds = (double)(End.QuadPart - Start.QuadPart) / (double)Frequency.QuadPart;
+    if (Seconds > 0)
+    {
+        trace("%lu random %u byte reads in a %u MB file: %.3f s, %.0f reads/s, %.2f MB/s\n",
+              i, TEST_READ_SIZE, TEST_FILE_SIZE / (1024 * 1024), Seconds,
+              i / Seconds, (i * (double)TEST_READ_SIZE) / (1024 * 1024) / Seconds);
+    }
+
+Cleanup:
+    CloseHandle(hFile);
+    HeapFree(GetProcessHeap(), 0, Buffer);
+}
@@ -0,0 +1,190 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for GetQueuedCompletionStatusEx and FILE_SKIP_COMPLETION_PORT_ON_SUCCESS
+ */
+
+#include "precomp.h"
+
+#define TEST_PACKETS    100
+#define TEST_BATCH      64
+
+#ifndef FILE_SKIP_COMPLETION_PORT_ON_SUCCESS
+#define FILE_SKIP_COMPLETION_PORT_ON_SUCCESS 0x1
+#endif
+
+static BOOL (WINAPI *pGetQueuedCompletionStatusEx)(HANDLE, LPOVERLAPPED_ENTRY, ULONG, PULONG, DWORD, BOOL);
+static BOOL (WINAPI *pSetFileCompletionNotificationModes)(HANDLE, UCHAR);
+
+static LONG ApcCount;
+
+static
+VOID
+CALLBACK
+ApcRoutine(ULONG_PTR Parameter)
+{
+    InterlockedIncrement(&ApcCount);
+}
+
+static
+VOID
+TestBatch(VOID)
+{
+    OVERLAPPED_ENTRY Entries[TEST_BATCH];
+    HANDLE Port;
+    ULONG Removed, Total, i;
+    BOOL Ret;
+
+    Port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+    ok(Port != NULL, "CreateIoCompletionPort failed: %lu\n", GetLastError());
+    if (!Port)
+        return;
+
+    /* Nothing queued yet */
+    Removed = 0xdeadbeef;
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, TEST_BATCH, &Removed, 0, FALSE);
+    ok(!Ret, "Expected failure\n");
+    ok_err(WAIT_TIMEOUT);
+    ok_long(Removed, 0);
+
+    /* A zero sized array is invalid */
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 0, &Removed, 0, FALSE);
+    ok(!Ret, "Expected failure\n");
+    ok_err(ERROR_INVALID_PARAMETER);
+
+    for (i = 0; i < TEST_PACKETS; i++)
+    {
+        Ret = PostQueuedCompletionStatus(Port, i * 2, i + 1, (LPOVERLAPPED)(ULONG_PTR)(i + 0x1000));
+        ok(Ret, "PostQueuedCompletionStatus failed: %lu\n", GetLastError());
+    }
+
+    /* Packets come back in order, as many as fit per call */
+    Total = 0;
+    while (Total < TEST_PACKETS)
+    {
+        Ret = pGetQueuedCompletionStatusEx(Port, Entries, TEST_BATCH, &Removed, 0, FALSE);
+        ok(Ret, "GetQueuedCompletionStatusEx failed: %lu\n", GetLastError());
+        if (!Ret)
+            break;
+
+        ok_long(Removed, min(TEST_BATCH, TEST_PACKETS - Total));
+        for (i = 0; i < Removed; i++)
+        {
+            ok_size_t(Entries[i].lpCompletionKey, Total + i + 1);
+            ok_ptr(Entries[i].lpOverlapped, (LPOVERLAPPED)(ULONG_PTR)(Total + i + 0x1000));
+            ok_long(Entries[i].dwNumberOfBytesTransferred, (Total + i) * 2);
+        }
+        Total += Removed;
+    }
+    ok_long(Total, TEST_PACKETS);
+
+    /* An alertable wait returns for APCs */
+    ApcCount = 0;
+    Ret = QueueUserAPC(ApcRoutine, GetCurrentThread(), 0);
+    ok(Ret, "QueueUserAPC failed: %lu\n", GetLastError());
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, TEST_BATCH, &Removed, INFINITE, TRUE);
+    ok(!Ret, "Expected failure\n");
+    ok_err(WAIT_IO_COMPLETION);
+    ok_long(Removed, 0);
+    ok_long(ApcCount, 1);
+
+    CloseHandle(Port);
+}
+
+static
+VOID
+TestSkipOnSuccess(VOID)
+{
+    OVERLAPPED_ENTRY Entry;
+    OVERLAPPED Overlapped;
+    HANDLE Port, Server, Client;
+    ULONG Removed;
+    DWORD Written;
+    BOOL Ret;
+
+    Server = CreateNamedPipeW(L"\\\\.\\pipe\\GetQueuedCompletionStatusEx",
+                              PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED,
+                              PIPE_TYPE_BYTE,
+                              1,
+                              4096,
+                              4096,
+                              0,
+                              NULL);
+    ok(Server != INVALID_HANDLE_VALUE, "CreateNamedPipeW failed: %lu\n", GetLastError());
+    if (Server == INVALID_HANDLE_VALUE)
+        return;
+
+    Client = CreateFileW(L"\\\\.\\pipe\\GetQueuedCompletionStatusEx",
+                         GENERIC_WRITE,
+                         0,
+                         NULL,
+                         OPEN_EXISTING,
+                         FILE_FLAG_OVERLAPPED,
+                         NULL);
+    ok(Client != INVALID_HANDLE_VALUE, "CreateFileW failed: %lu\n", GetLastError());
+    if (Client == INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(Server);
+        return;
+    }
+
+    Port = CreateIoCompletionPort(Client, NULL, 1, 0);
+    ok(Port != NULL, "CreateIoCompletionPort failed: %lu\n", GetLastError());
+
+    /* Without the flag, a synchronous success still queues a packet */
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    Ret = WriteFile(Client, "x", 1, &Written, &Overlapped);
+    ok(Ret, "WriteFile failed: %lu\n", GetLastError());
+    Ret = pGetQueuedCompletionStatusEx(Port, &Entry, 1, &Removed, 0, FALSE);
+    ok(Ret, "GetQueuedCompletionStatusEx failed: %lu\n", GetLastError());
+    ok_long(Removed, 1);
+    ok_ptr(Entry.lpOverlapped, &Overlapped);
+
+    Ret = pSetFileCompletionNotificationModes(Client, FILE_SKIP_COMPLETION_PORT_ON_SUCCESS);
+    ok(Ret, "SetFileCompletionNotificationModes failed: %lu\n", GetLastError());
+
+    /* With it, the caller handles the result and the port stays empty */
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    Ret = WriteFile(Client, "x", 1, &Written, &Overlapped);
+    ok(Ret, "WriteFile failed: %lu\n", GetLastError());
+    ok_long(Written, 1);
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, &Entry, 1, &Removed, 0, FALSE);
+    ok(!Ret, "Expected failure\n");
+    ok_err(WAIT_TIMEOUT);
+
+    CloseHandle(Port);
+    CloseHandle(Client);
+    CloseHandle(Server);
+}
+
+START_TEST(GetQueuedCompletionStatusEx)
+{
+    HMODULE hKernel32 = GetModuleHandleW(L"kernel32.dll");
+
+    pSetFileCompletionNotificationModes = (PVOID)GetProcAddress(hKernel32, "SetFileCompletionNotificationModes");
+
+    /* Not exported by our kernel32 yet */
+    pGetQueuedCompletionStatusEx = (PVOID)GetProcAddress(hKernel32, "GetQueuedCompletionStatusEx");
+    if (!pGetQueuedCompletionStatusEx)
+    {
+        hKernel32 = LoadLibraryW(L"kernel32_vista.dll");
+        if (hKernel32)
+            pGetQueuedCompletionStatusEx = (PVOID)GetProcAddress(hKernel32, "GetQueuedCompletionStatusEx");
+    }
+    if (!pGetQueuedCompletionStatusEx)
+    {
+        skip("GetQueuedCompletionStatusEx is not available\n");
+        return;
+    }
+
+    TestBatch();
+
+    if (!pSetFileCompletionNotificationModes)
+        skip("SetFileCompletionNotificationModes is not available\n");
+    else
+        TestSkipOnSuccess();
+}
@@ -0,0 +1,181 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Benchmark for concurrent page faults on a large mapped file
+ */
+
+#include "precomp.h"
+
+/*
+ * Section page tables are kept in slices of 1 MB, 64 of them per tree node.
+ * Mapping a view below and one above 64 MB needs a tree of two levels,
+ * and walking it has to go from one subtree to the other.
+ */
+#define TEST_VIEW_SIZE      (16 * 1024 * 1024)
+#define TEST_HIGH_OFFSET    (64 * 1024 * 1024)
+#define TEST_CHUNK_SIZE     (1024 * 1024)
+#define TEST_PAGE_SIZE      4096
+#define TEST_MAX_THREADS    8
+
+static PUCHAR LowView, HighView;
+static ULONG FaultThreads;
+static LONG Mismatches;
+
+static
+DWORD
+WINAPI
+FaultThread(PVOID Parameter)
+{
+    ULONG Offset;
+
+    /* Interleave the pages, so that all threads fault on the same part of the file */
+    for (Offset = PtrToUlong(Parameter) * TEST_PAGE_SIZE;
+         Offset < TEST_VIEW_SIZE;
+         Offset += FaultThreads * TEST_PAGE_SIZE)
+    {
+        /* Each ULONG of the file holds its own offset */
+        if (*(volatile ULONG *)(HighView + Offset) != TEST_HIGH_OFFSET + Offset)
+            InterlockedIncrement(&Mismatches);
+        if (*(volatile ULONG *)(LowView + Offset) != Offset)
+            InterlockedIncrement(&Mismatches);
+    }
+
+    return 0;
+}
+
+static
+VOID
+RunFaults(HANDLE hMapping, ULONG ThreadCount)
+{
+    HANDLE hThreads[TEST_MAX_THREADS];
+    LARGE_INTEGER Frequency, Start, End;
+    double Seconds;
+    ULONG i;
+
+    /* New views, so that every page faults again */
+    HighView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, TEST_HIGH_OFFSET, TEST_VIEW_SIZE);
+    ok(HighView != NULL, "MapViewOfFile failed: %lu\n", GetLastError());
+    LowView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, TEST_VIEW_SIZE);
+    ok(LowView != NULL, "MapViewOfFile failed: %lu\n", GetLastError());
+    if (!HighView || !LowView)
+        goto Cleanup;
+
+    /* Threads are created suspended, so that they all start together */
+    for (FaultThreads = 0; FaultThreads < ThreadCount; FaultThreads++)
+    {
+        hThreads[FaultThreads] = CreateThread(NULL, 0, FaultThread, UlongToPtr(FaultThreads),
+                                              CREATE_SUSPENDED, NULL);
+        ok(hThreads[FaultThreads] != NULL, "CreateThread failed: %lu\n", GetLastError());
+        if (!hThreads[FaultThreads])
+            break;
+    }
+
+    Mismatches = 0;
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < FaultThreads; i++)
+        ResumeThread(hThreads[i]);
+    WaitForMultipleObjects(FaultThreads, hThreads, TRUE, INFINITE);
+    QueryPerformanceCounter(&End);
+
+    for (i = 0; i < FaultThreads; i++)
+        CloseHandle(hThreads[i]);
+
+    ok(Mismatches == 0, "%lu threads: %ld pages had wrong data\n", FaultThreads, Mismatches);
+
+    /* Flushing looks for the page tables across the whole tree */
+    ok(FlushViewOfFile(LowView, 0), "FlushViewOfFile failed: %lu\n", GetLastError());
+    ok(FlushViewOfFile(HighView, 0), "FlushViewOfFile failed: %lu\n", GetLastError());
+
+    Seconds = (double)(End.QuadPart - Start.QuadPart) / (double)Frequency.QuadPart;
+    if (FaultThreads && (Seconds > 0))
+    {
+        trace("%lu threads, 2 x %u MB views: %.3f s, %.0f faults/s\n",
+              FaultThreads, TEST_VIEW_SIZE / (1024 * 1024), Seconds,
+              (2 * TEST_VIEW_SIZE / TEST_PAGE_SIZE) / Seconds);
+    }
+
+Cleanup:
+    if (LowView) UnmapViewOfFile(LowView);
+    if (HighView) UnmapViewOfFile(HighView);
+}
+
+static
+BOOL
+WritePattern(HANDLE hFile, PULONG Buffer, ULONG FileOffset)
+{
+    ULONG Offset, i;
+    DWORD Done;
+
+    if (SetFilePointer(hFile, FileOffset, NULL, FILE_BEGIN) != FileOffset)
+        return FALSE;
+
+    for (Offset = FileOffset; Offset < FileOffset + TEST_VIEW_SIZE; Offset += TEST_CHUNK_SIZE)
+    {
+        for (i = 0; i < TEST_CHUNK_SIZE / sizeof(ULONG); i++)
+            Buffer[i] = Offset + i * sizeof(ULONG);
+
+        if (!WriteFile(hFile, Buffer, TEST_CHUNK_SIZE, &Done, NULL) || Done != TEST_CHUNK_SIZE)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+START_TEST(MappedFileFault)
+{
+    CHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    HANDLE hFile, hMapping;
+    PULONG Buffer;
+    ULONG ThreadCount;
+
+    if (!GetTempPathA(sizeof(TempPath), TempPath) ||
+        !GetTempFileNameA(TempPath, "mff", 0, FileName))
+    {
+        skip("No temporary file available\n");
+        return;
+    }
+
+    hFile = CreateFileA(FileName,
+                        GENERIC_READ | GENERIC_WRITE,
+                        0,
+                        NULL,
+                        CREATE_ALWAYS,
+                        FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+                        NULL);
+    ok(hFile != INVALID_HANDLE_VALUE, "CreateFile failed: %lu\n", GetLastError());
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        DeleteFileA(FileName);
+        return;
+    }
+
+    /* Only the two viewed parts get data, the space between them reads as zeroes */
+    Buffer = HeapAlloc(GetProcessHeap(), 0, TEST_CHUNK_SIZE);
+    ok(Buffer != NULL, "HeapAlloc failed\n");
+    if (!Buffer ||
+        !WritePattern(hFile, Buffer, 0) ||
+        !WritePattern(hFile, Buffer, TEST_HIGH_OFFSET))
+    {
+        skip("Could not write the test file (%lu)\n", GetLastError());
+        goto Cleanup;
+    }
+
+    hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    ok(hMapping != NULL, "CreateFileMapping failed: %lu\n", GetLastError());
+    if (!hMapping)
+        goto Cleanup;
+
+    /* The first run reads the file in, the next ones find the pages in the section */
+    for (ThreadCount = 1; ThreadCount <= TEST_MAX_THREADS; ThreadCount *= 2)
+    {
+        RunFaults(hMapping, ThreadCount);
+    }
+    RunFaults(hMapping, 1);
+
+    CloseHandle(hMapping);
+
+Cleanup:
+    if (Buffer) HeapFree(GetProcessHeap(), 0, Buffer);
+    CloseHandle(hFile);
+}
@@ -0,0 +1,430 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test and benchmark for the Vista thread pool
+ */
+
+#include "precomp.h"
+
+#define TEST_WAITS          100
+#define TEST_BENCH_ITEMS    100000
+
+static PTP_POOL (WINAPI *pCreateThreadpool)(PVOID);
+static VOID (WINAPI *pCloseThreadpool)(PTP_POOL);
+static BOOL (WINAPI *pSetThreadpoolThreadMinimum)(PTP_POOL, DWORD);
+static VOID (WINAPI *pSetThreadpoolThreadMaximum)(PTP_POOL, DWORD);
+static PTP_CLEANUP_GROUP (WINAPI *pCreateThreadpoolCleanupGroup)(VOID);
+static VOID (WINAPI *pCloseThreadpoolCleanupGroup)(PTP_CLEANUP_GROUP);
+static VOID (WINAPI *pCloseThreadpoolCleanupGroupMembers)(PTP_CLEANUP_GROUP, BOOL, PVOID);
+static PTP_WORK (WINAPI *pCreateThreadpoolWork)(PTP_WORK_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static VOID (WINAPI *pSubmitThreadpoolWork)(PTP_WORK);
+static VOID (WINAPI *pWaitForThreadpoolWorkCallbacks)(PTP_WORK, BOOL);
+static VOID (WINAPI *pCloseThreadpoolWork)(PTP_WORK);
+static BOOL (WINAPI *pTrySubmitThreadpoolCallback)(PTP_SIMPLE_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static PTP_TIMER (WINAPI *pCreateThreadpoolTimer)(PTP_TIMER_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static VOID (WINAPI *pSetThreadpoolTimer)(PTP_TIMER, PFILETIME, DWORD, DWORD);
+static BOOL (WINAPI *pIsThreadpoolTimerSet)(PTP_TIMER);
+static VOID (WINAPI *pWaitForThreadpoolTimerCallbacks)(PTP_TIMER, BOOL);
+static VOID (WINAPI *pCloseThreadpoolTimer)(PTP_TIMER);
+static PTP_WAIT (WINAPI *pCreateThreadpoolWait)(PTP_WAIT_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static VOID (WINAPI *pSetThreadpoolWait)(PTP_WAIT, HANDLE, PFILETIME);
+static VOID (WINAPI *pWaitForThreadpoolWaitCallbacks)(PTP_WAIT, BOOL);
+static VOID (WINAPI *pCloseThreadpoolWait)(PTP_WAIT);
+static VOID (WINAPI *pSetEventWhenCallbackReturns)(PTP_CALLBACK_INSTANCE, HANDLE);
+
+static HANDLE ReleaseEvent;
+static HANDLE StartedEvent;
+
+static
+BOOL
+InitFunctionPointers(VOID)
+{
+    HMODULE hKernel32 = GetModuleHandleW(L"kernel32.dll");
+
+    /* Not exported by our kernel32 yet */
+    if (!GetProcAddress(hKernel32, "CreateThreadpoolWork"))
+        hKernel32 = LoadLibraryW(L"kernel32_vista.dll");
+    if (!hKernel32)
+        return FALSE;
+
+#define LOAD_FUNCTION(Name) \
+    p##Name = (PVOID)GetProcAddress(hKernel32, #Name); \
+    if (!p##Name) return FALSE
+
+    LOAD_FUNCTION(CreateThreadpool);
+    LOAD_FUNCTION(CloseThreadpool);
+    LOAD_FUNCTION(SetThreadpoolThreadMinimum);
+    LOAD_FUNCTION(SetThreadpoolThreadMaximum);
+    LOAD_FUNCTION(CreateThreadpoolCleanupGroup);
+    LOAD_FUNCTION(CloseThreadpoolCleanupGroup);
+    LOAD_FUNCTION(CloseThreadpoolCleanupGroupMembers);
+    LOAD_FUNCTION(CreateThreadpoolWork);
+    LOAD_FUNCTION(SubmitThreadpoolWork);
+    LOAD_FUNCTION(WaitForThreadpoolWorkCallbacks);
+    LOAD_FUNCTION(CloseThreadpoolWork);
+    LOAD_FUNCTION(TrySubmitThreadpoolCallback);
+    LOAD_FUNCTION(CreateThreadpoolTimer);
+    LOAD_FUNCTION(SetThreadpoolTimer);
+    LOAD_FUNCTION(IsThreadpoolTimerSet);
+    LOAD_FUNCTION(WaitForThreadpoolTimerCallbacks);
+    LOAD_FUNCTION(CloseThreadpoolTimer);
+    LOAD_FUNCTION(CreateThreadpoolWait);
+    LOAD_FUNCTION(SetThreadpoolWait);
+    LOAD_FUNCTION(WaitForThreadpoolWaitCallbacks);
+    LOAD_FUNCTION(CloseThreadpoolWait);
+    LOAD_FUNCTION(SetEventWhenCallbackReturns);
+
+#undef LOAD_FUNCTION
+    return TRUE;
+}
+
+static
+VOID
+NTAPI
+CountWorkCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WORK Work)
+{
+    InterlockedIncrement((PLONG)Context);
+}
+
+static
+VOID
+NTAPI
+BlockingWorkCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WORK Work)
+{
+    InterlockedIncrement((PLONG)Context);
+    SetEvent(StartedEvent);
+    WaitForSingleObject(ReleaseEvent, INFINITE);
+}
+
+static
+VOID
+NTAPI
+ReleaseCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context)
+{
+    Sleep(100);
+    SetEvent(ReleaseEvent);
+}
+
+static
+VOID
+NTAPI
+SignalCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context)
+{
+    pSetEventWhenCallbackReturns(Instance, (HANDLE)Context);
+}
+
+static
+VOID
+TestWork(VOID)
+{
+    TP_CALLBACK_ENVIRON Environ;
+    PTP_POOL Pool;
+    PTP_WORK Work;
+    HANDLE Event;
+    LONG Counter = 0;
+    ULONG i;
+
+    Work = pCreateThreadpoolWork(CountWorkCallback, &Counter, NULL);
+    ok(Work != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+    if (!Work)
+        return;
+
+    for (i = 0; i < 1000; i++)
+        pSubmitThreadpoolWork(Work);
+    pWaitForThreadpoolWorkCallbacks(Work, FALSE);
+    ok(Counter == 1000, "Counter is %ld\n", Counter);
+    pCloseThreadpoolWork(Work);
+
+    /* Completion actions */
+    Event = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(pTrySubmitThreadpoolCallback(SignalCallback, Event, NULL), "TrySubmitThreadpoolCallback failed: %lu\n", GetLastError());
+    ok(WaitForSingleObject(Event, 5000) == WAIT_OBJECT_0, "The event wasn't set\n");
+    CloseHandle(Event);
+
+    /* Cancelling what didn't start yet, on a private pool with a single thread */
+    Pool = pCreateThreadpool(NULL);
+    ok(Pool != NULL, "CreateThreadpool failed: %lu\n", GetLastError());
+    if (!Pool)
+        return;
+    pSetThreadpoolThreadMaximum(Pool, 1);
+    ok(pSetThreadpoolThreadMinimum(Pool, 1), "SetThreadpoolThreadMinimum failed: %lu\n", GetLastError());
+
+    TpInitializeCallbackEnviron(&Environ);
+    TpSetCallbackThreadpool(&Environ, Pool);
+
+    Counter = 0;
+    ReleaseEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    StartedEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    Work = pCreateThreadpoolWork(BlockingWorkCallback, &Counter, &Environ);
+    ok(Work != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+    if (Work)
+    {
+        for (i = 0; i < 10; i++)
+            pSubmitThreadpoolWork(Work);
+        ok(WaitForSingleObject(StartedEvent, 5000) == WAIT_OBJECT_0, "The callback didn't start\n");
+
+        /* The running callback is released from the default pool */
+        ok(pTrySubmitThreadpoolCallback(ReleaseCallback, NULL, NULL), "TrySubmitThreadpoolCallback failed: %lu\n", GetLastError());
+        pWaitForThreadpoolWorkCallbacks(Work, TRUE);
+        ok(Counter == 1, "Counter is %ld\n", Counter);
+        pCloseThreadpoolWork(Work);
+    }
+
+    CloseHandle(ReleaseEvent);
+    CloseHandle(StartedEvent);
+    pCloseThreadpool(Pool);
+}
+
+static
+VOID
+NTAPI
+TimerCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_TIMER Timer)
+{
+    InterlockedIncrement((PLONG)Context);
+}
+
+static
+VOID
+TestTimer(VOID)
+{
+    PTP_TIMER Timer;
+    LARGE_INTEGER DueTime;
+    FILETIME FileTime;
+    LONG Counter = 0;
+
+    Timer = pCreateThreadpoolTimer(TimerCallback, &Counter, NULL);
+    ok(Timer != NULL, "CreateThreadpoolTimer failed: %lu\n", GetLastError());
+    if (!Timer)
+        return;
+    ok(!pIsThreadpoolTimerSet(Timer), "The timer is set\n");
+
+    /* One shot, 50 ms from now */
+    DueTime.QuadPart = -50 * 10000;
+    FileTime.dwLowDateTime = DueTime.LowPart;
+    FileTime.dwHighDateTime = DueTime.HighPart;
+    pSetThreadpoolTimer(Timer, &FileTime, 0, 0);
+    ok(pIsThreadpoolTimerSet(Timer), "The timer isn't set\n");
+    Sleep(500);
+    pWaitForThreadpoolTimerCallbacks(Timer, FALSE);
+    ok(Counter == 1, "Counter is %ld\n", Counter);
+
+    /* Periodic, with a window to batch it with others */
+    Counter = 0;
+    DueTime.QuadPart = -10 * 10000;
+    FileTime.dwLowDateTime = DueTime.LowPart;
+    FileTime.dwHighDateTime = DueTime.HighPart;
+    pSetThreadpoolTimer(Timer, &FileTime, 20, 5);
+    Sleep(500);
+    pSetThreadpoolTimer(Timer, NULL, 0, 0);
+    ok(!pIsThreadpoolTimerSet(Timer), "The timer is set\n");
+    pWaitForThreadpoolTimerCallbacks(Timer, TRUE);
+    ok(Counter >= 5 && Counter <= 30, "Counter is %ld\n", Counter);
+
+    pCloseThreadpoolTimer(Timer);
+}
+
+static
+VOID
+NTAPI
+WaitCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WAIT Wait, TP_WAIT_RESULT WaitResult)
+{
+    if (WaitResult == WAIT_OBJECT_0)
+        InterlockedIncrement((PLONG)Context);
+    else if (WaitResult == WAIT_TIMEOUT)
+        InterlockedExchangeAdd((PLONG)Context, 0x10000);
+}
+
+static
+VOID
+TestWait(VOID)
+{
+    PTP_WAIT Waits[TEST_WAITS];
+    HANDLE Events[TEST_WAITS];
+    LARGE_INTEGER Timeout;
+    FILETIME FileTime;
+    LONG Counter = 0;
+    ULONG i;
+
+    /* More waits than a single thread can handle */
+    for (i = 0; i < TEST_WAITS; i++)
+    {
+        Events[i] = CreateEventW(NULL, FALSE, FALSE, NULL);
+        Waits[i] = pCreateThreadpoolWait(WaitCallback, &Counter, NULL);
+        ok(Waits[i] != NULL, "CreateThreadpoolWait failed: %lu\n", GetLastError());
+        if (!Waits[i])
+            return;
+        pSetThreadpoolWait(Waits[i], Events[i], NULL);
+    }
+
+    for (i = 0; i < TEST_WAITS; i++)
+        SetEvent(Events[i]);
+    for (i = 0; i < 50 && Counter < TEST_WAITS; i++)
+        Sleep(100);
+    for (i = 0; i < TEST_WAITS; i++)
+        pWaitForThreadpoolWaitCallbacks(Waits[i], FALSE);
+    ok(Counter == TEST_WAITS, "Counter is 0x%lx\n", Counter);
+
+    /* Waits are one shot */
+    Counter = 0;
+    SetEvent(Events[0]);
+    Sleep(100);
+    ok(Counter == 0, "Counter is 0x%lx\n", Counter);
+    ResetEvent(Events[0]);
+
+    /* Timeouts */
+    Timeout.QuadPart = -50 * 10000;
+    FileTime.dwLowDateTime = Timeout.LowPart;
+    FileTime.dwHighDateTime = Timeout.HighPart;
+    pSetThreadpoolWait(Waits[0], Events[0], &FileTime);
+    Sleep(500);
+    pWaitForThreadpoolWaitCallbacks(Waits[0], FALSE);
+    ok(Counter == 0x10000, "Counter is 0x%lx\n", Counter);
+
+    /* A cancelled wait never fires */
+    Counter = 0;
+    pSetThreadpoolWait(Waits[0], Events[0], NULL);
+    pSetThreadpoolWait(Waits[0], NULL, NULL);
+    SetEvent(Events[0]);
+    Sleep(100);
+    ok(Counter == 0, "Counter is 0x%lx\n", Counter);
+
+    for (i = 0; i < TEST_WAITS; i++)
+    {
+        pCloseThreadpoolWait(Waits[i]);
+        CloseHandle(Events[i]);
+    }
+}
+
+static
+VOID
+NTAPI
+GroupCancelCallback(PVOID ObjectContext, PVOID CleanupContext)
+{
+    InterlockedIncrement((PLONG)CleanupContext);
+}
+
+static
+VOID
+TestCleanupGroup(VOID)
+{
+    TP_CALLBACK_ENVIRON Environ;
+    PTP_CLEANUP_GROUP Group;
+    PTP_WORK Work;
+    LONG Counter = 0, Cancelled = 0;
+    ULONG i;
+
+    Group = pCreateThreadpoolCleanupGroup();
+    ok(Group != NULL, "CreateThreadpoolCleanupGroup failed: %lu\n", GetLastError());
+    if (!Group)
+        return;
+
+    TpInitializeCallbackEnviron(&Environ);
+    TpSetCallbackCleanupGroup(&Environ, Group, GroupCancelCallback);
+
+    for (i = 0; i < 10; i++)
+    {
+        Work = pCreateThreadpoolWork(CountWorkCallback, &Counter, &Environ);
+        ok(Work != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+        if (Work)
+            pSubmitThreadpoolWork(Work);
+    }
+
+    /* Waits for everything and closes the members */
+    pCloseThreadpoolCleanupGroupMembers(Group, FALSE, &Cancelled);
+    ok(Counter == 10, "Counter is %ld\n", Counter);
+    ok(Cancelled == 0, "Cancelled is %ld\n", Cancelled);
+
+    /* The group can be used again */
+    Work = pCreateThreadpoolWork(CountWorkCallback, &Counter, &Environ);
+    ok(Work != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+    pCloseThreadpoolCleanupGroupMembers(Group, TRUE, &Cancelled);
+    ok(Cancelled == 1, "Cancelled is %ld\n", Cancelled);
+
+    pCloseThreadpoolCleanupGroup(Group);
+}
+
+static LONG BenchCounter;
+static HANDLE BenchDone;
+
+static
+VOID
+NTAPI
+BenchWorkCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WORK Work)
+{
+    InterlockedIncrement(&BenchCounter);
+}
+
+static
+DWORD
+WINAPI
+BenchWorkItem(PVOID Context)
+{
+    if (InterlockedIncrement(&BenchCounter) == TEST_BENCH_ITEMS)
+        SetEvent(BenchDone);
+    return 0;
+}
+
+static
+VOID
+RunBenchmark(VOID)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    PTP_WORK Work;
+    ULONG i;
+    double Seconds;
+
+    QueryPerformanceFrequency(&Frequency);
+
+    Work = pCreateThreadpoolWork(BenchWorkCallback, NULL, NULL);
+    ok(Work != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+    if (!Work)
+        return;
+
+    BenchCounter = 0;
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < TEST_BENCH_ITEMS; i++)
+        pSubmitThreadpoolWork(Work);
+    pWaitForThreadpoolWorkCallbacks(Work, FALSE);
+    QueryPerformanceCounter(&End);
+    pCloseThreadpoolWork(Work);
+
+    ok(BenchCounter == TEST_BENCH_ITEMS, "Counter is %ld\n", BenchCounter);
+    Seconds = (double)(End.QuadPart - Start.QuadPart) / (double)Frequency.QuadPart;
+    if (Seconds > 0)
+        trace("SubmitThreadpoolWork: %u items in %.3f s, %.0f items/s\n", TEST_BENCH_ITEMS, Seconds, TEST_BENCH_ITEMS / Seconds);
+
+    BenchCounter = 0;
+    BenchDone = CreateEventW(NULL, TRUE, FALSE, NULL);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < TEST_BENCH_ITEMS; i++)
+    {
+        if (!QueueUserWorkItem(BenchWorkItem, NULL, WT_EXECUTEDEFAULT))
+        {
+            ok(0, "QueueUserWorkItem failed: %lu\n", GetLastError());
+            break;
+        }
+    }
+    if (i == TEST_BENCH_ITEMS)
+        ok(WaitForSingleObject(BenchDone, 60000) == WAIT_OBJECT_0, "The work items didn't complete\n");
+    QueryPerformanceCounter(&End);
+    CloseHandle(BenchDone);
+
+    Seconds = (double)(End.QuadPart - Start.QuadPart) / (double)Frequency.QuadPart;
+    if (Seconds > 0)
+        trace("QueueUserWorkItem: %u items in %.3f s, %.0f items/s\n", TEST_BENCH_ITEMS, Seconds, TEST_BENCH_ITEMS / Seconds);
+}
+
+START_TEST(ThreadpoolWork)
+{
+    if (!InitFunctionPointers())
+    {
+        skip("The thread pool API is not available\n");
+        return;
+    }
+
+    TestWork();
+    TestTimer();
+    TestWait();
+    TestCleanupGroup();
+    RunBenchmark();
+}
@@ -17,6 +17,7 @@ typedef struct _TEST_CONNECTION_INFO
 } TEST_CONNECTION_INFO, *PTEST_CONNECTION_INFO;
 
 #define TEST_MESSAGE_MESSAGE 0x4455cdef
+#define TEST_ROUND_TRIPS 10000
 typedef struct _TEST_MESSAGE
 {
     PORT_MESSAGE Header;
@@ -34,9 +35,10 @@ ServerThread(
     _Inout_ PVOID Parameter)
 {
     NTSTATUS Status;
-    TEST_MESSAGE Message;
+    TEST_MESSAGE Message, Reply;
     HANDLE PortHandle;
     HANDLE ServerPortHandle = Parameter;
+    ULONG i;
 
     /* Listen, but refuse the connection */
     RtlZeroMemory(&Message, sizeof(Message));
@@ -123,6 +125,34 @@ ServerThread(
        Message.Header.ClientId.UniqueThread, ClientThreadId);
     ok(Message.Message == TEST_MESSAGE_MESSAGE, "Message = %lx\n", Message.Message);
 
+    /* Answer requests, each reply goes out with the wait for the next one */
+    for (i = 0; i < TEST_ROUND_TRIPS; i++)
+    {
+        RtlZeroMemory(&Message, sizeof(Message));
+        Status = NtReplyWaitReceivePort(PortHandle,
+                                        NULL,
+                                        i ? &Reply.Header : NULL,
+                                        &Message.Header);
+        if (Status != STATUS_SUCCESS ||
+            Message.Header.u2.s2.Type != LPC_REQUEST ||
+            Message.Header.ClientId.UniqueThread != UlongToHandle(ClientThreadId) ||
+            Message.Message != i)
+        {
+            ok(0, "Request %lu: Status = %lx, Type = %x, Message = %lx\n",
+               i, Status, Message.Header.u2.s2.Type, Message.Message);
+            break;
+        }
+
+        Reply = Message;
+        Reply.Message = Message.Message + 1;
+    }
+
+    if (i == TEST_ROUND_TRIPS)
+    {
+        Status = NtReplyPort(PortHandle, &Reply.Header);
+        ok_hex(Status, STATUS_SUCCESS);
+    }
+
     Status = NtClose(PortHandle);
     ok_hex(Status, STATUS_SUCCESS);
 
@@ -139,7 +169,10 @@ ClientThread(
     TEST_CONNECTION_INFO ConnectInfo;
     ULONG ConnectInfoLength;
     SECURITY_QUALITY_OF_SERVICE SecurityQos;
-    TEST_MESSAGE Message;
+    TEST_MESSAGE Message, Reply;
+    LARGE_INTEGER Frequency, Start, End;
+    double Seconds;
+    ULONG i;
 
     SecurityQos.Length = sizeof(SecurityQos);
     SecurityQos.ImpersonationLevel = SecurityIdentification;
@@ -187,6 +220,38 @@ ClientThread(
                            &Message.Header);
     ok_hex(Status, STATUS_SUCCESS);
 
+    /* Request/reply round trips, the server answers with our value plus one */
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < TEST_ROUND_TRIPS; i++)
+    {
+        RtlZeroMemory(&Message, sizeof(Message));
+        Message.Header.u1.s1.TotalLength = sizeof(Message);
+        Message.Header.u1.s1.DataLength = sizeof(Message.Message);
+        Message.Message = i;
+        RtlZeroMemory(&Reply, sizeof(Reply));
+        Status = NtRequestWaitReplyPort(PortHandle,
+                                        &Message.Header,
+                                        &Reply.Header);
+        if (Status != STATUS_SUCCESS ||
+            Reply.Header.u2.s2.Type != LPC_REPLY ||
+            Reply.Header.ClientId.UniqueThread != UlongToHandle(ServerThreadId) ||
+            Reply.Message != i + 1)
+        {
+            ok(0, "Round trip %lu: Status = %lx, Type = %x, Message = %lx\n",
+               i, Status, Reply.Header.u2.s2.Type, Reply.Message);
+            break;
+        }
+    }
+    QueryPerformanceCounter(&End);
+    ok(i == TEST_ROUND_TRIPS, "Only %lu round trips completed\n", i);
+
+    Seconds = (double)(End.QuadPart - Start.QuadPart) / (double)Frequency.QuadPart;
+    if (i && (Seconds > 0))
+    {
+        trace("%lu round trips: %.3f s, %.0f round trips/s\n", i, Seconds, i / Seconds);
+    }
+
     Status = NtClose(PortHandle);
     ok_hex(Status, STATUS_SUCCESS);
 
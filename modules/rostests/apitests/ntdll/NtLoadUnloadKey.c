@@ -13,6 +13,10 @@
 
 #define REG_FORCE_UNLOAD        1
 
+/* Enough keys and data to spread over a few hundred hive blocks */
+#define FLUSH_TEST_KEYS         512
+#define FLUSH_TEST_DATA_SIZE    2048
+
 #if 1
 
     #define NDEBUG
@@ -390,6 +394,121 @@ DisconnectRegistry(
     return pNtUnloadKey2(&ObjectAttributes, Flags);
 }
 
+/*
+ * Should be called under privileges
+ */
+static VOID
+TestFlushLargeHive(
+    IN PUNICODE_STRING RootPath,
+    IN PCWSTR RegMountPoint,
+    IN PCWSTR RegistryKey)
+{
+    NTSTATUS Status;
+    UNICODE_STRING KeyName;
+    UNICODE_STRING ValueName = RTL_CONSTANT_STRING(L"Data");
+    HANDLE RootHandle, KeyHandle;
+    LARGE_INTEGER Frequency, Start, End;
+    UCHAR Data[FLUSH_TEST_DATA_SIZE];
+    UCHAR Buffer[FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data) + FLUSH_TEST_DATA_SIZE];
+    PKEY_VALUE_PARTIAL_INFORMATION Info = (PVOID)Buffer;
+    WCHAR PathBuffer[32];
+    ULONG i, Pass, ResultLength, Mismatches;
+
+    Status = ConnectRegistry(NULL, RegMountPoint, NULL, RootPath, RegistryKey);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    RtlInitUnicodeString(&KeyName, RegMountPoint);
+    Status = CreateRegKey(&RootHandle, NULL, &KeyName, REG_OPTION_NON_VOLATILE, NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        DisconnectRegistry(NULL, RegMountPoint, REG_FORCE_UNLOAD);
+        return;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+
+    /* The first pass dirties the whole hive, the second one only every 8th key */
+    for (Pass = 0; Pass < 2; Pass++)
+    {
+        for (i = 0; i < FLUSH_TEST_KEYS; i++)
+        {
+            if (Pass && (i % 8))
+                continue;
+
+            StringCchPrintfW(PathBuffer, _countof(PathBuffer), L"Key%lu", i);
+            RtlInitUnicodeString(&KeyName, PathBuffer);
+            Status = CreateRegKey(&KeyHandle, RootHandle, &KeyName, REG_OPTION_NON_VOLATILE, NULL);
+            if (!NT_SUCCESS(Status))
+                break;
+
+            RtlFillMemory(Data, sizeof(Data), (UCHAR)(i + Pass));
+            Status = NtSetValueKey(KeyHandle, &ValueName, 0, REG_BINARY, Data, sizeof(Data));
+            NtClose(KeyHandle);
+            if (!NT_SUCCESS(Status))
+                break;
+        }
+        ok_ntstatus(Status, STATUS_SUCCESS);
+
+        QueryPerformanceCounter(&Start);
+        Status = NtFlushKey(RootHandle);
+        QueryPerformanceCounter(&End);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+
+        trace("%s flush: %.3f ms\n", Pass ? "Sparse" : "Full",
+              (double)(End.QuadPart - Start.QuadPart) * 1000.0 / (double)Frequency.QuadPart);
+    }
+
+    NtClose(RootHandle);
+
+    /* Load the hive again and check that all the data made it to the file */
+    Status = DisconnectRegistry(NULL, RegMountPoint, 0);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Status = ConnectRegistry(NULL, RegMountPoint, NULL, RootPath, RegistryKey);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    RtlInitUnicodeString(&KeyName, RegMountPoint);
+    Status = CreateRegKey(&RootHandle, NULL, &KeyName, REG_OPTION_NON_VOLATILE, NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status))
+    {
+        Mismatches = 0;
+        for (i = 0; i < FLUSH_TEST_KEYS; i++)
+        {
+            StringCchPrintfW(PathBuffer, _countof(PathBuffer), L"Key%lu", i);
+            RtlInitUnicodeString(&KeyName, PathBuffer);
+            Status = CreateRegKey(&KeyHandle, RootHandle, &KeyName, REG_OPTION_NON_VOLATILE, NULL);
+            if (!NT_SUCCESS(Status))
+            {
+                Mismatches++;
+                continue;
+            }
+
+            Status = NtQueryValueKey(KeyHandle, &ValueName, KeyValuePartialInformation,
+                                     Info, sizeof(Buffer), &ResultLength);
+            NtClose(KeyHandle);
+
+            RtlFillMemory(Data, sizeof(Data), (UCHAR)((i % 8) ? i : i + 1));
+            if (!NT_SUCCESS(Status) ||
+                (Info->DataLength != sizeof(Data)) ||
+                (RtlCompareMemory(Info->Data, Data, sizeof(Data)) != sizeof(Data)))
+            {
+                Mismatches++;
+            }
+        }
+        ok(Mismatches == 0, "%lu of %u keys were not written correctly\n", Mismatches, FLUSH_TEST_KEYS);
+
+        NtClose(RootHandle);
+    }
+
+    Status = DisconnectRegistry(NULL, RegMountPoint, 0);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+}
+
 
 START_TEST(NtLoadUnloadKey)
 {
@@ -606,6 +725,15 @@ START_TEST(NtLoadUnloadKey)
 #endif
 
 
+/***********************************************************************************************/
+
+
+    /* Dirty and flush a larger hive, then check it made it to the disk */
+    TestFlushLargeHive(&NtTestPath,
+                       RegistryHives[1].RegMountPoint,
+                       RegistryHives[1].HiveName);
+
+
 /***********************************************************************************************/
 
 
@@ -1,13 +1,115 @@
 /*
  * PROJECT:         ReactOS api tests
  * LICENSE:         LGPLv2.1+ - See COPYING.LIB in the top level directory
- * PURPOSE:         Test for NtOpenKey data alignment
+ * PURPOSE:         Test for NtOpenKey data alignment and deep path lookups
  * PROGRAMMER:      Mark Jansen (mark.jansen@reactos.org)
  */
 
 #include "precomp.h"
 
 #define TEST_STR    L"\\Registry\\Machine\\SOFTWARE"
+#define TEST_ROOT   L"\\Registry\\Machine\\Software\\RosTests"
+#define TEST_DEEP   TEST_ROOT L"\\CacheA\\CacheB\\CacheC"
+#define OPEN_LOOPS  20000
+
+static
+NTSTATUS
+OpenKey(PHANDLE KeyHandle, HANDLE RootDirectory, PCWSTR Path, BOOLEAN Create)
+{
+    UNICODE_STRING String;
+    OBJECT_ATTRIBUTES Object;
+
+    RtlInitUnicodeString(&String, Path);
+    InitializeObjectAttributes(&Object, &String, OBJ_CASE_INSENSITIVE, RootDirectory, NULL);
+    if (Create)
+        return NtCreateKey(KeyHandle, KEY_READ | DELETE, &Object, 0, NULL, REG_OPTION_VOLATILE, NULL);
+    return NtOpenKey(KeyHandle, KEY_QUERY_VALUE, &Object);
+}
+
+static
+VOID
+TestDeepPaths(VOID)
+{
+    HANDLE Root, KeyA, KeyB, KeyC, KeyHandle;
+    LARGE_INTEGER Frequency, Start, End;
+    NTSTATUS Status;
+    ULONG i;
+
+    Status = OpenKey(&Root, NULL, TEST_ROOT, TRUE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+    Status = OpenKey(&KeyA, Root, L"CacheA", TRUE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Status = OpenKey(&KeyB, KeyA, L"CacheB", TRUE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Status = OpenKey(&KeyC, KeyB, L"CacheC", TRUE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    /* The keys are open, so the path must be found whatever the case */
+    Status = OpenKey(&KeyHandle, NULL, TEST_ROOT L"\\cachea\\CACHEB\\cacheC", FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status))
+        NtClose(KeyHandle);
+    Status = OpenKey(&KeyHandle, Root, L"CacheA\\CacheB\\CacheC", FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status))
+        NtClose(KeyHandle);
+
+    /* Other orders and deeper paths must not match */
+    Status = OpenKey(&KeyHandle, NULL, TEST_ROOT L"\\CacheB\\CacheA\\CacheC", FALSE);
+    ok_ntstatus(Status, STATUS_OBJECT_NAME_NOT_FOUND);
+    Status = OpenKey(&KeyHandle, NULL, TEST_ROOT L"\\CacheA\\CacheB\\CacheC\\CacheD", FALSE);
+    ok_ntstatus(Status, STATUS_OBJECT_NAME_NOT_FOUND);
+
+    /* Time repeated opens of the deep path */
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < OPEN_LOOPS; i++)
+    {
+        Status = OpenKey(&KeyHandle, NULL, TEST_DEEP, FALSE);
+        if (!NT_SUCCESS(Status))
+            break;
+        NtClose(KeyHandle);
+    }
+    QueryPerformanceCounter(&End);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (Frequency.QuadPart)
+    {
+        trace("%lu opens of %ls: %.3f s\n",
+              i, TEST_DEEP,
+              (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart);
+    }
+
+    /* A deleted key must not be found, even while its subkey is still open */
+    Status = NtDeleteKey(KeyC);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Status = OpenKey(&KeyHandle, NULL, TEST_DEEP, FALSE);
+    ok_ntstatus(Status, STATUS_OBJECT_NAME_NOT_FOUND);
+    Status = NtDeleteKey(KeyB);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Status = OpenKey(&KeyHandle, NULL, TEST_DEEP, FALSE);
+    ok_ntstatus(Status, STATUS_OBJECT_NAME_NOT_FOUND);
+    Status = OpenKey(&KeyHandle, KeyA, L"CacheB", FALSE);
+    ok_ntstatus(Status, STATUS_OBJECT_NAME_NOT_FOUND);
+
+    /* Recreating it gives a working path again */
+    NtClose(KeyC);
+    NtClose(KeyB);
+    Status = OpenKey(&KeyB, KeyA, L"CacheB", TRUE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Status = OpenKey(&KeyHandle, NULL, TEST_ROOT L"\\CacheA\\CacheB", FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status))
+        NtClose(KeyHandle);
+
+    NtDeleteKey(KeyB);
+    NtClose(KeyB);
+    NtDeleteKey(KeyA);
+    NtClose(KeyA);
+    NtDeleteKey(Root);
+    NtClose(Root);
+}
 
 START_TEST(NtOpenKey)
 {
@@ -50,4 +152,6 @@ START_TEST(NtOpenKey)
     {
         NtClose(*(HANDLE*)(UnalignedKey));
     }
+
+    TestDeepPaths();
 }
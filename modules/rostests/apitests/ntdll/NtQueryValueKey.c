@@ -8,6 +8,137 @@
 #include "precomp.h"
 #include <winreg.h>
 
+#define TEST_MAX_THREADS    8
+#define TEST_ITERATIONS     20000
+
+typedef struct _TEST_CONTEXT
+{
+    HANDLE KeyHandle;
+    HANDLE StartEvent;
+    BOOLEAN Reopen;
+    ULONG ExpectedLength;
+    volatile LONG Failures;
+} TEST_CONTEXT, *PTEST_CONTEXT;
+
+static
+DWORD
+WINAPI
+QueryThread(PVOID Parameter)
+{
+    PTEST_CONTEXT Context = Parameter;
+    UNICODE_STRING KeyName = RTL_CONSTANT_STRING(L"\\Registry\\Machine\\SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion");
+    UNICODE_STRING ValueName = RTL_CONSTANT_STRING(L"SystemRoot");
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    UCHAR Buffer[FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data) + MAX_PATH * sizeof(WCHAR)];
+    PKEY_VALUE_PARTIAL_INFORMATION Info = (PVOID)Buffer;
+    HANDLE KeyHandle = Context->KeyHandle;
+    ULONG ResultLength;
+    NTSTATUS Status;
+    ULONG i;
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &KeyName,
+                               OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+
+    WaitForSingleObject(Context->StartEvent, INFINITE);
+
+    for (i = 0; i < TEST_ITERATIONS; i++)
+    {
+        /* Optionally go through the parse path as well */
+        if (Context->Reopen)
+        {
+            Status = NtOpenKey(&KeyHandle, KEY_QUERY_VALUE, &ObjectAttributes);
+            if (!NT_SUCCESS(Status))
+            {
+                InterlockedIncrement(&Context->Failures);
+                continue;
+            }
+        }
+
+        Status = NtQueryValueKey(KeyHandle,
+                                 &ValueName,
+                                 KeyValuePartialInformation,
+                                 Info,
+                                 sizeof(Buffer),
+                                 &ResultLength);
+        if (!NT_SUCCESS(Status) ||
+            (ResultLength != Context->ExpectedLength) ||
+            (Info->Type != REG_SZ))
+        {
+            InterlockedIncrement(&Context->Failures);
+        }
+
+        if (Context->Reopen)
+            NtClose(KeyHandle);
+    }
+
+    return 0;
+}
+
+static
+VOID
+RunConcurrentQueries(HANDLE KeyHandle, ULONG ExpectedLength, ULONG ThreadCount, BOOLEAN Reopen)
+{
+    TEST_CONTEXT Context;
+    HANDLE Threads[TEST_MAX_THREADS];
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG i, Started = 0;
+    double Seconds;
+
+    Context.KeyHandle = KeyHandle;
+    Context.Reopen = Reopen;
+    Context.ExpectedLength = ExpectedLength;
+    Context.Failures = 0;
+    Context.StartEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(Context.StartEvent != NULL, "CreateEventW failed: %lu\n", GetLastError());
+    if (!Context.StartEvent)
+        return;
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        Threads[Started] = CreateThread(NULL, 0, QueryThread, &Context, 0, NULL);
+        ok(Threads[Started] != NULL, "CreateThread failed: %lu\n", GetLastError());
+        if (Threads[Started]) Started++;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    SetEvent(Context.StartEvent);
+    WaitForMultipleObjects(Started, Threads, TRUE, INFINITE);
+    QueryPerformanceCounter(&End);
+
+    for (i = 0; i < Started; i++)
+        CloseHandle(Threads[i]);
+    CloseHandle(Context.StartEvent);
+
+    ok(Context.Failures == 0, "%lu threads, reopen %d: %ld failed queries\n",
+       Started, Reopen, Context.Failures);
+
+    Seconds = (double)(End.QuadPart - Start.QuadPart) / (double)Frequency.QuadPart;
+    if (Seconds > 0)
+    {
+        trace("%lu threads, reopen %d: %.3f s, %.0f queries/s\n",
+              Started, Reopen, Seconds,
+              (Started * (double)TEST_ITERATIONS) / Seconds);
+    }
+}
+
+static
+VOID
+TestConcurrentQueries(HANDLE KeyHandle, ULONG ExpectedLength)
+{
+    ULONG ThreadCount;
+
+    /* Readers of the same key shouldn't serialize on each other */
+    for (ThreadCount = 1; ThreadCount <= TEST_MAX_THREADS; ThreadCount *= 2)
+    {
+        RunConcurrentQueries(KeyHandle, ExpectedLength, ThreadCount, FALSE);
+        RunConcurrentQueries(KeyHandle, ExpectedLength, ThreadCount, TRUE);
+    }
+}
+
 START_TEST(NtQueryValueKey)
 {
     NTSTATUS Status;
@@ -109,6 +240,10 @@ START_TEST(NtQueryValueKey)
 
     RtlFreeHeap(RtlGetProcessHeap(), 0, Info);
 
+    /* Now the same query from several threads at once */
+    TestConcurrentQueries(KeyHandle,
+                          FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data) + StringLength);
+
 Exit:
     Status = NtClose(KeyHandle);
     ok_hex(Status, STATUS_SUCCESS);
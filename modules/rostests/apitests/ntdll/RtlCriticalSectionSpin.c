@@ -0,0 +1,152 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test and benchmark for critical section spinning
+ */
+
+#include "precomp.h"
+
+#define TEST_MAX_THREADS    16
+#define TEST_ITERATIONS     100000
+#define TEST_SPIN_COUNT     4000
+
+/* Vista and later keep flags in the high byte of the spin count */
+#define SPIN_COUNT(cs)      ((cs)->SpinCount & 0x00FFFFFF)
+
+typedef struct _TEST_CONTEXT
+{
+    RTL_CRITICAL_SECTION CriticalSection;
+    HANDLE StartEvent;
+    volatile ULONG Counter;
+} TEST_CONTEXT, *PTEST_CONTEXT;
+
+static
+DWORD
+WINAPI
+EnterLeaveThread(PVOID Parameter)
+{
+    PTEST_CONTEXT Context = Parameter;
+    ULONG i, j;
+
+    WaitForSingleObject(Context->StartEvent, INFINITE);
+
+    for (i = 0; i < TEST_ITERATIONS; i++)
+    {
+        RtlEnterCriticalSection(&Context->CriticalSection);
+        /* A short critical section, like most of them are */
+        for (j = 0; j < 16; j++)
+            Context->Counter++;
+        RtlLeaveCriticalSection(&Context->CriticalSection);
+    }
+
+    return 0;
+}
+
+static
+VOID
+RunBenchmark(ULONG ThreadCount, ULONG SpinCount)
+{
+    TEST_CONTEXT Context;
+    HANDLE Threads[TEST_MAX_THREADS];
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG i, Started = 0, Waits;
+    NTSTATUS Status;
+    double Seconds;
+
+    Status = RtlInitializeCriticalSectionAndSpinCount(&Context.CriticalSection, SpinCount);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+    Context.Counter = 0;
+    Context.StartEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(Context.StartEvent != NULL, "CreateEventW failed: %lu\n", GetLastError());
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        Threads[Started] = CreateThread(NULL, 0, EnterLeaveThread, &Context, 0, NULL);
+        ok(Threads[Started] != NULL, "CreateThread failed: %lu\n", GetLastError());
+        if (Threads[Started]) Started++;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    SetEvent(Context.StartEvent);
+    WaitForMultipleObjects(Started, Threads, TRUE, INFINITE);
+    QueryPerformanceCounter(&End);
+
+    for (i = 0; i < Started; i++)
+        CloseHandle(Threads[i]);
+    CloseHandle(Context.StartEvent);
+
+    ok(Context.Counter == Started * TEST_ITERATIONS * 16,
+       "%lu threads, spin %lu: counter is %lu\n", Started, SpinCount, Context.Counter);
+    ok(Context.CriticalSection.RecursionCount == 0, "RecursionCount is %ld\n", Context.CriticalSection.RecursionCount);
+    ok(Context.CriticalSection.OwningThread == NULL, "OwningThread is %p\n", Context.CriticalSection.OwningThread);
+
+    /* Spinning must not leave anything behind in the spin count */
+    ok(SPIN_COUNT(&Context.CriticalSection) == ((NtCurrentPeb()->NumberOfProcessors > 1) ? SpinCount : 0),
+       "%lu threads, spin %lu: SpinCount is %Iu\n", Started, SpinCount, Context.CriticalSection.SpinCount);
+
+    /* Every wait is a wait syscall for the waiter, and a signal syscall for the owner */
+    Waits = Context.CriticalSection.DebugInfo ? Context.CriticalSection.DebugInfo->ContentionCount : 0;
+
+    Seconds = (double)(End.QuadPart - Start.QuadPart) / (double)Frequency.QuadPart;
+    if (Seconds > 0)
+    {
+        trace("%2lu threads, spin %4lu: %.3f s, %.0f enter/leave pairs/s, %lu waits\n",
+              Started, SpinCount, Seconds,
+              (Started * (double)TEST_ITERATIONS) / Seconds, Waits);
+    }
+
+    RtlDeleteCriticalSection(&Context.CriticalSection);
+}
+
+static
+VOID
+TestSpinCount(VOID)
+{
+    RTL_CRITICAL_SECTION CriticalSection;
+    ULONG Expected, OldCount;
+    NTSTATUS Status;
+
+    /* The spin count is ignored on uniprocessor systems */
+    Expected = (NtCurrentPeb()->NumberOfProcessors > 1) ? TEST_SPIN_COUNT : 0;
+
+    Status = RtlInitializeCriticalSectionAndSpinCount(&CriticalSection, TEST_SPIN_COUNT);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    ok(SPIN_COUNT(&CriticalSection) == Expected, "SpinCount is %Iu\n", CriticalSection.SpinCount);
+    OldCount = RtlSetCriticalSectionSpinCount(&CriticalSection, 0);
+    ok((OldCount & 0x00FFFFFF) == Expected, "Old spin count is %lu\n", OldCount);
+    ok(SPIN_COUNT(&CriticalSection) == 0, "SpinCount is %Iu\n", CriticalSection.SpinCount);
+    OldCount = RtlSetCriticalSectionSpinCount(&CriticalSection, TEST_SPIN_COUNT);
+    ok((OldCount & 0x00FFFFFF) == 0, "Old spin count is %lu\n", OldCount);
+
+    /* Recursion still works when spinning */
+    RtlEnterCriticalSection(&CriticalSection);
+    RtlEnterCriticalSection(&CriticalSection);
+    ok(CriticalSection.RecursionCount == 2, "RecursionCount is %ld\n", CriticalSection.RecursionCount);
+    ok(CriticalSection.OwningThread == UlongToHandle(GetCurrentThreadId()),
+       "OwningThread is %p\n", CriticalSection.OwningThread);
+    RtlLeaveCriticalSection(&CriticalSection);
+    RtlLeaveCriticalSection(&CriticalSection);
+    ok(CriticalSection.RecursionCount == 0, "RecursionCount is %ld\n", CriticalSection.RecursionCount);
+    ok(CriticalSection.OwningThread == NULL, "OwningThread is %p\n", CriticalSection.OwningThread);
+
+    RtlDeleteCriticalSection(&CriticalSection);
+}
+
+START_TEST(RtlCriticalSectionSpin)
+{
+    ULONG ThreadCount;
+
+    TestSpinCount();
+
+    for (ThreadCount = 2; ThreadCount <= TEST_MAX_THREADS; ThreadCount *= 2)
+    {
+        RunBenchmark(ThreadCount, 0);
+        RunBenchmark(ThreadCount, TEST_SPIN_COUNT);
+    }
+}
@@ -0,0 +1,256 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for RtlDecompressBufferEx and the XPRESS formats
+ */
+
+#include "precomp.h"
+
+static NTSTATUS (NTAPI *pRtlDecompressBufferEx)(USHORT, PUCHAR, ULONG, PUCHAR, ULONG, PULONG, PVOID);
+
+/* "abcdefghijklmnopqrstuvwxyz" and "abc" * 100 from [MS-XCA] */
+static UCHAR Alphabet[] = "\x3f\x00\x00\x00" "abcdefghijklmnopqrstuvwxyz";
+static UCHAR Repeated[] = { 0xff, 0xff, 0xff, 0x1f, 'a', 'b', 'c', 0x17, 0x00, 0x0f, 0xff, 0x26, 0x01 };
+
+/* A match with offset 3 before any output */
+static UCHAR BadOffset[] = { 0x00, 0x00, 0x00, 0x80, 0x10, 0x00 };
+
+static
+VOID
+TestRoundTrip(USHORT FormatAndEngine, PUCHAR Data, ULONG DataSize)
+{
+    ULONG CompressWorkSpaceSize, DecompressWorkSpaceSize;
+    ULONG CompressedSize, FinalSize;
+    PUCHAR Compressed, Decompressed;
+    PVOID WorkSpace, DecompressWorkSpace;
+    NTSTATUS Status;
+
+    Status = RtlGetCompressionWorkSpaceSize(FormatAndEngine, &CompressWorkSpaceSize,
+                                            &DecompressWorkSpaceSize);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok(CompressWorkSpaceSize != 0, "CompressWorkSpaceSize is 0\n");
+
+    WorkSpace = RtlAllocateHeap(RtlGetProcessHeap(), 0, CompressWorkSpaceSize);
+    DecompressWorkSpace = RtlAllocateHeap(RtlGetProcessHeap(), 0, DecompressWorkSpaceSize + 1);
+    Compressed = RtlAllocateHeap(RtlGetProcessHeap(), 0, DataSize);
+    Decompressed = RtlAllocateHeap(RtlGetProcessHeap(), 0, DataSize + 1);
+    if (!WorkSpace || !DecompressWorkSpace || !Compressed || !Decompressed)
+    {
+        skip("Out of memory\n");
+        goto Cleanup;
+    }
+
+    CompressedSize = 0xdeadbeef;
+    Status = RtlCompressBuffer(FormatAndEngine, Data, DataSize, Compressed, DataSize,
+                               4096, &CompressedSize, WorkSpace);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok(CompressedSize < DataSize / 2, "0x%04x: CompressedSize = %lu\n", FormatAndEngine, CompressedSize);
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+
+    /* A buffer that is one byte too small must be rejected */
+    Status = RtlCompressBuffer(FormatAndEngine, Data, DataSize, Compressed, CompressedSize - 1,
+                               4096, &FinalSize, WorkSpace);
+    ok_ntstatus(Status, STATUS_BUFFER_TOO_SMALL);
+    Status = RtlCompressBuffer(FormatAndEngine, Data, DataSize, Compressed, CompressedSize,
+                               4096, &FinalSize, WorkSpace);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    FinalSize = 0xdeadbeef;
+    Decompressed[DataSize] = 0x55;
+    Status = pRtlDecompressBufferEx(FormatAndEngine & 0xFF, Decompressed, DataSize,
+                                    Compressed, CompressedSize, &FinalSize, DecompressWorkSpace);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_int(FinalSize, DataSize);
+    ok(!memcmp(Decompressed, Data, DataSize), "0x%04x: data mismatch\n", FormatAndEngine);
+    ok_int(Decompressed[DataSize], 0x55);
+
+    /* The allocating variant must agree */
+    FinalSize = 0xdeadbeef;
+    RtlZeroMemory(Decompressed, DataSize);
+    Status = RtlDecompressBuffer(FormatAndEngine & 0xFF, Decompressed, DataSize,
+                                 Compressed, CompressedSize, &FinalSize);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_int(FinalSize, DataSize);
+    ok(!memcmp(Decompressed, Data, DataSize), "0x%04x: data mismatch\n", FormatAndEngine);
+
+Cleanup:
+    if (Decompressed) RtlFreeHeap(RtlGetProcessHeap(), 0, Decompressed);
+    if (Compressed) RtlFreeHeap(RtlGetProcessHeap(), 0, Compressed);
+    if (DecompressWorkSpace) RtlFreeHeap(RtlGetProcessHeap(), 0, DecompressWorkSpace);
+    if (WorkSpace) RtlFreeHeap(RtlGetProcessHeap(), 0, WorkSpace);
+}
+
+/* Compression ratio and throughput of one format, for comparing them */
+static
+VOID
+TestSpeed(USHORT FormatAndEngine, PCSTR Name, PUCHAR Data, ULONG DataSize)
+{
+    ULONG CompressWorkSpaceSize, DecompressWorkSpaceSize;
+    ULONG CompressedSize, FinalSize, Iterations, i;
+    PUCHAR Compressed = NULL, Decompressed = NULL;
+    PVOID WorkSpace = NULL, DecompressWorkSpace = NULL;
+    LARGE_INTEGER Frequency, Start, Middle, End;
+    double CompressSeconds, DecompressSeconds;
+    NTSTATUS Status;
+
+    Status = RtlGetCompressionWorkSpaceSize(FormatAndEngine, &CompressWorkSpaceSize,
+                                            &DecompressWorkSpaceSize);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    /* LZNT1 may store chunks uncompressed, which takes a bit more room */
+    WorkSpace = RtlAllocateHeap(RtlGetProcessHeap(), 0, CompressWorkSpaceSize);
+    DecompressWorkSpace = RtlAllocateHeap(RtlGetProcessHeap(), 0, DecompressWorkSpaceSize + 1);
+    Compressed = RtlAllocateHeap(RtlGetProcessHeap(), 0, DataSize + DataSize / 8 + 4096);
+    Decompressed = RtlAllocateHeap(RtlGetProcessHeap(), 0, DataSize);
+    if (!WorkSpace || !DecompressWorkSpace || !Compressed || !Decompressed)
+    {
+        skip("Out of memory\n");
+        goto Cleanup;
+    }
+
+    Iterations = 10;
+    CompressedSize = 0;
+    FinalSize = 0;
+    QueryPerformanceFrequency(&Frequency);
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < Iterations; i++)
+    {
+        Status = RtlCompressBuffer(FormatAndEngine, Data, DataSize, Compressed,
+                                   DataSize + DataSize / 8 + 4096, 4096, &CompressedSize, WorkSpace);
+        if (!NT_SUCCESS(Status))
+            break;
+    }
+    QueryPerformanceCounter(&Middle);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+
+    for (i = 0; i < Iterations; i++)
+    {
+        Status = pRtlDecompressBufferEx(FormatAndEngine & 0xFF, Decompressed, DataSize,
+                                        Compressed, CompressedSize, &FinalSize, DecompressWorkSpace);
+        if (!NT_SUCCESS(Status))
+            break;
+    }
+    QueryPerformanceCounter(&End);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_int(FinalSize, DataSize);
+    ok(!memcmp(Decompressed, Data, DataSize), "%s: data mismatch\n", Name);
+
+    CompressSeconds = (double)(Middle.QuadPart - Start.QuadPart) / (double)Frequency.QuadPart;
+    DecompressSeconds = (double)(End.QuadPart - Middle.QuadPart) / (double)Frequency.QuadPart;
+    if ((CompressSeconds > 0) && (DecompressSeconds > 0))
+    {
+        trace("%s: %lu -> %lu bytes (%lu%%), compress %.1f MB/s, decompress %.1f MB/s\n",
+              Name, DataSize, CompressedSize, (ULONG)((ULONGLONG)CompressedSize * 100 / DataSize),
+              (double)DataSize * Iterations / (1024 * 1024) / CompressSeconds,
+              (double)DataSize * Iterations / (1024 * 1024) / DecompressSeconds);
+    }
+
+Cleanup:
+    if (Decompressed) RtlFreeHeap(RtlGetProcessHeap(), 0, Decompressed);
+    if (Compressed) RtlFreeHeap(RtlGetProcessHeap(), 0, Compressed);
+    if (DecompressWorkSpace) RtlFreeHeap(RtlGetProcessHeap(), 0, DecompressWorkSpace);
+    if (WorkSpace) RtlFreeHeap(RtlGetProcessHeap(), 0, WorkSpace);
+}
+
+/* Random sentences from a small vocabulary, closer to real text than a repeated one */
+static
+VOID
+FillSpeedData(PUCHAR Data, ULONG DataSize)
+{
+    static const PCSTR Words[] =
+    {
+        "the ", "status ", "buffer ", "of ", "if ", "return ", "NULL", "; ", "(", ") ",
+        "{\n", "}\n", "    ", "Length ", "= ", "0x", "1000", "&", "Irp->", "FileObject ",
+        "Process", "Thread", ", ", "\n"
+    };
+    ULONG Seed = 0x12345678, i = 0;
+    PCSTR Word;
+
+    while (i < DataSize)
+    {
+        Seed = Seed * 1103515245 + 12345;
+        for (Word = Words[(Seed >> 16) % _countof(Words)]; *Word && (i < DataSize); Word++)
+            Data[i++] = *Word;
+    }
+}
+
+START_TEST(RtlDecompressBufferEx)
+{
+    static const CHAR Text[] = "The quick brown fox jumps over the lazy dog. ";
+    UCHAR Output[300];
+    ULONG FinalSize, DataSize, i;
+    PUCHAR Data;
+    NTSTATUS Status;
+
+    pRtlDecompressBufferEx = (PVOID)GetProcAddress(GetModuleHandleW(L"ntdll.dll"),
+                                                   "RtlDecompressBufferEx");
+    if (!pRtlDecompressBufferEx)
+    {
+        win_skip("RtlDecompressBufferEx (NT >= 6.2 API) not available\n");
+        return;
+    }
+
+    /* Reference streams */
+    FinalSize = 0xdeadbeef;
+    Status = pRtlDecompressBufferEx(COMPRESSION_FORMAT_XPRESS, Output, sizeof(Output),
+                                    Alphabet, sizeof(Alphabet) - 1, &FinalSize, NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_int(FinalSize, 26);
+    ok(!memcmp(Output, "abcdefghijklmnopqrstuvwxyz", 26), "Wrong data\n");
+
+    FinalSize = 0xdeadbeef;
+    Status = pRtlDecompressBufferEx(COMPRESSION_FORMAT_XPRESS, Output, sizeof(Output),
+                                    Repeated, sizeof(Repeated), &FinalSize, NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_int(FinalSize, 300);
+    for (i = 0; i < 300; i++)
+    {
+        if (Output[i] != "abc"[i % 3])
+            break;
+    }
+    ok_int(i, 300);
+
+    Status = pRtlDecompressBufferEx(COMPRESSION_FORMAT_XPRESS, Output, sizeof(Output),
+                                    BadOffset, sizeof(BadOffset), &FinalSize, NULL);
+    ok_ntstatus(Status, STATUS_BAD_COMPRESSION_BUFFER);
+
+    Status = pRtlDecompressBufferEx(COMPRESSION_FORMAT_NONE, Output, sizeof(Output),
+                                    Alphabet, sizeof(Alphabet) - 1, &FinalSize, NULL);
+    ok_ntstatus(Status, STATUS_INVALID_PARAMETER);
+
+    /* Some text with a few variations, large enough for several Huffman blocks */
+    DataSize = 300000;
+    Data = RtlAllocateHeap(RtlGetProcessHeap(), 0, DataSize);
+    if (!Data)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    for (i = 0; i < DataSize; i++)
+        Data[i] = Text[i % (sizeof(Text) - 1)] + ((i % 1021) == 0);
+
+    TestRoundTrip(COMPRESSION_FORMAT_XPRESS, Data, DataSize);
+    TestRoundTrip(COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_MAXIMUM, Data, DataSize);
+    TestRoundTrip(COMPRESSION_FORMAT_XPRESS_HUFF, Data, DataSize);
+    TestRoundTrip(COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_MAXIMUM, Data, DataSize);
+
+    /* Exactly one Huffman block, the end marker goes into a block of its own */
+    TestRoundTrip(COMPRESSION_FORMAT_XPRESS_HUFF, Data, 0x10000);
+
+    /* Compare the formats on the same data */
+    FillSpeedData(Data, DataSize);
+    TestSpeed(COMPRESSION_FORMAT_LZNT1, "LZNT1", Data, DataSize);
+    TestSpeed(COMPRESSION_FORMAT_XPRESS, "XPRESS", Data, DataSize);
+    TestSpeed(COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_MAXIMUM, "XPRESS max", Data, DataSize);
+    TestSpeed(COMPRESSION_FORMAT_XPRESS_HUFF, "XPRESS Huffman", Data, DataSize);
+    TestSpeed(COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_MAXIMUM, "XPRESS Huffman max", Data, DataSize);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Data);
+}
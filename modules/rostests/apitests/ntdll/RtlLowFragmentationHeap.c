@@ -0,0 +1,248 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test and benchmark for the low fragmentation heap
+ */
+
+#include "precomp.h"
+
+#define TEST_THREADS        8
+#define TEST_FRONT_END_LFH  2
+#define TEST_ITERATIONS     200000
+#define TEST_LIVE_BLOCKS    64
+#define TEST_MAX_SIZE       512
+
+typedef struct _TEST_CONTEXT
+{
+    PVOID HeapHandle;
+    ULONG Seed;
+    ULONG Failures;
+} TEST_CONTEXT, *PTEST_CONTEXT;
+
+static
+ULONG
+NextRandom(PULONG Seed)
+{
+    /* Simple LCG, we only want reproducible sizes */
+    *Seed = *Seed * 1103515245 + 12345;
+    return *Seed >> 8;
+}
+
+static
+ULONG
+QueryFrontEndHeapType(PVOID HeapHandle)
+{
+    ULONG Type = 0xdeadbeef;
+    NTSTATUS Status;
+
+    Status = RtlQueryHeapInformation(HeapHandle, HeapCompatibilityInformation, &Type, sizeof(Type), NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    return Type;
+}
+
+static
+DWORD
+WINAPI
+AllocFreeThread(PVOID Parameter)
+{
+    PTEST_CONTEXT Context = Parameter;
+    PUCHAR Blocks[TEST_LIVE_BLOCKS] = { NULL };
+    SIZE_T Sizes[TEST_LIVE_BLOCKS] = { 0 };
+    ULONG i, Slot;
+
+    for (i = 0; i < TEST_ITERATIONS; i++)
+    {
+        Slot = NextRandom(&Context->Seed) % TEST_LIVE_BLOCKS;
+
+        if (Blocks[Slot])
+        {
+            /* Check the block wasn't handed out to someone else meanwhile */
+            if (Blocks[Slot][0] != (UCHAR)Slot || Blocks[Slot][Sizes[Slot] - 1] != (UCHAR)Slot)
+                Context->Failures++;
+            if (!RtlFreeHeap(Context->HeapHandle, 0, Blocks[Slot]))
+                Context->Failures++;
+        }
+
+        Sizes[Slot] = 1 + NextRandom(&Context->Seed) % TEST_MAX_SIZE;
+        Blocks[Slot] = RtlAllocateHeap(Context->HeapHandle, 0, Sizes[Slot]);
+        if (!Blocks[Slot])
+        {
+            Context->Failures++;
+            continue;
+        }
+        Blocks[Slot][0] = (UCHAR)Slot;
+        Blocks[Slot][Sizes[Slot] - 1] = (UCHAR)Slot;
+    }
+
+    for (Slot = 0; Slot < TEST_LIVE_BLOCKS; Slot++)
+    {
+        if (Blocks[Slot] && !RtlFreeHeap(Context->HeapHandle, 0, Blocks[Slot]))
+            Context->Failures++;
+    }
+
+    return 0;
+}
+
+static
+VOID
+RunBenchmark(PVOID HeapHandle, PCSTR Name)
+{
+    TEST_CONTEXT Contexts[TEST_THREADS];
+    HANDLE Threads[TEST_THREADS];
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG i, Started = 0, Failures = 0;
+    double Seconds;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    for (i = 0; i < TEST_THREADS; i++)
+    {
+        Contexts[i].HeapHandle = HeapHandle;
+        Contexts[i].Seed = 0x12345678 + i;
+        Contexts[i].Failures = 0;
+        Threads[Started] = CreateThread(NULL, 0, AllocFreeThread, &Contexts[i], 0, NULL);
+        ok(Threads[Started] != NULL, "CreateThread failed: %lu\n", GetLastError());
+        if (Threads[Started]) Started++;
+    }
+
+    WaitForMultipleObjects(Started, Threads, TRUE, INFINITE);
+    QueryPerformanceCounter(&End);
+
+    for (i = 0; i < Started; i++)
+    {
+        CloseHandle(Threads[i]);
+        Failures += Contexts[i].Failures;
+    }
+    ok(Failures == 0, "%s: %lu failures\n", Name, Failures);
+
+    Seconds = (double)(End.QuadPart - Start.QuadPart) / (double)Frequency.QuadPart;
+    if (Seconds > 0)
+    {
+        trace("%s: %lu threads, %u alloc/free pairs each: %.3f s, %.0f pairs/s, front end %lu\n",
+              Name, Started, TEST_ITERATIONS, Seconds,
+              (Started * (double)TEST_ITERATIONS) / Seconds, QueryFrontEndHeapType(HeapHandle));
+    }
+}
+
+static
+VOID
+TestBlocks(PVOID HeapHandle)
+{
+    PUCHAR Blocks[TEST_MAX_SIZE + 1];
+    PUCHAR NewBlock;
+    SIZE_T Size;
+    ULONG i;
+
+    for (Size = 0; Size <= TEST_MAX_SIZE; Size++)
+    {
+        Blocks[Size] = RtlAllocateHeap(HeapHandle, HEAP_ZERO_MEMORY, Size);
+        ok(Blocks[Size] != NULL, "Allocation of %Iu bytes failed\n", Size);
+        if (!Blocks[Size]) continue;
+
+        ok(((ULONG_PTR)Blocks[Size] & (sizeof(PVOID) * 2 - 1)) == 0, "Block %p is misaligned\n", Blocks[Size]);
+        ok(RtlSizeHeap(HeapHandle, 0, Blocks[Size]) == Size, "Wrong size for a block of %Iu bytes\n", Size);
+        ok(RtlValidateHeap(HeapHandle, 0, Blocks[Size]), "Block of %Iu bytes is invalid\n", Size);
+        for (i = 0; i < Size; i++)
+        {
+            if (Blocks[Size][i] != 0)
+            {
+                ok(0, "Block of %Iu bytes isn't zeroed at %lu\n", Size, i);
+                break;
+            }
+        }
+        RtlFillMemory(Blocks[Size], Size, (UCHAR)Size);
+    }
+
+    /* Blocks must not overlap */
+    for (Size = 0; Size <= TEST_MAX_SIZE; Size++)
+    {
+        if (!Blocks[Size]) continue;
+        for (i = 0; i < Size; i++)
+        {
+            if (Blocks[Size][i] != (UCHAR)Size)
+            {
+                ok(0, "Block of %Iu bytes was overwritten at %lu\n", Size, i);
+                break;
+            }
+        }
+    }
+
+    /* Grow and shrink a few of them */
+    for (Size = 1; Size <= TEST_MAX_SIZE; Size *= 2)
+    {
+        if (!Blocks[Size]) continue;
+
+        NewBlock = RtlReAllocateHeap(HeapHandle, HEAP_ZERO_MEMORY, Blocks[Size], Size * 3);
+        ok(NewBlock != NULL, "Growing a block of %Iu bytes failed\n", Size);
+        if (!NewBlock) continue;
+        Blocks[Size] = NewBlock;
+        ok(RtlSizeHeap(HeapHandle, 0, NewBlock) == Size * 3, "Wrong size after growing a block of %Iu bytes\n", Size);
+        ok(NewBlock[0] == (UCHAR)Size && NewBlock[Size - 1] == (UCHAR)Size, "Content lost growing a block of %Iu bytes\n", Size);
+        ok(NewBlock[Size] == 0 && NewBlock[Size * 3 - 1] == 0, "Growing a block of %Iu bytes didn't zero it\n", Size);
+
+        NewBlock = RtlReAllocateHeap(HeapHandle, 0, Blocks[Size], Size);
+        ok(NewBlock != NULL, "Shrinking a block of %Iu bytes failed\n", Size);
+        if (!NewBlock) continue;
+        Blocks[Size] = NewBlock;
+        ok(RtlSizeHeap(HeapHandle, 0, NewBlock) == Size, "Wrong size after shrinking a block of %Iu bytes\n", Size);
+        ok(NewBlock[0] == (UCHAR)Size && NewBlock[Size - 1] == (UCHAR)Size, "Content lost shrinking a block of %Iu bytes\n", Size);
+    }
+
+    for (Size = 0; Size <= TEST_MAX_SIZE; Size++)
+    {
+        if (Blocks[Size])
+            ok(RtlFreeHeap(HeapHandle, 0, Blocks[Size]), "Freeing a block of %Iu bytes failed\n", Size);
+    }
+
+    ok(RtlValidateHeap(HeapHandle, 0, NULL), "Heap is invalid\n");
+}
+
+START_TEST(RtlLowFragmentationHeap)
+{
+    PVOID HeapHandle;
+    ULONG Type;
+    NTSTATUS Status;
+
+    /* Heaps without serialization can't have a front end */
+    HeapHandle = RtlCreateHeap(HEAP_GROWABLE | HEAP_NO_SERIALIZE, NULL, 0, 0, NULL, NULL);
+    ok(HeapHandle != NULL, "RtlCreateHeap failed\n");
+    if (HeapHandle)
+    {
+        Type = TEST_FRONT_END_LFH;
+        Status = RtlSetHeapInformation(HeapHandle, HeapCompatibilityInformation, &Type, sizeof(Type));
+        ok(!NT_SUCCESS(Status), "Enabling the LFH of a HEAP_NO_SERIALIZE heap returned 0x%lx\n", Status);
+        ok_long(QueryFrontEndHeapType(HeapHandle), 0);
+        RtlDestroyHeap(HeapHandle);
+    }
+
+    /* The back end alone, until the heuristics enable the front end */
+    HeapHandle = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    ok(HeapHandle != NULL, "RtlCreateHeap failed\n");
+    if (!HeapHandle)
+        return;
+    ok_long(QueryFrontEndHeapType(HeapHandle), 0);
+    TestBlocks(HeapHandle);
+    RunBenchmark(HeapHandle, "Default heap");
+    RtlDestroyHeap(HeapHandle);
+
+    /* The front end from the start */
+    HeapHandle = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    ok(HeapHandle != NULL, "RtlCreateHeap failed\n");
+    if (!HeapHandle)
+        return;
+
+    Type = 1;
+    Status = RtlSetHeapInformation(HeapHandle, HeapCompatibilityInformation, &Type, sizeof(Type));
+    ok_ntstatus(Status, STATUS_UNSUCCESSFUL);
+
+    Type = TEST_FRONT_END_LFH;
+    Status = RtlSetHeapInformation(HeapHandle, HeapCompatibilityInformation, &Type, sizeof(Type));
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_long(QueryFrontEndHeapType(HeapHandle), TEST_FRONT_END_LFH);
+
+    TestBlocks(HeapHandle);
+    RunBenchmark(HeapHandle, "LFH heap");
+    ok_long(QueryFrontEndHeapType(HeapHandle), TEST_FRONT_END_LFH);
+    RtlDestroyHeap(HeapHandle);
+}
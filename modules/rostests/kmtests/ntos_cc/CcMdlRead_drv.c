@@ -0,0 +1,389 @@
+/*
+ * PROJECT:         ReactOS kernel-mode tests
+ * LICENSE:         LGPLv2.1+ - See COPYING.LIB in the top level directory
+ * PURPOSE:         Test driver for CcMdlRead and CcPrepareMdlWrite functions
+ */
+
+#include <kmt_test.h>
+
+#define NDEBUG
+#include <debug.h>
+
+#define TEST_FILE_SIZE 1000000
+
+typedef struct _TEST_FCB
+{
+    FSRTL_ADVANCED_FCB_HEADER Header;
+    SECTION_OBJECT_POINTERS SectionObjectPointers;
+    FAST_MUTEX HeaderMutex;
+} TEST_FCB, *PTEST_FCB;
+
+static PFILE_OBJECT TestFileObject;
+static PDEVICE_OBJECT TestDeviceObject;
+static KMT_IRP_HANDLER TestIrpHandler;
+static FAST_IO_DISPATCH TestFastIoDispatch;
+
+static
+BOOLEAN
+NTAPI
+FastIoRead(
+    _In_ PFILE_OBJECT FileObject,
+    _In_ PLARGE_INTEGER FileOffset,
+    _In_ ULONG Length,
+    _In_ BOOLEAN Wait,
+    _In_ ULONG LockKey,
+    _Out_ PVOID Buffer,
+    _Out_ PIO_STATUS_BLOCK IoStatus,
+    _In_ PDEVICE_OBJECT DeviceObject)
+{
+    IoStatus->Status = STATUS_NOT_SUPPORTED;
+    return FALSE;
+}
+
+NTSTATUS
+TestEntry(
+    _In_ PDRIVER_OBJECT DriverObject,
+    _In_ PCUNICODE_STRING RegistryPath,
+    _Out_ PCWSTR *DeviceName,
+    _Inout_ INT *Flags)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    PAGED_CODE();
+
+    UNREFERENCED_PARAMETER(RegistryPath);
+
+    *DeviceName = L"CcMdlRead";
+    *Flags = TESTENTRY_NO_EXCLUSIVE_DEVICE |
+             TESTENTRY_BUFFERED_IO_DEVICE |
+             TESTENTRY_NO_READONLY_DEVICE;
+
+    KmtRegisterIrpHandler(IRP_MJ_CLEANUP, NULL, TestIrpHandler);
+    KmtRegisterIrpHandler(IRP_MJ_CREATE, NULL, TestIrpHandler);
+    KmtRegisterIrpHandler(IRP_MJ_READ, NULL, TestIrpHandler);
+    KmtRegisterIrpHandler(IRP_MJ_WRITE, NULL, TestIrpHandler);
+
+    TestFastIoDispatch.FastIoRead = FastIoRead;
+    DriverObject->FastIoDispatch = &TestFastIoDispatch;
+
+    return Status;
+}
+
+VOID
+TestUnload(
+    _In_ PDRIVER_OBJECT DriverObject)
+{
+    PAGED_CODE();
+}
+
+BOOLEAN
+NTAPI
+AcquireForLazyWrite(
+    _In_ PVOID Context,
+    _In_ BOOLEAN Wait)
+{
+    return TRUE;
+}
+
+VOID
+NTAPI
+ReleaseFromLazyWrite(
+    _In_ PVOID Context)
+{
+    return;
+}
+
+BOOLEAN
+NTAPI
+AcquireForReadAhead(
+    _In_ PVOID Context,
+    _In_ BOOLEAN Wait)
+{
+    return TRUE;
+}
+
+VOID
+NTAPI
+ReleaseFromReadAhead(
+    _In_ PVOID Context)
+{
+    return;
+}
+
+static CACHE_MANAGER_CALLBACKS Callbacks = {
+    AcquireForLazyWrite,
+    ReleaseFromLazyWrite,
+    AcquireForReadAhead,
+    ReleaseFromReadAhead,
+};
+
+static
+PVOID
+MapAndLockUserBuffer(
+    _In_ _Out_ PIRP Irp,
+    _In_ ULONG BufferLength,
+    _In_ LOCK_OPERATION Operation)
+{
+    PMDL Mdl;
+
+    if (Irp->MdlAddress == NULL)
+    {
+        Mdl = IoAllocateMdl(Irp->UserBuffer, BufferLength, FALSE, FALSE, Irp);
+        if (Mdl == NULL)
+        {
+            return NULL;
+        }
+
+        _SEH2_TRY
+        {
+            MmProbeAndLockPages(Mdl, Irp->RequestorMode, Operation);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            IoFreeMdl(Mdl);
+            Irp->MdlAddress = NULL;
+            _SEH2_YIELD(return NULL);
+        }
+        _SEH2_END;
+    }
+
+    return MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority);
+}
+
+static
+BOOLEAN
+CheckMdlContent(
+    _In_ PMDL Mdl,
+    _In_ UCHAR Expected)
+{
+    PUCHAR Buffer;
+    ULONG i;
+
+    Buffer = MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority);
+    ok(Buffer != NULL, "Null pointer!\n");
+    if (!Buffer)
+        return FALSE;
+
+    for (i = 0; i < MmGetMdlByteCount(Mdl); ++i)
+    {
+        if (Buffer[i] != Expected)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+VOID
+Test_CcMdlRead(PFILE_OBJECT FileObject)
+{
+    LARGE_INTEGER Offset;
+    IO_STATUS_BLOCK IoStatus;
+    PMDL MdlChain, Mdl;
+    ULONG Length;
+    ULONG Count;
+    PUCHAR Buffer;
+    UCHAR ReadBuffer[10];
+    BOOLEAN Ret;
+
+    /* Nothing to read gives an empty chain */
+    MdlChain = NULL;
+    Offset.QuadPart = 0;
+    memset(&IoStatus, 0xAB, sizeof(IoStatus));
+    KmtStartSeh()
+        CcMdlRead(FileObject, &Offset, 0, &MdlChain, &IoStatus);
+    KmtEndSeh(STATUS_SUCCESS);
+    ok_eq_pointer(MdlChain, NULL);
+    ok_eq_hex(IoStatus.Status, STATUS_SUCCESS);
+    ok_eq_ulongptr(IoStatus.Information, 0);
+
+    /* Reading across a view boundary gives one MDL per view */
+    MdlChain = NULL;
+    Offset.QuadPart = 3;
+    memset(&IoStatus, 0xAB, sizeof(IoStatus));
+    KmtStartSeh()
+        CcMdlRead(FileObject, &Offset, 300000, &MdlChain, &IoStatus);
+    KmtEndSeh(STATUS_SUCCESS);
+    ok_eq_hex(IoStatus.Status, STATUS_SUCCESS);
+    ok_eq_ulongptr(IoStatus.Information, 300000);
+    ok(MdlChain != NULL, "Null pointer for MDL!\n");
+
+    Length = 0;
+    Count = 0;
+    for (Mdl = MdlChain; Mdl; Mdl = Mdl->Next)
+    {
+        ok((Mdl->MdlFlags & MDL_PAGES_LOCKED) != 0, "MDL not locked\n");
+        ok(CheckMdlContent(Mdl, 0xBA), "Unexpected data in MDL %lu\n", Count);
+        Length += MmGetMdlByteCount(Mdl);
+        ++Count;
+    }
+    ok_eq_ulong(Length, 300000);
+    ok_eq_ulong(Count, 2);
+    if (MdlChain)
+    {
+        ok_eq_ulong(MmGetMdlByteCount(MdlChain), VACB_MAPPING_GRANULARITY - 3);
+        CcMdlReadComplete(FileObject, MdlChain);
+    }
+
+    /* Write through an MDL, and read it back from the cache */
+    MdlChain = NULL;
+    Offset.QuadPart = PAGE_SIZE;
+    memset(&IoStatus, 0xAB, sizeof(IoStatus));
+    KmtStartSeh()
+        CcPrepareMdlWrite(FileObject, &Offset, sizeof(ReadBuffer), &MdlChain, &IoStatus);
+    KmtEndSeh(STATUS_SUCCESS);
+    ok_eq_hex(IoStatus.Status, STATUS_SUCCESS);
+    ok_eq_ulongptr(IoStatus.Information, sizeof(ReadBuffer));
+    ok(MdlChain != NULL, "Null pointer for MDL!\n");
+    if (MdlChain)
+    {
+        ok_eq_pointer(MdlChain->Next, NULL);
+        ok_eq_ulong(MmGetMdlByteCount(MdlChain), sizeof(ReadBuffer));
+
+        Buffer = MmGetSystemAddressForMdlSafe(MdlChain, NormalPagePriority);
+        ok(Buffer != NULL, "Null pointer!\n");
+        if (Buffer)
+            RtlFillMemory(Buffer, sizeof(ReadBuffer), 0xCD);
+
+        CcMdlWriteComplete(FileObject, &Offset, MdlChain);
+    }
+
+    memset(ReadBuffer, 0, sizeof(ReadBuffer));
+    Ret = CcCopyRead(FileObject, &Offset, sizeof(ReadBuffer), TRUE, ReadBuffer, &IoStatus);
+    ok_bool_true(Ret, "CcCopyRead should succeed\n");
+    ok_eq_hex(ReadBuffer[0], 0xCD);
+    ok_eq_hex(ReadBuffer[sizeof(ReadBuffer) - 1], 0xCD);
+
+    /* An aborted write leaves the chain unused and gets rid of it */
+    MdlChain = NULL;
+    Offset.QuadPart = PAGE_SIZE * 2;
+    KmtStartSeh()
+        CcPrepareMdlWrite(FileObject, &Offset, PAGE_SIZE, &MdlChain, &IoStatus);
+    KmtEndSeh(STATUS_SUCCESS);
+    ok(MdlChain != NULL, "Null pointer for MDL!\n");
+    if (MdlChain)
+        CcMdlWriteAbort(FileObject, MdlChain);
+}
+
+static
+NTSTATUS
+TestIrpHandler(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp,
+    _In_ PIO_STACK_LOCATION IoStack)
+{
+    LARGE_INTEGER Zero = RTL_CONSTANT_LARGE_INTEGER(0LL);
+    NTSTATUS Status;
+    PTEST_FCB Fcb;
+    CACHE_UNINITIALIZE_EVENT CacheUninitEvent;
+
+    PAGED_CODE();
+
+    DPRINT("IRP %x/%x\n", IoStack->MajorFunction, IoStack->MinorFunction);
+    ASSERT(IoStack->MajorFunction == IRP_MJ_CLEANUP ||
+           IoStack->MajorFunction == IRP_MJ_CREATE ||
+           IoStack->MajorFunction == IRP_MJ_READ ||
+           IoStack->MajorFunction == IRP_MJ_WRITE);
+
+    Status = STATUS_NOT_SUPPORTED;
+    Irp->IoStatus.Information = 0;
+
+    if (IoStack->MajorFunction == IRP_MJ_CREATE)
+    {
+        ok_irql(PASSIVE_LEVEL);
+
+        if (IoStack->FileObject->FileName.Length >= 2 * sizeof(WCHAR))
+        {
+            TestDeviceObject = DeviceObject;
+            TestFileObject = IoStack->FileObject;
+        }
+        Fcb = ExAllocatePoolWithTag(NonPagedPool, sizeof(*Fcb), 'FwrI');
+        RtlZeroMemory(Fcb, sizeof(*Fcb));
+        ExInitializeFastMutex(&Fcb->HeaderMutex);
+        FsRtlSetupAdvancedHeader(&Fcb->Header, &Fcb->HeaderMutex);
+        Fcb->Header.AllocationSize.QuadPart = TEST_FILE_SIZE;
+        Fcb->Header.FileSize.QuadPart = TEST_FILE_SIZE;
+        Fcb->Header.ValidDataLength.QuadPart = TEST_FILE_SIZE;
+        Fcb->Header.IsFastIoPossible = FastIoIsNotPossible;
+        IoStack->FileObject->FsContext = Fcb;
+        IoStack->FileObject->SectionObjectPointer = &Fcb->SectionObjectPointers;
+
+        CcInitializeCacheMap(IoStack->FileObject,
+                             (PCC_FILE_SIZES)&Fcb->Header.AllocationSize,
+                             FALSE, &Callbacks, NULL);
+
+        Irp->IoStatus.Information = FILE_OPENED;
+        Status = STATUS_SUCCESS;
+    }
+    else if (IoStack->MajorFunction == IRP_MJ_READ)
+    {
+        ULONG Length;
+        PVOID Buffer;
+        LARGE_INTEGER Offset;
+
+        Offset = IoStack->Parameters.Read.ByteOffset;
+        Length = IoStack->Parameters.Read.Length;
+
+        ok_eq_pointer(DeviceObject, TestDeviceObject);
+        ok_eq_pointer(IoStack->FileObject, TestFileObject);
+
+        if (!FlagOn(Irp->Flags, IRP_NOCACHE))
+        {
+            ok_irql(PASSIVE_LEVEL);
+
+            Test_CcMdlRead(IoStack->FileObject);
+            Status = STATUS_SUCCESS;
+        }
+        else
+        {
+            ok((Offset.QuadPart % PAGE_SIZE == 0 || Offset.QuadPart == 0), "Offset is not aligned: %I64i\n", Offset.QuadPart);
+            ok(Length % PAGE_SIZE == 0, "Length is not aligned: %I64i\n", Length);
+
+            Buffer = MapAndLockUserBuffer(Irp, Length, IoWriteAccess);
+            ok(Buffer != NULL, "Null pointer!\n");
+            if (Buffer)
+                RtlFillMemory(Buffer, Length, 0xBA);
+
+            Status = STATUS_SUCCESS;
+        }
+
+        if (NT_SUCCESS(Status))
+        {
+            Irp->IoStatus.Information = Length;
+            IoStack->FileObject->CurrentByteOffset.QuadPart = Offset.QuadPart + Length;
+        }
+    }
+    else if (IoStack->MajorFunction == IRP_MJ_WRITE)
+    {
+        /* Only the lazy writer comes here, pretend the data hit the disk */
+        ok(FlagOn(Irp->Flags, IRP_NOCACHE), "Cached write!\n");
+
+        Irp->IoStatus.Information = IoStack->Parameters.Write.Length;
+        Status = STATUS_SUCCESS;
+    }
+    else if (IoStack->MajorFunction == IRP_MJ_CLEANUP)
+    {
+        ok_irql(PASSIVE_LEVEL);
+        KeInitializeEvent(&CacheUninitEvent.Event, NotificationEvent, FALSE);
+        CcUninitializeCacheMap(IoStack->FileObject, &Zero, &CacheUninitEvent);
+        KeWaitForSingleObject(&CacheUninitEvent.Event, Executive, KernelMode, FALSE, NULL);
+        Fcb = IoStack->FileObject->FsContext;
+        ExFreePoolWithTag(Fcb, 'FwrI');
+        IoStack->FileObject->FsContext = NULL;
+        Status = STATUS_SUCCESS;
+    }
+
+    if (Status == STATUS_PENDING)
+    {
+        IoMarkIrpPending(Irp);
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+        Status = STATUS_PENDING;
+    }
+    else
+    {
+        Irp->IoStatus.Status = Status;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+    }
+
+    return Status;
+}
@@ -305,6 +305,136 @@ TestBigPoolExpansion(VOID)
     }
 }
 
+#define STRESS_THREADS 32
+#define STRESS_SLOTS 64
+#define STRESS_ITERATIONS 20000
+
+typedef struct _STRESS_THREAD_DATA
+{
+    PKTHREAD Thread;
+    ULONG Number;
+    POOL_TYPE PoolType;
+    PKEVENT StartEvent;
+    PVOID volatile *Slots;
+    ULONG Allocations;
+    ULONG Corruptions;
+} STRESS_THREAD_DATA, *PSTRESS_THREAD_DATA;
+
+static
+VOID
+NTAPI
+StressPoolThread(
+    _In_ PVOID Context)
+{
+    PSTRESS_THREAD_DATA ThreadData = Context;
+    PULONG Block, Previous;
+    ULONG Size, Slot, i;
+
+    KeSetSystemAffinityThread((KAFFINITY)1 << ThreadData->Number);
+    KeWaitForSingleObject(ThreadData->StartEvent, Executive, KernelMode, FALSE, NULL);
+
+    for (i = 0; i < STRESS_ITERATIONS; i++)
+    {
+        /* Stay clear of the lookaside lists so that we really hit the pool */
+        Size = 300 + ((i * 37 + ThreadData->Number * 101) % 1500);
+        Block = ExAllocatePoolWithTag(ThreadData->PoolType, Size, TAG_POOLTEST);
+        if (!Block)
+            continue;
+        ThreadData->Allocations++;
+        Block[0] = Size;
+        Block[Size / sizeof(ULONG) - 1] = ~Size;
+
+        /* Swap it with whatever another processor left there, and free that */
+        Slot = (i + ThreadData->Number * 7) % STRESS_SLOTS;
+        Previous = InterlockedExchangePointer(&ThreadData->Slots[Slot], Block);
+        if (Previous)
+        {
+            if (Previous[Previous[0] / sizeof(ULONG) - 1] != ~Previous[0])
+                ThreadData->Corruptions++;
+            ExFreePoolWithTag(Previous, TAG_POOLTEST);
+        }
+    }
+
+    KeRevertToUserAffinityThread();
+}
+
+static
+VOID
+TestCrossProcessorStress(VOID)
+{
+    PSTRESS_THREAD_DATA ThreadData;
+    PVOID volatile *Slots;
+    KEVENT StartEvent;
+    POOL_TYPE PoolType;
+    LARGE_INTEGER Start, End, Frequency;
+    ULONG ThreadCount, Allocations, i;
+    ULONGLONG Microseconds;
+
+    ThreadCount = min((ULONG)KeNumberProcessors, STRESS_THREADS);
+    ThreadData = ExAllocatePoolWithTag(NonPagedPool, ThreadCount * sizeof(*ThreadData), 'TSmK');
+    Slots = ExAllocatePoolWithTag(NonPagedPool, STRESS_SLOTS * sizeof(*Slots), 'TSmK');
+    if (skip(ThreadData != NULL && Slots != NULL, "Out of memory\n"))
+    {
+        if (ThreadData)
+            ExFreePoolWithTag(ThreadData, 'TSmK');
+        if (Slots)
+            ExFreePoolWithTag((PVOID)Slots, 'TSmK');
+        return;
+    }
+
+    for (PoolType = NonPagedPool; PoolType <= PagedPool; PoolType++)
+    {
+        KeInitializeEvent(&StartEvent, NotificationEvent, FALSE);
+        RtlZeroMemory((PVOID)Slots, STRESS_SLOTS * sizeof(*Slots));
+        RtlZeroMemory(ThreadData, ThreadCount * sizeof(*ThreadData));
+        for (i = 0; i < ThreadCount; i++)
+        {
+            ThreadData[i].Number = i;
+            ThreadData[i].PoolType = PoolType;
+            ThreadData[i].StartEvent = &StartEvent;
+            ThreadData[i].Slots = Slots;
+            ThreadData[i].Thread = KmtStartThread(StressPoolThread, &ThreadData[i]);
+        }
+
+        /* Let them all go at once */
+        Start = KeQueryPerformanceCounter(&Frequency);
+        KeSetEvent(&StartEvent, IO_NO_INCREMENT, FALSE);
+        for (i = 0; i < ThreadCount; i++)
+        {
+            KmtFinishThread(ThreadData[i].Thread, NULL);
+        }
+        End = KeQueryPerformanceCounter(NULL);
+
+        Allocations = 0;
+        for (i = 0; i < ThreadCount; i++)
+        {
+            ok(ThreadData[i].Corruptions == 0,
+               "[%d] Thread %lu found %lu corrupted blocks\n",
+               PoolType, i, ThreadData[i].Corruptions);
+            Allocations += ThreadData[i].Allocations;
+        }
+        ok(Allocations != 0, "[%d] No allocation succeeded\n", PoolType);
+
+        /* Free what is left over */
+        for (i = 0; i < STRESS_SLOTS; i++)
+        {
+            if (Slots[i])
+                ExFreePoolWithTag(Slots[i], TAG_POOLTEST);
+        }
+
+        Microseconds = (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart;
+        trace("PoolType %d: %lu allocations on %lu processors in %I64u us (%I64u per second)\n",
+              PoolType,
+              Allocations,
+              ThreadCount,
+              Microseconds,
+              Microseconds ? (ULONGLONG)Allocations * 1000000 / Microseconds : 0ULL);
+    }
+
+    ExFreePoolWithTag((PVOID)Slots, 'TSmK');
+    ExFreePoolWithTag(ThreadData, 'TSmK');
+}
+
 START_TEST(ExPools)
 {
     PoolsTest();
@@ -312,4 +442,5 @@ START_TEST(ExPools)
     TestPoolTags();
     TestPoolQuota();
     TestBigPoolExpansion();
+    TestCrossProcessorStress();
 }
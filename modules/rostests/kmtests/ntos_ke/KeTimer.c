@@ -47,6 +47,48 @@ TestTimerFunctional(
     CheckTimer(Timer, TimerNotificationObject + Type, 0L, FALSE, OriginalIrql, (PVOID *)NULL, 0);
 }
 
+typedef BOOLEAN (NTAPI *PKE_SET_COALESCABLE_TIMER)(PKTIMER, LARGE_INTEGER, ULONG, ULONG, PKDPC);
+
+static
+VOID
+TestCoalescableTimer(VOID)
+{
+    static UNICODE_STRING RoutineName = RTL_CONSTANT_STRING(L"KeSetCoalescableTimer");
+    PKE_SET_COALESCABLE_TIMER pKeSetCoalescableTimer;
+    KTIMER Timer;
+    LARGE_INTEGER DueTime, Timeout;
+    ULONGLONG Start;
+    NTSTATUS Status;
+
+    pKeSetCoalescableTimer = MmGetSystemRoutineAddress(&RoutineName);
+    if (skip(pKeSetCoalescableTimer != NULL, "KeSetCoalescableTimer unavailable\n"))
+        return;
+
+    /* Ask for 10ms, but tolerate up to one second */
+    KeInitializeTimerEx(&Timer, NotificationTimer);
+    DueTime.QuadPart = -10 * 1000 * 10;
+    Start = KeQueryInterruptTime();
+    ok_bool_false(pKeSetCoalescableTimer(&Timer, DueTime, 0, 1000, NULL), "KeSetCoalescableTimer returned");
+    ok_eq_long(KeReadStateTimer(&Timer), 0L);
+    ok(Timer.DueTime.QuadPart >= Start + 10 * 1000 * 10,
+       "DueTime %I64u is too early\n", Timer.DueTime.QuadPart);
+    ok(Timer.DueTime.QuadPart <= KeQueryInterruptTime() + 10 * 1000 * 10 + 1000 * 1000 * 10,
+       "DueTime %I64u is later than tolerated\n", Timer.DueTime.QuadPart);
+
+    /* It must still expire within its tolerance */
+    Timeout.QuadPart = -2000 * 1000 * 10;
+    Status = KeWaitForSingleObject(&Timer, Executive, KernelMode, FALSE, &Timeout);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    ok_eq_long(KeReadStateTimer(&Timer), 1L);
+    ok_bool_false(KeCancelTimer(&Timer), "KeCancelTimer returned");
+
+    /* Setting it again while pending reports it as inserted */
+    DueTime.QuadPart = -60 * 1000 * 1000 * 10LL;
+    ok_bool_false(pKeSetCoalescableTimer(&Timer, DueTime, 0, 250, NULL), "KeSetCoalescableTimer returned");
+    ok_bool_true(pKeSetCoalescableTimer(&Timer, DueTime, 0, 0, NULL), "KeSetCoalescableTimer returned");
+    ok_bool_true(KeCancelTimer(&Timer), "KeCancelTimer returned");
+}
+
 START_TEST(KeTimer)
 {
     KTIMER Timer;
@@ -54,6 +96,8 @@ START_TEST(KeTimer)
     KIRQL Irqls[] = { PASSIVE_LEVEL, APC_LEVEL, DISPATCH_LEVEL, HIGH_LEVEL };
     INT i;
 
+    TestCoalescableTimer();
+
     for (i = 0; i < sizeof Irqls / sizeof Irqls[0]; ++i)
     {
         /* DRIVER_IRQL_NOT_LESS_OR_EQUAL (TODO: on MP only?) */
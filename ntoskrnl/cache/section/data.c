@@ -55,7 +55,7 @@ the overall mapped file.  Temporarily unmapping the file has no effect on the
 section membership.
 
 This necessitates a change in the section page table implementation, which is
-now an RtlGenericTable.  This will be elaborated more in sptab.c.  One upshot
+now a sparse radix tree.  This will be elaborated more in sptab.c.  One upshot
 of this change is that a mapping of a small files takes a bit more than 1/4
 of the size in nonpaged kernel space as it did previously.
 
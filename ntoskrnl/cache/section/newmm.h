@@ -30,6 +30,16 @@ typedef struct _CACHE_SECTION_PAGE_TABLE
     ULONG_PTR PageEntries[ENTRIES_PER_ELEMENT];
 } CACHE_SECTION_PAGE_TABLE, *PCACHE_SECTION_PAGE_TABLE;
 
+/* The page tables of a segment hang off a radix tree indexed by file offset */
+#define PAGE_NODE_SHIFT 6
+#define ENTRIES_PER_NODE (1 << PAGE_NODE_SHIFT)
+
+typedef struct _CACHE_SECTION_PAGE_NODE
+{
+    ULONG Height;
+    PVOID Slots[ENTRIES_PER_NODE];
+} CACHE_SECTION_PAGE_NODE, *PCACHE_SECTION_PAGE_NODE;
+
 struct _MM_REQUIRED_RESOURCES;
 
 typedef NTSTATUS (NTAPI * AcquireResource)(
@@ -104,6 +114,15 @@ NTAPI
 MmFreePageTablesSectionSegment(PMM_SECTION_SEGMENT Segment,
                                FREE_SECTION_PAGE_FUN FreePage);
 
+PCACHE_SECTION_PAGE_TABLE
+NTAPI
+MmGetNextSectionPageTable(PMM_SECTION_SEGMENT Segment,
+                          PLARGE_INTEGER FileOffset);
+
+PCACHE_SECTION_PAGE_TABLE
+NTAPI
+MmGetLastSectionPageTable(PMM_SECTION_SEGMENT Segment);
+
 NTSTATUS
 NTAPI
 MmSetSectionAssociation(PFN_NUMBER Page,
@@ -25,10 +25,14 @@
 
 /*
 
-This file implements the section page table.  It relies on rtl generic table
-functionality to provide access to 256-page chunks.  Calls to
-MiSetPageEntrySectionSegment and MiGetPageEntrySectionSegment must be
-synchronized by holding the segment lock.
+This file implements the section page table.  The 256-page chunks are kept
+in a radix tree indexed by their file offset, with 64 slots per node.  The
+tree grows at the top as larger offsets are used, and nodes and chunks are
+only freed when the whole table is destroyed.  Because every node and chunk
+is fully initialized before it is published with an interlocked exchange,
+lookups never write to the tree and can walk it without taking any lock.
+Calls to MiSetPageEntrySectionSegment, as well as anything that allocates or
+frees parts of the tree, must be synchronized by holding the segment lock.
 
 Each page table entry is a ULONG as in x86.
 
@@ -64,113 +68,220 @@ paging machinery.
 
 extern KSPIN_LOCK MiSectionPageTableLock;
 
-_Function_class_(RTL_GENERIC_ALLOCATE_ROUTINE)
-static
-PVOID
-NTAPI
-MiSectionPageTableAllocate(PRTL_GENERIC_TABLE Table, CLONG Bytes)
-{
-    PVOID Result;
-    Result = ExAllocatePoolWithTag(NonPagedPool, Bytes, 'tPmM');
-    //DPRINT("MiSectionPageTableAllocate(%d) => %p\n", Bytes, Result);
-    return Result;
-}
+/* Size of the file range covered by one page table */
+#define PAGE_TABLE_RANGE ((ULONGLONG)ENTRIES_PER_ELEMENT * PAGE_SIZE)
+
+/* Slot of a page table index in a node of the given height */
+#define PAGE_NODE_SLOT(Index, Height) \
+    ((ULONG)((Index) >> (((Height) - 1) * PAGE_NODE_SHIFT)) & (ENTRIES_PER_NODE - 1))
 
-_Function_class_(RTL_GENERIC_FREE_ROUTINE)
 static
-VOID
-NTAPI
-MiSectionPageTableFree(PRTL_GENERIC_TABLE Table, PVOID Data)
+PCACHE_SECTION_PAGE_NODE
+MiSectionPageNodeAllocate(ULONG Height)
 {
-    //DPRINT("MiSectionPageTableFree(%p)\n", Data);
-    ExFreePoolWithTag(Data, 'tPmM');
+    PCACHE_SECTION_PAGE_NODE Node;
+
+    Node = ExAllocatePoolWithTag(NonPagedPool, sizeof(*Node), 'tPmM');
+    if (!Node) return NULL;
+
+    RtlZeroMemory(Node, sizeof(*Node));
+    Node->Height = Height;
+    return Node;
 }
 
-_Function_class_(RTL_GENERIC_COMPARE_ROUTINE)
 static
-RTL_GENERIC_COMPARE_RESULTS
-NTAPI
-MiSectionPageTableCompare(PRTL_GENERIC_TABLE Table,
-                          PVOID PtrA,
-                          PVOID PtrB)
+VOID
+MiSectionPageNodeFree(PCACHE_SECTION_PAGE_NODE Node)
 {
-    PLARGE_INTEGER A = PtrA, B = PtrB;
-    BOOLEAN Result = (A->QuadPart < B->QuadPart) ? GenericLessThan :
-        (A->QuadPart == B->QuadPart) ? GenericEqual : GenericGreaterThan;
+    ULONG i;
 
-#if 0
-    DPRINT
-        ("Compare: %08x%08x vs %08x%08x => %s\n",
-         A->u.HighPart, A->u.LowPart,
-         B->u.HighPart, B->u.LowPart,
-         Result == GenericLessThan ? "GenericLessThan" :
-         Result == GenericGreaterThan ? "GenericGreaterThan" :
-            "GenericEqual");
-#endif
+    /* The page tables themselves must be gone already */
+    for (i = 0; i < ENTRIES_PER_NODE; i++)
+    {
+        ASSERT(Node->Height > 1 || !Node->Slots[i]);
+        if (Node->Height > 1 && Node->Slots[i])
+            MiSectionPageNodeFree(Node->Slots[i]);
+    }
 
-    return Result;
+    ExFreePoolWithTag(Node, 'tPmM');
 }
 
 static
 PCACHE_SECTION_PAGE_TABLE
 NTAPI
-MiSectionPageTableGet(PRTL_GENERIC_TABLE Table,
+MiSectionPageTableGet(PMM_SECTION_SEGMENT Segment,
                       PLARGE_INTEGER FileOffset)
 {
-    LARGE_INTEGER SearchFileOffset;
-    PCACHE_SECTION_PAGE_TABLE PageTable;
-    SearchFileOffset.QuadPart = ROUND_DOWN(FileOffset->QuadPart,
-                                           ENTRIES_PER_ELEMENT * PAGE_SIZE);
-    PageTable = RtlLookupElementGenericTable(Table, &SearchFileOffset);
+    PCACHE_SECTION_PAGE_NODE Node;
+    ULONGLONG Index = (ULONGLONG)FileOffset->QuadPart / PAGE_TABLE_RANGE;
+    ULONG Height;
 
     DPRINT("MiSectionPageTableGet(%p,%I64x)\n",
-           Table,
+           Segment,
            FileOffset->QuadPart);
 
-    return PageTable;
+    /* No lock needed, only read each pointer once */
+    Node = *(PCACHE_SECTION_PAGE_NODE volatile *)&Segment->PageTable;
+    if (!Node || (Index >> (Node->Height * PAGE_NODE_SHIFT))) return NULL;
+
+    for (Height = Node->Height; Height > 1; Height--)
+    {
+        Node = *(PCACHE_SECTION_PAGE_NODE volatile *)&Node->Slots[PAGE_NODE_SLOT(Index, Height)];
+        if (!Node) return NULL;
+    }
+
+    return *(PCACHE_SECTION_PAGE_TABLE volatile *)&Node->Slots[PAGE_NODE_SLOT(Index, 1)];
 }
 
 static
 PCACHE_SECTION_PAGE_TABLE
 NTAPI
-MiSectionPageTableGetOrAllocate(PRTL_GENERIC_TABLE Table,
+MiSectionPageTableGetOrAllocate(PMM_SECTION_SEGMENT Segment,
                                 PLARGE_INTEGER FileOffset)
 {
-    LARGE_INTEGER SearchFileOffset;
-    CACHE_SECTION_PAGE_TABLE SectionZeroPageTable;
-    PCACHE_SECTION_PAGE_TABLE PageTableSlice = MiSectionPageTableGet(Table,
+    PCACHE_SECTION_PAGE_NODE Node, NewNode;
+    ULONGLONG Index = (ULONGLONG)FileOffset->QuadPart / PAGE_TABLE_RANGE;
+    ULONG Height;
+    PVOID *Slot;
+    PCACHE_SECTION_PAGE_TABLE PageTableSlice = MiSectionPageTableGet(Segment,
                                                                      FileOffset);
-    /* Please zero memory when taking away zero initialization. */
-    RtlZeroMemory(&SectionZeroPageTable, sizeof(CACHE_SECTION_PAGE_TABLE));
-    if (!PageTableSlice)
+    if (PageTableSlice) return PageTableSlice;
+
+    ASSERT(Segment->Locked);
+
+    /* Add levels on top of the tree until it reaches this offset */
+    Node = Segment->PageTable;
+    if (!Node)
+    {
+        Node = MiSectionPageNodeAllocate(1);
+        if (!Node) return NULL;
+        InterlockedExchangePointer((PVOID*)&Segment->PageTable, Node);
+    }
+    while (Index >> (Node->Height * PAGE_NODE_SHIFT))
+    {
+        NewNode = MiSectionPageNodeAllocate(Node->Height + 1);
+        if (!NewNode) return NULL;
+        NewNode->Slots[0] = Node;
+        InterlockedExchangePointer((PVOID*)&Segment->PageTable, NewNode);
+        Node = NewNode;
+    }
+
+    /* Walk down, creating the missing nodes */
+    for (Height = Node->Height; Height > 1; Height--)
     {
-        SearchFileOffset.QuadPart = ROUND_DOWN(FileOffset->QuadPart,
-                                               ENTRIES_PER_ELEMENT * PAGE_SIZE);
-        SectionZeroPageTable.FileOffset = SearchFileOffset;
-        SectionZeroPageTable.Refcount = 1;
-        PageTableSlice = RtlInsertElementGenericTable(Table,
-                                                      &SectionZeroPageTable,
-                                                      sizeof(SectionZeroPageTable),
-                                                      NULL);
-        if (!PageTableSlice) return NULL;
-        DPRINT("Allocate page table %p (%I64x)\n",
-               PageTableSlice,
-               PageTableSlice->FileOffset.QuadPart);
+        Slot = &Node->Slots[PAGE_NODE_SLOT(Index, Height)];
+        if (!*Slot)
+        {
+            NewNode = MiSectionPageNodeAllocate(Height - 1);
+            if (!NewNode) return NULL;
+            InterlockedExchangePointer(Slot, NewNode);
+        }
+        Node = *Slot;
     }
+
+    /* Please zero memory when taking away zero initialization. */
+    PageTableSlice = ExAllocatePoolWithTag(NonPagedPool, sizeof(*PageTableSlice), 'tPmM');
+    if (!PageTableSlice) return NULL;
+    RtlZeroMemory(PageTableSlice, sizeof(*PageTableSlice));
+    PageTableSlice->FileOffset.QuadPart = Index * PAGE_TABLE_RANGE;
+    PageTableSlice->Segment = Segment;
+    PageTableSlice->Refcount = 1;
+    InterlockedExchangePointer(&Node->Slots[PAGE_NODE_SLOT(Index, 1)], PageTableSlice);
+
+    DPRINT("Allocate page table %p (%I64x)\n",
+           PageTableSlice,
+           PageTableSlice->FileOffset.QuadPart);
     return PageTableSlice;
 }
 
+static
+PCACHE_SECTION_PAGE_TABLE
+MiSectionPageTableFindNext(PCACHE_SECTION_PAGE_NODE Node,
+                           ULONGLONG Index)
+{
+    PCACHE_SECTION_PAGE_TABLE PageTable;
+    PVOID Child;
+    ULONG i;
+
+    for (i = PAGE_NODE_SLOT(Index, Node->Height); i < ENTRIES_PER_NODE; i++)
+    {
+        Child = *(PVOID volatile *)&Node->Slots[i];
+        if (Child)
+        {
+            if (Node->Height == 1) return Child;
+            PageTable = MiSectionPageTableFindNext(Child, Index);
+            if (PageTable) return PageTable;
+        }
+
+        /* Everything in the next slots comes after the index */
+        Index = 0;
+    }
+
+    return NULL;
+}
+
+static
+PCACHE_SECTION_PAGE_TABLE
+MiSectionPageTableFindLast(PCACHE_SECTION_PAGE_NODE Node)
+{
+    PCACHE_SECTION_PAGE_TABLE PageTable;
+    PVOID Child;
+    ULONG i;
+
+    for (i = ENTRIES_PER_NODE; i > 0; i--)
+    {
+        Child = *(PVOID volatile *)&Node->Slots[i - 1];
+        if (Child)
+        {
+            if (Node->Height == 1) return Child;
+            PageTable = MiSectionPageTableFindLast(Child);
+            if (PageTable) return PageTable;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+
+Returns the first page table at or after the given offset, or NULL if there
+is none.  Use it to walk all the page tables of a segment in offset order.
+
+*/
+
+PCACHE_SECTION_PAGE_TABLE
+NTAPI
+MmGetNextSectionPageTable(PMM_SECTION_SEGMENT Segment,
+                          PLARGE_INTEGER FileOffset)
+{
+    PCACHE_SECTION_PAGE_NODE Node;
+    ULONGLONG Index = (ULONGLONG)FileOffset->QuadPart / PAGE_TABLE_RANGE;
+
+    Node = *(PCACHE_SECTION_PAGE_NODE volatile *)&Segment->PageTable;
+    if (!Node || (Index >> (Node->Height * PAGE_NODE_SHIFT))) return NULL;
+
+    return MiSectionPageTableFindNext(Node, Index);
+}
+
+PCACHE_SECTION_PAGE_TABLE
+NTAPI
+MmGetLastSectionPageTable(PMM_SECTION_SEGMENT Segment)
+{
+    PCACHE_SECTION_PAGE_NODE Node;
+
+    Node = *(PCACHE_SECTION_PAGE_NODE volatile *)&Segment->PageTable;
+    if (!Node) return NULL;
+
+    return MiSectionPageTableFindLast(Node);
+}
+
 VOID
 NTAPI
 MiInitializeSectionPageTable(PMM_SECTION_SEGMENT Segment)
 {
-    RtlInitializeGenericTable(&Segment->PageTable,
-                              MiSectionPageTableCompare,
-                              MiSectionPageTableAllocate,
-                              MiSectionPageTableFree,
-                              NULL);
+    Segment->PageTable = NULL;
 
-    DPRINT("MiInitializeSectionPageTable(%p)\n", &Segment->PageTable);
+    DPRINT("MiInitializeSectionPageTable(%p)\n", Segment);
 }
 
 NTSTATUS
@@ -187,11 +298,11 @@ _MmSetPageEntrySectionSegment(PMM_SECTION_SEGMENT Segment,
     ASSERT(Segment->Locked);
     ASSERT(!IS_SWAP_FROM_SSE(Entry) || !IS_DIRTY_SSE(Entry));
 
-    PageTable = MiSectionPageTableGetOrAllocate(&Segment->PageTable, Offset);
+    PageTable = MiSectionPageTableGetOrAllocate(Segment, Offset);
 
     if (!PageTable) return STATUS_NO_MEMORY;
 
-    ASSERT(MiSectionPageTableGet(&Segment->PageTable, Offset));
+    ASSERT(MiSectionPageTableGet(Segment, Offset));
 
     PageTable->Segment = Segment;
     PageIndex = (ULONG_PTR)((Offset->QuadPart - PageTable->FileOffset.QuadPart) / PAGE_SIZE);
@@ -275,7 +386,7 @@ _MmGetPageEntrySectionSegment(PMM_SECTION_SEGMENT Segment,
     ASSERT(Segment->Locked);
     FileOffset.QuadPart = ROUND_DOWN(Offset->QuadPart,
                                      ENTRIES_PER_ELEMENT * PAGE_SIZE);
-    PageTable = MiSectionPageTableGet(&Segment->PageTable, &FileOffset);
+    PageTable = MiSectionPageTableGet(Segment, &FileOffset);
     if (!PageTable) return 0;
     PageIndex = (ULONG_PTR)((Offset->QuadPart - PageTable->FileOffset.QuadPart) / PAGE_SIZE);
     Result = PageTable->PageEntries[PageIndex];
@@ -293,12 +404,11 @@ _MmGetPageEntrySectionSegment(PMM_SECTION_SEGMENT Segment,
 
 /*
 
-Destroy the rtl generic table that serves as the section's page table.  Call
-the FreePage function for each non-zero entry in the section page table as
-we go.  Note that the page table is still techinally valid until after all
-pages are destroyed, as we don't finally destroy the table until we've free
-each slice.  There is no order guarantee for deletion of individual elements
-although it's in-order as written now.
+Destroy the radix tree that serves as the section's page table.  Call the
+FreePage function for each non-zero entry in the section page table as we go.
+Each slice is unlinked from the tree before it is freed, so that FreePage and
+anything it calls still find a consistent table.  Slices are deleted in offset
+order, and the tree nodes are freed at the end.
 
 */
 
@@ -308,8 +418,14 @@ MmFreePageTablesSectionSegment(PMM_SECTION_SEGMENT Segment,
                                FREE_SECTION_PAGE_FUN FreePage)
 {
     PCACHE_SECTION_PAGE_TABLE Element;
-    DPRINT("MiFreePageTablesSectionSegment(%p)\n", &Segment->PageTable);
-    while ((Element = RtlGetElementGenericTable(&Segment->PageTable, 0))) {
+    PCACHE_SECTION_PAGE_NODE Node;
+    LARGE_INTEGER SearchOffset;
+    ULONGLONG Index;
+    ULONG Height;
+
+    DPRINT("MiFreePageTablesSectionSegment(%p)\n", Segment);
+    SearchOffset.QuadPart = 0;
+    while ((Element = MmGetNextSectionPageTable(Segment, &SearchOffset))) {
         DPRINT("Delete table for <%wZ> %p -> %I64x\n",
                Segment->FileObject ? &Segment->FileObject->FileName : NULL,
                Segment,
@@ -335,8 +451,20 @@ MmFreePageTablesSectionSegment(PMM_SECTION_SEGMENT Segment,
             }
         }
         DPRINT("Remove memory\n");
-        RtlDeleteElementGenericTable(&Segment->PageTable, Element);
+        Index = (ULONGLONG)Element->FileOffset.QuadPart / PAGE_TABLE_RANGE;
+        Node = Segment->PageTable;
+        for (Height = Node->Height; Height > 1; Height--)
+            Node = Node->Slots[PAGE_NODE_SLOT(Index, Height)];
+        ASSERT(Node->Slots[PAGE_NODE_SLOT(Index, 1)] == Element);
+        InterlockedExchangePointer(&Node->Slots[PAGE_NODE_SLOT(Index, 1)], NULL);
+
+        SearchOffset.QuadPart = Element->FileOffset.QuadPart + PAGE_TABLE_RANGE;
+        ExFreePoolWithTag(Element, 'tPmM');
     }
+
+    /* Now only empty nodes are left */
+    Node = InterlockedExchangePointer((PVOID*)&Segment->PageTable, NULL);
+    if (Node) MiSectionPageNodeFree(Node);
     DPRINT("Done\n");
 }
 
@@ -386,7 +514,7 @@ MmSetSectionAssociation(PFN_NUMBER Page,
     PCACHE_SECTION_PAGE_TABLE PageTable;
     ULONG ActualOffset;
 
-    PageTable = MiSectionPageTableGet(&Segment->PageTable, Offset);
+    PageTable = MiSectionPageTableGet(Segment, Offset);
     ASSERT(PageTable);
 
     ActualOffset = (ULONG)(Offset->QuadPart - PageTable->FileOffset.QuadPart);
@@ -591,19 +591,16 @@ MiCacheEvictPages(PMM_SECTION_SEGMENT Segment,
                   ULONG Target)
 {
     ULONG_PTR Entry;
-    ULONG Result = 0, i, j;
+    ULONG Result = 0, j;
     NTSTATUS Status;
     PFN_NUMBER Page;
     LARGE_INTEGER Offset;
+    PCACHE_SECTION_PAGE_TABLE Element;
 
     MmLockSectionSegment(Segment);
 
-    for (i = 0; i < RtlNumberGenericTableElements(&Segment->PageTable); i++) {
-
-        PCACHE_SECTION_PAGE_TABLE Element = RtlGetElementGenericTable(&Segment->PageTable,
-                                                                      i);
-
-        ASSERT(Element);
+    Offset.QuadPart = 0;
+    while ((Element = MmGetNextSectionPageTable(Segment, &Offset))) {
 
         Offset = Element->FileOffset;
         for (j = 0; j < ENTRIES_PER_ELEMENT; j++, Offset.QuadPart += PAGE_SIZE) {
@@ -13,6 +13,192 @@
 #define NDEBUG
 #include <debug.h>
 
+/* GLOBALS *******************************************************************/
+
+/* Counters:
+ * - Number of calls to CcMdlRead
+ * - Number of views CcMdlRead had to fault in from the disk
+ */
+ULONG CcMdlReadWait = 0;
+ULONG CcMdlReadWaitMiss = 0;
+
+/* MDLs handed out by the MDL functions, along with the VACB each one keeps
+ * referenced until it is given back to one of the Mdl*Complete routines
+ */
+typedef struct _CC_VACB_MDL
+{
+    PROS_VACB Vacb;
+    MDL Mdl;
+    /* The PFN array of the MDL follows */
+} CC_VACB_MDL, *PCC_VACB_MDL;
+
+/* PRIVATE FUNCTIONS *********************************************************/
+
+static
+VOID
+CcpFreeMdlChain(
+    _In_ PMDL MdlChain,
+    _In_ BOOLEAN Dirty)
+{
+    PCC_VACB_MDL VacbMdl;
+    PMDL Mdl;
+
+    while ((Mdl = MdlChain))
+    {
+        MdlChain = Mdl->Next;
+        VacbMdl = CONTAINING_RECORD(Mdl, CC_VACB_MDL, Mdl);
+
+        MmUnlockPages(Mdl);
+        CcRosReleaseVacb(VacbMdl->Vacb->SharedCacheMap, VacbMdl->Vacb, Dirty, FALSE);
+        ExFreePoolWithTag(VacbMdl, TAG_CC_MDL);
+    }
+}
+
+/*
+ * Locks the physical pages backing a range of a VACB view and returns an MDL
+ * describing them. On success, the MDL takes over the caller's reference on
+ * the VACB, so that the view stays where it is until the MDL is freed.
+ */
+static
+PMDL
+CcpLockVacbRange(
+    _In_ PROS_VACB Vacb,
+    _In_ ULONG VacbOffset,
+    _In_ ULONG Length,
+    _In_ LOCK_OPERATION Operation)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    PCC_VACB_MDL VacbMdl;
+    PVOID Address;
+
+    Address = Add2Ptr(Vacb->BaseAddress, VacbOffset);
+    VacbMdl = ExAllocatePoolWithTag(NonPagedPool,
+                                    FIELD_OFFSET(CC_VACB_MDL, Mdl) + MmSizeOfMdl(Address, Length),
+                                    TAG_CC_MDL);
+    if (!VacbMdl)
+    {
+        ExRaiseStatus(STATUS_INSUFFICIENT_RESOURCES);
+    }
+
+    MmInitializeMdl(&VacbMdl->Mdl, Address, Length);
+
+    _SEH2_TRY
+    {
+        MmProbeAndLockPages(&VacbMdl->Mdl, KernelMode, Operation);
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        Status = _SEH2_GetExceptionCode();
+    }
+    _SEH2_END;
+
+    if (!NT_SUCCESS(Status))
+    {
+        ExFreePoolWithTag(VacbMdl, TAG_CC_MDL);
+        ExRaiseStatus(Status);
+    }
+
+    VacbMdl->Vacb = Vacb;
+    return &VacbMdl->Mdl;
+}
+
+/*
+ * Builds a chain of locked MDLs, one per VACB, describing the cached pages of
+ * the given file range. The chain is appended to whatever the caller already
+ * has in MdlChain. On failure, the MDLs built so far are released and the
+ * exception is propagated to the caller.
+ */
+static
+VOID
+CcpBuildMdlChain(
+    _In_ PFILE_OBJECT FileObject,
+    _In_ PLARGE_INTEGER FileOffset,
+    _In_ ULONG Length,
+    _In_ LOCK_OPERATION Operation,
+    _Inout_ PMDL *MdlChain,
+    _Out_ PIO_STATUS_BLOCK IoStatus)
+{
+    PROS_SHARED_CACHE_MAP SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    PROS_VACB Vacb;
+    NTSTATUS Status;
+    PMDL *Link;
+    PMDL Mdl;
+    LONGLONG CurrentOffset;
+    LONGLONG End;
+    ULONG_PTR Information = 0;
+
+    Status = RtlLongLongAdd(FileOffset->QuadPart, Length, &End);
+    if (!NT_SUCCESS(Status))
+        ExRaiseStatus(Status);
+
+    /* Find the end of the caller's chain, that's where our MDLs go */
+    Link = MdlChain;
+    while (*Link)
+    {
+        Link = &(*Link)->Next;
+    }
+
+    _SEH2_TRY
+    {
+        PMDL *Tail = Link;
+
+        CurrentOffset = FileOffset->QuadPart;
+        while (CurrentOffset < End)
+        {
+            ULONG VacbOffset = CurrentOffset % VACB_MAPPING_GRANULARITY;
+            ULONG VacbLength = (ULONG)min(End - CurrentOffset, VACB_MAPPING_GRANULARITY - VacbOffset);
+
+            Status = CcRosGetVacb(SharedCacheMap, CurrentOffset, &Vacb);
+            if (!NT_SUCCESS(Status))
+            {
+                ExRaiseStatus(Status);
+            }
+
+            _SEH2_TRY
+            {
+                /* Bring the data in, so that the caller sees (or partially
+                 * overwrites) what is actually in the file
+                 */
+                if (!CcRosEnsureVacbResident(Vacb, FALSE, FALSE, VacbOffset, VacbLength))
+                {
+                    if (Operation == IoReadAccess)
+                        ++CcMdlReadWaitMiss;
+
+                    CcRosEnsureVacbResident(Vacb, TRUE, FALSE, VacbOffset, VacbLength);
+                }
+
+                Mdl = CcpLockVacbRange(Vacb, VacbOffset, VacbLength, Operation);
+            }
+            _SEH2_FINALLY
+            {
+                /* Once locked, the MDL owns our reference on the VACB */
+                if (_SEH2_AbnormalTermination())
+                    CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE);
+            }
+            _SEH2_END;
+
+            *Tail = Mdl;
+            Tail = &Mdl->Next;
+
+            Information += VacbLength;
+            CurrentOffset += VacbLength;
+        }
+    }
+    _SEH2_FINALLY
+    {
+        if (_SEH2_AbnormalTermination())
+        {
+            /* Give back what we locked so far, and leave the caller's chain as it was */
+            CcpFreeMdlChain(*Link, FALSE);
+            *Link = NULL;
+        }
+    }
+    _SEH2_END;
+
+    IoStatus->Status = STATUS_SUCCESS;
+    IoStatus->Information = Information;
+}
+
 /* FUNCTIONS *****************************************************************/
 
 /*
@@ -31,7 +217,9 @@ CcMdlRead (
     CCTRACE(CC_API_DEBUG, "FileObject=%p FileOffset=%I64d Length=%lu\n",
         FileObject, FileOffset->QuadPart, Length);
 
-    UNIMPLEMENTED;
+    ++CcMdlReadWait;
+
+    CcpBuildMdlChain(FileObject, FileOffset, Length, IoReadAccess, MdlChain, IoStatus);
 }
 
 /*
@@ -58,15 +246,8 @@ CcMdlReadComplete2 (
     IN PMDL MemoryDescriptorList
 )
 {
-    PMDL Mdl;
-
     /* Free MDLs */
-    while ((Mdl = MemoryDescriptorList))
-    {
-        MemoryDescriptorList = Mdl->Next;
-        MmUnlockPages(Mdl);
-        IoFreeMdl(Mdl);
-    }
+    CcpFreeMdlChain(MemoryDescriptorList, FALSE);
 }
 
 /*
@@ -150,6 +331,18 @@ CcMdlWriteComplete (
     CcMdlWriteComplete2(FileObject,FileOffset, MdlChain);
 }
 
+/*
+ * NAME                            INTERNAL
+ * CcMdlWriteComplete2@12
+ *
+ * DESCRIPTION
+ *  Marks the data written through an MDL chain returned by
+ *  CcPrepareMdlWrite as dirty and releases the chain.
+ *
+ * NOTE
+ *     Used by CcMdlWriteComplete@12 and FsRtl
+ *
+ */
 VOID
 NTAPI
 CcMdlWriteComplete2 (
@@ -157,11 +350,39 @@ CcMdlWriteComplete2 (
     IN PLARGE_INTEGER FileOffset,
     IN PMDL MdlChain)
 {
-    UNIMPLEMENTED;
+    NTSTATUS Status;
+    ULONG Length = 0;
+    PMDL Mdl;
+
+    CCTRACE(CC_API_DEBUG, "FileObject=%p FileOffset=%I64d MdlChain=%p\n",
+        FileObject, FileOffset->QuadPart, MdlChain);
+
+    _SEH2_TRY
+    {
+        /* The data was written to the physical pages, tell Mm about it */
+        for (Mdl = MdlChain; Mdl; Mdl = Mdl->Next)
+        {
+            Status = MmMakePagesDirty(NULL, MmGetMdlVirtualAddress(Mdl), MmGetMdlByteCount(Mdl));
+            if (!NT_SUCCESS(Status))
+                ExRaiseStatus(Status);
+
+            Length += MmGetMdlByteCount(Mdl);
+        }
+    }
+    _SEH2_FINALLY
+    {
+        /* Each MDL still references the VACB it was built from, dirty these for Cc */
+        CcpFreeMdlChain(MdlChain, !_SEH2_AbnormalTermination());
+    }
+    _SEH2_END;
+
+    /* Flush if needed */
+    if (FileObject->Flags & FO_WRITE_THROUGH)
+        CcFlushCache(FileObject->SectionObjectPointer, FileOffset, Length, NULL);
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -169,11 +390,14 @@ CcMdlWriteAbort (
     IN PFILE_OBJECT FileObject,
     IN PMDL MdlChain)
 {
-    UNIMPLEMENTED;
+    CCTRACE(CC_API_DEBUG, "FileObject=%p MdlChain=%p\n", FileObject, MdlChain);
+
+    /* Nothing was written, don't dirty anything */
+    CcpFreeMdlChain(MdlChain, FALSE);
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -187,5 +411,5 @@ CcPrepareMdlWrite (
     CCTRACE(CC_API_DEBUG, "FileObject=%p FileOffset=%I64d Length=%lu\n",
         FileObject, FileOffset->QuadPart, Length);
 
-    UNIMPLEMENTED;
+    CcpBuildMdlChain(FileObject, FileOffset, Length, IoWriteAccess, MdlChain, IoStatus);
 }
@@ -250,6 +250,7 @@ CcRosDeleteFileCache (
         ULONG RefCount;
 
         InitializeListHead(&Vacb->CacheMapVacbListEntry);
+        CcRosRemoveVacbFromIndex(SharedCacheMap, Vacb);
 
         /* Flush to disk, if needed */
         if (Vacb->Dirty)
@@ -288,6 +289,8 @@ CcRosDeleteFileCache (
 #endif
     }
 
+    ASSERT(SharedCacheMap->VacbIndex == NULL);
+
     /* Release the references we own */
     if(SharedCacheMap->Section)
         ObDereferenceObject(SharedCacheMap->Section);
@@ -480,13 +483,237 @@ CcRosReleaseVacb (
     return STATUS_SUCCESS;
 }
 
+static
+ULONGLONG
+CcRosVacbIndexCapacity(
+    ULONG Depth)
+{
+    /* Anything past the deepest level covers the whole file */
+    if (Depth >= VACB_INDEX_MAX_DEPTH)
+        return MAXULONGLONG;
+
+    return 1ULL << (Depth * VACB_INDEX_LEVEL_SHIFT);
+}
+
+static
+PROS_VACB
+CcRosLookupVacbInIndex(
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset)
+/*
+ * FUNCTION: Finds the VACB mapping the given offset, if any.
+ * Must be called with the cache map lock held.
+ */
+{
+    PROS_VACB_INDEX_LEVEL Level;
+    ULONGLONG View;
+    ULONG Shift;
+    PVOID Entry;
+
+    View = (ULONGLONG)FileOffset / VACB_MAPPING_GRANULARITY;
+
+    Level = SharedCacheMap->VacbIndex;
+    if (Level == NULL || View >= CcRosVacbIndexCapacity(SharedCacheMap->VacbIndexDepth))
+        return NULL;
+
+    /* Walk down the levels, each one consumes VACB_INDEX_LEVEL_SHIFT bits of the view */
+    Shift = (SharedCacheMap->VacbIndexDepth - 1) * VACB_INDEX_LEVEL_SHIFT;
+    for (;;)
+    {
+        Entry = Level->Entries[(View >> Shift) & (VACB_INDEX_LEVEL_SIZE - 1)];
+        if (Entry == NULL || Shift == 0)
+            return Entry;
+
+        Level = Entry;
+        Shift -= VACB_INDEX_LEVEL_SHIFT;
+    }
+}
+
+static
+PROS_VACB_INDEX_LEVEL
+CcRosAllocateVacbIndexLevel(VOID)
+{
+    PROS_VACB_INDEX_LEVEL Level;
+
+    /* We're called with spin locks held */
+    Level = ExAllocatePoolWithTag(NonPagedPool, sizeof(*Level), TAG_VACB_INDEX);
+    if (Level != NULL)
+    {
+        RtlZeroMemory(Level, sizeof(*Level));
+    }
+
+    return Level;
+}
+
+static
+NTSTATUS
+CcRosInsertVacbInIndex(
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    PROS_VACB Vacb)
+/*
+ * FUNCTION: Makes the given VACB reachable through the index.
+ * Must be called with the cache map lock held.
+ */
+{
+    PROS_VACB_INDEX_LEVEL Level, NewLevel;
+    ULONGLONG View;
+    ULONG Shift, Index;
+
+    View = (ULONGLONG)Vacb->FileOffset.QuadPart / VACB_MAPPING_GRANULARITY;
+
+    /* Create the top level if the index is empty */
+    if (SharedCacheMap->VacbIndex == NULL)
+    {
+        SharedCacheMap->VacbIndex = CcRosAllocateVacbIndexLevel();
+        if (SharedCacheMap->VacbIndex == NULL)
+            return STATUS_INSUFFICIENT_RESOURCES;
+        SharedCacheMap->VacbIndexDepth = 1;
+    }
+
+    /* Grow the index until it covers this view */
+    while (View >= CcRosVacbIndexCapacity(SharedCacheMap->VacbIndexDepth))
+    {
+        NewLevel = CcRosAllocateVacbIndexLevel();
+        if (NewLevel == NULL)
+            return STATUS_INSUFFICIENT_RESOURCES;
+
+        /* The old top level covers the first views of the new one */
+        NewLevel->Entries[0] = SharedCacheMap->VacbIndex;
+        NewLevel->ActiveEntries = 1;
+        SharedCacheMap->VacbIndex = NewLevel;
+        SharedCacheMap->VacbIndexDepth++;
+    }
+
+    /* Walk down the levels, creating the missing ones */
+    Level = SharedCacheMap->VacbIndex;
+    Shift = (SharedCacheMap->VacbIndexDepth - 1) * VACB_INDEX_LEVEL_SHIFT;
+    while (Shift != 0)
+    {
+        Index = (View >> Shift) & (VACB_INDEX_LEVEL_SIZE - 1);
+        if (Level->Entries[Index] == NULL)
+        {
+            NewLevel = CcRosAllocateVacbIndexLevel();
+            if (NewLevel == NULL)
+                return STATUS_INSUFFICIENT_RESOURCES;
+
+            Level->Entries[Index] = NewLevel;
+            Level->ActiveEntries++;
+        }
+
+        Level = Level->Entries[Index];
+        Shift -= VACB_INDEX_LEVEL_SHIFT;
+    }
+
+    Index = View & (VACB_INDEX_LEVEL_SIZE - 1);
+    ASSERT(Level->Entries[Index] == NULL);
+    Level->Entries[Index] = Vacb;
+    Level->ActiveEntries++;
+
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+CcRosPruneVacbIndex(
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    ULONGLONG View)
+/*
+ * FUNCTION: Frees the empty levels on the path to the given view.
+ * Must be called with the cache map lock held.
+ */
+{
+    PROS_VACB_INDEX_LEVEL Path[VACB_INDEX_MAX_DEPTH];
+    ULONG Indexes[VACB_INDEX_MAX_DEPTH];
+    PROS_VACB_INDEX_LEVEL Level;
+    ULONG Shift, Count;
+
+    Level = SharedCacheMap->VacbIndex;
+    if (Level == NULL)
+        return;
+
+    /* Walk down the levels, remembering where we went */
+    Count = 0;
+    Shift = (SharedCacheMap->VacbIndexDepth - 1) * VACB_INDEX_LEVEL_SHIFT;
+    for (;;)
+    {
+        Path[Count] = Level;
+        Indexes[Count] = (View >> Shift) & (VACB_INDEX_LEVEL_SIZE - 1);
+        Count++;
+
+        if (Shift == 0)
+            break;
+
+        Level = Level->Entries[Indexes[Count - 1]];
+        if (Level == NULL)
+            break;
+
+        Shift -= VACB_INDEX_LEVEL_SHIFT;
+    }
+
+    /* Release the empty levels, deepest first */
+    while (Count-- > 0)
+    {
+        if (Path[Count]->ActiveEntries != 0)
+            return;
+
+        ExFreePoolWithTag(Path[Count], TAG_VACB_INDEX);
+
+        if (Count == 0)
+        {
+            /* The whole index is empty */
+            SharedCacheMap->VacbIndex = NULL;
+            SharedCacheMap->VacbIndexDepth = 0;
+            return;
+        }
+
+        Path[Count - 1]->Entries[Indexes[Count - 1]] = NULL;
+        Path[Count - 1]->ActiveEntries--;
+    }
+}
+
+VOID
+CcRosRemoveVacbFromIndex(
+    _In_ PROS_SHARED_CACHE_MAP SharedCacheMap,
+    _In_ PROS_VACB Vacb)
+/*
+ * FUNCTION: Removes the given VACB from the index, and frees the levels
+ * which became empty. Must be called with the cache map lock held, or once
+ * the cache map can't be reached anymore.
+ */
+{
+    PROS_VACB_INDEX_LEVEL Level;
+    ULONGLONG View;
+    ULONG Shift, Index;
+
+    View = (ULONGLONG)Vacb->FileOffset.QuadPart / VACB_MAPPING_GRANULARITY;
+    ASSERT(SharedCacheMap->VacbIndex != NULL);
+    ASSERT(View < CcRosVacbIndexCapacity(SharedCacheMap->VacbIndexDepth));
+
+    /* Walk down to the bottom level */
+    Level = SharedCacheMap->VacbIndex;
+    Shift = (SharedCacheMap->VacbIndexDepth - 1) * VACB_INDEX_LEVEL_SHIFT;
+    while (Shift != 0)
+    {
+        Level = Level->Entries[(View >> Shift) & (VACB_INDEX_LEVEL_SIZE - 1)];
+        ASSERT(Level != NULL);
+        Shift -= VACB_INDEX_LEVEL_SHIFT;
+    }
+
+    /* Clear the entry and get rid of what became empty */
+    Index = View & (VACB_INDEX_LEVEL_SIZE - 1);
+    ASSERT(Level->Entries[Index] == Vacb);
+    Level->Entries[Index] = NULL;
+    Level->ActiveEntries--;
+
+    CcRosPruneVacbIndex(SharedCacheMap, View);
+}
+
 /* Returns with VACB Lock Held! */
 PROS_VACB
 CcRosLookupVacb (
     PROS_SHARED_CACHE_MAP SharedCacheMap,
     LONGLONG FileOffset)
 {
-    PLIST_ENTRY current_entry;
     PROS_VACB current;
     KIRQL oldIrql;
 
@@ -495,33 +722,21 @@ CcRosLookupVacb (
     DPRINT("CcRosLookupVacb(SharedCacheMap 0x%p, FileOffset %I64u)\n",
            SharedCacheMap, FileOffset);
 
-    oldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
-    KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
+    /* The index only needs the cache map lock, not the master one */
+    KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &oldIrql);
 
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    current = CcRosLookupVacbInIndex(SharedCacheMap, FileOffset);
+    if (current != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
-            KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
-            return current;
-        }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+        ASSERT(IsPointInRange(current->FileOffset.QuadPart,
+                              VACB_MAPPING_GRANULARITY,
+                              FileOffset));
+        CcRosVacbIncRefCount(current);
     }
 
-    KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
-    KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+    KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
 
-    return NULL;
+    return current;
 }
 
 VOID
@@ -635,6 +850,7 @@ CcRosFreeUnusedVacb (
             ASSERT(Refs == 1);
 
             /* Reset and move to free list */
+            CcRosRemoveVacbFromIndex(current->SharedCacheMap, current);
             RemoveEntryList(&current->CacheMapVacbListEntry);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
@@ -685,8 +901,6 @@ CcRosCreateVacb (
     PROS_VACB *Vacb)
 {
     PROS_VACB current;
-    PROS_VACB previous;
-    PLIST_ENTRY current_entry;
     NTSTATUS Status;
     KIRQL oldIrql;
     ULONG Refs;
@@ -752,56 +966,47 @@ Retry:
      * our newly created VACB and return the existing one.
      */
     KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    previous = NULL;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    current = CcRosLookupVacbInIndex(SharedCacheMap, FileOffset);
+    if (current != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+        CcRosVacbIncRefCount(current);
+        KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 #if DBG
-            if (SharedCacheMap->Trace)
-            {
-                DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
-                        SharedCacheMap,
-                        (*Vacb),
-                        current);
-            }
+        if (SharedCacheMap->Trace)
+        {
+            DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
+                    SharedCacheMap,
+                    (*Vacb),
+                    current);
+        }
 #endif
-            KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+        KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
 
-            Refs = CcRosVacbDecRefCount(*Vacb);
-            ASSERT(Refs == 0);
+        Refs = CcRosVacbDecRefCount(*Vacb);
+        ASSERT(Refs == 0);
 
-            *Vacb = current;
-            return STATUS_SUCCESS;
-        }
-        if (current->FileOffset.QuadPart < FileOffset)
-        {
-            ASSERT(previous == NULL ||
-                   previous->FileOffset.QuadPart < current->FileOffset.QuadPart);
-            previous = current;
-        }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+        *Vacb = current;
+        return STATUS_SUCCESS;
     }
+
     /* There was no existing VACB. */
     current = *Vacb;
-    if (previous)
-    {
-        InsertHeadList(&previous->CacheMapVacbListEntry, &current->CacheMapVacbListEntry);
-    }
-    else
+    Status = CcRosInsertVacbInIndex(SharedCacheMap, current);
+    if (!NT_SUCCESS(Status))
     {
-        InsertHeadList(&SharedCacheMap->CacheMapVacbListHead, &current->CacheMapVacbListEntry);
+        /* Don't leave half built levels behind */
+        CcRosPruneVacbIndex(SharedCacheMap,
+                            (ULONGLONG)current->FileOffset.QuadPart / VACB_MAPPING_GRANULARITY);
+        KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+        KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+
+        Refs = CcRosVacbDecRefCount(current);
+        ASSERT(Refs == 0);
+
+        *Vacb = NULL;
+        return Status;
     }
+    InsertTailList(&SharedCacheMap->CacheMapVacbListHead, &current->CacheMapVacbListEntry);
     KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
     InsertTailList(&VacbLruListHead, &current->VacbLruListEntry);
     KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
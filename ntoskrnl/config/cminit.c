@@ -194,6 +194,9 @@ CmpInitializeHive(OUT PCMHIVE *CmHive,
         return Status;
     }
 
+    /* Write runs of dirty blocks with as few writes as possible */
+    Hive->Hive.FileWriteGather = CmpFileWriteGather;
+
     /* Check if we should verify the registry */
     if ((OperationType == HINIT_FILE) ||
         (OperationType == HINIT_MEMORY) ||
@@ -650,6 +650,62 @@ InitializeKCBKeyBodyList(IN PCM_KEY_CONTROL_BLOCK Kcb)
     Kcb->KeyBodyArray[3] = NULL;
 }
 
+static
+PCM_KEY_CONTROL_BLOCK
+CmpReferenceCachedKeyControlBlock(IN PHHIVE Hive,
+                                  IN HCELL_INDEX Index,
+                                  IN PCM_KEY_NODE Node,
+                                  IN ULONG ConvKey)
+{
+    PCM_KEY_HASH Entry;
+    PCM_KEY_CONTROL_BLOCK Kcb = NULL;
+
+    /* Lock the hash entry shared, so that readers don't block each other */
+    CmpAcquireKcbLockSharedByIndex(GET_HASH_INDEX(ConvKey));
+
+    /* Loop the hash table */
+    Entry = GET_HASH_ENTRY(CmpCacheTable, ConvKey)->Entry;
+    while (Entry)
+    {
+        /* Check if this matches */
+        ASSERT_VALID_HASH(Entry);
+        if ((Entry->ConvKey == ConvKey) &&
+            (Entry->KeyCell == Index) &&
+            (Entry->KeyHive == Hive))
+        {
+            /*
+             * Only take it if CmpCreateKeyControlBlock would leave it as it
+             * is: a live, real key whose cached node information is current.
+             */
+            Kcb = CONTAINING_RECORD(Entry, CM_KEY_CONTROL_BLOCK, KeyHash);
+            if ((Kcb->Delete) ||
+                (Kcb->ExtFlags & (CM_KCB_KEY_NON_EXIST |
+                                  CM_KCB_INVALID_CACHED_INFO |
+                                  CM_KCB_NO_SUBKEY |
+                                  CM_KCB_SUBKEY_ONE |
+                                  CM_KCB_SUBKEY_HINT)) ||
+                (Kcb->SubKeyCount != Node->SubKeyCounts[Stable] +
+                                     Node->SubKeyCounts[Volatile]) ||
+                (Kcb->KcbLastWriteTime.QuadPart != Node->LastWriteTime.QuadPart) ||
+                (Kcb->KcbMaxNameLen != (USHORT)Node->MaxNameLen) ||
+                (Kcb->KcbMaxValueNameLen != (USHORT)Node->MaxValueNameLen) ||
+                (Kcb->KcbMaxValueDataLen != Node->MaxValueDataLen) ||
+                !(CmpReferenceKeyControlBlock(Kcb)))
+            {
+                Kcb = NULL;
+            }
+            break;
+        }
+
+        /* Keep looping */
+        Entry = Entry->NextHash;
+    }
+
+    /* Release the lock, it may have been converted to exclusive */
+    CmpReleaseKcbLockByKey(ConvKey);
+    return Kcb;
+}
+
 PCM_KEY_CONTROL_BLOCK
 NTAPI
 CmpCreateKeyControlBlock(IN PHHIVE Hive,
@@ -708,6 +764,19 @@ CmpCreateKeyControlBlock(IN PHHIVE Hive,
         p++;
     }
 
+    /*
+     * Most opens are for keys that already have a KCB. Look for it with the
+     * hash entry locked shared first, and only build a new KCB under the
+     * exclusive locks if that fails.
+     */
+    if (!(IsFake) &&
+        !(Flags & CMP_LOCK_HASHES_FOR_KCB) &&
+        !(((PCMHIVE)Hive)->Frozen))
+    {
+        Kcb = CmpReferenceCachedKeyControlBlock(Hive, Index, Node, ConvKey);
+        if (Kcb) return Kcb;
+    }
+
     /* Allocate the KCB */
     Kcb = CmpAllocateKeyControlBlock();
     if (!Kcb) return NULL;
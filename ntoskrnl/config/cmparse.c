@@ -989,11 +989,115 @@ CmpHandleExitNode(IN OUT PHHIVE *Hive,
     }
 }
 
+typedef struct _CM_HASH_STACK_ENTRY
+{
+    ULONG ConvKey;
+    UNICODE_STRING KeyName;
+    UNICODE_STRING RemainingName;
+} CM_HASH_STACK_ENTRY, *PCM_HASH_STACK_ENTRY;
+
+static
+BOOLEAN
+CmpCompareKcbName(IN PCM_KEY_CONTROL_BLOCK Kcb,
+                  IN PUNICODE_STRING KeyName)
+{
+    PCM_NAME_CONTROL_BLOCK Ncb = Kcb->NameBlock;
+    PWCHAR p, pp;
+    ULONG i;
+
+    /* A KCB without a name can't be part of the path */
+    if (!Ncb) return FALSE;
+
+    /* Compressed names are stored one byte per character */
+    if (Ncb->Compressed)
+        return !CmpCompareCompressedName(KeyName, Ncb->Name, Ncb->NameLength);
+
+    /* Otherwise the length is in bytes, like ours */
+    if (Ncb->NameLength != KeyName->Length) return FALSE;
+
+    /* Do a manual compare */
+    p = KeyName->Buffer;
+    pp = Ncb->Name;
+    for (i = 0; i < Ncb->NameLength; i += sizeof(WCHAR))
+    {
+        /* Compare the character */
+        if (RtlUpcaseUnicodeChar(*p) != RtlUpcaseUnicodeChar(*pp)) return FALSE;
+
+        /* Next chars */
+        p++;
+        pp++;
+    }
+
+    /* The names match */
+    return TRUE;
+}
+
+static
+PCM_KEY_CONTROL_BLOCK
+CmpLookupCachedKcb(IN PCM_KEY_CONTROL_BLOCK RootKcb,
+                   IN PCM_HASH_STACK_ENTRY HashStack,
+                   IN ULONG Level)
+{
+    PCM_KEY_HASH Entry;
+    PCM_KEY_CONTROL_BLOCK Kcb, CurrentKcb = NULL;
+    ULONG ConvKey = HashStack[Level].ConvKey;
+    LONG i;
+
+    /* Lock the hash entry shared, so that nothing in it goes away */
+    CmpAcquireKcbLockSharedByIndex(GET_HASH_INDEX(ConvKey));
+
+    /* Loop the hash table */
+    Entry = GET_HASH_ENTRY(CmpCacheTable, ConvKey)->Entry;
+    while (Entry)
+    {
+        /* Skip anything with another hash */
+        ASSERT_VALID_HASH(Entry);
+        if (Entry->ConvKey == ConvKey)
+        {
+            /*
+             * Walk up the parents and compare each name with the path. The
+             * keys on the way must be live, real and not symbolic links, and
+             * we must end up back on the KCB that we started parsing from.
+             */
+            Kcb = CONTAINING_RECORD(Entry, CM_KEY_CONTROL_BLOCK, KeyHash);
+            CurrentKcb = Kcb;
+            for (i = Level; i >= 0; i--)
+            {
+                if ((CurrentKcb->Delete) ||
+                    (CurrentKcb->ExtFlags & CM_KCB_KEY_NON_EXIST) ||
+                    (CurrentKcb->Flags & KEY_SYM_LINK) ||
+                    !(CmpCompareKcbName(CurrentKcb, &HashStack[i].KeyName)))
+                {
+                    break;
+                }
+
+                CurrentKcb = CurrentKcb->ParentKcb;
+                if (!CurrentKcb) break;
+            }
+
+            /* Check if the whole prefix matched, and reference the KCB */
+            if ((i < 0) && (CurrentKcb == RootKcb))
+            {
+                if (!CmpReferenceKeyControlBlock(Kcb)) Kcb = NULL;
+                CmpReleaseKcbLockByKey(ConvKey);
+                return Kcb;
+            }
+        }
+
+        /* Keep looping */
+        Entry = Entry->NextHash;
+    }
+
+    /* Not cached */
+    CmpReleaseKcbLockByKey(ConvKey);
+    return NULL;
+}
+
 NTSTATUS
 NTAPI
 CmpBuildHashStackAndLookupCache(IN PCM_KEY_BODY ParseObject,
                                 IN OUT PCM_KEY_CONTROL_BLOCK *Kcb,
-                                IN PUNICODE_STRING Current,
+                                IN OUT PUNICODE_STRING Current,
                                 OUT PHHIVE *Hive,
                                 OUT HCELL_INDEX *Cell,
                                 OUT PULONG TotalRemainingSubkeys,
@@ -1002,26 +1106,87 @@ CmpBuildHashStackAndLookupCache(IN PCM_KEY_BODY ParseObject,
                                 OUT PULONG OuterStackArray,
                                 OUT PULONG *LockedKcbs)
 {
+    CM_HASH_STACK_ENTRY HashStack[CMP_HASH_STACK_SIZE];
+    PCM_KEY_CONTROL_BLOCK CachedKcb = NULL;
+    UNICODE_STRING Remaining, NextName;
+    ULONG ConvKey, Subkeys = 0, Levels = 0, Matched = 0, i;
+    BOOLEAN Result, Last;
+    PWCHAR p;
+
     /* We don't lock anything for now */
     *LockedKcbs = NULL;
 
-    /* Calculate hash values */
-    *TotalRemainingSubkeys = 0xBAADF00D;
+    /* Calculate the hash of every component, as KCBs hash their full path */
+    ConvKey = (*Kcb)->ConvKey;
+    Remaining = *Current;
+    while (TRUE)
+    {
+        /* Get the next component and stop at the end */
+        Result = CmpGetNextName(&Remaining, &NextName, &Last);
+        if (!NextName.Length) break;
+        Subkeys++;
+
+        /* Stop hashing at the first name the parse loop would reject */
+        if (!(Result) ||
+            (Levels != Subkeys - 1) ||
+            (Levels == CMP_HASH_STACK_SIZE))
+        {
+            continue;
+        }
+
+        /* Add this component to the hash */
+        for (p = NextName.Buffer, i = 0; i < NextName.Length; i += sizeof(WCHAR))
+        {
+            ConvKey = 37 * ConvKey + RtlUpcaseUnicodeChar(*p++);
+        }
+
+        /* Save it on the stack */
+        HashStack[Levels].ConvKey = ConvKey;
+        HashStack[Levels].KeyName = NextName;
+        HashStack[Levels].RemainingName = Remaining;
+        Levels++;
+    }
 
     /* Lock the registry */
     CmpLockRegistry();
 
+    /*
+     * Look for the longest prefix that has a KCB. The last component is
+     * always left to the parse loop so that it does the actual open.
+     */
+    if (!((*Kcb)->Flags & KEY_SYM_LINK) && !((*Kcb)->Delete))
+    {
+        for (Matched = min(Levels, Subkeys - 1); Matched; Matched--)
+        {
+            CachedKcb = CmpLookupCachedKcb(*Kcb, HashStack, Matched - 1);
+            if (CachedKcb) break;
+        }
+    }
+
+    /* Check if we found one */
+    if (CachedKcb)
+    {
+        /* Continue parsing from there */
+        *Kcb = CachedKcb;
+        *Current = HashStack[Matched - 1].RemainingName;
+    }
+    else
+    {
+        /* Make sure it's not a dead KCB */
+        ASSERT((*Kcb)->RefCount > 0);
+
+        /* Reference the one we started from */
+        (VOID)CmpReferenceKeyControlBlock(*Kcb);
+    }
+
     /* Return hive and cell data */
     *Hive = (*Kcb)->KeyHive;
     *Cell = (*Kcb)->KeyCell;
 
-    /* Make sure it's not a dead KCB */
-    ASSERT((*Kcb)->RefCount > 0);
-
-    /* Reference it */
-    (VOID)CmpReferenceKeyControlBlock(*Kcb);
-
-    /* Return success for now */
+    /* Return how much of the path was found in the cache */
+    *TotalSubkeys = Subkeys;
+    *MatchRemainSubkeyLevel = Matched;
+    *TotalRemainingSubkeys = Subkeys - Matched;
     return STATUS_SUCCESS;
 }
 
@@ -1102,9 +1267,8 @@ CmpParseKey(IN PVOID ParseObject,
     /* Sanity check */
     ASSERT(ParentKcb != NULL);
 
-    /* Check if everything was found cached */
-    if (!TotalRemainingSubkeys)
-        ASSERTMSG("Caching not implemented\n", FALSE);
+    /* The cache always leaves the last component to us */
+    ASSERT(TotalRemainingSubkeys || !TotalSubkeys);
 
     /* Don't do anything if we're being deleted */
     if (Kcb->Delete)
@@ -1415,6 +1579,15 @@ Quickie:
     if (ParentKcb)
         CmpDereferenceKeyControlBlock(ParentKcb);
 
+    /* Let the kernel logger see the open or create */
+    if (WmiTraceEnabled(WMIP_TRACE_REGISTRY))
+    {
+        WmipTraceRegistryParse(ParseContext != NULL,
+                               Status,
+                               CompleteName,
+                               (Status == STATUS_SUCCESS) ? *Object : NULL);
+    }
+
     /* Unlock the registry */
     CmpUnlockRegistry();
     return Status;
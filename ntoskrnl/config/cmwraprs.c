@@ -120,6 +120,84 @@ CmpFileWrite(IN PHHIVE RegistryHive,
     return NT_SUCCESS(Status) ? TRUE : FALSE;
 }
 
+BOOLEAN
+NTAPI
+CmpFileWriteGather(IN PHHIVE RegistryHive,
+                   IN ULONG FileType,
+                   IN PCMP_OFFSET_ARRAY OffsetArray,
+                   IN ULONG OffsetArrayCount)
+{
+    PCMHIVE CmHive = (PCMHIVE)RegistryHive;
+    HANDLE HiveHandle = CmHive->FileHandles[FileType];
+    LARGE_INTEGER _FileOffset;
+    IO_STATUS_BLOCK IoStatusBlock;
+    NTSTATUS Status = STATUS_SUCCESS;
+    PUCHAR Buffer = NULL, Ptr;
+    PVOID WriteBuffer;
+    ULONG Length;
+    ULONG i, j, k;
+
+    /* Just return success if no file is associated with this hive */
+    if (HiveHandle == NULL)
+        return TRUE;
+
+    /* Don't do anything if we're not supposed to */
+    if (CmpNoWrite)
+        return TRUE;
+
+    for (i = 0; i < OffsetArrayCount; i = j)
+    {
+        /* Find the pieces that follow this one in the file and fit in the buffer */
+        Length = OffsetArray[i].DataLength;
+        for (j = i + 1; j < OffsetArrayCount; j++)
+        {
+            if ((OffsetArray[j].FileOffset != OffsetArray[i].FileOffset + Length) ||
+                (Length + OffsetArray[j].DataLength > CMP_GATHER_BUFFER_SIZE))
+            {
+                break;
+            }
+
+            Length += OffsetArray[j].DataLength;
+        }
+
+        /* Merge them into one write if we can, otherwise write this one alone */
+        WriteBuffer = OffsetArray[i].DataBuffer;
+        if (j - i > 1)
+        {
+            if (!Buffer)
+                Buffer = ExAllocatePoolWithTag(PagedPool, CMP_GATHER_BUFFER_SIZE, TAG_CM);
+
+            if (Buffer)
+            {
+                Ptr = Buffer;
+                for (k = i; k < j; k++)
+                {
+                    RtlCopyMemory(Ptr, OffsetArray[k].DataBuffer, OffsetArray[k].DataLength);
+                    Ptr += OffsetArray[k].DataLength;
+                }
+
+                WriteBuffer = Buffer;
+            }
+            else
+            {
+                j = i + 1;
+                Length = OffsetArray[i].DataLength;
+            }
+        }
+
+        _FileOffset.QuadPart = OffsetArray[i].FileOffset;
+        Status = ZwWriteFile(HiveHandle, NULL, NULL, NULL, &IoStatusBlock,
+                             WriteBuffer, Length, &_FileOffset, NULL);
+        if (!NT_SUCCESS(Status))
+            break;
+    }
+
+    if (Buffer)
+        ExFreePoolWithTag(Buffer, TAG_CM);
+
+    return NT_SUCCESS(Status) ? TRUE : FALSE;
+}
+
 BOOLEAN
 NTAPI
 CmpFileSetSize(IN PHHIVE RegistryHive,
@@ -738,8 +738,8 @@ QSI_DEF(SystemPerformanceInformation)
     Spi->PageReadIoCount = 0; /* FIXME */
     Spi->CacheReadCount = 0; /* FIXME */
     Spi->CacheIoCount = 0; /* FIXME */
-    Spi->DirtyPagesWriteCount = 0; /* FIXME */
-    Spi->DirtyWriteIoCount = 0; /* FIXME */
+    Spi->DirtyPagesWriteCount = MiPageFileWritePageCount;
+    Spi->DirtyWriteIoCount = MiPageFileWriteIoCount;
     Spi->MappedPagesWriteCount = 0; /* FIXME */
     Spi->MappedWriteIoCount = 0; /* FIXME */
 
@@ -796,9 +796,9 @@ QSI_DEF(SystemPerformanceInformation)
     Spi->CcCopyReadWaitMiss = 0; /* FIXME */
 
     Spi->CcMdlReadNoWait = 0; /* FIXME */
-    Spi->CcMdlReadWait = 0; /* FIXME */
+    Spi->CcMdlReadWait = CcMdlReadWait;
     Spi->CcMdlReadNoWaitMiss = 0; /* FIXME */
-    Spi->CcMdlReadWaitMiss = 0; /* FIXME */
+    Spi->CcMdlReadWaitMiss = CcMdlReadWaitMiss;
     Spi->CcReadAheadIos = 0; /* FIXME */
     Spi->CcLazyWriteIos = CcLazyWriteIos;
     Spi->CcLazyWritePages = CcLazyWritePages;
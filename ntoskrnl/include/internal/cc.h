@@ -63,6 +63,8 @@ extern ULONG CcMapDataNoWait;
 extern ULONG CcPinReadWait;
 extern ULONG CcPinReadNoWait;
 extern ULONG CcPinMappedDataCount;
+extern ULONG CcMdlReadWait;
+extern ULONG CcMdlReadWaitMiss;
 extern ULONG CcDataPages;
 extern ULONG CcDataFlushes;
 
@@ -167,6 +169,22 @@ typedef struct _PFSN_PREFETCHER_GLOBALS
     LONG ActivePrefetches;
 } PFSN_PREFETCHER_GLOBALS, *PPFSN_PREFETCHER_GLOBALS;
 
+/*
+ * Each level of the VACB index covers VACB_INDEX_LEVEL_SIZE consecutive views
+ * of the level below it. The bottom level points to the VACBs themselves.
+ */
+#define VACB_INDEX_LEVEL_SHIFT 7
+#define VACB_INDEX_LEVEL_SIZE (1 << VACB_INDEX_LEVEL_SHIFT)
+#define VACB_INDEX_MAX_DEPTH ((63 - 18 + VACB_INDEX_LEVEL_SHIFT - 1) / VACB_INDEX_LEVEL_SHIFT)
+
+typedef struct _ROS_VACB_INDEX_LEVEL
+{
+    /* Number of non-NULL entries */
+    ULONG ActiveEntries;
+    /* Next level or VACB for each view */
+    PVOID Entries[VACB_INDEX_LEVEL_SIZE];
+} ROS_VACB_INDEX_LEVEL, *PROS_VACB_INDEX_LEVEL;
+
 typedef struct _ROS_SHARED_CACHE_MAP
 {
     CSHORT NodeTypeCode;
@@ -190,7 +208,11 @@ typedef struct _ROS_SHARED_CACHE_MAP
     PRIVATE_CACHE_MAP PrivateCacheMap;
 
     /* ROS specific */
+    /* VACBs of this map, in no particular order */
     LIST_ENTRY CacheMapVacbListHead;
+    /* Index of the VACBs by view, protected by CacheMapLock */
+    PROS_VACB_INDEX_LEVEL VacbIndex;
+    ULONG VacbIndexDepth;
     BOOLEAN PinAccess;
     KSPIN_LOCK CacheMapLock;
 #if DBG
@@ -315,6 +337,12 @@ CcRosFlushVacb(
     _Out_opt_ PIO_STATUS_BLOCK Iosb
 );
 
+VOID
+CcRosRemoveVacbFromIndex(
+    _In_ PROS_SHARED_CACHE_MAP SharedCacheMap,
+    _In_ PROS_VACB Vacb
+);
+
 NTSTATUS
 CcRosGetVacb(
     PROS_SHARED_CACHE_MAP SharedCacheMap,
@@ -78,6 +78,12 @@
 //
 #define CMP_SECURITY_HASH_LISTS                         64
 #define CMP_MAX_CALLBACKS                               100
+#define CMP_HASH_STACK_SIZE                             32
+
+//
+// Largest buffer used to merge the pieces of a gathered hive write
+//
+#define CMP_GATHER_BUFFER_SIZE                          (64 * 1024)
 
 //
 // Hashing Constants
@@ -1266,6 +1272,15 @@ CmpFileWrite(
     IN SIZE_T BufferLength
 );
 
+BOOLEAN
+NTAPI
+CmpFileWriteGather(
+    IN PHHIVE RegistryHive,
+    IN ULONG FileType,
+    IN PCMP_OFFSET_ARRAY OffsetArray,
+    IN ULONG OffsetArrayCount
+);
+
 BOOLEAN
 NTAPI
 CmpFileSetSize(
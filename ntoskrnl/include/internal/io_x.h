@@ -76,6 +76,20 @@ IopUnQueueIrpFromThread(IN PIRP Irp)
     InitializeListHead(&Irp->ThreadListEntry);
 }
 
+FORCEINLINE
+BOOLEAN
+IopSkipCompletionPort(IN PFILE_OBJECT FileObject,
+                      IN NTSTATUS Status)
+{
+    /*
+     * With FILE_SKIP_COMPLETION_PORT_ON_SUCCESS the caller already handled
+     * the result of a request that succeeded without pending, so don't post
+     * a completion packet for it.
+     */
+    return ((FileObject->Flags & FO_SKIP_COMPLETION_PORT) &&
+            NT_SUCCESS(Status));
+}
+
 static
 __inline
 VOID
@@ -67,6 +67,7 @@ typedef struct _KI_SAMPLE_MAP
 } KI_SAMPLE_MAP, *PKI_SAMPLE_MAP;
 
 #define MAX_TIMER_DPCS                      16
+#define KI_TIMER_COALESCING_WINDOWS         4
 
 typedef struct _DPC_QUEUE_ENTRY
 {
@@ -83,6 +84,22 @@ typedef struct _KNMI_HANDLER_CALLBACK
     PVOID Handle;
 } KNMI_HANDLER_CALLBACK, *PKNMI_HANDLER_CALLBACK;
 
+//
+// Per-processor dispatcher placement statistics. Each entry is only updated
+// while holding the PRCB lock of the processor it describes.
+//
+typedef struct DECLSPEC_CACHEALIGN _KI_READY_QUEUE_STATISTICS
+{
+    ULONG ReadyInsertCount;
+    ULONG IdleDispatchCount;
+    ULONG StandbyPreemptCount;
+    ULONG RunningPreemptCount;
+    ULONG IdealProcessorCount;
+    ULONG LastProcessorCount;
+    ULONG RemotePlacementCount;
+    ULONG StealCount;
+} KI_READY_QUEUE_STATISTICS, *PKI_READY_QUEUE_STATISTICS;
+
 typedef PCHAR
 (NTAPI *PKE_BUGCHECK_UNICODE_TO_ANSI)(
     IN PUNICODE_STRING Unicode,
@@ -129,6 +146,7 @@ extern LIST_ENTRY KeBugcheckCallbackListHead, KeBugcheckReasonCallbackListHead;
 extern KSPIN_LOCK BugCheckCallbackLock;
 extern KDPC KiTimerExpireDpc;
 extern KTIMER_TABLE_ENTRY KiTimerTableListHead[TIMER_TABLE_SIZE];
+extern ULONG KiTimerCoalescingWindows[KI_TIMER_COALESCING_WINDOWS];
 extern FAST_MUTEX KiGenericCallDpcMutex;
 extern LIST_ENTRY KiProfileListHead, KiProfileSourceListHead;
 extern KSPIN_LOCK KiProfileLock;
@@ -139,6 +157,7 @@ extern KEVENT KiSwapEvent;
 extern PKPRCB KiProcessorBlock[];
 extern ULONG KiMask32Array[MAXIMUM_PRIORITY];
 extern ULONG_PTR KiIdleSummary;
+extern KI_READY_QUEUE_STATISTICS KiReadyQueueStatistics[MAXIMUM_PROCESSORS];
 extern PVOID KeUserApcDispatcher;
 extern PVOID KeUserCallbackDispatcher;
 extern PVOID KeUserExceptionDispatcher;
@@ -276,6 +295,12 @@ KiSelectNextThread(
     IN PKPRCB Prcb
 );
 
+PKTHREAD
+FASTCALL
+KiStealReadyThread(
+    IN PKPRCB Prcb
+);
+
 BOOLEAN
 FASTCALL
 KiInsertTimerTable(
@@ -374,7 +399,7 @@ UCHAR
 NTAPI
 KeFindNextRightSetAffinity(
     IN UCHAR Number,
-    IN ULONG Set
+    IN KAFFINITY Set
 );
 
 VOID
@@ -649,6 +674,19 @@ KiInsertQueue(
     BOOLEAN Head
 );
 
+#if (NTDDI_VERSION < NTDDI_VISTA)
+ULONG
+NTAPI
+KeRemoveQueueEx(
+    IN PKQUEUE Queue,
+    IN KPROCESSOR_MODE WaitMode,
+    IN BOOLEAN Alertable,
+    IN PLARGE_INTEGER Timeout OPTIONAL,
+    OUT PLIST_ENTRY *EntryArray,
+    IN ULONG Count
+);
+#endif
+
 VOID
 NTAPI
 KiTimerExpiration(
@@ -232,6 +232,17 @@ KiReleasePrcbLock(IN PKPRCB Prcb)
     UNREFERENCED_PARAMETER(Prcb);
 }
 
+//
+// This routine protects against multiple CPU acquires, it's meaningless on UP.
+//
+FORCEINLINE
+BOOLEAN
+KiTryAcquirePrcbLock(IN PKPRCB Prcb)
+{
+    UNREFERENCED_PARAMETER(Prcb);
+    return TRUE;
+}
+
 //
 // This routine protects against multiple CPU acquires, it's meaningless on UP.
 //
@@ -476,6 +487,27 @@ KiReleasePrcbLock(IN PKPRCB Prcb)
     InterlockedAnd((PLONG)&Prcb->PrcbLock, 0);
 }
 
+//
+// This routine attempts to acquire the PRCB lock of another processor without
+// spinning, so that it can be taken while already holding a PRCB lock.
+//
+// Since this is a simple optimized spin-lock, it must only be acquired
+// at dispatcher level or higher!
+//
+FORCEINLINE
+BOOLEAN
+KiTryAcquirePrcbLock(IN PKPRCB Prcb)
+{
+    /* Make sure we're at a safe level to touch the PRCB lock */
+    ASSERT(KeGetCurrentIrql() >= DISPATCH_LEVEL);
+
+    /* Don't bother if someone else already owns it */
+    if (Prcb->PrcbLock) return FALSE;
+
+    /* Try to acquire it and return whether we got it first */
+    return (InterlockedExchange((PLONG)&Prcb->PrcbLock, 1) == 0);
+}
+
 //
 // This routine acquires the thread lock so that only one caller can touch
 // volatile thread data.
@@ -883,6 +915,28 @@ KiComputeTimerTableIndex(IN ULONGLONG DueTime)
     return (DueTime / KeMaximumIncrement) & (TIMER_TABLE_SIZE - 1);
 }
 
+//
+// Rounds the due time of a coalescable timer up to the next multiple of its
+// coalescing window, so that timers with a similar tolerance share a tick
+//
+FORCEINLINE
+ULONGLONG
+KiCoalesceDueTime(IN ULONGLONG DueTime,
+                  IN ULONG EncodedTolerableDelay)
+{
+    ULONGLONG Window;
+
+    /* Get the window, in 100ns units */
+    ASSERT(EncodedTolerableDelay != 0);
+    ASSERT(EncodedTolerableDelay <= KI_TIMER_COALESCING_WINDOWS);
+    Window = UInt32x32To64(KiTimerCoalescingWindows[EncodedTolerableDelay - 1],
+                           10000);
+
+    /* Round up to it */
+    DueTime += Window - 1;
+    return DueTime - (DueTime % Window);
+}
+
 //
 // Called from KiCompleteTimer, KiInsertTreeTimer, KeSetSystemTime
 // to remove timer entries
@@ -987,6 +1041,15 @@ KiComputeDueTime(IN PKTIMER Timer,
     /* Recalculate due time */
     Timer->DueTime.QuadPart = InterruptTime.QuadPart - DueTime.QuadPart;
 
+    /* Check if the timer can be delayed */
+    if (Timer->Header.Coalescable)
+    {
+        /* Round it up to its window, so it expires along with its peers */
+        Timer->DueTime.QuadPart =
+            KiCoalesceDueTime(Timer->DueTime.QuadPart,
+                              Timer->Header.EncodedTolerableDelay);
+    }
+
     /* Get the handle */
     *Hand = KiComputeTimerTableIndex(Timer->DueTime.QuadPart);
     Timer->Header.Hand = (UCHAR)*Hand;
@@ -1240,7 +1303,7 @@ KxSetTimerForThreadWait(IN PKTIMER Timer,
     }                                                                       \
                                                                             \
     /* Set wait settings */                                                 \
-    Thread->Alertable = FALSE;                                              \
+    Thread->Alertable = Alertable;                                          \
     Thread->WaitMode = WaitMode;                                            \
     Thread->WaitReason = WrQueue;                                           \
                                                                             \
@@ -92,6 +92,17 @@
     KeReleaseSemaphore(s, 1, 1, FALSE);                     \
 }
 
+//
+// Releases an LPC Semaphore and keeps the dispatcher lock held, so the wait
+// that must follow starts before the woken thread can preempt the caller
+//
+#define LpcpCompleteWaitNext(s)                             \
+{                                                           \
+    /* Release the semaphore */                             \
+    LPCTRACE(LPC_SEND_DEBUG, "Release next: %p\n", s);      \
+    KeReleaseSemaphore(s, 1, 1, TRUE);                      \
+}
+
 //
 // Allocates a new message
 //
@@ -13,6 +13,8 @@ struct _EPROCESS;
 extern PMMSUPPORT MmKernelAddressSpace;
 extern PFN_COUNT MiFreeSwapPages;
 extern PFN_COUNT MiUsedSwapPages;
+extern ULONG MiPageFileWriteIoCount;
+extern ULONG MiPageFileWritePageCount;
 extern PFN_COUNT MmNumberOfPhysicalPages;
 extern UCHAR MmDisablePagingExecutive;
 extern PFN_NUMBER MmLowestPhysicalPage;
@@ -217,7 +219,7 @@ typedef struct _MM_SECTION_SEGMENT
 
     ULONGLONG LastPage;
 
-	RTL_GENERIC_TABLE PageTable;
+	struct _CACHE_SECTION_PAGE_NODE *PageTable;	/* radix tree of page tables, see sptab.c */
 } MM_SECTION_SEGMENT, *PMM_SECTION_SEGMENT;
 
 typedef struct _MM_IMAGE_SECTION_OBJECT
@@ -506,6 +508,7 @@ typedef struct _MMPAGING_FILE
     PFILE_OBJECT FileObject;
     UNICODE_STRING PageFileName;
     PRTL_BITMAP Bitmap;
+    ULONG Hint;
     HANDLE FileHandle;
 }
 MMPAGING_FILE, *PMMPAGING_FILE;
@@ -704,6 +707,12 @@ SWAPENTRY
 NTAPI
 MmAllocSwapPage(VOID);
 
+SWAPENTRY
+NTAPI
+MmAllocSwapPages(
+    _Inout_ PULONG Count
+);
+
 VOID
 NTAPI
 MmFreeSwapPage(SWAPENTRY Entry);
@@ -731,6 +740,18 @@ MmWriteToSwapPage(
     PFN_NUMBER Page
 );
 
+NTSTATUS
+NTAPI
+MmQueueSwapPageWrite(
+    _In_ PEPROCESS Process,
+    _In_ PVOID Address,
+    _In_ PFN_NUMBER Page
+);
+
+ULONG
+NTAPI
+MmFlushSwapPageWrites(VOID);
+
 VOID
 NTAPI
 MmShowOutOfSpaceMessagePagingFile(VOID);
@@ -956,6 +977,15 @@ NTSTATUS
 NTAPI
 MmPageOutPhysicalAddress(PFN_NUMBER Page);
 
+VOID
+NTAPI
+MmFinishPageOut(
+    _In_ PEPROCESS Process,
+    _In_ PVOID Address,
+    _In_ PFN_NUMBER Page,
+    _In_ SWAPENTRY SwapEntry
+);
+
 PMM_SECTION_SEGMENT
 NTAPI
 MmGetSectionAssociation(PFN_NUMBER Page,
@@ -79,6 +79,7 @@
 #include "hal.h"
 #include "hdl.h"
 #include "icif.h"
+#include "wmi.h"
 #include "arch/intrin_i.h"
 #include <arbiter.h>
 
@@ -13,9 +13,11 @@
 /* Cache Manager Tags */
 #define TAG_CC                  '  cC'
 #define TAG_VACB                'aVcC'
+#define TAG_VACB_INDEX          'iVcC'
 #define TAG_SHARED_CACHE_MAP    'cScC'
 #define TAG_PRIVATE_CACHE_MAP   'cPcC'
 #define TAG_BCB                 'cBcC'
+#define TAG_CC_MDL              'dMcC'
 
 /* Executive Tags */
 #define TAG_CALLBACK_ROUTINE_BLOCK 'brbC'
@@ -167,3 +169,7 @@
 
 /* FSTUB Tag */
 #define TAG_FSTUB 'BtsF'
+
+/* WMI Tags */
+#define TAG_WMI_LOGGER 'LimW'
+#define TAG_WMI_BUFFER 'BimW'
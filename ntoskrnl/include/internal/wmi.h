@@ -0,0 +1,62 @@
+/*
+ * PROJECT:     ReactOS Kernel
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Internal header for the kernel logger hooks
+ */
+
+#pragma once
+
+//
+// Event groups of the kernel logger, same values as EVENT_TRACE_FLAG_*
+//
+#define WMIP_TRACE_CSWITCH          0x00000010
+#define WMIP_TRACE_DISK_IO          0x00000100
+#define WMIP_TRACE_DISK_IO_INIT     0x00000400
+#define WMIP_TRACE_PAGE_FAULTS      0x00001000
+#define WMIP_TRACE_REGISTRY         0x00020000
+
+//
+// Enable flags of the running kernel logger, zero while it is stopped.
+// Hooks test their group here before calling into the logger, so that
+// with tracing off they cost one load and one predictable branch.
+//
+extern ULONG WmipKernelLoggerFlags;
+
+#define WmiTraceEnabled(Group) (WmipKernelLoggerFlags & (Group))
+
+VOID
+FASTCALL
+WmipTraceContextSwitch(
+    IN PKTHREAD OldThread,
+    IN PKTHREAD NewThread
+);
+
+VOID
+FASTCALL
+WmipTraceIrpStart(
+    IN PDEVICE_OBJECT DeviceObject,
+    IN PIRP Irp
+);
+
+VOID
+FASTCALL
+WmipTraceIrpCompletion(
+    IN PIRP Irp
+);
+
+VOID
+FASTCALL
+WmipTracePageFault(
+    IN NTSTATUS Status,
+    IN PVOID Address,
+    IN PVOID TrapInformation
+);
+
+VOID
+NTAPI
+WmipTraceRegistryParse(
+    IN BOOLEAN Create,
+    IN NTSTATUS Status,
+    IN PCUNICODE_STRING KeyName,
+    IN PVOID Object
+);
@@ -333,7 +333,9 @@ IopCompleteRequest(IN PKAPC Apc,
          !IsIrpSynchronous(Irp, FileObject)))
     {
         /* Get any information we need from the FO before we kill it */
-        if ((FileObject) && (FileObject->CompletionContext))
+        if ((FileObject) && (FileObject->CompletionContext) &&
+            ((Irp->PendingReturned) ||
+             !(IopSkipCompletionPort(FileObject, Irp->IoStatus.Status))))
         {
             /* Save Completion Data */
             Port = FileObject->CompletionContext->Port;
@@ -399,8 +401,12 @@ IopCompleteRequest(IN PKAPC Apc,
         }
         else if (FileObject)
         {
-            /* Signal the file object and set the status */
-            KeSetEvent(&FileObject->Event, 0, FALSE);
+            /* Signal the file object, unless the caller asked us not to */
+            if ((FileObject->Flags & FO_SYNCHRONOUS_IO) ||
+                !(FileObject->Flags & FO_SKIP_SET_EVENT))
+            {
+                KeSetEvent(&FileObject->Event, 0, FALSE);
+            }
             FileObject->FinalStatus = Irp->IoStatus.Status;
 
             /*
@@ -1282,6 +1288,10 @@ IofCallDriver(IN PDEVICE_OBJECT DeviceObject,
     /* Get the Device Object */
     StackPtr->DeviceObject = DeviceObject;
 
+    /* Let the kernel logger see the request */
+    if (WmiTraceEnabled(WMIP_TRACE_DISK_IO_INIT))
+        WmipTraceIrpStart(DeviceObject, Irp);
+
     /* Call it */
     return DriverObject->MajorFunction[StackPtr->MajorFunction](DeviceObject,
                                                                 Irp);
@@ -1337,6 +1347,10 @@ IofCompleteRequest(IN PIRP Irp,
     ASSERT(Irp->IoStatus.Status != STATUS_PENDING);
     ASSERT(Irp->IoStatus.Status != (NTSTATUS)0xFFFFFFFF);
 
+    /* Let the kernel logger see the completion */
+    if (WmiTraceEnabled(WMIP_TRACE_DISK_IO))
+        WmipTraceIrpCompletion(Irp);
+
     /* Get the last stack */
     LastStackPtr = (PIO_STACK_LOCATION)(Irp + 1);
     if (LastStackPtr->Control & SL_ERROR_RETURNED)
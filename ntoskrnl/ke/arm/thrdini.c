@@ -176,31 +176,51 @@ KiIdleLoop(VOID)
             KiRetireDpcList(Prcb);
         }
 
-        /* Check if a new thread is scheduled for execution */
-        if (Prcb->NextThread)
+        /* Check if we should look for ready threads on other processors */
+        if (Prcb->IdleSchedule)
         {
-            /* Enable interrupts */
-            _enable();
-
-            /* Capture current thread data */
-            OldThread = Prcb->CurrentThread;
+            /* Scan for one, this returns with the PRCB lock held */
+            NewThread = KiIdleSchedule(Prcb);
+        }
+        else if (Prcb->NextThread)
+        {
+            /* Acquire the PRCB lock, other processors may replace the standby thread */
+            KiAcquirePrcbLock(Prcb);
             NewThread = Prcb->NextThread;
-
-            /* Set new thread data */
-            Prcb->NextThread = NULL;
-            Prcb->CurrentThread = NewThread;
-
-            /* The thread is now running */
-            NewThread->State = Running;
-
-            /* Switch away from the idle thread */
-            KiSwapContext(APC_LEVEL, OldThread);
         }
         else
         {
             /* Continue staying idle. Note the HAL returns with interrupts on */
             Prcb->PowerState.IdleFunction(&Prcb->PowerState);
+            continue;
         }
+
+        /* Make sure we have something to run now that we own the lock */
+        if (!NewThread)
+        {
+            /* Go back to the start of the idle loop */
+            KiReleasePrcbLock(Prcb);
+            continue;
+        }
+
+        /* Enable interrupts */
+        _enable();
+
+        /* Capture current thread data */
+        OldThread = Prcb->CurrentThread;
+
+        /* Set new thread data */
+        Prcb->NextThread = NULL;
+        Prcb->CurrentThread = NewThread;
+
+        /* The thread is now running */
+        NewThread->State = Running;
+
+        /* Release the PRCB lock, the idle thread is never queued */
+        KiReleasePrcbLock(Prcb);
+
+        /* Switch away from the idle thread */
+        KiSwapContext(APC_LEVEL, OldThread);
     }
 }
 
@@ -324,9 +344,20 @@ KiDispatchInterrupt(VOID)
     }
     else if (Prcb->NextThread)
     {
+        /* Acquire the PRCB lock */
+        KiAcquirePrcbLock(Prcb);
+
+        /* Make sure we still have something to run now that we own the lock */
+        NewThread = Prcb->NextThread;
+        if (!NewThread)
+        {
+            /* Nothing to switch to */
+            KiReleasePrcbLock(Prcb);
+            return;
+        }
+
         /* Capture current thread data */
         OldThread = Prcb->CurrentThread;
-        NewThread = Prcb->NextThread;
 
         /* Set new thread data */
         Prcb->NextThread = NULL;
@@ -550,6 +550,10 @@ KiQuantumEnd(VOID)
     /* Set wait IRQL to APC_LEVEL */
     Thread->WaitIrql = APC_LEVEL;
 
+    /* Log the switch if the kernel logger wants it */
+    if (WmiTraceEnabled(WMIP_TRACE_CSWITCH))
+        WmipTraceContextSwitch(Thread, NextThread);
+
     /* Swap threads */
     KiSwapContext(APC_LEVEL, Thread);
 
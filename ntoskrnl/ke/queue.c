@@ -138,6 +138,33 @@ KiInsertQueue(IN PKQUEUE Queue,
     return InitialState;
 }
 
+/*
+ * Moves already queued entries into the caller's array, up to Count.
+ * The calling thread is already accounted for in CurrentCount, so these
+ * don't take any more concurrency. Called with the dispatcher lock held.
+ */
+static
+ULONG
+KiRemoveQueueEntries(IN PKQUEUE Queue,
+                     OUT PLIST_ENTRY *EntryArray,
+                     IN ULONG EntryCount,
+                     IN ULONG Count)
+{
+    PLIST_ENTRY QueueEntry;
+
+    while ((EntryCount < Count) &&
+           (Queue->EntryListHead.Flink != &Queue->EntryListHead))
+    {
+        /* Remove the Entry */
+        QueueEntry = RemoveHeadList(&Queue->EntryListHead);
+        QueueEntry->Flink = NULL;
+        Queue->Header.SignalState--;
+        EntryArray[EntryCount++] = QueueEntry;
+    }
+
+    return EntryCount;
+}
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*
@@ -240,7 +267,32 @@ KeRemoveQueue(IN PKQUEUE Queue,
               IN PLARGE_INTEGER Timeout OPTIONAL)
 {
     PLIST_ENTRY QueueEntry;
+
+    /* Remove a single entry, or get the wait status back */
+    KeRemoveQueueEx(Queue, WaitMode, FALSE, Timeout, &QueueEntry, 1);
+    return QueueEntry;
+}
+
+/*
+ * @implemented
+ *
+ * Removes up to Count entries from the queue, waiting only for the first one.
+ * If the wait fails, a single status (cast to PLIST_ENTRY) is returned in
+ * EntryArray[0].
+ */
+ULONG
+NTAPI
+KeRemoveQueueEx(IN PKQUEUE Queue,
+                IN KPROCESSOR_MODE WaitMode,
+                IN BOOLEAN Alertable,
+                IN PLARGE_INTEGER Timeout OPTIONAL,
+                OUT PLIST_ENTRY *EntryArray,
+                IN ULONG Count)
+{
+    PLIST_ENTRY QueueEntry;
+    ULONG EntryCount = 0;
     LONG_PTR Status;
+    KIRQL OldIrql;
     PKTHREAD Thread = KeGetCurrentThread();
     PKQUEUE PreviousQueue;
     PKWAIT_BLOCK WaitBlock = &Thread->WaitBlock[0];
@@ -252,6 +304,7 @@ KeRemoveQueue(IN PKQUEUE Queue,
     ULONG Hand = 0;
     ASSERT_QUEUE(Queue);
     ASSERT_IRQL_LESS_OR_EQUAL(DISPATCH_LEVEL);
+    ASSERT(Count != 0);
 
     /* Check if the Lock is already held */
     if (Thread->WaitNext)
@@ -327,6 +380,10 @@ KeRemoveQueue(IN PKQUEUE Queue,
             /* Remove the Entry */
             RemoveEntryList(QueueEntry);
             QueueEntry->Flink = NULL;
+            EntryArray[EntryCount++] = QueueEntry;
+
+            /* Grab whatever else is already queued */
+            EntryCount = KiRemoveQueueEntries(Queue, EntryArray, EntryCount, Count);
 
             /* Nothing to wait on */
             break;
@@ -344,12 +401,12 @@ KeRemoveQueue(IN PKQUEUE Queue,
             }
             else
             {
-                /* Fail if there's a User APC Pending */
-                if ((WaitMode != KernelMode) &&
-                    (Thread->ApcState.UserApcPending))
+                /* Fail if we were alerted or there's a User APC Pending */
+                Status = KiCheckAlertability(Thread, Alertable, WaitMode);
+                if (Status != STATUS_WAIT_0)
                 {
                     /* Return the status and increase the pending threads */
-                    QueueEntry = (PLIST_ENTRY)STATUS_USER_APC;
+                    EntryArray[EntryCount++] = (PLIST_ENTRY)Status;
                     Queue->CurrentCount++;
                     break;
                 }
@@ -362,7 +419,7 @@ KeRemoveQueue(IN PKQUEUE Queue,
                     if ((ULONG64)InterruptTime.QuadPart >= Timer->DueTime.QuadPart)
                     {
                         /* It did, so we don't need to wait */
-                        QueueEntry = (PLIST_ENTRY)STATUS_TIMEOUT;
+                        EntryArray[EntryCount++] = (PLIST_ENTRY)STATUS_TIMEOUT;
                         Queue->CurrentCount++;
                         break;
                     }
@@ -404,7 +461,28 @@ KeRemoveQueue(IN PKQUEUE Queue,
                 Thread->WaitReason = 0;
 
                 /* Check if we were executing an APC */
-                if (Status != STATUS_KERNEL_APC) return (PLIST_ENTRY)Status;
+                if (Status != STATUS_KERNEL_APC)
+                {
+                    /* We were woken up with an entry or a status */
+                    EntryArray[0] = (PLIST_ENTRY)Status;
+                    EntryCount = 1;
+
+                    /* If it was an entry, pick up what got queued meanwhile */
+                    if ((Count > 1) &&
+                        (Status != STATUS_TIMEOUT) &&
+                        (Status != STATUS_USER_APC) &&
+                        (Status != STATUS_ALERTED))
+                    {
+                        OldIrql = KiAcquireDispatcherLock();
+                        EntryCount = KiRemoveQueueEntries(Queue,
+                                                          EntryArray,
+                                                          EntryCount,
+                                                          Count);
+                        KiReleaseDispatcherLock(OldIrql);
+                    }
+
+                    return EntryCount;
+                }
 
                 /* Check if we had a timeout */
                 if (Timeout)
@@ -427,7 +505,7 @@ KeRemoveQueue(IN PKQUEUE Queue,
     /* Unlock Database and return */
     KiReleaseDispatcherLockFromSynchLevel();
     KiExitDispatcher(Thread->WaitIrql);
-    return QueueEntry;
+    return EntryCount;
 }
 
 /*
@@ -15,25 +15,271 @@
 #ifdef _WIN64
 # define InterlockedOrSetMember(Destination, SetMember) \
     InterlockedOr64((PLONG64)Destination, SetMember);
+# define InterlockedAndSetMember(Destination, SetMember) \
+    InterlockedAnd64((PLONG64)Destination, SetMember);
 #else
 # define InterlockedOrSetMember(Destination, SetMember) \
     InterlockedOr((PLONG)Destination, SetMember);
+# define InterlockedAndSetMember(Destination, SetMember) \
+    InterlockedAnd((PLONG)Destination, SetMember);
 #endif
 
+/* Maximum number of other processors an idle processor tries to steal from */
+#define KI_MAXIMUM_STEAL_ATTEMPTS 4
+
 /* GLOBALS *******************************************************************/
 
 ULONG_PTR KiIdleSummary;
 ULONG_PTR KiIdleSMTSummary;
+KI_READY_QUEUE_STATISTICS KiReadyQueueStatistics[MAXIMUM_PROCESSORS];
+
+/* PRIVATE FUNCTIONS *********************************************************/
+
+//
+// Returns the priority of the thread that will run next on the given
+// processor. This is read without the PRCB lock and is only a hint.
+//
+FORCEINLINE
+KPRIORITY
+KiGetScheduledPriority(IN PKPRCB Prcb)
+{
+    PKTHREAD Thread;
+
+    /* Use the standby thread if there is one, otherwise the running one */
+    Thread = *(PKTHREAD volatile *)&Prcb->NextThread;
+    if (!Thread) Thread = *(PKTHREAD volatile *)&Prcb->CurrentThread;
+    return Thread->Priority;
+}
+
+//
+// Picks a processor for the thread out of the given set, preferring its ideal
+// processor, then the processor it last ran on to keep its cache warm, and
+// finally the closest processor to the ideal one.
+//
+FORCEINLINE
+ULONG
+KiSelectPreferredProcessor(IN PKTHREAD Thread,
+                           IN KAFFINITY Set)
+{
+    ULONG Processor;
+    ASSERT(Set != 0);
+
+    /* Check the ideal processor first */
+    Processor = Thread->IdealProcessor;
+    if (Set & AFFINITY_MASK(Processor)) return Processor;
+
+    /* Then the last processor the thread ran on */
+    Processor = Thread->NextProcessor;
+    if (Set & AFFINITY_MASK(Processor)) return Processor;
+
+    /* Neither is in the set, pick the closest one */
+    return KeFindNextRightSetAffinity(Thread->IdealProcessor, Set);
+}
+
+//
+// Records where a thread was placed compared to its ideal and last
+// processors. Must be called with the target PRCB lock held, before
+// NextProcessor is updated.
+//
+FORCEINLINE
+VOID
+KiUpdatePlacementStatistics(IN PKTHREAD Thread,
+                            IN ULONG Processor)
+{
+    PKI_READY_QUEUE_STATISTICS Statistics = &KiReadyQueueStatistics[Processor];
+
+    /* Check if we kept the thread on its ideal or its previous processor */
+    if (Processor == Thread->IdealProcessor)
+    {
+        Statistics->IdealProcessorCount++;
+    }
+    else if (Processor == Thread->NextProcessor)
+    {
+        Statistics->LastProcessorCount++;
+    }
+
+    /* Check if the placement was done on behalf of another processor */
+    if (Processor != KeGetCurrentProcessorNumber())
+    {
+        Statistics->RemotePlacementCount++;
+    }
+}
+
+//
+// Asks a processor to pick up its new standby thread if it isn't this one.
+// Must be called with the target PRCB lock released.
+//
+FORCEINLINE
+VOID
+KiRequestRemoteDispatch(IN ULONG Processor)
+{
+    /* Check if we're running on another CPU */
+    if (KeGetCurrentProcessorNumber() != Processor)
+    {
+        /* We are, send an IPI */
+        KiIpiSend(AFFINITY_MASK(Processor), IPI_DPC);
+    }
+}
+
+//
+// Removes the highest priority thread that may run on the given processor from
+// another processor's ready queues. Must be called with the victim's PRCB lock
+// held.
+//
+FORCEINLINE
+PKTHREAD
+KiStealReadyThreadFromPrcb(IN PKPRCB VictimPrcb,
+                           IN PKPRCB Prcb)
+{
+    ULONG PrioritySet;
+    ULONG Priority;
+    PLIST_ENTRY ListHead, ListEntry;
+    PKTHREAD Thread;
+
+    /* Go through every priority level with a ready thread, highest first */
+    PrioritySet = VictimPrcb->ReadySummary;
+    while (PrioritySet)
+    {
+        /* Get the highest priority left */
+        BitScanReverse(&Priority, PrioritySet);
+        PrioritySet ^= PRIORITY_MASK(Priority);
+
+        /* Look for a thread that is allowed to run on our processor */
+        ListHead = &VictimPrcb->DispatcherReadyListHead[Priority];
+        for (ListEntry = ListHead->Flink;
+             ListEntry != ListHead;
+             ListEntry = ListEntry->Flink)
+        {
+            Thread = CONTAINING_RECORD(ListEntry, KTHREAD, WaitListEntry);
+            if (!(Thread->Affinity & Prcb->SetMember)) continue;
+
+            /* Make sure this thread is here for a reason */
+            ASSERT(Thread->State == Ready);
+            ASSERT(Thread->Priority == (KPRIORITY)Priority);
+            ASSERT(Thread->NextProcessor == VictimPrcb->Number);
+
+            /* Remove it from the list */
+            if (RemoveEntryList(&Thread->WaitListEntry))
+            {
+                /* The list is empty now, reset the ready summary */
+                VictimPrcb->ReadySummary ^= PRIORITY_MASK(Priority);
+            }
+
+            /* The thread now belongs to our processor */
+            Thread->NextProcessor = Prcb->Number;
+            return Thread;
+        }
+    }
+
+    /* Nothing we can run */
+    return NULL;
+}
+
+//
+// Looks for a ready thread on the other processors' ready queues. Victims are
+// picked by their highest ready priority, closest processor first on ties,
+// and only a bounded number of their PRCB locks are attempted. Must be called
+// with the PRCB lock of the current processor held.
+//
+PKTHREAD
+FASTCALL
+KiStealReadyThread(IN PKPRCB Prcb)
+{
+    KAFFINITY VictimSet;
+    ULONG Attempt, Offset, Number, Victim, Priority;
+    LONG BestPriority;
+    ULONG ReadySummary;
+    PKPRCB VictimPrcb;
+    PKTHREAD Thread;
+
+    /* Only look at other active processors */
+    VictimSet = KeActiveProcessors & ~Prcb->SetMember;
+
+    for (Attempt = 0; (Attempt < KI_MAXIMUM_STEAL_ATTEMPTS) && (VictimSet); Attempt++)
+    {
+        /* Find the victim with the most important ready thread, locklessly */
+        BestPriority = -1;
+        Victim = 0;
+        for (Offset = 1; Offset < (ULONG)KeNumberProcessors; Offset++)
+        {
+            Number = (Prcb->Number + Offset) % (ULONG)KeNumberProcessors;
+            if (!(VictimSet & AFFINITY_MASK(Number))) continue;
+
+            ReadySummary = KiProcessorBlock[Number]->ReadySummary;
+            if (!ReadySummary) continue;
+
+            BitScanReverse(&Priority, ReadySummary);
+            if ((LONG)Priority > BestPriority)
+            {
+                BestPriority = (LONG)Priority;
+                Victim = Number;
+            }
+        }
+
+        /* Nobody has anything ready, we're done */
+        if (BestPriority < 0) break;
+
+        /* Don't visit this victim again */
+        VictimSet &= ~(KAFFINITY)AFFINITY_MASK(Victim);
+
+        /* Never spin on another PRCB lock while holding ours */
+        VictimPrcb = KiProcessorBlock[Victim];
+        if (!KiTryAcquirePrcbLock(VictimPrcb)) continue;
+
+        /* Try to take a thread from it */
+        Thread = KiStealReadyThreadFromPrcb(VictimPrcb, Prcb);
+        KiReleasePrcbLock(VictimPrcb);
+        if (Thread)
+        {
+            /* Got one */
+            KiReadyQueueStatistics[Prcb->Number].StealCount++;
+            return Thread;
+        }
+    }
+
+    /* Nothing to steal */
+    return NULL;
+}
 
 /* FUNCTIONS *****************************************************************/
 
+//
+// Called by the idle loop to look for a thread to run. Returns the standby
+// thread, if any, with the PRCB lock held: the caller must switch to it and
+// release the lock.
+//
 PKTHREAD
 FASTCALL
 KiIdleSchedule(IN PKPRCB Prcb)
 {
-    /* FIXME: TODO */
-    ASSERTMSG("SMP: Not yet implemented\n", FALSE);
-    return NULL;
+    PKTHREAD Thread;
+
+    /* Acquire the PRCB lock */
+    KiAcquirePrcbLock(Prcb);
+
+    /* Only scan once, going idle again will ask for another scan */
+    Prcb->IdleSchedule = FALSE;
+
+    /* Check if somebody already gave us something to run */
+    Thread = Prcb->NextThread;
+    if (!Thread)
+    {
+        /* Check our own ready queues, then the other processors' ones */
+        Thread = KiSelectReadyThread(0, Prcb);
+        if (!Thread) Thread = KiStealReadyThread(Prcb);
+        if (Thread)
+        {
+            /* We're not idle anymore */
+            InterlockedAndSetMember(&KiIdleSummary, ~Prcb->SetMember);
+
+            /* Set the thread on standby */
+            Thread->State = Standby;
+            Prcb->NextThread = Thread;
+        }
+    }
+
+    /* Return the thread with the PRCB lock still held */
+    return Thread;
 }
 
 VOID
@@ -80,8 +326,9 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
 {
     PKPRCB Prcb;
     BOOLEAN Preempted;
-    ULONG Processor = 0;
-    KPRIORITY OldPriority;
+    ULONG Processor, Candidate;
+    KPRIORITY OldPriority, LowestPriority, ScheduledPriority;
+    KAFFINITY Affinity, IdleSet, ScanSet;
     PKTHREAD NextThread;
 
     /* Sanity checks */
@@ -228,25 +475,91 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
     OldPriority = Thread->Priority;
     Thread->Preempted = FALSE;
 
-    /* Queue the thread on CPU 0 and get the PRCB and lock it */
-    Thread->NextProcessor = 0;
-    Prcb = KiProcessorBlock[0];
-    KiAcquirePrcbLock(Prcb);
+    /* Get the set of processors that this thread is allowed to run on */
+    Affinity = Thread->Affinity & KeActiveProcessors;
+    ASSERT(Affinity != 0);
 
-    /* Check if we have an idle summary */
-    if (KiIdleSummary)
+    /* Get the idle processors in this set and try to hand the thread to one */
+    IdleSet = KiIdleSummary & Affinity;
+    while (IdleSet)
     {
-        /* Clear it and set this thread as the next one */
-        KiIdleSummary = 0;
-        Thread->State = Standby;
-        Prcb->NextThread = Thread;
+        /* Prefer the ideal processor, then the last one we ran on */
+        Processor = KiSelectPreferredProcessor(Thread, IdleSet);
+
+        /* Get the PRCB for the processor and lock it */
+        Prcb = KiProcessorBlock[Processor];
+        KiAcquirePrcbLock(Prcb);
+
+        /* Make sure the processor is still idle and nobody beat us to it */
+        if ((KiIdleSummary & AFFINITY_MASK(Processor)) && !(Prcb->NextThread))
+        {
+            /* Claim the processor by removing it from the idle summary */
+            InterlockedAndSetMember(&KiIdleSummary, ~Prcb->SetMember);
+
+            /* Set this thread as the next one on this processor */
+            KiUpdatePlacementStatistics(Thread, Processor);
+            KiReadyQueueStatistics[Processor].IdleDispatchCount++;
+            Thread->NextProcessor = (UCHAR)Processor;
+            Thread->State = Standby;
+            Prcb->NextThread = Thread;
+
+            /* Unlock the PRCB and wake the processor up if it isn't us */
+            KiReleasePrcbLock(Prcb);
+            KiRequestRemoteDispatch(Processor);
+            return;
+        }
 
-        /* Unlock the PRCB and return */
+        /* Release the lock and try the next idle processor, if any */
         KiReleasePrcbLock(Prcb);
-        return;
+        IdleSet &= ~(KAFFINITY)AFFINITY_MASK(Processor);
     }
 
+    /* No idle processor, so start with the ideal one, or the last one */
+    Processor = KiSelectPreferredProcessor(Thread, Affinity);
+
+    /*
+     * If this thread can't preempt whatever is scheduled on that processor,
+     * look for the lowest priority thread in the allowed set instead. This
+     * is only a hint, the decision is made again below under the PRCB lock.
+     */
+    LowestPriority = KiGetScheduledPriority(KiProcessorBlock[Processor]);
+    if (LowestPriority >= OldPriority)
+    {
+        /* Scan every other processor this thread is allowed to run on */
+        ScanSet = Affinity & ~(KAFFINITY)AFFINITY_MASK(Processor);
+        while (ScanSet)
+        {
+            /* Get the next processor and remove it from the set */
+#ifdef _WIN64
+            BitScanForward64(&Candidate, ScanSet);
+#else
+            BitScanForward(&Candidate, ScanSet);
+#endif
+            ScanSet &= ScanSet - 1;
+
+            /* Check if it is running something less important */
+            ScheduledPriority = KiGetScheduledPriority(KiProcessorBlock[Candidate]);
+            if (ScheduledPriority < LowestPriority)
+            {
+                /* Remember it */
+                LowestPriority = ScheduledPriority;
+                Processor = Candidate;
+            }
+        }
+
+        /* Nothing to preempt: queue on the preferred processor after all */
+        if (LowestPriority >= OldPriority)
+        {
+            Processor = KiSelectPreferredProcessor(Thread, Affinity);
+        }
+    }
+
+    /* Get the PRCB for the processor and lock it */
+    Prcb = KiProcessorBlock[Processor];
+    KiAcquirePrcbLock(Prcb);
+
     /* Set the CPU number */
+    KiUpdatePlacementStatistics(Thread, Processor);
     Thread->NextProcessor = (UCHAR)Processor;
 
     /* Get the next scheduled thread */
@@ -261,6 +574,7 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
         {
             /* Preempt the thread */
             NextThread->Preempted = TRUE;
+            KiReadyQueueStatistics[Processor].StandbyPreemptCount++;
 
             /* Put this one as the next one */
             Thread->State = Standby;
@@ -282,6 +596,7 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
         {
             /* Preempt it if it's already running */
             if (NextThread->State == Running) NextThread->Preempted = TRUE;
+            KiReadyQueueStatistics[Processor].RunningPreemptCount++;
 
             /* Set the thread on standby and as the next thread */
             Thread->State = Standby;
@@ -291,11 +606,7 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
             KiReleasePrcbLock(Prcb);
 
             /* Check if we're running on another CPU */
-            if (KeGetCurrentProcessorNumber() != Thread->NextProcessor)
-            {
-                /* We are, send an IPI */
-                KiIpiSend(AFFINITY_MASK(Thread->NextProcessor), IPI_DPC);
-            }
+            KiRequestRemoteDispatch(Thread->NextProcessor);
             return;
         }
     }
@@ -315,6 +626,7 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
 
     /* Update the ready summary */
     Prcb->ReadySummary |= PRIORITY_MASK(OldPriority);
+    KiReadyQueueStatistics[Processor].ReadyInsertCount++;
 
     /* Sanity check */
     ASSERT(OldPriority == Thread->Priority);
@@ -329,8 +641,9 @@ KiSelectNextThread(IN PKPRCB Prcb)
 {
     PKTHREAD Thread;
 
-    /* Select a ready thread */
+    /* Select a ready thread, or take one from another processor */
     Thread = KiSelectReadyThread(0, Prcb);
+    if (!Thread) Thread = KiStealReadyThread(Prcb);
     if (!Thread)
     {
         /* Didn't find any, get the current idle thread */
@@ -341,7 +654,6 @@ KiSelectNextThread(IN PKPRCB Prcb)
         Prcb->IdleSchedule = TRUE;
 
         /* FIXME: SMT support */
-        ASSERTMSG("SMP: Not yet implemented\n", FALSE);
     }
 
     /* Sanity checks and return the thread */
@@ -375,8 +687,9 @@ KiSwapThread(IN PKTHREAD CurrentThread,
     }
     else
     {
-        /* Try to find a ready thread */
+        /* Try to find a ready thread, or take one from another processor */
         NextThread = KiSelectReadyThread(0, Prcb);
+        if (!NextThread) NextThread = KiStealReadyThread(Prcb);
         if (NextThread)
         {
             /* Switch to it */
@@ -385,8 +698,9 @@ KiSwapThread(IN PKTHREAD CurrentThread,
         }
         else
         {
-            /* Set the idle summary */
+            /* Set the idle summary and keep looking for work while idle */
             InterlockedOrSetMember(&KiIdleSummary, Prcb->SetMember);
+            Prcb->IdleSchedule = TRUE;
 
             /* Schedule the idle thread */
             NextThread = Prcb->IdleThread;
@@ -399,6 +713,10 @@ KiSwapThread(IN PKTHREAD CurrentThread,
     ASSERT(CurrentThread != Prcb->IdleThread);
     KiReleasePrcbLock(Prcb);
 
+    /* Log the switch if the kernel logger wants it */
+    if (WmiTraceEnabled(WMIP_TRACE_CSWITCH))
+        WmipTraceContextSwitch(CurrentThread, NextThread);
+
     /* Save the wait IRQL */
     WaitIrql = CurrentThread->WaitIrql;
 
@@ -800,6 +1118,10 @@ NtYieldExecution(VOID)
             /* Sanity check */
             ASSERT(OldIrql <= DISPATCH_LEVEL);
 
+            /* Log the switch if the kernel logger wants it */
+            if (WmiTraceEnabled(WMIP_TRACE_CSWITCH))
+                WmipTraceContextSwitch(Thread, NextThread);
+
             /* Swap to new thread */
             KiSwapContext(APC_LEVEL, Thread);
             Status = STATUS_SUCCESS;
@@ -816,3 +1138,55 @@ NtYieldExecution(VOID)
     KeLowerIrql(OldIrql);
     return Status;
 }
+
+#if DBG && defined(KDBG)
+BOOLEAN
+ExpKdbgExtReadyQueue(ULONG Argc, PCHAR Argv[])
+{
+    PKPRCB Prcb;
+    PKI_READY_QUEUE_STATISTICS Statistics;
+    PLIST_ENTRY ListHead, ListEntry;
+    ULONG Processor, Priority, Depth;
+
+    KdbpPrint("IdleSummary: %p\n", (PVOID)KiIdleSummary);
+    KdbpPrint("CPU\tSummary\t\tDepth\tInserts\tIdle\tSbPre\tRunPre\tIdeal\tLast\tRemote\tStolen\n");
+
+    /* No need to lock the PRCBs here, we're in DBG */
+    for (Processor = 0; Processor < (ULONG)KeNumberProcessors; Processor++)
+    {
+        Prcb = KiProcessorBlock[Processor];
+        if (!Prcb) continue;
+
+        /* Count the threads sitting in the ready queues */
+        Depth = 0;
+        for (Priority = 0; Priority < MAXIMUM_PRIORITY; Priority++)
+        {
+            ListHead = &Prcb->DispatcherReadyListHead[Priority];
+            for (ListEntry = ListHead->Flink;
+                 ListEntry != ListHead;
+                 ListEntry = ListEntry->Flink)
+            {
+                Depth++;
+            }
+        }
+
+        Statistics = &KiReadyQueueStatistics[Processor];
+        KdbpPrint("%lu\t%08lx\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\n",
+                  Processor,
+                  Prcb->ReadySummary,
+                  Depth,
+                  Statistics->ReadyInsertCount,
+                  Statistics->IdleDispatchCount,
+                  Statistics->StandbyPreemptCount,
+                  Statistics->RunningPreemptCount,
+                  Statistics->IdealProcessorCount,
+                  Statistics->LastProcessorCount,
+                  Statistics->RemotePlacementCount,
+                  Statistics->StealCount);
+    }
+
+    return TRUE;
+}
+#endif
+
+/* EOF */
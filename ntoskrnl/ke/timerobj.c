@@ -19,6 +19,12 @@ LARGE_INTEGER KiTimeIncrementReciprocal;
 UCHAR KiTimeIncrementShiftCount;
 BOOLEAN KiEnableTimerWatchdog = FALSE;
 
+/* Coalescing windows in milliseconds, indexed by EncodedTolerableDelay - 1 */
+ULONG KiTimerCoalescingWindows[KI_TIMER_COALESCING_WINDOWS] =
+{
+    50, 100, 250, 1000
+};
+
 /* PRIVATE FUNCTIONS *********************************************************/
 
 BOOLEAN
@@ -196,6 +202,74 @@ KiCompleteTimer(IN PKTIMER Timer,
     if (RequestInterrupt) HalRequestSoftwareInterrupt(DISPATCH_LEVEL);
 }
 
+static
+BOOLEAN
+KiSetTimerEx(IN OUT PKTIMER Timer,
+             IN LARGE_INTEGER DueTime,
+             IN LONG Period,
+             IN ULONG TolerableDelay,
+             IN PKDPC Dpc OPTIONAL)
+{
+    KIRQL OldIrql;
+    BOOLEAN Inserted;
+    ULONG Hand = 0;
+    BOOLEAN RequestInterrupt = FALSE;
+    ULONG i;
+    ASSERT_TIMER(Timer);
+    ASSERT(KeGetCurrentIrql() <= DISPATCH_LEVEL);
+    DPRINT("KiSetTimerEx(): Timer %p, DueTime %I64d, Period %d, Delay %lu, Dpc %p\n",
+           Timer, DueTime.QuadPart, Period, TolerableDelay, Dpc);
+
+    /* Lock the Database and Raise IRQL */
+    OldIrql = KiAcquireDispatcherLock();
+
+    /* Check if it's inserted, and remove it if it is */
+    Inserted = Timer->Header.Inserted;
+    if (Inserted) KxRemoveTreeTimer(Timer);
+
+    /* Set Default Timer Data */
+    Timer->Dpc = Dpc;
+    Timer->Period = Period;
+
+    /* Use the widest coalescing window that the caller can tolerate */
+    Timer->Header.Coalescable = FALSE;
+    Timer->Header.EncodedTolerableDelay = 0;
+    for (i = KI_TIMER_COALESCING_WINDOWS; i > 0; i--)
+    {
+        if (TolerableDelay >= KiTimerCoalescingWindows[i - 1])
+        {
+            Timer->Header.Coalescable = TRUE;
+            Timer->Header.EncodedTolerableDelay = i;
+            break;
+        }
+    }
+
+    /* Compute the due time */
+    if (!KiComputeDueTime(Timer, DueTime, &Hand))
+    {
+        /* Signal the timer */
+        RequestInterrupt = KiSignalTimer(Timer);
+
+        /* Release the dispatcher lock */
+        KiReleaseDispatcherLockFromSynchLevel();
+
+        /* Check if we need to do an interrupt */
+        if (RequestInterrupt) HalRequestSoftwareInterrupt(DISPATCH_LEVEL);
+    }
+    else
+    {
+        /* Insert the timer */
+        Timer->Header.SignalState = FALSE;
+        KxInsertTimer(Timer, Hand);
+    }
+
+    /* Exit the dispatcher */
+    KiExitDispatcher(OldIrql);
+
+    /* Return old state */
+    return Inserted;
+}
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*
@@ -296,47 +370,22 @@ KeSetTimerEx(IN OUT PKTIMER Timer,
              IN LONG Period,
              IN PKDPC Dpc OPTIONAL)
 {
-    KIRQL OldIrql;
-    BOOLEAN Inserted;
-    ULONG Hand = 0;
-    BOOLEAN RequestInterrupt = FALSE;
-    ASSERT_TIMER(Timer);
-    ASSERT(KeGetCurrentIrql() <= DISPATCH_LEVEL);
-    DPRINT("KeSetTimerEx(): Timer %p, DueTime %I64d, Period %d, Dpc %p\n",
-           Timer, DueTime.QuadPart, Period, Dpc);
-
-    /* Lock the Database and Raise IRQL */
-    OldIrql = KiAcquireDispatcherLock();
-
-    /* Check if it's inserted, and remove it if it is */
-    Inserted = Timer->Header.Inserted;
-    if (Inserted) KxRemoveTreeTimer(Timer);
-
-    /* Set Default Timer Data */
-    Timer->Dpc = Dpc;
-    Timer->Period = Period;
-    if (!KiComputeDueTime(Timer, DueTime, &Hand))
-    {
-        /* Signal the timer */
-        RequestInterrupt = KiSignalTimer(Timer);
-
-        /* Release the dispatcher lock */
-        KiReleaseDispatcherLockFromSynchLevel();
-
-        /* Check if we need to do an interrupt */
-        if (RequestInterrupt) HalRequestSoftwareInterrupt(DISPATCH_LEVEL);
-    }
-    else
-    {
-        /* Insert the timer */
-        Timer->Header.SignalState = FALSE;
-        KxInsertTimer(Timer, Hand);
-    }
-
-    /* Exit the dispatcher */
-    KiExitDispatcher(OldIrql);
+    /* Call the internal function without any tolerable delay */
+    return KiSetTimerEx(Timer, DueTime, Period, 0, Dpc);
+}
 
-    /* Return old state */
-    return Inserted;
+/*
+ * @implemented
+ */
+BOOLEAN
+NTAPI
+KeSetCoalescableTimer(IN OUT PKTIMER Timer,
+                      IN LARGE_INTEGER DueTime,
+                      IN ULONG Period,
+                      IN ULONG TolerableDelay,
+                      IN PKDPC Dpc OPTIONAL)
+{
+    /* Call the internal function */
+    return KiSetTimerEx(Timer, DueTime, (LONG)Period, TolerableDelay, Dpc);
 }
 
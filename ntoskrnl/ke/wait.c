@@ -228,8 +228,16 @@ KiExitDispatcher(IN KIRQL OldIrql)
     /* Lock the PRCB */
     KiAcquirePrcbLock(Prcb);
 
-    /* Get the next and current threads now */
+    /* Get the next thread now, and make sure it's still there */
     NextThread = Prcb->NextThread;
+    if (!NextThread)
+    {
+        /* Nothing to switch to */
+        KiReleasePrcbLock(Prcb);
+        goto Quickie;
+    }
+
+    /* Get the current thread */
     Thread = Prcb->CurrentThread;
 
     /* Set current thread's swap busy to true */
@@ -248,6 +256,10 @@ KiExitDispatcher(IN KIRQL OldIrql)
     /* Set wait IRQL */
     Thread->WaitIrql = OldIrql;
 
+    /* Log the switch if the kernel logger wants it */
+    if (WmiTraceEnabled(WMIP_TRACE_CSWITCH))
+        WmipTraceContextSwitch(Thread, NextThread);
+
     /* Swap threads and check if APCs were pending */
     PendingApc = KiSwapContext(OldIrql, Thread);
     if (PendingApc)
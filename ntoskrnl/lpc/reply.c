@@ -369,7 +369,7 @@ NtReplyWaitReceivePortEx(IN HANDLE PortHandle,
     LARGE_INTEGER CapturedTimeout;
     PLPCP_PORT_OBJECT Port, ReceivePort, ConnectionPort = NULL;
     PLPCP_MESSAGE Message;
-    PETHREAD Thread = PsGetCurrentThread(), WakeupThread;
+    PETHREAD Thread = PsGetCurrentThread(), WakeupThread = NULL;
     PLPCP_CONNECTION_MESSAGE ConnectMessage;
     ULONG ConnectionInfoLength;
 
@@ -586,16 +586,20 @@ NtReplyWaitReceivePortEx(IN HANDLE PortHandle,
                                 CapturedReplyMessage.CallbackId,
                                 CapturedReplyMessage.ClientId);
 
-        /* Release the lock and release the LPC semaphore to wake up waiters */
+        /*
+         * Release the lock and wake up the client. The dispatcher lock stays
+         * held until our receive wait below, so we block before the client
+         * gets to preempt us.
+         */
         KeReleaseGuardedMutex(&LpcpLock);
-        LpcpCompleteWait(&WakeupThread->LpcReplySemaphore);
-
-        /* Now we can let go of the thread */
-        ObDereferenceObject(WakeupThread);
+        LpcpCompleteWaitNext(&WakeupThread->LpcReplySemaphore);
     }
 
     /* Now wait for someone to reply to us */
     LpcpReceiveWait(ReceivePort->MsgQueue.Semaphore, WaitMode);
+
+    /* Now we can let go of the thread we replied to */
+    if (WakeupThread) ObDereferenceObject(WakeupThread);
     if (Status != STATUS_SUCCESS) goto Cleanup;
 
     /* Wait done, get the LPC lock */
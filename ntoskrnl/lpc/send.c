@@ -351,8 +351,12 @@ LpcRequestWaitReplyPort(IN PVOID PortObject,
         }
     }
 
-    /* Now release the semaphore */
-    LpcpCompleteWait(Semaphore);
+    /*
+     * Now release the semaphore, the reply wait is entered right after.
+     * This leaves us at SYNCH_LEVEL, so leaving the critical region only
+     * requests the APC interrupt and APCs are delivered in the wait.
+     */
+    LpcpCompleteWaitNext(Semaphore);
     KeLeaveCriticalRegion();
 
     /* And let's wait for the reply */
@@ -956,8 +960,12 @@ NtRequestWaitReplyPort(IN HANDLE PortHandle,
         }
     }
 
-    /* Now release the semaphore */
-    LpcpCompleteWait(Semaphore);
+    /*
+     * Now release the semaphore, the reply wait is entered right after.
+     * This leaves us at SYNCH_LEVEL, so leaving the critical region only
+     * requests the APC interrupt and APCs are delivered in the wait.
+     */
+    LpcpCompleteWaitNext(Semaphore);
     KeLeaveCriticalRegion();
 
     /* And let's wait for the reply */
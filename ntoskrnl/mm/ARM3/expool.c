@@ -39,14 +39,19 @@ typedef struct _POOL_DPC_CONTEXT
 } POOL_DPC_CONTEXT, *PPOOL_DPC_CONTEXT;
 
 ULONG ExpNumberOfPagedPools;
+ULONG ExpNumberOfNonPagedPools;
 POOL_DESCRIPTOR NonPagedPoolDescriptor;
 PPOOL_DESCRIPTOR ExpPagedPoolDescriptor[16 + 1];
+PPOOL_DESCRIPTOR ExpNonPagedPoolDescriptor[16 + 1];
 PPOOL_DESCRIPTOR PoolVector[2];
 PKGUARDED_MUTEX ExpPagedPoolMutex;
 SIZE_T PoolTrackTableSize, PoolTrackTableMask;
 SIZE_T PoolBigPageTableSize, PoolBigPageTableHash;
 ULONG ExpBigTableExpansionFailed;
 PPOOL_TRACKER_TABLE PoolTrackTable;
+PPOOL_TRACKER_TABLE ExPoolTagTables[MAXIMUM_PROCESSORS];
+PPOOL_TRACKER_TABLE PoolTrackTableExpansion;
+SIZE_T PoolTrackTableExpansionSize, PoolTrackTableExpansionPages;
 PPOOL_TRACKER_BIG_PAGES PoolBigPageTable;
 KSPIN_LOCK ExpTaggedPoolLock;
 ULONG PoolHitTag;
@@ -470,6 +475,51 @@ ExpComputePartialHashForAddress(IN PVOID BaseAddress)
     return (Result >> 24) ^ (Result >> 16) ^ (Result >> 8) ^ Result;
 }
 
+/*
+ * Each processor has its own copy of the tracker table so that the counters
+ * are never written to by more than one processor on the fast path. All the
+ * copies always have the same tags in the same buckets, so reading an entry
+ * is just a matter of adding up that bucket on every processor. Indexes past
+ * the end of the tables refer to the expansion table.
+ */
+static
+VOID
+ExpGetPoolTrackerEntry(IN SIZE_T Index,
+                       OUT PPOOL_TRACKER_TABLE Entry)
+{
+    PPOOL_TRACKER_TABLE Table;
+    ULONG i;
+
+    //
+    // Entries in the expansion table only exist once
+    //
+    if (Index >= PoolTrackTableSize)
+    {
+        *Entry = PoolTrackTableExpansion[Index - PoolTrackTableSize];
+        return;
+    }
+
+    //
+    // Start with the boot processor's table, which every tag goes into first
+    //
+    *Entry = PoolTrackTable[Index];
+    for (i = 1; i < (ULONG)KeNumberProcessors; i++)
+    {
+        //
+        // Processors whose table wasn't allocated use the boot processor's one
+        //
+        Table = ExPoolTagTables[i];
+        if (!Table) continue;
+
+        Entry->NonPagedAllocs += Table[Index].NonPagedAllocs;
+        Entry->NonPagedFrees += Table[Index].NonPagedFrees;
+        Entry->NonPagedBytes += Table[Index].NonPagedBytes;
+        Entry->PagedAllocs += Table[Index].PagedAllocs;
+        Entry->PagedFrees += Table[Index].PagedFrees;
+        Entry->PagedBytes += Table[Index].PagedBytes;
+    }
+}
+
 #if DBG
 /*
  * FORCEINLINE
@@ -532,11 +582,12 @@ MiDumpPoolConsumers(BOOLEAN CalledFromDbg, ULONG Tag, ULONG Mask, ULONG Flags)
     //
     // We'll extract allocations for all the tracked pools
     //
-    for (i = 0; i < PoolTrackTableSize; ++i)
+    for (i = 0; i < PoolTrackTableSize + PoolTrackTableExpansionSize; ++i)
     {
-        PPOOL_TRACKER_TABLE TableEntry;
+        POOL_TRACKER_TABLE MergedEntry;
+        PPOOL_TRACKER_TABLE TableEntry = &MergedEntry;
 
-        TableEntry = &PoolTrackTable[i];
+        ExpGetPoolTrackerEntry(i, &MergedEntry);
 
         //
         // We only care about tags which have allocated memory
@@ -751,6 +802,132 @@ ExpSeedHotTags(VOID)
     }
 }
 
+static
+VOID
+ExpInsertPoolTrackerExpansion(IN ULONG Key,
+                              IN SIZE_T NumberOfBytes,
+                              IN POOL_TYPE PoolType)
+{
+    KIRQL OldIrql;
+    PPOOL_TRACKER_TABLE TableEntry, NewTable, OldTable;
+    SIZE_T i, OldSize, NewPages;
+
+    ExAcquireSpinLock(&ExpTaggedPoolLock, &OldIrql);
+    while (TRUE)
+    {
+        //
+        // Look for this tag, or for a free entry to put it into. This table is
+        // shared by all processors, so it is only ever touched under the lock
+        //
+        for (i = 0; i < PoolTrackTableExpansionSize; i++)
+        {
+            TableEntry = &PoolTrackTableExpansion[i];
+            if ((TableEntry->Key != Key) && (TableEntry->Key)) continue;
+
+            TableEntry->Key = Key;
+            if ((PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
+            {
+                TableEntry->NonPagedAllocs++;
+                TableEntry->NonPagedBytes += NumberOfBytes;
+            }
+            else
+            {
+                TableEntry->PagedAllocs++;
+                TableEntry->PagedBytes += NumberOfBytes;
+            }
+            ExReleaseSpinLock(&ExpTaggedPoolLock, OldIrql);
+            return;
+        }
+
+        //
+        // The expansion table is full too, so grow it by a page. We can't call
+        // into the page allocator with the lock held, so drop it meanwhile
+        //
+        OldSize = PoolTrackTableExpansionSize;
+        NewPages = PoolTrackTableExpansionPages + 1;
+        ExReleaseSpinLock(&ExpTaggedPoolLock, OldIrql);
+
+        NewTable = MiAllocatePoolPages(NonPagedPool, NewPages << PAGE_SHIFT);
+        if (!NewTable)
+        {
+            DPRINT1("Out of pool tag space, ignoring...\n");
+            return;
+        }
+        RtlZeroMemory(NewTable, NewPages << PAGE_SHIFT);
+
+        ExAcquireSpinLock(&ExpTaggedPoolLock, &OldIrql);
+        if (PoolTrackTableExpansionSize != OldSize)
+        {
+            //
+            // Someone else grew it in the meantime, use theirs instead
+            //
+            ExReleaseSpinLock(&ExpTaggedPoolLock, OldIrql);
+            MiFreePoolPages(NewTable);
+            ExAcquireSpinLock(&ExpTaggedPoolLock, &OldIrql);
+            continue;
+        }
+
+        //
+        // Switch to the new table
+        //
+        OldTable = PoolTrackTableExpansion;
+        if (OldTable)
+        {
+            RtlCopyMemory(NewTable, OldTable, OldSize * sizeof(POOL_TRACKER_TABLE));
+        }
+        PoolTrackTableExpansion = NewTable;
+        PoolTrackTableExpansionPages = NewPages;
+        PoolTrackTableExpansionSize = (NewPages << PAGE_SHIFT) / sizeof(POOL_TRACKER_TABLE);
+
+        //
+        // Free the old one without the lock held, and look again
+        //
+        if (OldTable)
+        {
+            ExReleaseSpinLock(&ExpTaggedPoolLock, OldIrql);
+            MiFreePoolPages(OldTable);
+            ExAcquireSpinLock(&ExpTaggedPoolLock, &OldIrql);
+        }
+    }
+}
+
+static
+VOID
+ExpRemovePoolTrackerExpansion(IN ULONG Key,
+                              IN SIZE_T NumberOfBytes,
+                              IN POOL_TYPE PoolType)
+{
+    KIRQL OldIrql;
+    PPOOL_TRACKER_TABLE TableEntry;
+    SIZE_T i;
+
+    ExAcquireSpinLock(&ExpTaggedPoolLock, &OldIrql);
+    for (i = 0; i < PoolTrackTableExpansionSize; i++)
+    {
+        TableEntry = &PoolTrackTableExpansion[i];
+        if (TableEntry->Key != Key) continue;
+
+        if ((PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
+        {
+            TableEntry->NonPagedFrees++;
+            TableEntry->NonPagedBytes -= NumberOfBytes;
+        }
+        else
+        {
+            TableEntry->PagedFrees++;
+            TableEntry->PagedBytes -= NumberOfBytes;
+        }
+        ExReleaseSpinLock(&ExpTaggedPoolLock, OldIrql);
+        return;
+    }
+    ExReleaseSpinLock(&ExpTaggedPoolLock, OldIrql);
+
+    //
+    // The allocation was made while we were out of tag space
+    //
+    DPRINT1("Out of pool tag space, ignoring...\n");
+}
+
 VOID
 NTAPI
 ExpRemovePoolTracker(IN ULONG Key,
@@ -780,7 +957,12 @@ ExpRemovePoolTracker(IN ULONG Key,
     // way so that the day we DO support session pool, it won't require that
     // many changes
     //
-    Table = PoolTrackTable;
+    // Use this processor's own copy of the table, if it has one. If we get
+    // moved to another processor in the meantime, we'll just update the old
+    // processor's copy, which is fine since they all get added up anyway
+    //
+    Table = ExPoolTagTables[KeGetCurrentProcessorNumber()];
+    if (!Table) Table = PoolTrackTable;
     TableMask = PoolTrackTableMask;
     TableSize = PoolTrackTableSize;
     DBG_UNREFERENCED_LOCAL_VARIABLE(TableSize);
@@ -835,11 +1017,10 @@ ExpRemovePoolTracker(IN ULONG Key,
     }
 
     //
-    // And finally this path is hit when all the buckets are full, and we need
-    // some expansion. This path is not yet supported in ReactOS and so we'll
-    // ignore the tag
+    // And finally this path is hit when all the buckets are full, so the tag
+    // must have gone into the expansion table
     //
-    DPRINT1("Out of pool tag space, ignoring...\n");
+    ExpRemovePoolTrackerExpansion(Key, NumberOfBytes, PoolType);
 }
 
 VOID
@@ -848,7 +1029,7 @@ ExpInsertPoolTracker(IN ULONG Key,
                      IN SIZE_T NumberOfBytes,
                      IN POOL_TYPE PoolType)
 {
-    ULONG Hash, Index;
+    ULONG Hash, Index, i;
     KIRQL OldIrql;
     PPOOL_TRACKER_TABLE Table, TableEntry;
     SIZE_T TableMask, TableSize;
@@ -873,7 +1054,6 @@ ExpInsertPoolTracker(IN ULONG Key,
     // ASSERT on ReactOS features not yet supported
     //
     ASSERT(!(PoolType & SESSION_POOL_MASK));
-    ASSERT(KeGetCurrentProcessorNumber() == 0);
 
     //
     // Why the double indirection? Because normally this function is also used
@@ -883,7 +1063,12 @@ ExpInsertPoolTracker(IN ULONG Key,
     // way so that the day we DO support session pool, it won't require that
     // many changes
     //
-    Table = PoolTrackTable;
+    // Use this processor's own copy of the table, if it has one. If we get
+    // moved to another processor in the meantime, we'll just update the old
+    // processor's copy, which is fine since they all get added up anyway
+    //
+    Table = ExPoolTagTables[KeGetCurrentProcessorNumber()];
+    if (!Table) Table = PoolTrackTable;
     TableMask = PoolTrackTableMask;
     TableSize = PoolTrackTableSize;
     DBG_UNREFERENCED_LOCAL_VARIABLE(TableSize);
@@ -930,10 +1115,14 @@ ExpInsertPoolTracker(IN ULONG Key,
             {
                 //
                 // We've won the race, so now create this entry in the bucket
+                // of every processor's table, to keep them all in sync
                 //
                 ASSERT(Table[Hash].Key == 0);
                 PoolTrackTable[Hash].Key = Key;
-                TableEntry->Key = Key;
+                for (i = 1; i < (ULONG)KeNumberProcessors; i++)
+                {
+                    if (ExPoolTagTables[i]) ExPoolTagTables[i][Hash].Key = Key;
+                }
             }
             ExReleaseSpinLock(&ExpTaggedPoolLock, OldIrql);
 
@@ -954,10 +1143,9 @@ ExpInsertPoolTracker(IN ULONG Key,
 
     //
     // And finally this path is hit when all the buckets are full, and we need
-    // some expansion. This path is not yet supported in ReactOS and so we'll
-    // ignore the tag
+    // some expansion
     //
-    DPRINT1("Out of pool tag space, ignoring...\n");
+    ExpInsertPoolTrackerExpansion(Key, NumberOfBytes, PoolType);
 }
 
 CODE_SEG("INIT")
@@ -1011,6 +1199,120 @@ ExInitializePoolDescriptor(IN PPOOL_DESCRIPTOR PoolDescriptor,
     ASSERT(PoolType != PagedPoolSession);
 }
 
+CODE_SEG("INIT")
+VOID
+NTAPI
+ExpAllocatePoolTrackTables(VOID)
+{
+    PPOOL_TRACKER_TABLE Table;
+    SIZE_T TableBytes, j;
+    KIRQL OldIrql;
+    ULONG i;
+
+    TableBytes = PoolTrackTableSize * sizeof(POOL_TRACKER_TABLE);
+    for (i = 1; i < (ULONG)KeNumberProcessors; i++)
+    {
+        //
+        // If we can't get one, this processor keeps sharing the boot
+        // processor's table, which works, only slower
+        //
+        Table = MiAllocatePoolPages(NonPagedPool, TableBytes);
+        if (!Table)
+        {
+            DPRINT1("EXPOOL: No tracker table for processor %lu\n", i);
+            continue;
+        }
+        RtlZeroMemory(Table, TableBytes);
+
+        //
+        // Copy the tags that exist so far, and publish the table while holding
+        // the lock, so that no new tag can be missed in between
+        //
+        ExAcquireSpinLock(&ExpTaggedPoolLock, &OldIrql);
+        for (j = 0; j < PoolTrackTableSize; j++)
+        {
+            Table[j].Key = PoolTrackTable[j].Key;
+        }
+        ExPoolTagTables[i] = Table;
+        ExReleaseSpinLock(&ExpTaggedPoolLock, OldIrql);
+
+        ExpInsertPoolTracker('looP', ROUND_TO_PAGES(TableBytes), NonPagedPool);
+    }
+}
+
+CODE_SEG("INIT")
+VOID
+NTAPI
+ExpAllocatePoolDescriptors(VOID)
+{
+    PPOOL_DESCRIPTOR Descriptor;
+    PKGUARDED_MUTEX PagedLock;
+    PKSPIN_LOCK NonPagedLock;
+    ULONG Count, i;
+
+    //
+    // One pool per processor, as many as we can fit in the descriptor arrays.
+    // With a single processor there is nothing to gain, keep the first pool
+    //
+    Count = min((ULONG)KeNumberProcessors, RTL_NUMBER_OF(ExpPagedPoolDescriptor) - 1);
+    if (Count < 2) return;
+
+    //
+    // Set up the paged pools first. Each one gets its own guarded mutex, right
+    // after the descriptor, just like the first one
+    //
+    for (i = 1; i <= Count; i++)
+    {
+        Descriptor = ExAllocatePoolWithTag(NonPagedPool,
+                                           sizeof(KGUARDED_MUTEX) +
+                                           sizeof(POOL_DESCRIPTOR),
+                                           'looP');
+        if (!Descriptor) break;
+
+        PagedLock = (PKGUARDED_MUTEX)(Descriptor + 1);
+        KeInitializeGuardedMutex(PagedLock);
+        ExInitializePoolDescriptor(Descriptor,
+                                   PagedPool,
+                                   i,
+                                   PoolVector[PagedPool]->Threshold,
+                                   PagedLock);
+        ExpPagedPoolDescriptor[i] = Descriptor;
+    }
+
+    //
+    // Only start using them once they are all ready
+    //
+    KeMemoryBarrier();
+    ExpNumberOfPagedPools = i - 1;
+
+    //
+    // Now do the same for nonpaged pool, with a spin lock for each one
+    //
+    for (i = 1; i <= Count; i++)
+    {
+        Descriptor = ExAllocatePoolWithTag(NonPagedPool,
+                                           sizeof(KSPIN_LOCK) +
+                                           sizeof(POOL_DESCRIPTOR),
+                                           'looP');
+        if (!Descriptor) break;
+
+        NonPagedLock = (PKSPIN_LOCK)(Descriptor + 1);
+        KeInitializeSpinLock(NonPagedLock);
+        ExInitializePoolDescriptor(Descriptor,
+                                   NonPagedPool,
+                                   i,
+                                   PoolVector[NonPagedPool]->Threshold,
+                                   NonPagedLock);
+        ExpNonPagedPoolDescriptor[i] = Descriptor;
+    }
+
+    KeMemoryBarrier();
+    ExpNumberOfNonPagedPools = i - 1;
+
+    DPRINT("EXPOOL: %lu paged and %lu nonpaged pools\n",
+           ExpNumberOfPagedPools, ExpNumberOfNonPagedPools);
+}
+
 CODE_SEG("INIT")
 VOID
 NTAPI
@@ -1108,6 +1410,12 @@ InitializePool(IN POOL_TYPE PoolType,
         RtlZeroMemory(PoolTrackTable,
                       PoolTrackTableSize * sizeof(POOL_TRACKER_TABLE));
 
+        //
+        // This is also the boot processor's own table. The other processors
+        // get theirs once they are all running, in ExpAllocatePoolTrackTables
+        //
+        ExPoolTagTables[0] = PoolTrackTable;
+
         //
         // Finally, add the most used tags to speed up those allocations
         //
@@ -1211,6 +1519,7 @@ InitializePool(IN POOL_TYPE PoolType,
         // Initialize the nonpaged pool descriptor
         //
         PoolVector[NonPagedPool] = &NonPagedPoolDescriptor;
+        ExpNonPagedPoolDescriptor[0] = &NonPagedPoolDescriptor;
         ExInitializePoolDescriptor(PoolVector[NonPagedPool],
                                    NonPagedPool,
                                    0,
@@ -1274,10 +1583,19 @@ ExLockPool(IN PPOOL_DESCRIPTOR Descriptor)
     //
     if ((Descriptor->PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
     {
+        KIRQL OldIrql;
+
         //
-        // Use the queued spin lock
+        // The first descriptor uses the queued spin lock, the others each
+        // have their own
         //
-        return KeAcquireQueuedSpinLock(LockQueueNonPagedPoolLock);
+        if (!Descriptor->LockAddress)
+        {
+            return KeAcquireQueuedSpinLock(LockQueueNonPagedPoolLock);
+        }
+
+        KeAcquireSpinLock(Descriptor->LockAddress, &OldIrql);
+        return OldIrql;
     }
     else
     {
@@ -1300,9 +1618,17 @@ ExUnlockPool(IN PPOOL_DESCRIPTOR Descriptor,
     if ((Descriptor->PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
     {
         //
-        // Use the queued spin lock
+        // The first descriptor uses the queued spin lock, the others each
+        // have their own
         //
-        KeReleaseQueuedSpinLock(LockQueueNonPagedPoolLock, OldIrql);
+        if (!Descriptor->LockAddress)
+        {
+            KeReleaseQueuedSpinLock(LockQueueNonPagedPoolLock, OldIrql);
+        }
+        else
+        {
+            KeReleaseSpinLock(Descriptor->LockAddress, OldIrql);
+        }
     }
     else
     {
@@ -1313,6 +1639,42 @@ ExUnlockPool(IN PPOOL_DESCRIPTOR Descriptor,
     }
 }
 
+FORCEINLINE
+PPOOL_DESCRIPTOR
+ExpSelectPoolDescriptor(IN POOL_TYPE PoolType)
+{
+    ULONG Count;
+
+    //
+    // Once there is more than one descriptor, each processor sticks to its own
+    // so that allocations on different processors don't fight over the lock.
+    // The first descriptor is only used until the others are set up
+    //
+    if (PoolType == PagedPool)
+    {
+        Count = ExpNumberOfPagedPools;
+        if (!Count) return PoolVector[PagedPool];
+        return ExpPagedPoolDescriptor[1 + KeGetCurrentProcessorNumber() % Count];
+    }
+
+    Count = ExpNumberOfNonPagedPools;
+    if (!Count) return PoolVector[NonPagedPool];
+    return ExpNonPagedPoolDescriptor[1 + KeGetCurrentProcessorNumber() % Count];
+}
+
+FORCEINLINE
+PPOOL_DESCRIPTOR
+ExpGetPoolDescriptor(IN POOL_TYPE PoolType,
+                     IN ULONG PoolIndex)
+{
+    //
+    // A block always goes back to the descriptor that owns its page, whichever
+    // processor it is freed on
+    //
+    if (PoolType == PagedPool) return ExpPagedPoolDescriptor[PoolIndex];
+    return ExpNonPagedPoolDescriptor[PoolIndex];
+}
+
 VOID
 NTAPI
 ExpGetPoolTagInfoTarget(IN PKDPC Dpc,
@@ -1321,22 +1683,35 @@ ExpGetPoolTagInfoTarget(IN PKDPC Dpc,
                         IN PVOID SystemArgument2)
 {
     PPOOL_DPC_CONTEXT Context = DeferredContext;
+    SIZE_T i;
     UNREFERENCED_PARAMETER(Dpc);
     ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
 
     //
-    // Make sure we win the race, and if we did, copy the data atomically
+    // Make sure we win the race, and if we did, copy the data atomically,
+    // adding up the tables of all the processors as we go
     //
     if (KeSignalCallDpcSynchronize(SystemArgument2))
     {
-        RtlCopyMemory(Context->PoolTrackTable,
-                      PoolTrackTable,
-                      Context->PoolTrackTableSize * sizeof(POOL_TRACKER_TABLE));
+        for (i = 0; i < Context->PoolTrackTableSize; i++)
+        {
+            ExpGetPoolTrackerEntry(i, &Context->PoolTrackTable[i]);
+        }
 
         //
-        // This is here because ReactOS does not yet support expansion
+        // Nobody can be holding the lock now, since every processor is here.
+        // If the expansion table grew since the caller sized its buffer, just
+        // let it know how big it is now so that it can try again
         //
-        ASSERT(Context->PoolTrackTableSizeExpansion == 0);
+        KeAcquireSpinLockAtDpcLevel(&ExpTaggedPoolLock);
+        if (PoolTrackTableExpansionSize <= Context->PoolTrackTableSizeExpansion)
+        {
+            RtlCopyMemory(Context->PoolTrackTableExpansion,
+                          PoolTrackTableExpansion,
+                          PoolTrackTableExpansionSize * sizeof(POOL_TRACKER_TABLE));
+        }
+        Context->PoolTrackTableSizeExpansion = PoolTrackTableExpansionSize;
+        KeReleaseSpinLockFromDpcLevel(&ExpTaggedPoolLock);
     }
 
     //
@@ -1355,7 +1730,7 @@ ExGetPoolTagInfo(IN PSYSTEM_POOLTAG_INFORMATION SystemInformation,
                  IN OUT PULONG ReturnLength OPTIONAL)
 {
     ULONG TableSize, CurrentLength;
-    ULONG EntryCount;
+    ULONG EntryCount, ExpansionCount;
     NTSTATUS Status = STATUS_SUCCESS;
     PSYSTEM_POOLTAG TagEntry;
     PPOOL_TRACKER_TABLE Buffer, TrackerEntry;
@@ -1373,27 +1748,42 @@ ExGetPoolTagInfo(IN PSYSTEM_POOLTAG_INFORMATION SystemInformation,
     TagEntry = &SystemInformation->TagInfo[0];
     SystemInformation->Count = 0;
 
-    //
-    // Capture the number of entries, and the total size needed to make a copy
-    // of the table
-    //
-    EntryCount = (ULONG)PoolTrackTableSize;
-    TableSize = EntryCount * sizeof(POOL_TRACKER_TABLE);
+    ExpansionCount = (ULONG)PoolTrackTableExpansionSize;
+    while (TRUE)
+    {
+        //
+        // Capture the number of entries, and the total size needed to make a
+        // copy of the table and of its expansion
+        //
+        EntryCount = (ULONG)PoolTrackTableSize + ExpansionCount;
+        TableSize = EntryCount * sizeof(POOL_TRACKER_TABLE);
 
-    //
-    // Allocate the "Generic DPC" temporary buffer
-    //
-    Buffer = ExAllocatePoolWithTag(NonPagedPool, TableSize, 'ofnI');
-    if (!Buffer) return STATUS_INSUFFICIENT_RESOURCES;
+        //
+        // Allocate the "Generic DPC" temporary buffer
+        //
+        Buffer = ExAllocatePoolWithTag(NonPagedPool, TableSize, 'ofnI');
+        if (!Buffer) return STATUS_INSUFFICIENT_RESOURCES;
 
-    //
-    // Do a "Generic DPC" to atomically retrieve the tag and allocation data
-    //
-    Context.PoolTrackTable = Buffer;
-    Context.PoolTrackTableSize = PoolTrackTableSize;
-    Context.PoolTrackTableExpansion = NULL;
-    Context.PoolTrackTableSizeExpansion = 0;
-    KeGenericCallDpc(ExpGetPoolTagInfoTarget, &Context);
+        //
+        // Do a "Generic DPC" to atomically retrieve the tag and allocation data
+        //
+        Context.PoolTrackTable = Buffer;
+        Context.PoolTrackTableSize = PoolTrackTableSize;
+        Context.PoolTrackTableExpansion = Buffer + PoolTrackTableSize;
+        Context.PoolTrackTableSizeExpansion = ExpansionCount;
+        KeGenericCallDpc(ExpGetPoolTagInfoTarget, &Context);
+
+        //
+        // Try again if the expansion table grew in the meantime
+        //
+        if (Context.PoolTrackTableSizeExpansion <= ExpansionCount)
+        {
+            EntryCount = (ULONG)(PoolTrackTableSize + Context.PoolTrackTableSizeExpansion);
+            break;
+        }
+        ExpansionCount = (ULONG)Context.PoolTrackTableSizeExpansion;
+        ExFreePoolWithTag(Buffer, 'ofnI');
+    }
 
     //
     // Now parse the results
@@ -1804,10 +2194,9 @@ ExQueryPoolUsage(OUT PULONG PagedPoolPages,
     // If the system has more than one non-paged pool, copy the other descriptor
     // totals as well
     //
-#if 0
-    if (ExpNumberOfNonPagedPools > 1)
+    if (ExpNumberOfNonPagedPools)
     {
-        for (i = 0; i < ExpNumberOfNonPagedPools; i++)
+        for (i = 1; i < ExpNumberOfNonPagedPools + 1; i++)
         {
             PoolDesc = ExpNonPagedPoolDescriptor[i];
             *NonPagedPoolPages += PoolDesc->TotalPages + PoolDesc->TotalBigPages;
@@ -1815,7 +2204,6 @@ ExQueryPoolUsage(OUT PULONG PagedPoolPages,
             *NonPagedPoolFrees += PoolDesc->RunningDeAllocs;
         }
     }
-#endif
 
     //
     // Get the amount of hits in the system lookaside lists
@@ -2128,6 +2516,13 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
         }
     }
 
+    //
+    // Big pages are accounted for in the first descriptor, but the blocks come
+    // from the one that belongs to this processor
+    //
+    PoolDesc = ExpSelectPoolDescriptor(PoolType);
+    ASSERT(PoolDesc != NULL);
+
     //
     // Loop in the free lists looking for a block if this size. Start with the
     // list optimized for this kind of size lookup
@@ -2252,9 +2647,13 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
                 }
 
                 //
-                // Now our (allocation) entry is the right size
+                // Now our (allocation) entry is the right size. Either it or
+                // the fragment has a brand new header, so note down which
+                // descriptor their page belongs to
                 //
                 Entry->BlockSize = i;
+                Entry->PoolIndex = PoolDesc->PoolIndex;
+                FragmentEntry->PoolIndex = PoolDesc->PoolIndex;
 
                 //
                 // And the next entry is now the free fragment which contains
@@ -2384,6 +2783,7 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
     //
     Entry->Ulong1 = 0;
     Entry->BlockSize = i;
+    Entry->PoolIndex = PoolDesc->PoolIndex;
     Entry->PoolType = OriginalType + 1;
 
     //
@@ -2397,6 +2797,7 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
     FragmentEntry->Ulong1 = 0;
     FragmentEntry->BlockSize = BlockSize;
     FragmentEntry->PreviousSize = i;
+    FragmentEntry->PoolIndex = PoolDesc->PoolIndex;
 
     //
     // Increment required counters
@@ -2668,7 +3069,8 @@ ExFreePoolWithTag(IN PVOID P,
     //
     BlockSize = Entry->BlockSize;
     PoolType = (Entry->PoolType - 1) & BASE_POOL_TYPE_MASK;
-    PoolDesc = PoolVector[PoolType];
+    PoolDesc = ExpGetPoolDescriptor(PoolType, Entry->PoolIndex);
+    ASSERT(PoolDesc != NULL);
 
     //
     // Make sure that the IRQL makes sense
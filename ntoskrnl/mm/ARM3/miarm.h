@@ -389,8 +389,10 @@ typedef struct _POOL_TRACKER_BIG_PAGES
 } POOL_TRACKER_BIG_PAGES, *PPOOL_TRACKER_BIG_PAGES;
 
 extern ULONG ExpNumberOfPagedPools;
+extern ULONG ExpNumberOfNonPagedPools;
 extern POOL_DESCRIPTOR NonPagedPoolDescriptor;
 extern PPOOL_DESCRIPTOR ExpPagedPoolDescriptor[16 + 1];
+extern PPOOL_DESCRIPTOR ExpNonPagedPoolDescriptor[16 + 1];
 extern PPOOL_TRACKER_TABLE PoolTrackTable;
 
 //
@@ -1963,6 +1965,22 @@ InitializePool(           //
     IN ULONG Threshold    //
 );                        //
 
+// FIXFIX: THIS ONE TOO
+CODE_SEG("INIT")
+VOID
+NTAPI
+ExpAllocatePoolTrackTables(
+    VOID
+);
+
+// FIXFIX: THIS ONE TOO
+CODE_SEG("INIT")
+VOID
+NTAPI
+ExpAllocatePoolDescriptors(
+    VOID
+);
+
 // FIXFIX: THIS ONE TOO
 CODE_SEG("INIT")
 VOID
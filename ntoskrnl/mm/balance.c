@@ -150,7 +150,12 @@ MmTrimUserMemory(ULONG Target, ULONG Priority, PULONG NrFreedPages)
         if (Priority)
         {
             Status = MmPageOutPhysicalAddress(CurrentPage);
-            if (NT_SUCCESS(Status))
+            if (Status == STATUS_PENDING)
+            {
+                /* Queued for the paging file, it is counted once written */
+                Target--;
+            }
+            else if (NT_SUCCESS(Status))
             {
                 DPRINT("Succeeded\n");
                 Target--;
@@ -255,6 +260,9 @@ MmTrimUserMemory(ULONG Target, ULONG Priority, PULONG NrFreedPages)
         CurrentPage = MmGetLRUNextUserPage(CurrentPage, TRUE);
     }
 
+    /* The pages we queued for the paging file are only freed once written */
+    (*NrFreedPages) += MmFlushSwapPageWrites();
+
     if (CurrentPage)
     {
         KIRQL OldIrql = MiAcquirePfnLock();
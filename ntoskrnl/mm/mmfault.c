@@ -208,6 +208,7 @@ MmAccessFault(IN ULONG FaultCode,
               IN PVOID TrapInformation)
 {
     PMEMORY_AREA MemoryArea = NULL;
+    NTSTATUS Status;
 
     /* Cute little hack for ROS */
     if ((ULONG_PTR)Address >= (ULONG_PTR)MmSystemRangeStart)
@@ -227,7 +228,8 @@ MmAccessFault(IN ULONG FaultCode,
     {
         /* This is an ARM3 fault */
         DPRINT("ARM3 fault %p\n", MemoryArea);
-        return MmArmAccessFault(FaultCode, Address, Mode, TrapInformation);
+        Status = MmArmAccessFault(FaultCode, Address, Mode, TrapInformation);
+        goto Done;
     }
 
     /* Is there a ReactOS address space yet? */
@@ -249,19 +251,27 @@ MmAccessFault(IN ULONG FaultCode,
     {
         /* This is an ARM3 fault */
         DPRINT("ARM3 fault %p\n", MemoryArea);
-        return MmArmAccessFault(FaultCode, Address, Mode, TrapInformation);
+        Status = MmArmAccessFault(FaultCode, Address, Mode, TrapInformation);
+        goto Done;
     }
 
     /* Keep same old ReactOS Behaviour */
     if (!MI_IS_NOT_PRESENT_FAULT(FaultCode))
     {
         /* Call access fault */
-        return MmpAccessFault(Mode, (ULONG_PTR)Address, TrapInformation ? FALSE : TRUE);
+        Status = MmpAccessFault(Mode, (ULONG_PTR)Address, TrapInformation ? FALSE : TRUE);
     }
     else
     {
         /* Call not present */
-        return MmNotPresentFault(Mode, (ULONG_PTR)Address, TrapInformation ? FALSE : TRUE);
+        Status = MmNotPresentFault(Mode, (ULONG_PTR)Address, TrapInformation ? FALSE : TRUE);
     }
+
+Done:
+    /* Let the kernel logger see the fault */
+    if (WmiTraceEnabled(WMIP_TRACE_PAGE_FAULTS))
+        WmipTracePageFault(Status, Address, TrapInformation);
+
+    return Status;
 }
 
@@ -269,6 +269,11 @@ MmInitSystem(IN ULONG Phase,
     /* Setup session IDs */
     MiInitializeSessionIds();
 
+    /* All processors are running now, give each its own pool tracker table
+       and its own paged and nonpaged pools */
+    ExpAllocatePoolTrackTables();
+    ExpAllocatePoolDescriptors();
+
     /* Setup the memory threshold events */
     if (!MiInitializeMemoryEvents()) return FALSE;
 
@@ -87,6 +87,51 @@ static BOOLEAN MmSwapSpaceMessage = FALSE;
 
 static BOOLEAN MmSystemPageFileLocated = FALSE;
 
+/*
+ * Dirty pages the balancer pages out are not written one by one: they are
+ * gathered in clusters backed by a contiguous run of the paging file, and
+ * each cluster goes to the disk with a single I/O. A few clusters can be in
+ * flight at once; the oldest one is waited for when its slot is needed again.
+ */
+#define MI_PAGEFILE_WRITE_CLUSTER       (16)
+#define MI_PAGEFILE_WRITES_IN_FLIGHT    (4)
+
+typedef struct _MI_PAGEFILE_WRITE_ENTRY
+{
+    PEPROCESS Process;
+    PVOID Address;
+    PFN_NUMBER Page;
+} MI_PAGEFILE_WRITE_ENTRY, *PMI_PAGEFILE_WRITE_ENTRY;
+
+typedef struct _MI_PAGEFILE_WRITE
+{
+    SWAPENTRY FirstEntry;
+    ULONG Capacity;
+    ULONG Count;
+    BOOLEAN InFlight;
+    KEVENT Event;
+    IO_STATUS_BLOCK Iosb;
+    MI_PAGEFILE_WRITE_ENTRY Entries[MI_PAGEFILE_WRITE_CLUSTER];
+    union
+    {
+        MDL Mdl;
+        UCHAR MdlBase[sizeof(MDL) + MI_PAGEFILE_WRITE_CLUSTER * sizeof(PFN_NUMBER)];
+    } u;
+} MI_PAGEFILE_WRITE, *PMI_PAGEFILE_WRITE;
+
+/* Only the balancer thread pages out, so this needs no locking */
+static MI_PAGEFILE_WRITE MiPageFileWrites[MI_PAGEFILE_WRITES_IN_FLIGHT];
+static ULONG MiPageFileCurrentWrite;
+/* Pages freed by the writes completed since the last MmFlushSwapPageWrites */
+static ULONG MiPageFileWrittenPages;
+
+/* Counters:
+ * - Number of write I/Os issued to the paging files
+ * - Number of pages these I/Os carried
+ */
+ULONG MiPageFileWriteIoCount;
+ULONG MiPageFileWritePageCount;
+
 /* FUNCTIONS *****************************************************************/
 
 VOID
@@ -168,6 +213,8 @@ MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
                                     &file_offset,
                                     &Event,
                                     &Iosb);
+    MiPageFileWriteIoCount++;
+    MiPageFileWritePageCount++;
     if (Status == STATUS_PENDING)
     {
         KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
@@ -269,9 +316,11 @@ MmInitPagingFile(VOID)
     MmNumberOfPagingFiles = 0;
 }
 
+static
 VOID
-NTAPI
-MmFreeSwapPage(SWAPENTRY Entry)
+MiFreeSwapRun(
+    _In_ SWAPENTRY Entry,
+    _In_ ULONG Count)
 {
     ULONG i;
     ULONG_PTR off;
@@ -288,24 +337,41 @@ MmFreeSwapPage(SWAPENTRY Entry)
         KeBugCheck(MEMORY_MANAGEMENT);
     }
 
-    RtlClearBit(PagingFile->Bitmap, off >> 5);
+    RtlClearBits(PagingFile->Bitmap, (ULONG)off, Count);
 
-    PagingFile->FreeSpace++;
-    PagingFile->CurrentUsage--;
+    PagingFile->FreeSpace += Count;
+    PagingFile->CurrentUsage -= Count;
 
-    MiFreeSwapPages++;
-    MiUsedSwapPages--;
+    MiFreeSwapPages += Count;
+    MiUsedSwapPages -= Count;
 
     KeReleaseGuardedMutex(&MmPageFileCreationLock);
 }
 
+VOID
+NTAPI
+MmFreeSwapPage(SWAPENTRY Entry)
+{
+    MiFreeSwapRun(Entry, 1);
+}
+
+/*
+ * Allocates up to *Count contiguous slots from a single paging file, with
+ * one bitmap search. On return, *Count is the number of slots that were
+ * actually allocated; the first one is returned, or 0 if there is no swap
+ * space left.
+ */
 SWAPENTRY
 NTAPI
-MmAllocSwapPage(VOID)
+MmAllocSwapPages(
+    _Inout_ PULONG Count)
 {
     ULONG i;
     ULONG off;
-    SWAPENTRY entry;
+    ULONG Length;
+    PMMPAGING_FILE PagingFile;
+
+    ASSERT(*Count != 0);
 
     KeAcquireGuardedMutex(&MmPageFileCreationLock);
 
@@ -317,23 +383,35 @@ MmAllocSwapPage(VOID)
 
     for (i = 0; i < MAX_PAGING_FILES; i++)
     {
-        if (MmPagingFile[i] != NULL &&
-                MmPagingFile[i]->FreeSpace >= 1)
+        PagingFile = MmPagingFile[i];
+        if (PagingFile == NULL || PagingFile->FreeSpace == 0)
+            continue;
+
+        Length = (ULONG)min(*Count, PagingFile->FreeSpace);
+
+        /* Start where the previous run ended, that's where free space is likely to be */
+        off = RtlFindClearBitsAndSet(PagingFile->Bitmap, Length, PagingFile->Hint);
+        if (off == 0xFFFFFFFF)
         {
-            off = RtlFindClearBitsAndSet(MmPagingFile[i]->Bitmap, 1, 0);
-            if (off == 0xFFFFFFFF)
+            /* The file is fragmented, settle for the longest run there is */
+            Length = min(RtlFindLongestRunClear(PagingFile->Bitmap, &off), Length);
+            if (Length == 0)
             {
                 KeBugCheck(MEMORY_MANAGEMENT);
-                KeReleaseGuardedMutex(&MmPageFileCreationLock);
-                return(STATUS_UNSUCCESSFUL);
             }
-            MiUsedSwapPages++;
-            MiFreeSwapPages--;
-            KeReleaseGuardedMutex(&MmPageFileCreationLock);
-
-            entry = ENTRY_FROM_FILE_OFFSET(i, off + 1);
-            return(entry);
+            RtlSetBits(PagingFile->Bitmap, off, Length);
         }
+
+        PagingFile->Hint = off + Length;
+        PagingFile->FreeSpace -= Length;
+        PagingFile->CurrentUsage += Length;
+
+        MiUsedSwapPages += Length;
+        MiFreeSwapPages -= Length;
+        KeReleaseGuardedMutex(&MmPageFileCreationLock);
+
+        *Count = Length;
+        return ENTRY_FROM_FILE_OFFSET(i, off + 1);
     }
 
     KeReleaseGuardedMutex(&MmPageFileCreationLock);
@@ -341,6 +419,203 @@ MmAllocSwapPage(VOID)
     return(0);
 }
 
+SWAPENTRY
+NTAPI
+MmAllocSwapPage(VOID)
+{
+    ULONG Count = 1;
+
+    return MmAllocSwapPages(&Count);
+}
+
+static
+VOID
+MiCompletePageFileWrite(
+    _Inout_ PMI_PAGEFILE_WRITE Write,
+    _In_ NTSTATUS Status)
+{
+    ULONG i;
+
+    if (Write->u.Mdl.MdlFlags & MDL_MAPPED_TO_SYSTEM_VA)
+    {
+        MmUnmapLockedPages(Write->u.Mdl.MappedSystemVa, &Write->u.Mdl);
+    }
+
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to write %lu pages to the paging file: 0x%08lx\n", Write->Count, Status);
+        MiFreeSwapRun(Write->FirstEntry, Write->Count);
+    }
+    else
+    {
+        MiPageFileWrittenPages += Write->Count;
+    }
+
+    /* Hand the pages back to their owners, either swapped out or still resident */
+    for (i = 0; i < Write->Count; i++)
+    {
+        MmFinishPageOut(Write->Entries[i].Process,
+                        Write->Entries[i].Address,
+                        Write->Entries[i].Page,
+                        NT_SUCCESS(Status) ?
+                            ENTRY_FROM_FILE_OFFSET(FILE_FROM_ENTRY(Write->FirstEntry),
+                                                   OFFSET_FROM_ENTRY(Write->FirstEntry) + i) :
+                            0);
+    }
+
+    Write->Count = 0;
+    Write->Capacity = 0;
+    Write->InFlight = FALSE;
+}
+
+static
+VOID
+MiWaitPageFileWrite(
+    _Inout_ PMI_PAGEFILE_WRITE Write)
+{
+    ASSERT(Write->InFlight);
+
+    KeWaitForSingleObject(&Write->Event, Executive, KernelMode, FALSE, NULL);
+    MiCompletePageFileWrite(Write, Write->Iosb.Status);
+}
+
+static
+VOID
+MiStartPageFileWrite(
+    _Inout_ PMI_PAGEFILE_WRITE Write)
+{
+    ULONG i;
+    PMMPAGING_FILE PagingFile;
+    LARGE_INTEGER FileOffset;
+    PPFN_NUMBER MdlPages;
+    NTSTATUS Status;
+
+    ASSERT(Write->Count != 0);
+    ASSERT(!Write->InFlight);
+
+    /* Give back the part of the run we didn't fill */
+    if (Write->Count < Write->Capacity)
+    {
+        MiFreeSwapRun(ENTRY_FROM_FILE_OFFSET(FILE_FROM_ENTRY(Write->FirstEntry),
+                                             OFFSET_FROM_ENTRY(Write->FirstEntry) + Write->Count),
+                      Write->Capacity - Write->Count);
+        Write->Capacity = Write->Count;
+    }
+
+    PagingFile = MmPagingFile[FILE_FROM_ENTRY(Write->FirstEntry)];
+    if (PagingFile->FileObject == NULL ||
+        PagingFile->FileObject->DeviceObject == NULL)
+    {
+        DPRINT1("Bad paging file 0x%.8X\n", Write->FirstEntry);
+        KeBugCheck(MEMORY_MANAGEMENT);
+    }
+
+    MmInitializeMdl(&Write->u.Mdl, NULL, Write->Count << PAGE_SHIFT);
+    MdlPages = MmGetMdlPfnArray(&Write->u.Mdl);
+    for (i = 0; i < Write->Count; i++)
+    {
+        MdlPages[i] = Write->Entries[i].Page;
+    }
+    Write->u.Mdl.MdlFlags |= MDL_PAGES_LOCKED;
+
+    FileOffset.QuadPart = (OFFSET_FROM_ENTRY(Write->FirstEntry) - 1) * PAGE_SIZE;
+
+    KeInitializeEvent(&Write->Event, NotificationEvent, FALSE);
+    Status = IoSynchronousPageWrite(PagingFile->FileObject,
+                                    &Write->u.Mdl,
+                                    &FileOffset,
+                                    &Write->Event,
+                                    &Write->Iosb);
+    MiPageFileWriteIoCount++;
+    MiPageFileWritePageCount += Write->Count;
+
+    Write->InFlight = TRUE;
+    if (Status != STATUS_PENDING)
+    {
+        /* Done already, or the IRP never made it to the driver */
+        MiCompletePageFileWrite(Write, Status);
+    }
+}
+
+/*
+ * Queues a dirty private page for writing to the paging file. The caller must
+ * have replaced its mapping with MM_WAIT_ENTRY and hands over its reference on
+ * the process and its rundown protection: MmFinishPageOut is called for the
+ * page once the cluster it belongs to has been written.
+ */
+NTSTATUS
+NTAPI
+MmQueueSwapPageWrite(
+    _In_ PEPROCESS Process,
+    _In_ PVOID Address,
+    _In_ PFN_NUMBER Page)
+{
+    PMI_PAGEFILE_WRITE Write = &MiPageFileWrites[MiPageFileCurrentWrite];
+
+    /* Wait for the oldest write if we wrapped around to it */
+    if (Write->InFlight)
+    {
+        MiWaitPageFileWrite(Write);
+    }
+
+    if (Write->Count == 0)
+    {
+        Write->Capacity = MI_PAGEFILE_WRITE_CLUSTER;
+        Write->FirstEntry = MmAllocSwapPages(&Write->Capacity);
+        if (Write->FirstEntry == 0)
+        {
+            Write->Capacity = 0;
+            MmShowOutOfSpaceMessagePagingFile();
+            return STATUS_PAGEFILE_QUOTA_EXCEEDED;
+        }
+    }
+
+    Write->Entries[Write->Count].Process = Process;
+    Write->Entries[Write->Count].Address = Address;
+    Write->Entries[Write->Count].Page = Page;
+    Write->Count++;
+
+    if (Write->Count == Write->Capacity)
+    {
+        MiStartPageFileWrite(Write);
+        MiPageFileCurrentWrite = (MiPageFileCurrentWrite + 1) % MI_PAGEFILE_WRITES_IN_FLIGHT;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Writes out the partially filled cluster, and waits for all the writes in
+ * flight. Once this returns, every page queued with MmQueueSwapPageWrite has
+ * been paged out (or put back in place if the write failed). Returns the
+ * number of queued pages that were actually paged out since the last call.
+ */
+ULONG
+NTAPI
+MmFlushSwapPageWrites(VOID)
+{
+    ULONG i, WrittenPages;
+    PMI_PAGEFILE_WRITE Write = &MiPageFileWrites[MiPageFileCurrentWrite];
+
+    if (Write->Count != 0 && !Write->InFlight)
+    {
+        MiStartPageFileWrite(Write);
+        MiPageFileCurrentWrite = (MiPageFileCurrentWrite + 1) % MI_PAGEFILE_WRITES_IN_FLIGHT;
+    }
+
+    for (i = 0; i < MI_PAGEFILE_WRITES_IN_FLIGHT; i++)
+    {
+        if (MiPageFileWrites[i].InFlight)
+        {
+            MiWaitPageFileWrite(&MiPageFileWrites[i]);
+        }
+    }
+
+    WrittenPages = MiPageFileWrittenPages;
+    MiPageFileWrittenPages = 0;
+    return WrittenPages;
+}
+
 NTSTATUS NTAPI
 NtCreatePagingFile(IN PUNICODE_STRING FileName,
                    IN PLARGE_INTEGER MinimumSize,
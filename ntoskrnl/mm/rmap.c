@@ -46,6 +46,10 @@ MmInitializeRmapList(VOID)
                                      50);
 }
 
+/*
+ * Returns STATUS_SUCCESS if the page was freed, or STATUS_PENDING if it was
+ * queued for the paging file and will only be freed by MmFinishPageOut.
+ */
 NTSTATUS
 NTAPI
 MmPageOutPhysicalAddress(PFN_NUMBER Page)
@@ -175,27 +179,22 @@ GetEntry:
 
             if ((SwapEntry == 0) && Dirty)
             {
-                /* We don't have a Swap entry, yet the page is dirty. Get one */
-                SwapEntry = MmAllocSwapPage();
-                if (!SwapEntry)
-                {
-                    PMM_REGION Region = MmFindRegion((PVOID)MA_GetStartingAddress(MemoryArea),
-                            &MemoryArea->SectionData.RegionListHead,
-                            Address, NULL);
-
-                    /* We can't, so let this page in the Process VM */
-                    MmCreateVirtualMapping(Process, Address, Region->Protect, Page);
-                    MmInsertRmap(Page, Process, Address);
-                    MmSetDirtyPage(Process, Address);
-
-                    MmUnlockAddressSpace(AddressSpace);
-                    if (Process != PsInitialSystemProcess)
-                        KeDetachProcess();
-                    ExReleaseRundownProtection(&Process->RundownProtect);
-                    ObDereferenceObject(Process);
-
-                    return STATUS_UNSUCCESSFUL;
-                }
+                /* We don't have a Swap entry, yet the page is dirty. Write it along with others */
+                MmCreatePageFileMapping(Process, Address, MM_WAIT_ENTRY);
+                MmUnlockAddressSpace(AddressSpace);
+                if (Process != PsInitialSystemProcess)
+                    KeDetachProcess();
+
+                /* The writer now owns our process reference and rundown protection.
+                 * The page is only freed once MmFinishPageOut is called for it.
+                 */
+                Status = MmQueueSwapPageWrite(Process, Address, Page);
+                if (NT_SUCCESS(Status))
+                    return STATUS_PENDING;
+
+                /* There is no swap space left, so let this page in the Process VM */
+                MmFinishPageOut(Process, Address, Page, 0);
+                return STATUS_UNSUCCESSFUL;
             }
 
             if (Dirty)
@@ -312,6 +311,72 @@ WriteSegment:
     return STATUS_UNSUCCESSFUL;
 }
 
+/*
+ * Completes the page out of a private page queued with MmQueueSwapPageWrite.
+ * If SwapEntry is 0, the page couldn't be written and is mapped back in.
+ */
+VOID
+NTAPI
+MmFinishPageOut(
+    _In_ PEPROCESS Process,
+    _In_ PVOID Address,
+    _In_ PFN_NUMBER Page,
+    _In_ SWAPENTRY SwapEntry)
+{
+    PMMSUPPORT AddressSpace = &Process->Vm;
+    PMEMORY_AREA MemoryArea;
+    SWAPENTRY Dummy;
+#if DBG
+    KIRQL OldIrql;
+#endif
+
+    MmLockAddressSpace(AddressSpace);
+    if (Process != PsInitialSystemProcess)
+        KeAttachProcess(&Process->Pcb);
+
+    MmDeletePageFileMapping(Process, Address, &Dummy);
+    ASSERT(Dummy == MM_WAIT_ENTRY);
+
+    if (SwapEntry == 0)
+    {
+        /* We failed at saving the content of this page. Keep it in */
+        PMM_REGION Region;
+
+        MemoryArea = MmLocateMemoryAreaByAddress(AddressSpace, Address);
+        ASSERT(MemoryArea != NULL);
+        Region = MmFindRegion((PVOID)MA_GetStartingAddress(MemoryArea),
+                              &MemoryArea->SectionData.RegionListHead,
+                              Address, NULL);
+
+        MmCreateVirtualMapping(Process, Address, Region->Protect, Page);
+        MmInsertRmap(Page, Process, Address);
+        MmSetDirtyPage(Process, Address);
+
+        MmUnlockAddressSpace(AddressSpace);
+        if (Process != PsInitialSystemProcess)
+            KeDetachProcess();
+    }
+    else
+    {
+        /* Keep this in the process VM */
+        MmCreatePageFileMapping(Process, Address, SwapEntry);
+
+        /* We can finally let this page go */
+        MmUnlockAddressSpace(AddressSpace);
+        if (Process != PsInitialSystemProcess)
+            KeDetachProcess();
+#if DBG
+        OldIrql = MiAcquirePfnLock();
+        ASSERT(MmGetRmapListHeadPage(Page) == NULL);
+        MiReleasePfnLock(OldIrql);
+#endif
+        MmReleasePageMemoryConsumer(MC_USER, Page);
+    }
+
+    ExReleaseRundownProtection(&Process->RundownProtect);
+    ObDereferenceObject(Process);
+}
+
 VOID
 NTAPI
 MmInsertRmap(PFN_NUMBER Page, PEPROCESS Process,
@@ -4200,14 +4200,16 @@ BOOLEAN
 MiPurgeImageSegment(PMM_SECTION_SEGMENT Segment)
 {
     PCACHE_SECTION_PAGE_TABLE PageTable;
+    LARGE_INTEGER SearchOffset;
 
     MmLockSectionSegment(Segment);
 
     /* Loop over all entries */
-    for (PageTable = RtlEnumerateGenericTable(&Segment->PageTable, TRUE);
-         PageTable != NULL;
-         PageTable = RtlEnumerateGenericTable(&Segment->PageTable, FALSE))
+    SearchOffset.QuadPart = 0;
+    while ((PageTable = MmGetNextSectionPageTable(Segment, &SearchOffset)) != NULL)
     {
+        SearchOffset.QuadPart = PageTable->FileOffset.QuadPart + _countof(PageTable->PageEntries) * PAGE_SIZE;
+
         for (ULONG i = 0; i < _countof(PageTable->PageEntries); i++)
         {
             ULONG_PTR Entry = PageTable->PageEntries[i];
@@ -4742,17 +4744,15 @@ MmPurgeSegment(
     if (!Length || !Offset)
     {
         /* We must calculate the length for ourselves */
-        /* FIXME: All of this is suboptimal */
-        ULONG ElemCount = RtlNumberGenericTableElements(&Segment->PageTable);
+        PCACHE_SECTION_PAGE_TABLE PageTable = MmGetLastSectionPageTable(Segment);
         /* No page. Nothing to purge */
-        if (!ElemCount)
+        if (!PageTable)
         {
             MmUnlockSectionSegment(Segment);
             MmDereferenceSegment(Segment);
             return TRUE;
         }
 
-        PCACHE_SECTION_PAGE_TABLE PageTable = RtlGetElementGenericTable(&Segment->PageTable, ElemCount - 1);
         PurgeEnd.QuadPart = PageTable->FileOffset.QuadPart + _countof(PageTable->PageEntries) * PAGE_SIZE;
     }
 
@@ -4864,10 +4864,9 @@ MmFlushSegment(
     {
         FlushStart.QuadPart = 0;
 
-        /* FIXME: All of this is suboptimal */
-        ULONG ElemCount = RtlNumberGenericTableElements(&Segment->PageTable);
+        PCACHE_SECTION_PAGE_TABLE PageTable = MmGetLastSectionPageTable(Segment);
         /* No page. Nothing to flush */
-        if (!ElemCount)
+        if (!PageTable)
         {
             MmUnlockSectionSegment(Segment);
             MmDereferenceSegment(Segment);
@@ -4879,7 +4878,6 @@ MmFlushSegment(
             return STATUS_SUCCESS;
         }
 
-        PCACHE_SECTION_PAGE_TABLE PageTable = RtlGetElementGenericTable(&Segment->PageTable, ElemCount - 1);
         FlushEnd.QuadPart = PageTable->FileOffset.QuadPart + _countof(PageTable->PageEntries) * PAGE_SIZE;
     }
 
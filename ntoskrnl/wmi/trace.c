@@ -0,0 +1,1199 @@
+/*
+ * PROJECT:         ReactOS Kernel
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * FILE:            ntoskrnl/wmi/trace.c
+ * PURPOSE:         Kernel logger of the event tracing support
+ * PROGRAMMERS:     ReactOS Portable Systems Group
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <ntoskrnl.h>
+#include <wmiguid.h>
+#include <wmistr.h>
+#include <wmiioctl.h>
+#include <wmilog.h>
+#define _WMIKM_
+#define INITGUID
+#include <guiddef.h>
+#include <evntrace.h>
+
+#include "wmip.h"
+
+#define NDEBUG
+#include <debug.h>
+
+/* The hooks use these instead of pulling evntrace.h everywhere */
+C_ASSERT(WMIP_TRACE_CSWITCH == EVENT_TRACE_FLAG_CSWITCH);
+C_ASSERT(WMIP_TRACE_DISK_IO == EVENT_TRACE_FLAG_DISK_IO);
+C_ASSERT(WMIP_TRACE_DISK_IO_INIT == EVENT_TRACE_FLAG_DISK_IO_INIT);
+C_ASSERT(WMIP_TRACE_PAGE_FAULTS == EVENT_TRACE_FLAG_MEMORY_PAGE_FAULTS);
+C_ASSERT(WMIP_TRACE_REGISTRY == EVENT_TRACE_FLAG_REGISTRY);
+
+#define WMIP_SUPPORTED_FLAGS (WMIP_TRACE_CSWITCH | \
+                              WMIP_TRACE_DISK_IO | \
+                              WMIP_TRACE_DISK_IO_INIT | \
+                              WMIP_TRACE_PAGE_FAULTS | \
+                              WMIP_TRACE_REGISTRY)
+
+/* Buffer sizes are in KB, like in EVENT_TRACE_PROPERTIES */
+#define WMIP_DEFAULT_BUFFER_SIZE    64
+#define WMIP_MINIMUM_BUFFER_SIZE    4
+#define WMIP_MAXIMUM_BUFFER_SIZE    1024
+#define WMIP_DEFAULT_FLUSH_TIMER    1
+#define WMIP_EXTRA_BUFFERS          16
+
+typedef enum _WMI_CLOCK_TYPE
+{
+    WMICT_DEFAULT,
+    WMICT_SYSTEMTIME,
+    WMICT_PERFCOUNTER,
+    WMICT_PROCESS,
+    WMICT_THREAD,
+    WMICT_CPUCYCLE
+} WMI_CLOCK_TYPE;
+
+LONG64
+FASTCALL
+WmiGetClock(IN WMI_CLOCK_TYPE ClockType,
+            IN PVOID Context);
+
+/*
+ * Every processor logs into its own current buffer. Writers reserve space
+ * in it with an interlocked add on CurrentOffset and hold a reference while
+ * they copy their event in, so whoever takes the buffer away from the
+ * processor only has to wait for the count to drop to zero before writing it
+ * out. Full buffers go to the flush list, empty ones come from the free list,
+ * both lock free since writers run at DISPATCH_LEVEL or above.
+ */
+typedef struct _WMIP_TRACE_BUFFER
+{
+    SLIST_ENTRY ListEntry;
+    LIST_ENTRY Link;
+    volatile LONG CurrentOffset;
+    volatile LONG ReferenceCount;
+    WMI_TRACE_BUFFER_HEADER Header;
+} WMIP_TRACE_BUFFER, *PWMIP_TRACE_BUFFER;
+
+typedef struct _WMIP_LOGGER_CONTEXT
+{
+    WMI_CLOCK_TYPE ClockType;
+    ULONG ClientContext;
+    ULONG BufferSize;
+    ULONG MinimumBuffers;
+    ULONG MaximumBuffers;
+    ULONG NumberOfBuffers;
+    ULONG MaximumFileSize;
+    ULONGLONG MaximumFileBytes;
+    ULONG LogFileMode;
+    ULONG FlushTimer;
+    ULONG EnableFlags;
+    volatile LONG EventsLost;
+    ULONG BuffersWritten;
+    ULONG LogBuffersLost;
+    ULONG SequenceNumber;
+    LARGE_INTEGER StartTime;
+    LARGE_INTEGER StartClock;
+    HANDLE FileHandle;
+    LARGE_INTEGER ByteOffset;
+    UNICODE_STRING LogFileName;
+    PKTHREAD Thread;
+    HANDLE ThreadId;
+    KEVENT FlushEvent;
+    KEVENT FlushDoneEvent;
+    KDPC FlushDpc;
+    LONG FlushRequested;
+    BOOLEAN StopRequested;
+    LIST_ENTRY BufferListHead;
+    SLIST_HEADER FreeList;
+    SLIST_HEADER FlushList;
+    ULONG NumberOfProcessors;
+    PWMIP_TRACE_BUFFER ProcessorBuffers[ANYSIZE_ARRAY];
+} WMIP_LOGGER_CONTEXT, *PWMIP_LOGGER_CONTEXT;
+
+/* Counts the writers on each processor that may still see the logger */
+typedef struct DECLSPEC_CACHEALIGN _WMIP_PROCESSOR_LOGGING
+{
+    volatile LONG Count;
+} WMIP_PROCESSOR_LOGGING, *PWMIP_PROCESSOR_LOGGING;
+
+/* GLOBALS ******************************************************************/
+
+static UNICODE_STRING WmipKernelLoggerName = RTL_CONSTANT_STRING(KERNEL_LOGGER_NAMEW);
+
+ULONG WmipKernelLoggerFlags;
+PWMIP_LOGGER_CONTEXT WmipKernelLogger;
+KGUARDED_MUTEX WmipLoggerMutex;
+WMIP_PROCESSOR_LOGGING WmipProcessorLogging[MAXIMUM_PROCESSORS];
+
+/* PRIVATE FUNCTIONS *********************************************************/
+
+CODE_SEG("INIT")
+VOID
+NTAPI
+WmipInitializeTracing(VOID)
+{
+    /* Serializes starting, stopping and controlling the kernel logger */
+    KeInitializeGuardedMutex(&WmipLoggerMutex);
+}
+
+static
+FORCEINLINE
+LONG64
+WmipGetLoggerClock(IN PWMIP_LOGGER_CONTEXT Logger)
+{
+    return WmiGetClock(Logger->ClockType, NULL);
+}
+
+static
+BOOLEAN
+WmipIsKernelLogger(IN PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    return (LoggerInfo->Wnode.HistoricalContext == WMI_KERNEL_LOGGER_ID) ||
+           IsEqualGUID(&LoggerInfo->Wnode.Guid, &SystemTraceControlGuid);
+}
+
+VOID
+NTAPI
+WmipFlushDpcRoutine(IN PKDPC Dpc,
+                    IN PVOID DeferredContext,
+                    IN PVOID SystemArgument1,
+                    IN PVOID SystemArgument2)
+{
+    PWMIP_LOGGER_CONTEXT Logger = DeferredContext;
+
+    /* Writers can't signal the logger thread themselves, so we do it here */
+    KeSetEvent(&Logger->FlushEvent, IO_NO_INCREMENT, FALSE);
+}
+
+static
+PVOID
+WmipReserveTraceBuffer(IN PWMIP_LOGGER_CONTEXT Logger,
+                       IN ULONG Size,
+                       OUT PWMIP_TRACE_BUFFER *OutBuffer)
+{
+    ULONG Processor = KeGetCurrentProcessorNumber();
+    PWMIP_TRACE_BUFFER Buffer, NewBuffer;
+    PSLIST_ENTRY ListEntry;
+    LONG Offset;
+
+    /* Events must fit into an empty buffer */
+    if (Size > (Logger->BufferSize - sizeof(WMI_TRACE_BUFFER_HEADER)))
+    {
+        InterlockedIncrement(&Logger->EventsLost);
+        return NULL;
+    }
+
+    for (;;)
+    {
+        Buffer = Logger->ProcessorBuffers[Processor];
+        if (Buffer)
+        {
+            /* Hold the buffer, then make sure it wasn't taken from us meanwhile */
+            InterlockedIncrement(&Buffer->ReferenceCount);
+            if (Buffer == Logger->ProcessorBuffers[Processor])
+            {
+                /* Reserve our space in it */
+                Offset = InterlockedExchangeAdd(&Buffer->CurrentOffset, Size);
+                if ((ULONG)Offset + Size <= Logger->BufferSize)
+                {
+                    *OutBuffer = Buffer;
+                    return (PUCHAR)&Buffer->Header + Offset;
+                }
+            }
+
+            /* It's full or gone, let it go */
+            InterlockedDecrement(&Buffer->ReferenceCount);
+        }
+
+        /* Grab an empty buffer for this processor */
+        ListEntry = InterlockedPopEntrySList(&Logger->FreeList);
+        if (!ListEntry)
+        {
+            /* The logger thread is behind, drop the event */
+            InterlockedIncrement(&Logger->EventsLost);
+            KeInsertQueueDpc(&Logger->FlushDpc, NULL, NULL);
+            return NULL;
+        }
+        NewBuffer = CONTAINING_RECORD(ListEntry, WMIP_TRACE_BUFFER, ListEntry);
+        NewBuffer->Header.ProcessorNumber = (USHORT)Processor;
+
+        /* Switch to it, unless the logger thread just did that for us */
+        if (InterlockedCompareExchangePointer((PVOID*)&Logger->ProcessorBuffers[Processor],
+                                              NewBuffer,
+                                              Buffer) == Buffer)
+        {
+            if (Buffer)
+            {
+                /* Queue the full one for writing */
+                InterlockedPushEntrySList(&Logger->FlushList, &Buffer->ListEntry);
+                KeInsertQueueDpc(&Logger->FlushDpc, NULL, NULL);
+            }
+        }
+        else
+        {
+            InterlockedPushEntrySList(&Logger->FreeList, &NewBuffer->ListEntry);
+        }
+    }
+}
+
+static
+VOID
+WmipLogEvent(IN LPCGUID Guid,
+             IN UCHAR Type,
+             IN PVOID Data,
+             IN ULONG DataLength)
+{
+    PWMIP_LOGGER_CONTEXT Logger;
+    PWMIP_TRACE_BUFFER Buffer;
+    PEVENT_TRACE_HEADER Event;
+    PKTHREAD Thread;
+    KIRQL OldIrql;
+    ULONG Size, Processor;
+
+    /* Writers never leave their processor and never wait */
+    OldIrql = KeGetCurrentIrql();
+    if (OldIrql < DISPATCH_LEVEL) KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+
+    /* Announce ourselves before looking at the logger, stopping it waits for us */
+    Processor = KeGetCurrentProcessorNumber();
+    InterlockedIncrement(&WmipProcessorLogging[Processor].Count);
+
+    Logger = WmipKernelLogger;
+    if (Logger)
+    {
+        Size = ALIGN_UP_BY(sizeof(EVENT_TRACE_HEADER) + DataLength, WMI_TRACE_ALIGNMENT);
+        Event = WmipReserveTraceBuffer(Logger, Size, &Buffer);
+        if (Event)
+        {
+            /* Fill the header */
+            Thread = KeGetCurrentThread();
+            Event->Size = (USHORT)(sizeof(EVENT_TRACE_HEADER) + DataLength);
+            Event->FieldTypeFlags = 0;
+            Event->Class.Type = Type;
+            Event->Class.Level = 0;
+            Event->Class.Version = 0;
+            Event->ThreadId = HandleToUlong(PsGetCurrentThreadId());
+            Event->ProcessId = HandleToUlong(PsGetCurrentProcessId());
+            Event->TimeStamp.QuadPart = WmipGetLoggerClock(Logger);
+            Event->Guid = *Guid;
+            Event->KernelTime = Thread->KernelTime;
+            Event->UserTime = Thread->UserTime;
+
+            /* Copy the data and release the buffer */
+            RtlCopyMemory(Event + 1, Data, DataLength);
+            InterlockedDecrement(&Buffer->ReferenceCount);
+        }
+    }
+
+    InterlockedDecrement(&WmipProcessorLogging[Processor].Count);
+    if (OldIrql < DISPATCH_LEVEL) KeLowerIrql(OldIrql);
+}
+
+static
+PWMIP_TRACE_BUFFER
+WmipAllocateTraceBuffer(IN PWMIP_LOGGER_CONTEXT Logger)
+{
+    PWMIP_TRACE_BUFFER Buffer;
+
+    Buffer = ExAllocatePoolWithTag(NonPagedPool,
+                                   FIELD_OFFSET(WMIP_TRACE_BUFFER, Header) + Logger->BufferSize,
+                                   TAG_WMI_BUFFER);
+    if (!Buffer) return NULL;
+
+    RtlZeroMemory(&Buffer->Header, Logger->BufferSize);
+    Buffer->CurrentOffset = sizeof(WMI_TRACE_BUFFER_HEADER);
+    Buffer->ReferenceCount = 0;
+    InsertTailList(&Logger->BufferListHead, &Buffer->Link);
+    Logger->NumberOfBuffers++;
+    return Buffer;
+}
+
+static
+VOID
+WmipGrowFreeList(IN PWMIP_LOGGER_CONTEXT Logger)
+{
+    PWMIP_TRACE_BUFFER Buffer;
+
+    /* Keep one spare buffer per processor, as long as we are allowed to */
+    while ((ExQueryDepthSList(&Logger->FreeList) < Logger->NumberOfProcessors) &&
+           (Logger->NumberOfBuffers < Logger->MaximumBuffers))
+    {
+        Buffer = WmipAllocateTraceBuffer(Logger);
+        if (!Buffer) break;
+        InterlockedPushEntrySList(&Logger->FreeList, &Buffer->ListEntry);
+    }
+}
+
+static
+BOOLEAN
+WmipWriteBuffer(IN PWMIP_LOGGER_CONTEXT Logger,
+                IN PVOID Data,
+                IN PLARGE_INTEGER ByteOffset)
+{
+    IO_STATUS_BLOCK IoStatusBlock;
+    NTSTATUS Status;
+
+    /* The log file has a size limit, the rest gets lost */
+    if ((Logger->MaximumFileBytes) &&
+        ((ULONGLONG)ByteOffset->QuadPart + Logger->BufferSize > Logger->MaximumFileBytes))
+    {
+        return FALSE;
+    }
+
+    Status = ZwWriteFile(Logger->FileHandle,
+                         NULL,
+                         NULL,
+                         NULL,
+                         &IoStatusBlock,
+                         Data,
+                         Logger->BufferSize,
+                         ByteOffset,
+                         NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to write trace buffer: 0x%lx\n", Status);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+VOID
+WmipWriteFlushList(IN PWMIP_LOGGER_CONTEXT Logger)
+{
+    PSLIST_ENTRY ListEntry, NextEntry, FifoList = NULL;
+    PWMIP_TRACE_BUFFER Buffer;
+
+    /* The list is LIFO, reverse it so each processor's buffers stay in order */
+    ListEntry = InterlockedFlushSList(&Logger->FlushList);
+    while (ListEntry)
+    {
+        NextEntry = ListEntry->Next;
+        ListEntry->Next = FifoList;
+        FifoList = ListEntry;
+        ListEntry = NextEntry;
+    }
+
+    while (FifoList)
+    {
+        Buffer = CONTAINING_RECORD(FifoList, WMIP_TRACE_BUFFER, ListEntry);
+        FifoList = FifoList->Next;
+
+        /* Wait for the writers that were still copying their events */
+        while (Buffer->ReferenceCount) YieldProcessor();
+
+        /* Seal it and write it out */
+        Buffer->Header.BufferSize = Logger->BufferSize;
+        Buffer->Header.SavedOffset = min((ULONG)Buffer->CurrentOffset, Logger->BufferSize);
+        Buffer->Header.SequenceNumber = ++Logger->SequenceNumber;
+        Buffer->Header.TimeStamp.QuadPart = WmipGetLoggerClock(Logger);
+        if (WmipWriteBuffer(Logger, &Buffer->Header, &Logger->ByteOffset))
+        {
+            Logger->ByteOffset.QuadPart += Logger->BufferSize;
+            Logger->BuffersWritten++;
+        }
+        else
+        {
+            Logger->LogBuffersLost++;
+        }
+
+        /* Clean it up and give it back to the writers */
+        RtlZeroMemory(&Buffer->Header, Logger->BufferSize);
+        Buffer->CurrentOffset = sizeof(WMI_TRACE_BUFFER_HEADER);
+        InterlockedPushEntrySList(&Logger->FreeList, &Buffer->ListEntry);
+    }
+}
+
+static
+VOID
+WmipCollectProcessorBuffers(IN PWMIP_LOGGER_CONTEXT Logger,
+                            IN BOOLEAN Final)
+{
+    PWMIP_TRACE_BUFFER Buffer, NewBuffer;
+    PSLIST_ENTRY ListEntry;
+    ULONG i;
+
+    for (i = 0; i < Logger->NumberOfProcessors; i++)
+    {
+        /* Skip processors that didn't log anything yet */
+        Buffer = Logger->ProcessorBuffers[i];
+        if (!(Buffer) || (Buffer->CurrentOffset == sizeof(WMI_TRACE_BUFFER_HEADER)))
+            continue;
+
+        /* Unless we are done, the processor gets a fresh buffer */
+        NewBuffer = NULL;
+        if (!Final)
+        {
+            ListEntry = InterlockedPopEntrySList(&Logger->FreeList);
+            if (!ListEntry) continue;
+            NewBuffer = CONTAINING_RECORD(ListEntry, WMIP_TRACE_BUFFER, ListEntry);
+            NewBuffer->Header.ProcessorNumber = (USHORT)i;
+        }
+
+        /* The processor may have switched buffers on its own meanwhile */
+        if (InterlockedCompareExchangePointer((PVOID*)&Logger->ProcessorBuffers[i],
+                                              NewBuffer,
+                                              Buffer) == Buffer)
+        {
+            InterlockedPushEntrySList(&Logger->FlushList, &Buffer->ListEntry);
+        }
+        else if (NewBuffer)
+        {
+            InterlockedPushEntrySList(&Logger->FreeList, &NewBuffer->ListEntry);
+        }
+    }
+}
+
+static
+NTSTATUS
+WmipWriteLogfileHeader(IN PWMIP_LOGGER_CONTEXT Logger)
+{
+    PWMI_TRACE_BUFFER_HEADER BufferHeader;
+    PEVENT_TRACE_HEADER Event;
+    PTRACE_LOGFILE_HEADER LogfileHeader;
+    LARGE_INTEGER ByteOffset, Frequency;
+    NTSTATUS Status;
+    PWCHAR Name;
+    ULONG Size;
+
+    /* The header, both names and their terminators have to fit in one buffer */
+    Size = sizeof(WMI_TRACE_BUFFER_HEADER) + sizeof(EVENT_TRACE_HEADER) +
+           sizeof(TRACE_LOGFILE_HEADER) + WmipKernelLoggerName.Length +
+           Logger->LogFileName.Length + 2 * sizeof(WCHAR);
+    if (Size > Logger->BufferSize) return STATUS_NAME_TOO_LONG;
+
+    BufferHeader = ExAllocatePoolWithTag(PagedPool, Logger->BufferSize, TAG_WMI_BUFFER);
+    if (!BufferHeader) return STATUS_INSUFFICIENT_RESOURCES;
+    RtlZeroMemory(BufferHeader, Logger->BufferSize);
+
+    /* The logfile header event is the only thing in the first buffer */
+    Event = (PEVENT_TRACE_HEADER)(BufferHeader + 1);
+    LogfileHeader = (PTRACE_LOGFILE_HEADER)(Event + 1);
+    Size -= sizeof(WMI_TRACE_BUFFER_HEADER);
+
+    BufferHeader->BufferSize = Logger->BufferSize;
+    BufferHeader->SavedOffset = sizeof(WMI_TRACE_BUFFER_HEADER) + ALIGN_UP_BY(Size, WMI_TRACE_ALIGNMENT);
+    BufferHeader->Flags = WMI_TRACE_BUFFER_FLAG_LOGFILE_HEADER;
+    BufferHeader->TimeStamp = Logger->StartClock;
+
+    Event->Size = (USHORT)Size;
+    Event->Class.Type = EVENT_TRACE_TYPE_INFO;
+    Event->ThreadId = HandleToUlong(Logger->ThreadId);
+    Event->ProcessId = HandleToUlong(PsGetCurrentProcessId());
+    Event->TimeStamp = Logger->StartClock;
+    Event->Guid = EventTraceGuid;
+
+    KeQueryPerformanceCounter(&Frequency);
+    LogfileHeader->BufferSize = Logger->BufferSize;
+    LogfileHeader->VersionDetail.MajorVersion = 1;
+    LogfileHeader->ProviderVersion = NtBuildNumber & 0xFFFF;
+    LogfileHeader->NumberOfProcessors = Logger->NumberOfProcessors;
+    KeQuerySystemTime(&LogfileHeader->EndTime);
+    LogfileHeader->TimerResolution = KeMaximumIncrement;
+    LogfileHeader->MaximumFileSize = Logger->MaximumFileSize;
+    LogfileHeader->LogFileMode = Logger->LogFileMode;
+    LogfileHeader->BuffersWritten = Logger->BuffersWritten + 1;
+    LogfileHeader->StartBuffers = 1;
+    LogfileHeader->PointerSize = sizeof(PVOID);
+    LogfileHeader->EventsLost = Logger->EventsLost;
+    LogfileHeader->CpuSpeedInMHz = KeGetCurrentPrcb()->MHz;
+    LogfileHeader->TimeZone = ExpTimeZoneInfo;
+    LogfileHeader->BootTime = KeBootTime;
+    LogfileHeader->PerfFreq = Frequency;
+    LogfileHeader->StartTime = Logger->StartTime;
+    LogfileHeader->ReservedFlags = Logger->ClientContext;
+    LogfileHeader->BuffersLost = Logger->LogBuffersLost;
+
+    /* The consumer points LoggerName and LogFileName to these */
+    Name = (PWCHAR)(LogfileHeader + 1);
+    RtlCopyMemory(Name, WmipKernelLoggerName.Buffer, WmipKernelLoggerName.Length);
+    Name += WmipKernelLoggerName.Length / sizeof(WCHAR) + 1;
+    RtlCopyMemory(Name, Logger->LogFileName.Buffer, Logger->LogFileName.Length);
+
+    /* It always goes at the start of the file */
+    ByteOffset.QuadPart = 0;
+    Status = WmipWriteBuffer(Logger, BufferHeader, &ByteOffset) ? STATUS_SUCCESS : STATUS_UNSUCCESSFUL;
+
+    ExFreePoolWithTag(BufferHeader, TAG_WMI_BUFFER);
+    return Status;
+}
+
+VOID
+NTAPI
+WmipLoggerThread(IN PVOID Context)
+{
+    PWMIP_LOGGER_CONTEXT Logger = Context;
+    LARGE_INTEGER Timeout;
+    NTSTATUS Status;
+    BOOLEAN Flush;
+
+    for (;;)
+    {
+        /* Wake up for full buffers, for control requests, or periodically */
+        Timeout.QuadPart = Int32x32To64(Logger->FlushTimer, -10 * 1000 * 1000);
+        Status = KeWaitForSingleObject(&Logger->FlushEvent,
+                                       Executive,
+                                       KernelMode,
+                                       FALSE,
+                                       &Timeout);
+
+        /* Take the flush request once, so that it is answered by what was done for it */
+        Flush = (BOOLEAN)InterlockedExchange(&Logger->FlushRequested, FALSE);
+
+        /* Periodic flushes also pick up the partially filled buffers */
+        if ((Status == STATUS_TIMEOUT) || Flush || (Logger->StopRequested))
+        {
+            WmipWriteFlushList(Logger);
+            WmipCollectProcessorBuffers(Logger, Logger->StopRequested);
+        }
+        WmipWriteFlushList(Logger);
+
+        if (Logger->StopRequested) break;
+
+        /* Make sure the writers have room for what comes next */
+        WmipGrowFreeList(Logger);
+
+        if (Flush)
+        {
+            KeSetEvent(&Logger->FlushDoneEvent, IO_NO_INCREMENT, FALSE);
+        }
+    }
+
+    /* Update the logfile header with the final statistics */
+    WmipWriteLogfileHeader(Logger);
+    PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+static
+VOID
+WmipDeleteLogger(IN PWMIP_LOGGER_CONTEXT Logger)
+{
+    PWMIP_TRACE_BUFFER Buffer;
+    PLIST_ENTRY ListEntry;
+
+    /* Close the log file */
+    if (Logger->FileHandle) ZwClose(Logger->FileHandle);
+    if (Logger->LogFileName.Buffer) ExFreePoolWithTag(Logger->LogFileName.Buffer, TAG_WMI_LOGGER);
+
+    /* Free all buffers, wherever they are */
+    while (!IsListEmpty(&Logger->BufferListHead))
+    {
+        ListEntry = RemoveHeadList(&Logger->BufferListHead);
+        Buffer = CONTAINING_RECORD(ListEntry, WMIP_TRACE_BUFFER, Link);
+        ExFreePoolWithTag(Buffer, TAG_WMI_BUFFER);
+    }
+
+    ExFreePoolWithTag(Logger, TAG_WMI_LOGGER);
+}
+
+static
+NTSTATUS
+WmipCreateLogger(IN PWMI_LOGGER_INFORMATION LoggerInfo,
+                 OUT PWMIP_LOGGER_CONTEXT *OutLogger)
+{
+    PWMIP_LOGGER_CONTEXT Logger;
+    PWMIP_TRACE_BUFFER Buffer;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    CLIENT_ID ClientId;
+    HANDLE ThreadHandle;
+    PWCHAR LogFileName;
+    ULONG NumberOfProcessors, i;
+    NTSTATUS Status;
+
+    /* Only sequential log files for now */
+    if (LoggerInfo->LogFileMode & ~(EVENT_TRACE_FILE_MODE_SEQUENTIAL |
+                                    EVENT_TRACE_USE_KBYTES_FOR_SIZE))
+    {
+        DPRINT1("Unsupported log file mode 0x%lx\n", LoggerInfo->LogFileMode);
+        return STATUS_NOT_SUPPORTED;
+    }
+    if (!LoggerInfo->LogFileNameOffset) return STATUS_INVALID_PARAMETER;
+
+    NumberOfProcessors = KeNumberProcessors;
+    Logger = ExAllocatePoolWithTag(NonPagedPool,
+                                   FIELD_OFFSET(WMIP_LOGGER_CONTEXT,
+                                                ProcessorBuffers[NumberOfProcessors]),
+                                   TAG_WMI_LOGGER);
+    if (!Logger) return STATUS_INSUFFICIENT_RESOURCES;
+    RtlZeroMemory(Logger,
+                  FIELD_OFFSET(WMIP_LOGGER_CONTEXT, ProcessorBuffers[NumberOfProcessors]));
+    Logger->NumberOfProcessors = NumberOfProcessors;
+    InitializeListHead(&Logger->BufferListHead);
+    InitializeSListHead(&Logger->FreeList);
+    InitializeSListHead(&Logger->FlushList);
+    KeInitializeEvent(&Logger->FlushEvent, SynchronizationEvent, FALSE);
+    KeInitializeEvent(&Logger->FlushDoneEvent, SynchronizationEvent, FALSE);
+    KeInitializeDpc(&Logger->FlushDpc, WmipFlushDpcRoutine, Logger);
+
+    /* Pick the clock */
+    Logger->ClientContext = LoggerInfo->Wnode.ClientContext;
+    switch (Logger->ClientContext)
+    {
+        case WMI_TRACE_CLOCK_SYSTEMTIME:
+            Logger->ClockType = WMICT_SYSTEMTIME;
+            break;
+
+        case WMI_TRACE_CLOCK_CPUCYCLE:
+            Logger->ClockType = WMICT_CPUCYCLE;
+            break;
+
+        default:
+            Logger->ClientContext = WMI_TRACE_CLOCK_PERFCOUNTER;
+            Logger->ClockType = WMICT_PERFCOUNTER;
+            break;
+    }
+
+    /* Sanitize the buffer parameters */
+    Logger->BufferSize = LoggerInfo->BufferSize ? LoggerInfo->BufferSize : WMIP_DEFAULT_BUFFER_SIZE;
+    Logger->BufferSize = max(Logger->BufferSize, WMIP_MINIMUM_BUFFER_SIZE);
+    Logger->BufferSize = min(Logger->BufferSize, WMIP_MAXIMUM_BUFFER_SIZE) * 1024;
+    Logger->MinimumBuffers = max(LoggerInfo->MinimumBuffers, 2 * NumberOfProcessors);
+    Logger->MaximumBuffers = LoggerInfo->MaximumBuffers;
+    if (Logger->MaximumBuffers < Logger->MinimumBuffers)
+        Logger->MaximumBuffers = Logger->MinimumBuffers + WMIP_EXTRA_BUFFERS;
+    Logger->FlushTimer = LoggerInfo->FlushTimer ? LoggerInfo->FlushTimer : WMIP_DEFAULT_FLUSH_TIMER;
+    Logger->LogFileMode = LoggerInfo->LogFileMode | EVENT_TRACE_FILE_MODE_SEQUENTIAL;
+    Logger->EnableFlags = LoggerInfo->EnableFlags;
+    Logger->MaximumFileSize = LoggerInfo->MaximumFileSize;
+    Logger->MaximumFileBytes = (ULONGLONG)LoggerInfo->MaximumFileSize *
+        ((LoggerInfo->LogFileMode & EVENT_TRACE_USE_KBYTES_FOR_SIZE) ? 1024 : 1024 * 1024);
+
+    /* Capture the log file name, the caller made sure it is terminated */
+    LogFileName = (PWCHAR)((PUCHAR)LoggerInfo + LoggerInfo->LogFileNameOffset);
+    Logger->LogFileName.Length = (USHORT)(wcslen(LogFileName) * sizeof(WCHAR));
+    Logger->LogFileName.MaximumLength = Logger->LogFileName.Length;
+    Logger->LogFileName.Buffer = ExAllocatePoolWithTag(PagedPool,
+                                                       Logger->LogFileName.Length + sizeof(WCHAR),
+                                                       TAG_WMI_LOGGER);
+    if (!Logger->LogFileName.Buffer)
+    {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Cleanup;
+    }
+    RtlCopyMemory(Logger->LogFileName.Buffer, LogFileName, Logger->LogFileName.Length);
+
+    /* Allocate the initial buffers */
+    for (i = 0; i < Logger->MinimumBuffers; i++)
+    {
+        Buffer = WmipAllocateTraceBuffer(Logger);
+        if (!Buffer)
+        {
+            Status = STATUS_NO_MEMORY;
+            goto Cleanup;
+        }
+        InterlockedPushEntrySList(&Logger->FreeList, &Buffer->ListEntry);
+    }
+
+    /* Create the log file, with the caller's access rights */
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &Logger->LogFileName,
+                               OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+                               NULL,
+                               NULL);
+    Status = IoCreateFile(&Logger->FileHandle,
+                          FILE_WRITE_DATA | SYNCHRONIZE,
+                          &ObjectAttributes,
+                          &IoStatusBlock,
+                          NULL,
+                          FILE_ATTRIBUTE_NORMAL,
+                          FILE_SHARE_READ,
+                          FILE_OVERWRITE_IF,
+                          FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE,
+                          NULL,
+                          0,
+                          CreateFileTypeNone,
+                          NULL,
+                          IO_FORCE_ACCESS_CHECK);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to create log file %wZ: 0x%lx\n", &Logger->LogFileName, Status);
+        Logger->FileHandle = NULL;
+        goto Cleanup;
+    }
+
+    /* The first buffer holds the logfile header */
+    KeQuerySystemTime(&Logger->StartTime);
+    Logger->StartClock.QuadPart = WmipGetLoggerClock(Logger);
+    Status = WmipWriteLogfileHeader(Logger);
+    if (!NT_SUCCESS(Status)) goto Cleanup;
+    Logger->ByteOffset.QuadPart = Logger->BufferSize;
+
+    /* Start the logger thread */
+    InitializeObjectAttributes(&ObjectAttributes, NULL, OBJ_KERNEL_HANDLE, NULL, NULL);
+    Status = PsCreateSystemThread(&ThreadHandle,
+                                  THREAD_ALL_ACCESS,
+                                  &ObjectAttributes,
+                                  NULL,
+                                  &ClientId,
+                                  WmipLoggerThread,
+                                  Logger);
+    if (!NT_SUCCESS(Status)) goto Cleanup;
+
+    Status = ObReferenceObjectByHandle(ThreadHandle,
+                                       SYNCHRONIZE,
+                                       PsThreadType,
+                                       KernelMode,
+                                       (PVOID*)&Logger->Thread,
+                                       NULL);
+    ASSERT(NT_SUCCESS(Status));
+    ZwClose(ThreadHandle);
+    Logger->ThreadId = ClientId.UniqueThread;
+
+    *OutLogger = Logger;
+    return STATUS_SUCCESS;
+
+Cleanup:
+    WmipDeleteLogger(Logger);
+    return Status;
+}
+
+static
+VOID
+WmipFillLoggerInformation(IN PWMIP_LOGGER_CONTEXT Logger,
+                          IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    ULONG Size = LoggerInfo->Wnode.BufferSize;
+
+    LoggerInfo->Wnode.HistoricalContext = WMI_KERNEL_LOGGER_ID;
+    LoggerInfo->Wnode.Guid = SystemTraceControlGuid;
+    LoggerInfo->Wnode.ClientContext = Logger->ClientContext;
+    LoggerInfo->Wnode.Flags |= WNODE_FLAG_TRACED_GUID;
+    LoggerInfo->BufferSize = Logger->BufferSize / 1024;
+    LoggerInfo->MinimumBuffers = Logger->MinimumBuffers;
+    LoggerInfo->MaximumBuffers = Logger->MaximumBuffers;
+    LoggerInfo->MaximumFileSize = Logger->MaximumFileSize;
+    LoggerInfo->LogFileMode = Logger->LogFileMode;
+    LoggerInfo->FlushTimer = Logger->FlushTimer;
+    LoggerInfo->EnableFlags = Logger->EnableFlags;
+    LoggerInfo->AgeLimit = 0;
+    LoggerInfo->NumberOfBuffers = Logger->NumberOfBuffers;
+    LoggerInfo->FreeBuffers = ExQueryDepthSList(&Logger->FreeList);
+    LoggerInfo->EventsLost = Logger->EventsLost;
+    LoggerInfo->BuffersWritten = Logger->BuffersWritten;
+    LoggerInfo->LogBuffersLost = Logger->LogBuffersLost;
+    LoggerInfo->RealTimeBuffersLost = 0;
+    LoggerInfo->LoggerThreadId = Logger->ThreadId;
+
+    /* Return the names where the caller has room for them */
+    if ((LoggerInfo->LoggerNameOffset >= sizeof(WMI_LOGGER_INFORMATION)) &&
+        (LoggerInfo->LoggerNameOffset < Size) &&
+        (Size - LoggerInfo->LoggerNameOffset >= WmipKernelLoggerName.Length + sizeof(WCHAR)))
+    {
+        RtlCopyMemory((PUCHAR)LoggerInfo + LoggerInfo->LoggerNameOffset,
+                      WmipKernelLoggerName.Buffer,
+                      WmipKernelLoggerName.Length);
+        *(PWCHAR)((PUCHAR)LoggerInfo + LoggerInfo->LoggerNameOffset +
+                  WmipKernelLoggerName.Length) = UNICODE_NULL;
+    }
+    if ((LoggerInfo->LogFileNameOffset >= sizeof(WMI_LOGGER_INFORMATION)) &&
+        (LoggerInfo->LogFileNameOffset < Size) &&
+        (Size - LoggerInfo->LogFileNameOffset >= Logger->LogFileName.Length + sizeof(WCHAR)))
+    {
+        RtlCopyMemory((PUCHAR)LoggerInfo + LoggerInfo->LogFileNameOffset,
+                      Logger->LogFileName.Buffer,
+                      Logger->LogFileName.Length);
+        *(PWCHAR)((PUCHAR)LoggerInfo + LoggerInfo->LogFileNameOffset +
+                  Logger->LogFileName.Length) = UNICODE_NULL;
+    }
+}
+
+/* HOOKS *********************************************************************/
+
+VOID
+FASTCALL
+WmipTraceContextSwitch(IN PKTHREAD OldThread,
+                       IN PKTHREAD NewThread)
+{
+    WMI_CSWITCH_EVENT Event;
+
+    Event.NewThreadId = HandleToUlong(((PETHREAD)NewThread)->Cid.UniqueThread);
+    Event.OldThreadId = HandleToUlong(((PETHREAD)OldThread)->Cid.UniqueThread);
+    Event.NewThreadPriority = NewThread->Priority;
+    Event.OldThreadPriority = OldThread->Priority;
+    Event.PreviousCState = 0;
+    Event.SpareByte = 0;
+    Event.OldThreadWaitReason = OldThread->WaitReason;
+    Event.OldThreadWaitMode = OldThread->WaitMode;
+    Event.OldThreadState = OldThread->State;
+    Event.OldThreadWaitIdealProcessor = OldThread->IdealProcessor;
+    Event.NewThreadWaitTime = KeTickCount.LowPart - NewThread->WaitTime;
+    Event.Reserved = 0;
+
+    WmipLogEvent(&ThreadGuid, WMI_TRACE_TYPE_CSWITCH, &Event, sizeof(Event));
+}
+
+static
+VOID
+WmipTraceDiskIo(IN UCHAR Type,
+                IN PIRP Irp,
+                IN PIO_STACK_LOCATION StackPtr,
+                IN ULONG TransferSize,
+                IN NTSTATUS Status)
+{
+    WMI_DISKIO_EVENT Event;
+
+    Event.Irp = Irp;
+    Event.DeviceObject = StackPtr->DeviceObject;
+    Event.FileObject = StackPtr->FileObject;
+    Event.ByteOffset = 0;
+    if ((StackPtr->MajorFunction == IRP_MJ_READ) || (StackPtr->MajorFunction == IRP_MJ_WRITE))
+    {
+        /* Read and write parameters have the same layout */
+        Event.ByteOffset = StackPtr->Parameters.Read.ByteOffset.QuadPart;
+    }
+    Event.TransferSize = TransferSize;
+    Event.IrpFlags = Irp->Flags;
+    Event.Status = Status;
+    Event.Reserved = 0;
+
+    WmipLogEvent(&DiskIoGuid, Type, &Event, sizeof(Event));
+}
+
+VOID
+FASTCALL
+WmipTraceIrpStart(IN PDEVICE_OBJECT DeviceObject,
+                  IN PIRP Irp)
+{
+    PIO_STACK_LOCATION StackPtr = IoGetCurrentIrpStackLocation(Irp);
+
+    /* Only requests to disks are of interest */
+    if (DeviceObject->DeviceType != FILE_DEVICE_DISK) return;
+
+    switch (StackPtr->MajorFunction)
+    {
+        case IRP_MJ_READ:
+            WmipTraceDiskIo(EVENT_TRACE_TYPE_IO_READ_INIT,
+                            Irp,
+                            StackPtr,
+                            StackPtr->Parameters.Read.Length,
+                            STATUS_PENDING);
+            break;
+
+        case IRP_MJ_WRITE:
+            WmipTraceDiskIo(EVENT_TRACE_TYPE_IO_WRITE_INIT,
+                            Irp,
+                            StackPtr,
+                            StackPtr->Parameters.Write.Length,
+                            STATUS_PENDING);
+            break;
+
+        case IRP_MJ_FLUSH_BUFFERS:
+            WmipTraceDiskIo(EVENT_TRACE_TYPE_IO_FLUSH_INIT, Irp, StackPtr, 0, STATUS_PENDING);
+            break;
+    }
+}
+
+VOID
+FASTCALL
+WmipTraceIrpCompletion(IN PIRP Irp)
+{
+    PIO_STACK_LOCATION StackPtr;
+
+    /* Requests that never got passed to a driver have no current location */
+    if (Irp->CurrentLocation > Irp->StackCount) return;
+
+    /* Only requests completed by disks are of interest */
+    StackPtr = IoGetCurrentIrpStackLocation(Irp);
+    if (!(StackPtr->DeviceObject) || (StackPtr->DeviceObject->DeviceType != FILE_DEVICE_DISK))
+        return;
+
+    switch (StackPtr->MajorFunction)
+    {
+        case IRP_MJ_READ:
+            WmipTraceDiskIo(EVENT_TRACE_TYPE_IO_READ,
+                            Irp,
+                            StackPtr,
+                            (ULONG)Irp->IoStatus.Information,
+                            Irp->IoStatus.Status);
+            break;
+
+        case IRP_MJ_WRITE:
+            WmipTraceDiskIo(EVENT_TRACE_TYPE_IO_WRITE,
+                            Irp,
+                            StackPtr,
+                            (ULONG)Irp->IoStatus.Information,
+                            Irp->IoStatus.Status);
+            break;
+
+        case IRP_MJ_FLUSH_BUFFERS:
+            WmipTraceDiskIo(EVENT_TRACE_TYPE_IO_FLUSH, Irp, StackPtr, 0, Irp->IoStatus.Status);
+            break;
+    }
+}
+
+VOID
+FASTCALL
+WmipTracePageFault(IN NTSTATUS Status,
+                   IN PVOID Address,
+                   IN PVOID TrapInformation)
+{
+    PKTRAP_FRAME TrapFrame = TrapInformation;
+    WMI_PAGEFAULT_EVENT Event;
+    UCHAR Type;
+
+    /* Tell what kind of fault it was from the way it was resolved */
+    switch (Status)
+    {
+        case STATUS_PAGE_FAULT_TRANSITION:
+            Type = EVENT_TRACE_TYPE_MM_TF;
+            break;
+
+        case STATUS_PAGE_FAULT_DEMAND_ZERO:
+            Type = EVENT_TRACE_TYPE_MM_DZF;
+            break;
+
+        case STATUS_PAGE_FAULT_COPY_ON_WRITE:
+            Type = EVENT_TRACE_TYPE_MM_COW;
+            break;
+
+        case STATUS_PAGE_FAULT_GUARD_PAGE:
+        case STATUS_GUARD_PAGE_VIOLATION:
+            Type = EVENT_TRACE_TYPE_MM_GPF;
+            break;
+
+        case STATUS_PAGE_FAULT_PAGING_FILE:
+            Type = EVENT_TRACE_TYPE_MM_HPF;
+            break;
+
+        default:
+            /* Other successes don't tell us anything, failures are access violations */
+            if (NT_SUCCESS(Status)) return;
+            Type = EVENT_TRACE_TYPE_MM_AV;
+            break;
+    }
+
+    Event.VirtualAddress = Address;
+    Event.ProgramCounter = NULL;
+    if (TrapFrame)
+    {
+#if defined(_M_IX86)
+        Event.ProgramCounter = (PVOID)TrapFrame->Eip;
+#elif defined(_M_AMD64)
+        Event.ProgramCounter = (PVOID)TrapFrame->Rip;
+#elif defined(_M_ARM)
+        Event.ProgramCounter = (PVOID)KeGetTrapFramePc(TrapFrame);
+#endif
+    }
+
+    WmipLogEvent(&PageFaultGuid, Type, &Event, sizeof(Event));
+}
+
+VOID
+NTAPI
+WmipTraceRegistryParse(IN BOOLEAN Create,
+                       IN NTSTATUS Status,
+                       IN PCUNICODE_STRING KeyName,
+                       IN PVOID Object)
+{
+    UCHAR Buffer[FIELD_OFFSET(WMI_REGISTRY_EVENT, KeyName) +
+                 (WMI_REGISTRY_NAME_LENGTH + 1) * sizeof(WCHAR)];
+    PWMI_REGISTRY_EVENT Event = (PWMI_REGISTRY_EVENT)Buffer;
+    ULONG Length;
+    PAGED_CODE();
+
+    /* The name may be paged, so copy it while we still can touch it */
+    Length = min(KeyName->Length / sizeof(WCHAR), WMI_REGISTRY_NAME_LENGTH);
+    RtlCopyMemory(Event->KeyName, KeyName->Buffer, Length * sizeof(WCHAR));
+    Event->KeyName[Length] = UNICODE_NULL;
+    Event->Status = Status;
+    Event->Reserved = 0;
+    Event->Object = Object;
+
+    WmipLogEvent(&RegistryGuid,
+                 Create ? EVENT_TRACE_TYPE_REGCREATE : EVENT_TRACE_TYPE_REGOPEN,
+                 Event,
+                 FIELD_OFFSET(WMI_REGISTRY_EVENT, KeyName[Length + 1]));
+}
+
+/* FUNCTIONS *****************************************************************/
+
+LONG64
+FASTCALL
+WmiGetClock(IN WMI_CLOCK_TYPE ClockType,
+            IN PVOID Context)
+{
+    LARGE_INTEGER Time;
+    PKTHREAD Thread;
+
+    switch (ClockType)
+    {
+        case WMICT_SYSTEMTIME:
+            KeQuerySystemTime(&Time);
+            return Time.QuadPart;
+
+        case WMICT_CPUCYCLE:
+#if defined(_M_IX86) || defined(_M_AMD64)
+            return __rdtsc();
+#else
+            return KeQueryPerformanceCounter(NULL).QuadPart;
+#endif
+
+        case WMICT_PROCESS:
+        case WMICT_THREAD:
+            /* Processor time of the current thread, in ticks */
+            Thread = KeGetCurrentThread();
+            return (LONG64)Thread->KernelTime + Thread->UserTime;
+
+        case WMICT_DEFAULT:
+        case WMICT_PERFCOUNTER:
+        default:
+            return KeQueryPerformanceCounter(NULL).QuadPart;
+    }
+}
+
+NTSTATUS
+NTAPI
+WmiStartTrace(IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    PWMIP_LOGGER_CONTEXT Logger;
+    NTSTATUS Status;
+    PAGED_CODE();
+
+    /* There is only the kernel logger for now */
+    if (!WmipIsKernelLogger(LoggerInfo)) return STATUS_NOT_SUPPORTED;
+
+    KeAcquireGuardedMutex(&WmipLoggerMutex);
+
+    if (WmipKernelLogger)
+    {
+        Status = STATUS_OBJECT_NAME_COLLISION;
+        goto Quickie;
+    }
+
+    Status = WmipCreateLogger(LoggerInfo, &Logger);
+    if (!NT_SUCCESS(Status)) goto Quickie;
+
+    /* Everything is ready, turn the hooks on */
+    InterlockedExchangePointer((PVOID*)&WmipKernelLogger, Logger);
+    InterlockedExchange((PLONG)&WmipKernelLoggerFlags, Logger->EnableFlags & WMIP_SUPPORTED_FLAGS);
+
+    WmipFillLoggerInformation(Logger, LoggerInfo);
+
+Quickie:
+    KeReleaseGuardedMutex(&WmipLoggerMutex);
+    return Status;
+}
+
+NTSTATUS
+NTAPI
+WmiStopTrace(IN PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    PWMIP_LOGGER_CONTEXT Logger;
+    ULONG i;
+    PAGED_CODE();
+
+    if (!WmipIsKernelLogger(LoggerInfo)) return STATUS_WMI_INSTANCE_NOT_FOUND;
+
+    KeAcquireGuardedMutex(&WmipLoggerMutex);
+
+    Logger = WmipKernelLogger;
+    if (!Logger)
+    {
+        KeReleaseGuardedMutex(&WmipLoggerMutex);
+        return STATUS_WMI_INSTANCE_NOT_FOUND;
+    }
+
+    /* Turn the hooks off, then wait until no processor can still see the logger */
+    InterlockedExchange((PLONG)&WmipKernelLoggerFlags, 0);
+    InterlockedExchangePointer((PVOID*)&WmipKernelLogger, NULL);
+    for (i = 0; i < Logger->NumberOfProcessors; i++)
+    {
+        while (WmipProcessorLogging[i].Count) YieldProcessor();
+    }
+
+    /* Let the logger thread write out what is left and exit */
+    Logger->StopRequested = TRUE;
+    KeSetEvent(&Logger->FlushEvent, IO_NO_INCREMENT, FALSE);
+    KeWaitForSingleObject(Logger->Thread, Executive, KernelMode, FALSE, NULL);
+    ObDereferenceObject(Logger->Thread);
+
+    /* The last writers may have queued the DPC */
+    KeRemoveQueueDpc(&Logger->FlushDpc);
+    KeFlushQueuedDpcs();
+
+    WmipFillLoggerInformation(Logger, LoggerInfo);
+    WmipDeleteLogger(Logger);
+
+    KeReleaseGuardedMutex(&WmipLoggerMutex);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+NTAPI
+WmiQueryTrace(IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    NTSTATUS Status = STATUS_WMI_INSTANCE_NOT_FOUND;
+    PAGED_CODE();
+
+    if (!WmipIsKernelLogger(LoggerInfo)) return Status;
+
+    KeAcquireGuardedMutex(&WmipLoggerMutex);
+    if (WmipKernelLogger)
+    {
+        WmipFillLoggerInformation(WmipKernelLogger, LoggerInfo);
+        Status = STATUS_SUCCESS;
+    }
+    KeReleaseGuardedMutex(&WmipLoggerMutex);
+
+    return Status;
+}
+
+NTSTATUS
+NTAPI
+WmiUpdateTrace(IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    PWMIP_LOGGER_CONTEXT Logger;
+    NTSTATUS Status = STATUS_WMI_INSTANCE_NOT_FOUND;
+    PAGED_CODE();
+
+    if (!WmipIsKernelLogger(LoggerInfo)) return Status;
+
+    KeAcquireGuardedMutex(&WmipLoggerMutex);
+    Logger = WmipKernelLogger;
+    if (Logger)
+    {
+        /* Only the flags and the flush timer can change while running */
+        Logger->EnableFlags = LoggerInfo->EnableFlags;
+        if (LoggerInfo->FlushTimer) Logger->FlushTimer = LoggerInfo->FlushTimer;
+        InterlockedExchange((PLONG)&WmipKernelLoggerFlags,
+                            Logger->EnableFlags & WMIP_SUPPORTED_FLAGS);
+
+        WmipFillLoggerInformation(Logger, LoggerInfo);
+        Status = STATUS_SUCCESS;
+    }
+    KeReleaseGuardedMutex(&WmipLoggerMutex);
+
+    return Status;
+}
+
+NTSTATUS
+NTAPI
+WmiFlushTrace(IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    PWMIP_LOGGER_CONTEXT Logger;
+    NTSTATUS Status = STATUS_WMI_INSTANCE_NOT_FOUND;
+    PAGED_CODE();
+
+    if (!WmipIsKernelLogger(LoggerInfo)) return Status;
+
+    KeAcquireGuardedMutex(&WmipLoggerMutex);
+    Logger = WmipKernelLogger;
+    if (Logger)
+    {
+        /* Have the logger thread write everything out and wait for it */
+        InterlockedExchange(&Logger->FlushRequested, TRUE);
+        KeSetEvent(&Logger->FlushEvent, IO_NO_INCREMENT, FALSE);
+        KeWaitForSingleObject(&Logger->FlushDoneEvent, Executive, KernelMode, FALSE, NULL);
+
+        WmipFillLoggerInformation(Logger, LoggerInfo);
+        Status = STATUS_SUCCESS;
+    }
+    KeReleaseGuardedMutex(&WmipLoggerMutex);
+
+    return Status;
+}
+
+/* EOF */
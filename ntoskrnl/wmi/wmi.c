@@ -19,18 +19,6 @@
 #define NDEBUG
 #include <debug.h>
 
-typedef PVOID PWMI_LOGGER_INFORMATION; // FIXME
-
-typedef enum _WMI_CLOCK_TYPE
-{
-    WMICT_DEFAULT,
-    WMICT_SYSTEMTIME,
-    WMICT_PERFCOUNTER,
-    WMICT_PROCESS,
-    WMICT_THREAD,
-    WMICT_CPUCYCLE
-} WMI_CLOCK_TYPE;
-
 /* FUNCTIONS *****************************************************************/
 
 BOOLEAN
@@ -41,6 +29,9 @@ WmiInitialize(
     UNICODE_STRING DriverName = RTL_CONSTANT_STRING(L"\\Driver\\WMIxWDM");
     NTSTATUS Status;
 
+    /* Initialize the kernel logger */
+    WmipInitializeTracing();
+
     /* Initialize the GUID object type */
     Status = WmipInitializeGuidObjectType();
     if (!NT_SUCCESS(Status))
@@ -375,47 +366,6 @@ WmiTraceMessageVa(IN TRACEHANDLE LoggerHandle,
     return STATUS_NOT_IMPLEMENTED;
 }
 
-NTSTATUS
-NTAPI
-WmiFlushTrace(IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
-{
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
-}
-
-LONG64
-FASTCALL
-WmiGetClock(IN WMI_CLOCK_TYPE ClockType,
-            IN PVOID Context)
-{
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
-}
-
-NTSTATUS
-NTAPI
-WmiQueryTrace(IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
-{
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
-}
-
-NTSTATUS
-NTAPI
-WmiStartTrace(IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
-{
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
-}
-
-NTSTATUS
-NTAPI
-WmiStopTrace(IN PWMI_LOGGER_INFORMATION LoggerInfo)
-{
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
-}
-
 NTSTATUS
 FASTCALL
 WmiTraceFastEvent(IN PWNODE_HEADER Wnode)
@@ -424,14 +374,6 @@ WmiTraceFastEvent(IN PWNODE_HEADER Wnode)
     return STATUS_NOT_IMPLEMENTED;
 }
 
-NTSTATUS
-NTAPI
-WmiUpdateTrace(IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
-{
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
-}
-
 /*
  * @unimplemented
  */
@@ -443,6 +443,101 @@ WmiSetMark(
     return STATUS_SUCCESS;
 }
 
+static
+BOOLEAN
+WmipIsValidLoggerString(
+    _In_ PWMI_LOGGER_INFORMATION LoggerInfo,
+    _In_ ULONG Offset)
+{
+    PWCHAR String;
+    ULONG MaxLength, i;
+
+    /* No string is fine */
+    if (Offset == 0)
+        return TRUE;
+
+    /* Otherwise it must lie behind the structure and be terminated in the buffer */
+    if ((Offset < sizeof(WMI_LOGGER_INFORMATION)) ||
+        (Offset >= LoggerInfo->Wnode.BufferSize) ||
+        (Offset & (sizeof(WCHAR) - 1)))
+    {
+        return FALSE;
+    }
+
+    String = (PWCHAR)((PUCHAR)LoggerInfo + Offset);
+    MaxLength = (LoggerInfo->Wnode.BufferSize - Offset) / sizeof(WCHAR);
+    for (i = 0; i < MaxLength; i++)
+    {
+        if (String[i] == UNICODE_NULL)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static
+NTSTATUS
+WmipControlLogger(
+    _In_ PIRP Irp,
+    _In_ ULONG IoControlCode,
+    _In_ PVOID Buffer,
+    _In_ ULONG InputLength,
+    _Inout_ PULONG OutputLength)
+{
+    PWMI_LOGGER_INFORMATION LoggerInfo = Buffer;
+    NTSTATUS Status;
+
+    /* Validate the buffer */
+    if ((InputLength < sizeof(WMI_LOGGER_INFORMATION)) ||
+        (*OutputLength < sizeof(WMI_LOGGER_INFORMATION)) ||
+        (LoggerInfo->Wnode.BufferSize < sizeof(WMI_LOGGER_INFORMATION)) ||
+        (LoggerInfo->Wnode.BufferSize > InputLength) ||
+        !WmipIsValidLoggerString(LoggerInfo, LoggerInfo->LogFileNameOffset) ||
+        !WmipIsValidLoggerString(LoggerInfo, LoggerInfo->LoggerNameOffset))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Anything but querying needs the profiling privilege */
+    if ((IoControlCode != IOCTL_WMI_QUERY_LOGGER) &&
+        !SeSinglePrivilegeCheck(SeSystemProfilePrivilege, Irp->RequestorMode))
+    {
+        return STATUS_PRIVILEGE_NOT_HELD;
+    }
+
+    switch (IoControlCode)
+    {
+        case IOCTL_WMI_START_LOGGER:
+            Status = WmiStartTrace(LoggerInfo);
+            break;
+
+        case IOCTL_WMI_STOP_LOGGER:
+            Status = WmiStopTrace(LoggerInfo);
+            break;
+
+        case IOCTL_WMI_QUERY_LOGGER:
+            Status = WmiQueryTrace(LoggerInfo);
+            break;
+
+        case IOCTL_WMI_UPDATE_LOGGER:
+            Status = WmiUpdateTrace(LoggerInfo);
+            break;
+
+        case IOCTL_WMI_FLUSH_LOGGER:
+            Status = WmiFlushTrace(LoggerInfo);
+            break;
+
+        default:
+            ASSERT(FALSE);
+            Status = STATUS_INVALID_DEVICE_REQUEST;
+            break;
+    }
+
+    /* Return the updated structure, and the names if the caller has room */
+    *OutputLength = min(*OutputLength, LoggerInfo->Wnode.BufferSize);
+    return Status;
+}
+
 NTSTATUS
 NTAPI
 WmipIoControl(
@@ -507,6 +602,20 @@ WmipIoControl(
             break;
         }
 
+        case IOCTL_WMI_START_LOGGER:
+        case IOCTL_WMI_STOP_LOGGER:
+        case IOCTL_WMI_QUERY_LOGGER:
+        case IOCTL_WMI_UPDATE_LOGGER:
+        case IOCTL_WMI_FLUSH_LOGGER:
+        {
+            Status = WmipControlLogger(Irp,
+                                       IoControlCode,
+                                       Buffer,
+                                       InputLength,
+                                       &OutputLength);
+            break;
+        }
+
         case IOCTL_WMI_SET_MARK:
         {
             if (InputLength < FIELD_OFFSET(WMI_SET_MARK, Mark))
@@ -1,6 +1,9 @@
 
 #pragma once
 
+#include <wmistr.h>
+#include <wmiioctl.h>
+
 extern POBJECT_TYPE WmipGuidObjectType;
 
 #define GUID_STRING_LENGTH 36
@@ -56,3 +59,33 @@ WmipQueryRawSMBiosTables(
     _Inout_ ULONG *InOutBufferSize,
     _Out_opt_ PVOID OutBuffer);
 
+CODE_SEG("INIT")
+VOID
+NTAPI
+WmipInitializeTracing(
+    VOID);
+
+NTSTATUS
+NTAPI
+WmiStartTrace(
+    _Inout_ PWMI_LOGGER_INFORMATION LoggerInfo);
+
+NTSTATUS
+NTAPI
+WmiStopTrace(
+    _Inout_ PWMI_LOGGER_INFORMATION LoggerInfo);
+
+NTSTATUS
+NTAPI
+WmiQueryTrace(
+    _Inout_ PWMI_LOGGER_INFORMATION LoggerInfo);
+
+NTSTATUS
+NTAPI
+WmiUpdateTrace(
+    _Inout_ PWMI_LOGGER_INFORMATION LoggerInfo);
+
+NTSTATUS
+NTAPI
+WmiFlushTrace(
+    _Inout_ PWMI_LOGGER_INFORMATION LoggerInfo);
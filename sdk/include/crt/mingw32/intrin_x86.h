@@ -120,6 +120,13 @@ __INTRIN_INLINE void _mm_sfence(void)
 }
 #endif
 
+#if defined(__x86_64__) && !HAS_BUILTIN(_mm_stream_si64x)
+__INTRIN_INLINE void _mm_stream_si64x(long long * Destination, long long Value)
+{
+	__asm__ __volatile__("movnti %1, %0" : "=m"(*Destination) : "r"(Value));
+}
+#endif
+
 #if defined(__x86_64__) && !HAS_BUILTIN(__faststorefence)
 __INTRIN_INLINE void __faststorefence(void)
 {
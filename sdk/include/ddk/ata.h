@@ -271,6 +271,8 @@ typedef struct _IDENTIFY_DEVICE_DATA {
 #define IDE_COMMAND_WRITE_DMA_QUEUED_FUA_EXT  0x3E
 #define IDE_COMMAND_VERIFY                    0x40
 #define IDE_COMMAND_VERIFY_EXT                0x42
+#define IDE_COMMAND_READ_FPDMA_QUEUED         0x60
+#define IDE_COMMAND_WRITE_FPDMA_QUEUED        0x61
 #define IDE_COMMAND_EXECUTE_DEVICE_DIAGNOSTIC 0x90
 #define IDE_COMMAND_SET_DRIVE_PARAMETERS      0x91
 #define IDE_COMMAND_ATAPI_PACKET              0xA0
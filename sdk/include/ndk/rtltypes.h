@@ -538,6 +538,20 @@ extern const PRTL_ALLOCATE_STRING_ROUTINE RtlAllocateStringRoutine;
 extern const PRTL_FREE_STRING_ROUTINE RtlFreeStringRoutine;
 extern const PRTL_REALLOCATE_STRING_ROUTINE RtlReallocateStringRoutine;
 
+#if (_WIN32_WINNT >= _WIN32_WINNT_VISTA)
+//
+// Native Thread Pool I/O Completion Callback
+//
+typedef VOID
+(NTAPI *PTP_IO_CALLBACK)(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Context,
+    _In_ PVOID ApcContext,
+    _In_ struct _IO_STATUS_BLOCK *IoStatusBlock,
+    _In_ PTP_IO Io
+);
+#endif
+
 #endif /* NTOS_MODE_USER */
 
 //
@@ -149,6 +149,30 @@ typedef struct _AFD_TDI_HANDLE_DATA
     HANDLE TdiConnectionHandle;
 } AFD_TDI_HANDLE_DATA, *PAFD_TDI_HANDLE_DATA;
 
+typedef struct _AFD_POLL_SET_ENTRY {
+    SOCKET				Handle;
+    ULONG				Operation;
+    ULONG				Events;
+    ULONG				Flags;
+    PVOID				Context;
+} AFD_POLL_SET_ENTRY, *PAFD_POLL_SET_ENTRY;
+
+typedef struct _AFD_POLL_SET_UPDATE_INFO {
+    ULONG				EntryCount;
+    AFD_POLL_SET_ENTRY			Entries[1];
+} AFD_POLL_SET_UPDATE_INFO, *PAFD_POLL_SET_UPDATE_INFO;
+
+typedef struct _AFD_POLL_SET_EVENT {
+    PVOID				Context;
+    ULONG				Events;
+} AFD_POLL_SET_EVENT, *PAFD_POLL_SET_EVENT;
+
+typedef struct _AFD_POLL_SET_WAIT_INFO {
+    LARGE_INTEGER			Timeout;
+    ULONG				EventCount;
+    AFD_POLL_SET_EVENT			Events[1];
+} AFD_POLL_SET_WAIT_INFO, *PAFD_POLL_SET_WAIT_INFO;
+
 /* AFD Packet Endpoint Flags */
 #define AFD_ENDPOINT_CONNECTIONLESS	0x1
 #define AFD_ENDPOINT_MESSAGE_ORIENTED	0x10
@@ -214,6 +238,14 @@ typedef struct _AFD_TDI_HANDLE_DATA
 #define AFD_EVENT_ROUTING_INTERFACE_CHANGE  (1 << AFD_EVENT_ROUTING_INTERFACE_CHANGE_BIT)
 #define AFD_EVENT_ADDRESS_LIST_CHANGE       (1 << AFD_EVENT_ADDRESS_LIST_CHANGE_BIT)
 
+/* AFD Poll Set Operations */
+#define AFD_POLL_SET_ADD		0x1
+#define AFD_POLL_SET_MODIFY		0x2
+#define AFD_POLL_SET_REMOVE		0x3
+
+/* AFD Poll Set Entry Flags */
+#define AFD_POLL_SET_ONESHOT		0x1
+
 /* AFD SEND/RECV Flags */
 #define AFD_SKIP_FIO			0x1L
 #define AFD_OVERLAPPED			0x2L
@@ -259,6 +291,8 @@ typedef struct _AFD_TDI_HANDLE_DATA
 #define AFD_EVENT_SELECT		33
 #define AFD_ENUM_NETWORK_EVENTS         34
 #define AFD_DEFER_ACCEPT		35
+#define AFD_POLL_SET_UPDATE		36
+#define AFD_POLL_SET_WAIT		37
 #define AFD_GET_PENDING_CONNECT_DATA	41
 #define AFD_VALIDATE_GROUP		42
 
@@ -336,6 +370,10 @@ typedef struct _AFD_TDI_HANDLE_DATA
   _AFD_CONTROL_CODE(AFD_ENUM_NETWORK_EVENTS, METHOD_NEITHER)
 #define IOCTL_AFD_VALIDATE_GROUP \
   _AFD_CONTROL_CODE(AFD_VALIDATE_GROUP, METHOD_NEITHER)
+#define IOCTL_AFD_POLL_SET_UPDATE \
+  _AFD_CONTROL_CODE(AFD_POLL_SET_UPDATE, METHOD_BUFFERED )
+#define IOCTL_AFD_POLL_SET_WAIT \
+  _AFD_CONTROL_CODE(AFD_POLL_SET_WAIT, METHOD_BUFFERED )
 
 typedef struct _AFD_SOCKET_INFORMATION {
     BOOL CommandChannel;
@@ -0,0 +1,80 @@
+#pragma once
+
+/*
+ * Log files written by the kernel logger are a sequence of buffers of the
+ * size given when starting the logger. Each one starts with the header below
+ * and holds EVENT_TRACE_HEADER records aligned to WMI_TRACE_ALIGNMENT, until
+ * SavedOffset or a record with a zero size. The first buffer of the file only
+ * holds the logfile header event (EventTraceGuid, EVENT_TRACE_TYPE_INFO)
+ * whose data is a TRACE_LOGFILE_HEADER followed by the logger and log file
+ * names. Its timestamp is the clock value at the time the logger started.
+ */
+typedef struct _WMI_TRACE_BUFFER_HEADER
+{
+    ULONG BufferSize;
+    ULONG SavedOffset;
+    ULONG SequenceNumber;
+    USHORT ProcessorNumber;
+    USHORT Flags;
+    LARGE_INTEGER TimeStamp;
+} WMI_TRACE_BUFFER_HEADER, *PWMI_TRACE_BUFFER_HEADER;
+
+#define WMI_TRACE_ALIGNMENT 8
+
+#define WMI_TRACE_BUFFER_FLAG_LOGFILE_HEADER 0x0001
+
+/* Values of TRACE_LOGFILE_HEADER.ReservedFlags and Wnode.ClientContext */
+#define WMI_TRACE_CLOCK_PERFCOUNTER 1
+#define WMI_TRACE_CLOCK_SYSTEMTIME 2
+#define WMI_TRACE_CLOCK_CPUCYCLE 3
+
+/* ThreadGuid */
+#define WMI_TRACE_TYPE_CSWITCH 36
+
+typedef struct _WMI_CSWITCH_EVENT
+{
+    ULONG NewThreadId;
+    ULONG OldThreadId;
+    CHAR NewThreadPriority;
+    CHAR OldThreadPriority;
+    UCHAR PreviousCState;
+    CHAR SpareByte;
+    CHAR OldThreadWaitReason;
+    CHAR OldThreadWaitMode;
+    CHAR OldThreadState;
+    CHAR OldThreadWaitIdealProcessor;
+    ULONG NewThreadWaitTime;
+    ULONG Reserved;
+} WMI_CSWITCH_EVENT, *PWMI_CSWITCH_EVENT;
+
+/* DiskIoGuid, EVENT_TRACE_TYPE_IO_* */
+typedef struct _WMI_DISKIO_EVENT
+{
+    PVOID Irp;
+    PVOID DeviceObject;
+    PVOID FileObject;
+    ULONGLONG ByteOffset;
+    ULONG TransferSize;
+    ULONG IrpFlags;
+    LONG Status;
+    ULONG Reserved;
+} WMI_DISKIO_EVENT, *PWMI_DISKIO_EVENT;
+
+/* PageFaultGuid, EVENT_TRACE_TYPE_MM_* */
+typedef struct _WMI_PAGEFAULT_EVENT
+{
+    PVOID VirtualAddress;
+    PVOID ProgramCounter;
+} WMI_PAGEFAULT_EVENT, *PWMI_PAGEFAULT_EVENT;
+
+/* RegistryGuid, EVENT_TRACE_TYPE_REG*. KeyName is null terminated and
+   truncated to WMI_REGISTRY_NAME_LENGTH characters */
+typedef struct _WMI_REGISTRY_EVENT
+{
+    LONG Status;
+    ULONG Reserved;
+    PVOID Object;
+    WCHAR KeyName[ANYSIZE_ARRAY];
+} WMI_REGISTRY_EVENT, *PWMI_REGISTRY_EVENT;
+
+#define WMI_REGISTRY_NAME_LENGTH 128
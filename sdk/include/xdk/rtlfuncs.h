@@ -2265,6 +2265,21 @@ RtlDecompressFragment(
   _Out_ PULONG FinalUncompressedSize,
   _In_ PVOID WorkSpace);
 
+#if (NTDDI_VERSION >= NTDDI_WIN8)
+_IRQL_requires_max_(APC_LEVEL)
+NTSYSAPI
+NTSTATUS
+NTAPI
+RtlDecompressBufferEx(
+  _In_ USHORT CompressionFormat,
+  _Out_writes_bytes_to_(UncompressedBufferSize, *FinalUncompressedSize) PUCHAR UncompressedBuffer,
+  _In_ ULONG UncompressedBufferSize,
+  _In_reads_bytes_(CompressedBufferSize) PUCHAR CompressedBuffer,
+  _In_ ULONG CompressedBufferSize,
+  _Out_ PULONG FinalUncompressedSize,
+  _In_opt_ PVOID WorkSpace);
+#endif /* (NTDDI_VERSION >= NTDDI_WIN8) */
+
 _IRQL_requires_max_(APC_LEVEL)
 NTSYSAPI
 NTSTATUS
@@ -111,6 +111,12 @@
         IN ULONG NumberToFind,
         IN ULONG HintIndex);
 
+    ULONG NTAPI
+    RtlFindNextForwardRunSet(
+        IN PRTL_BITMAP BitMapHeader,
+        IN ULONG FromIndex,
+        OUT PULONG StartingRunIndex);
+
     VOID NTAPI
     RtlSetBits(
         IN PRTL_BITMAP BitMapHeader,
@@ -173,6 +179,15 @@
     #undef PAGED_CODE
     #define PAGED_CODE()
 
+    /* Not in the DDK headers */
+    NTSYSAPI
+    ULONG
+    NTAPI
+    RtlFindNextForwardRunSet(
+        _In_ PRTL_BITMAP BitMapHeader,
+        _In_ ULONG FromIndex,
+        _Out_ PULONG StartingRunIndex);
+
     /* Prevent inclusion of Windows headers through <wine/unicode.h> */
     #define _WINDEF_
     #define _WINBASE_
@@ -237,6 +237,21 @@ typedef BOOLEAN
     SIZE_T BufferLength
 );
 
+typedef struct _CMP_OFFSET_ARRAY
+{
+    ULONG FileOffset;
+    PVOID DataBuffer;
+    ULONG DataLength;
+} CMP_OFFSET_ARRAY, *PCMP_OFFSET_ARRAY;
+
+typedef BOOLEAN
+(CMAPI *PFILE_WRITE_GATHER_ROUTINE)(
+    struct _HHIVE *RegistryHive,
+    ULONG FileType,
+    PCMP_OFFSET_ARRAY OffsetArray,
+    ULONG OffsetArrayCount
+);
+
 typedef BOOLEAN
 (CMAPI *PFILE_SET_SIZE_ROUTINE)(
     struct _HHIVE *RegistryHive,
@@ -296,6 +311,7 @@ typedef struct _HHIVE
     PFILE_WRITE_ROUTINE FileWrite;
     PFILE_READ_ROUTINE FileRead;
     PFILE_FLUSH_ROUTINE FileFlush;
+    PFILE_WRITE_GATHER_ROUTINE FileWriteGather; // Optional
 
 #if (NTDDI_VERSION >= NTDDI_WIN7)
     PVOID HiveLoadFailure; // PHIVE_LOAD_FAILURE
@@ -9,6 +9,99 @@
 #define NDEBUG
 #include <debug.h>
 
+/* Number of pieces handed to the file in one gather write */
+#define HV_GATHER_COUNT 16
+
+static BOOLEAN CMAPI
+HvpWriteGather(
+    PHHIVE RegistryHive,
+    ULONG FileType,
+    PCMP_OFFSET_ARRAY OffsetArray,
+    ULONG OffsetArrayCount)
+{
+    ULONG FileOffset;
+    ULONG i;
+
+    if (RegistryHive->FileWriteGather)
+    {
+        return RegistryHive->FileWriteGather(RegistryHive, FileType,
+                                             OffsetArray, OffsetArrayCount);
+    }
+
+    /* No gather support, write the pieces one by one */
+    for (i = 0; i < OffsetArrayCount; i++)
+    {
+        FileOffset = OffsetArray[i].FileOffset;
+        if (!RegistryHive->FileWrite(RegistryHive, FileType, &FileOffset,
+                                     OffsetArray[i].DataBuffer,
+                                     OffsetArray[i].DataLength))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/*
+ * Writes a run of stable blocks to the file. The blocks of a bin are
+ * contiguous in memory, so they are merged into a single piece, and the
+ * pieces of the run are written together.
+ */
+static BOOLEAN CMAPI
+HvpWriteBlockRun(
+    PHHIVE RegistryHive,
+    ULONG FileType,
+    ULONG BlockIndex,
+    ULONG BlockCount,
+    ULONG FileOffset)
+{
+    CMP_OFFSET_ARRAY OffsetArray[HV_GATHER_COUNT];
+    PCMP_OFFSET_ARRAY Piece = NULL;
+    ULONG_PTR BlockAddress;
+    ULONG Count = 0;
+
+    ASSERT(BlockIndex + BlockCount <= RegistryHive->Storage[Stable].Length);
+
+    while (BlockCount--)
+    {
+        BlockAddress = RegistryHive->Storage[Stable].BlockList[BlockIndex].BlockAddress;
+
+        /* Extend the current piece if this block follows it in memory */
+        if (Piece && ((ULONG_PTR)Piece->DataBuffer + Piece->DataLength == BlockAddress))
+        {
+            Piece->DataLength += HBLOCK_SIZE;
+        }
+        else
+        {
+            if (Count == HV_GATHER_COUNT)
+            {
+                if (!HvpWriteGather(RegistryHive, FileType, OffsetArray, Count))
+                {
+                    return FALSE;
+                }
+
+                Count = 0;
+            }
+
+            Piece = &OffsetArray[Count++];
+            Piece->FileOffset = FileOffset;
+            Piece->DataBuffer = (PVOID)BlockAddress;
+            Piece->DataLength = HBLOCK_SIZE;
+        }
+
+        BlockIndex++;
+        FileOffset += HBLOCK_SIZE;
+    }
+
+    if (Count)
+    {
+        return HvpWriteGather(RegistryHive, FileType, OffsetArray, Count);
+    }
+
+    return TRUE;
+}
+
 static BOOLEAN CMAPI
 HvpWriteLog(
     PHHIVE RegistryHive)
@@ -19,8 +112,7 @@ HvpWriteLog(
     PUCHAR Buffer;
     PUCHAR Ptr;
     ULONG BlockIndex;
-    ULONG LastIndex;
-    PVOID BlockPtr;
+    ULONG BlockCount;
     BOOLEAN Success;
     static ULONG PrintCount = 0;
 
@@ -78,30 +170,30 @@ HvpWriteLog(
         return FALSE;
     }
 
-    /* Write dirty blocks */
+    /* Write dirty blocks, one run at a time */
     FileOffset = BufferSize;
     BlockIndex = 0;
     while (BlockIndex < RegistryHive->Storage[Stable].Length)
     {
-        LastIndex = BlockIndex;
-        BlockIndex = RtlFindSetBits(&RegistryHive->DirtyVector, 1, BlockIndex);
-        if (BlockIndex == ~0U || BlockIndex < LastIndex)
+        BlockCount = RtlFindNextForwardRunSet(&RegistryHive->DirtyVector,
+                                              BlockIndex, &BlockIndex);
+        if (BlockCount == 0 || BlockIndex >= RegistryHive->Storage[Stable].Length)
         {
             break;
         }
 
-        BlockPtr = (PVOID)RegistryHive->Storage[Stable].BlockList[BlockIndex].BlockAddress;
+        BlockCount = min(BlockCount, RegistryHive->Storage[Stable].Length - BlockIndex);
 
-        /* Write hive block */
-        Success = RegistryHive->FileWrite(RegistryHive, HFILE_TYPE_LOG,
-                                         &FileOffset, BlockPtr, HBLOCK_SIZE);
+        /* Write hive blocks */
+        Success = HvpWriteBlockRun(RegistryHive, HFILE_TYPE_LOG,
+                                   BlockIndex, BlockCount, FileOffset);
         if (!Success)
         {
             return FALSE;
         }
 
-        BlockIndex++;
-        FileOffset += HBLOCK_SIZE;
+        BlockIndex += BlockCount;
+        FileOffset += BlockCount * HBLOCK_SIZE;
     }
 
     Success = RegistryHive->FileSetSize(RegistryHive, HFILE_TYPE_LOG, FileOffset, FileOffset);
@@ -150,8 +242,7 @@ HvpWriteHive(
 {
     ULONG FileOffset;
     ULONG BlockIndex;
-    ULONG LastIndex;
-    PVOID BlockPtr;
+    ULONG BlockCount;
     BOOLEAN Success;
 
     ASSERT(RegistryHive->ReadOnly == FALSE);
@@ -187,26 +278,30 @@ HvpWriteHive(
     {
         if (OnlyDirty)
         {
-            LastIndex = BlockIndex;
-            BlockIndex = RtlFindSetBits(&RegistryHive->DirtyVector, 1, BlockIndex);
-            if (BlockIndex == ~0U || BlockIndex < LastIndex)
+            BlockCount = RtlFindNextForwardRunSet(&RegistryHive->DirtyVector,
+                                                  BlockIndex, &BlockIndex);
+            if (BlockCount == 0 || BlockIndex >= RegistryHive->Storage[Stable].Length)
             {
                 break;
             }
+
+            BlockCount = min(BlockCount, RegistryHive->Storage[Stable].Length - BlockIndex);
+        }
+        else
+        {
+            BlockCount = RegistryHive->Storage[Stable].Length;
         }
 
-        BlockPtr = (PVOID)RegistryHive->Storage[Stable].BlockList[BlockIndex].BlockAddress;
+        /* Write hive blocks, they follow the base block in the file */
         FileOffset = (BlockIndex + 1) * HBLOCK_SIZE;
-
-        /* Write hive block */
-        Success = RegistryHive->FileWrite(RegistryHive, HFILE_TYPE_PRIMARY,
-                                          &FileOffset, BlockPtr, HBLOCK_SIZE);
+        Success = HvpWriteBlockRun(RegistryHive, HFILE_TYPE_PRIMARY,
+                                   BlockIndex, BlockCount, FileOffset);
         if (!Success)
         {
             return FALSE;
         }
 
-        BlockIndex++;
+        BlockIndex += BlockCount;
     }
 
     Success = RegistryHive->FileFlush(RegistryHive, HFILE_TYPE_PRIMARY, NULL, 0);
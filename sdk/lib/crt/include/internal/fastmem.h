@@ -0,0 +1,54 @@
+#ifndef __CRT_INTERNAL_FASTMEM_H
+#define __CRT_INTERNAL_FASTMEM_H
+
+/*
+ * Helpers for the amd64 memory and string routines. These only use general
+ * purpose registers and string instructions: libcntpr is also linked into
+ * freeldr, which runs with SSE disabled, and the kernel does not preserve
+ * the AVX state of its own code.
+ */
+
+#include <crtdefs.h>
+#include <intrin.h>
+
+/* Processor features, probed on first use */
+#define __CRT_MEM_PROBED    0x00000001
+#define __CRT_MEM_ERMS      0x00000002 /* Enhanced rep movsb/stosb */
+#define __CRT_MEM_FSRM      0x00000004 /* Fast short rep movsb */
+
+/* Below this, rep movsb/stosb only pays off with FSRM */
+#define __CRT_MEM_REP_THRESHOLD         256
+
+/* Copies and fills above this bypass the caches, they would only evict them */
+#define __CRT_MEM_NONTEMPORAL_THRESHOLD (1024 * 1024)
+
+extern unsigned int __crt_mem_features;
+
+unsigned int __cdecl __crt_probe_mem_features(void);
+
+static __inline unsigned int __crt_get_mem_features(void)
+{
+    unsigned int Features = __crt_mem_features;
+
+    if (!Features)
+        Features = __crt_probe_mem_features();
+
+    return Features;
+}
+
+#define __crt_load_qword(p) (*(const unsigned __int64 UNALIGNED *)(p))
+#define __crt_store_qword(p, v) (*(unsigned __int64 UNALIGNED *)(p) = (v))
+#define __crt_load_dword(p) (*(const unsigned int UNALIGNED *)(p))
+#define __crt_store_dword(p, v) (*(unsigned int UNALIGNED *)(p) = (v))
+
+#define __CRT_BYTE_ONES     0x0101010101010101ULL
+#define __CRT_BYTE_HIGHS    0x8080808080808080ULL
+#define __CRT_WORD_ONES     0x0001000100010001ULL
+#define __CRT_WORD_HIGHS    0x8000800080008000ULL
+
+/* Non zero if a byte (word) of x is zero. The lowest set bit is the high bit
+   of the first zero one, the bits above it are not reliable. */
+#define __crt_zero_bytes(x) (((x) - __CRT_BYTE_ONES) & ~(x) & __CRT_BYTE_HIGHS)
+#define __crt_zero_words(x) (((x) - __CRT_WORD_ONES) & ~(x) & __CRT_WORD_HIGHS)
+
+#endif /* __CRT_INTERNAL_FASTMEM_H */
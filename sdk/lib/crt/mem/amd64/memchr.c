@@ -0,0 +1,52 @@
+/*
+ * PROJECT:     ReactOS CRT library
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     memchr for amd64
+ */
+
+#include <string.h>
+#include <internal/fastmem.h>
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1910 || !defined(_WIN64))
+#pragma function(memchr)
+#endif /* _MSC_VER */
+
+void* __cdecl memchr(const void *s, int c, size_t n)
+{
+    const unsigned char *p = s;
+    unsigned char ch = (unsigned char)c;
+    unsigned __int64 pattern, mask;
+    unsigned long index;
+
+    /* Go byte by byte up to the first aligned qword */
+    while (n && ((size_t)p & 7))
+    {
+        if (*p == ch)
+            return (void *)p;
+        p++;
+        n--;
+    }
+
+    /* Then look for a zero byte in each qword xor'ed with the pattern */
+    pattern = ch * __CRT_BYTE_ONES;
+    while (n >= 8)
+    {
+        mask = __crt_zero_bytes(*(const unsigned __int64 *)p ^ pattern);
+        if (mask)
+        {
+            _BitScanForward64(&index, mask);
+            return (void *)(p + (index >> 3));
+        }
+        p += 8;
+        n -= 8;
+    }
+
+    while (n--)
+    {
+        if (*p == ch)
+            return (void *)p;
+        p++;
+    }
+
+    return NULL;
+}
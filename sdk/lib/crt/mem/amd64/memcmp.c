@@ -0,0 +1,45 @@
+/*
+ * PROJECT:     ReactOS CRT library
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     memcmp for amd64
+ */
+
+#include <string.h>
+#include <internal/fastmem.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable: 4164)
+#pragma function(memcmp)
+#endif
+
+int __cdecl memcmp(const void *s1, const void *s2, size_t n)
+{
+    const unsigned char *p1 = s1, *p2 = s2;
+    unsigned __int64 diff;
+    unsigned long index;
+
+    while (n >= 8)
+    {
+        diff = __crt_load_qword(p1) ^ __crt_load_qword(p2);
+        if (diff)
+        {
+            /* The lowest differing byte is the first one in memory */
+            _BitScanForward64(&index, diff);
+            index >>= 3;
+            return (p1[index] - p2[index]);
+        }
+        p1 += 8;
+        p2 += 8;
+        n -= 8;
+    }
+
+    while (n--)
+    {
+        if (*p1 != *p2)
+            return (*p1 - *p2);
+        p1++;
+        p2++;
+    }
+
+    return 0;
+}
@@ -0,0 +1,17 @@
+/*
+ * PROJECT:     ReactOS CRT library
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     memcpy for amd64
+ */
+
+#include <string.h>
+
+#ifdef _MSC_VER
+#pragma function(memcpy)
+#endif /* _MSC_VER */
+
+/* NOTE: Like the generic version, this handles overlapping buffers */
+void* __cdecl memcpy(void* dest, const void* src, size_t count)
+{
+    return memmove(dest, src, count);
+}
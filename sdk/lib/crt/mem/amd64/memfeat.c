@@ -0,0 +1,32 @@
+/*
+ * PROJECT:     ReactOS CRT library
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Processor feature detection for the amd64 memory routines
+ */
+
+#include <internal/fastmem.h>
+
+unsigned int __crt_mem_features;
+
+unsigned int
+__cdecl
+__crt_probe_mem_features(void)
+{
+    unsigned int Features = __CRT_MEM_PROBED;
+    int CpuInfo[4];
+
+    /* Structured extended features */
+    __cpuid(CpuInfo, 0);
+    if (CpuInfo[0] >= 7)
+    {
+        __cpuidex(CpuInfo, 7, 0);
+        if (CpuInfo[1] & (1 << 9))
+            Features |= __CRT_MEM_ERMS;
+        if (CpuInfo[3] & (1 << 4))
+            Features |= __CRT_MEM_FSRM;
+    }
+
+    /* Racing callers store the same value */
+    __crt_mem_features = Features;
+    return Features;
+}
@@ -0,0 +1,186 @@
+/*
+ * PROJECT:     ReactOS CRT library
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     memmove for amd64
+ */
+
+#include <string.h>
+#include <internal/fastmem.h>
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1910 || !defined(_WIN64))
+#pragma function(memmove)
+#endif /* _MSC_VER */
+
+static
+void
+__crt_copy_nontemporal(unsigned char *dest, const unsigned char *src, size_t count)
+{
+    unsigned __int64 a, b, c, d;
+    size_t head;
+
+    /* Align the destination, the first qword may be stored twice */
+    __crt_store_qword(dest, __crt_load_qword(src));
+    head = 8 - ((size_t)dest & 7);
+    dest += head;
+    src += head;
+    count -= head;
+
+    while (count >= 32)
+    {
+        a = __crt_load_qword(src);
+        b = __crt_load_qword(src + 8);
+        c = __crt_load_qword(src + 16);
+        d = __crt_load_qword(src + 24);
+        _mm_stream_si64x((__int64 *)dest, a);
+        _mm_stream_si64x((__int64 *)(dest + 8), b);
+        _mm_stream_si64x((__int64 *)(dest + 16), c);
+        _mm_stream_si64x((__int64 *)(dest + 24), d);
+        dest += 32;
+        src += 32;
+        count -= 32;
+    }
+
+    while (count >= 8)
+    {
+        _mm_stream_si64x((__int64 *)dest, __crt_load_qword(src));
+        dest += 8;
+        src += 8;
+        count -= 8;
+    }
+
+    /* Order the streaming stores before the tail and the caller's stores */
+    _mm_sfence();
+
+    if (count)
+        __crt_store_qword(dest + count - 8, __crt_load_qword(src + count - 8));
+}
+
+static
+void
+__crt_copy_forward(unsigned char *dest, const unsigned char *src, size_t count)
+{
+    unsigned __int64 a, b, c, d;
+
+    /* Load before storing, dest may overlap the source from below */
+    while (count >= 32)
+    {
+        a = __crt_load_qword(src);
+        b = __crt_load_qword(src + 8);
+        c = __crt_load_qword(src + 16);
+        d = __crt_load_qword(src + 24);
+        __crt_store_qword(dest, a);
+        __crt_store_qword(dest + 8, b);
+        __crt_store_qword(dest + 16, c);
+        __crt_store_qword(dest + 24, d);
+        dest += 32;
+        src += 32;
+        count -= 32;
+    }
+
+    while (count >= 8)
+    {
+        __crt_store_qword(dest, __crt_load_qword(src));
+        dest += 8;
+        src += 8;
+        count -= 8;
+    }
+
+    while (count--)
+        *dest++ = *src++;
+}
+
+static
+void
+__crt_copy_backward(unsigned char *dest, const unsigned char *src, size_t count)
+{
+    unsigned __int64 a, b, c, d;
+
+    /* Same from the end, dest overlaps the source from above */
+    while (count >= 32)
+    {
+        count -= 32;
+        a = __crt_load_qword(src + count + 24);
+        b = __crt_load_qword(src + count + 16);
+        c = __crt_load_qword(src + count + 8);
+        d = __crt_load_qword(src + count);
+        __crt_store_qword(dest + count + 24, a);
+        __crt_store_qword(dest + count + 16, b);
+        __crt_store_qword(dest + count + 8, c);
+        __crt_store_qword(dest + count, d);
+    }
+
+    while (count >= 8)
+    {
+        count -= 8;
+        __crt_store_qword(dest + count, __crt_load_qword(src + count));
+    }
+
+    while (count--)
+        dest[count] = src[count];
+}
+
+void * __cdecl memmove(void *dest, const void *src, size_t count)
+{
+    unsigned char *char_dest = (unsigned char *)dest;
+    const unsigned char *char_src = (const unsigned char *)src;
+    unsigned int features;
+    unsigned __int64 a, b;
+    unsigned char c0, c1, c2;
+
+    /* Small sizes load everything before storing, so overlap doesn't matter */
+    if (count <= 16)
+    {
+        if (count >= 8)
+        {
+            a = __crt_load_qword(char_src);
+            b = __crt_load_qword(char_src + count - 8);
+            __crt_store_qword(char_dest, a);
+            __crt_store_qword(char_dest + count - 8, b);
+        }
+        else if (count >= 4)
+        {
+            a = __crt_load_dword(char_src);
+            b = __crt_load_dword(char_src + count - 4);
+            __crt_store_dword(char_dest, (unsigned int)a);
+            __crt_store_dword(char_dest + count - 4, (unsigned int)b);
+        }
+        else if (count)
+        {
+            c0 = char_src[0];
+            c1 = char_src[count >> 1];
+            c2 = char_src[count - 1];
+            char_dest[0] = c0;
+            char_dest[count >> 1] = c1;
+            char_dest[count - 1] = c2;
+        }
+        return dest;
+    }
+
+    /* The destination starts inside the source, copy from the end */
+    if ((size_t)(char_dest - char_src) < count)
+    {
+        if (char_dest != char_src)
+            __crt_copy_backward(char_dest, char_src, count);
+        return dest;
+    }
+
+    features = __crt_get_mem_features();
+
+    if ((count >= __CRT_MEM_NONTEMPORAL_THRESHOLD) &&
+        ((size_t)(char_src - char_dest) >= count))
+    {
+        __crt_copy_nontemporal(char_dest, char_src, count);
+    }
+    else if ((features & __CRT_MEM_ERMS) &&
+             ((count >= __CRT_MEM_REP_THRESHOLD) || (features & __CRT_MEM_FSRM)))
+    {
+        /* rep movsb behaves as a byte loop, so a source above dest is fine */
+        __movsb(char_dest, char_src, count);
+    }
+    else
+    {
+        __crt_copy_forward(char_dest, char_src, count);
+    }
+
+    return dest;
+}
@@ -0,0 +1,93 @@
+/*
+ * PROJECT:     ReactOS CRT library
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     memset for amd64
+ */
+
+#include <string.h>
+#include <internal/fastmem.h>
+
+#ifdef _MSC_VER
+#pragma function(memset)
+#endif /* _MSC_VER */
+
+void* __cdecl memset(void* src, int val, size_t count)
+{
+    unsigned char *char_src = (unsigned char *)src;
+    unsigned __int64 pattern = (unsigned char)val * __CRT_BYTE_ONES;
+    unsigned int features;
+    size_t head;
+
+    /* Small sizes use overlapping stores */
+    if (count <= 16)
+    {
+        if (count >= 8)
+        {
+            __crt_store_qword(char_src, pattern);
+            __crt_store_qword(char_src + count - 8, pattern);
+        }
+        else if (count >= 4)
+        {
+            __crt_store_dword(char_src, (unsigned int)pattern);
+            __crt_store_dword(char_src + count - 4, (unsigned int)pattern);
+        }
+        else if (count)
+        {
+            char_src[0] = (unsigned char)val;
+            char_src[count >> 1] = (unsigned char)val;
+            char_src[count - 1] = (unsigned char)val;
+        }
+        return src;
+    }
+
+    features = __crt_get_mem_features();
+
+    if ((features & __CRT_MEM_ERMS) &&
+        (count >= __CRT_MEM_REP_THRESHOLD) &&
+        (count < __CRT_MEM_NONTEMPORAL_THRESHOLD))
+    {
+        __stosb(char_src, (unsigned char)val, count);
+        return src;
+    }
+
+    /* Align the destination, the first qword may be stored twice */
+    __crt_store_qword(char_src, pattern);
+    head = 8 - ((size_t)char_src & 7);
+    char_src += head;
+    count -= head;
+
+    if (count >= __CRT_MEM_NONTEMPORAL_THRESHOLD)
+    {
+        while (count >= 32)
+        {
+            _mm_stream_si64x((__int64 *)char_src, pattern);
+            _mm_stream_si64x((__int64 *)(char_src + 8), pattern);
+            _mm_stream_si64x((__int64 *)(char_src + 16), pattern);
+            _mm_stream_si64x((__int64 *)(char_src + 24), pattern);
+            char_src += 32;
+            count -= 32;
+        }
+
+        /* Order the streaming stores before the tail and the caller's stores */
+        _mm_sfence();
+    }
+    else if (count >= __CRT_MEM_REP_THRESHOLD)
+    {
+        __stosq((unsigned __int64 *)char_src, pattern, count >> 3);
+        char_src += count & ~7;
+        count &= 7;
+    }
+
+    while (count >= 8)
+    {
+        *(unsigned __int64 *)char_src = pattern;
+        char_src += 8;
+        count -= 8;
+    }
+
+    /* The last qword overlaps the previous one */
+    if (count)
+        __crt_store_qword(char_src + count - 8, pattern);
+
+    return src;
+}
@@ -0,0 +1,41 @@
+/*
+ * PROJECT:     ReactOS CRT library
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     strlen for amd64
+ */
+
+#include <string.h>
+#include <internal/fastmem.h>
+
+#ifdef _MSC_VER
+#pragma function(strlen)
+#endif /* _MSC_VER */
+
+size_t __cdecl strlen(const char *str)
+{
+    const char *s = str;
+    unsigned __int64 mask;
+    unsigned long index;
+
+    if (str == 0) return 0;
+
+    /* Go byte by byte up to the first aligned qword */
+    for (; (size_t)s & 7; s++)
+    {
+        if (!*s)
+            return s - str;
+    }
+
+    /* Aligned reads never cross into the next page */
+    for (;; s += 8)
+    {
+        mask = __crt_zero_bytes(*(const unsigned __int64 *)s);
+        if (mask)
+        {
+            _BitScanForward64(&index, mask);
+            return (s + (index >> 3)) - str;
+        }
+    }
+}
+
+/* EOF */
@@ -0,0 +1,47 @@
+/*
+ * PROJECT:     ReactOS CRT library
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     wcslen for amd64
+ */
+
+#include <string.h>
+#include <internal/fastmem.h>
+
+#ifdef _MSC_VER
+#pragma function(wcslen)
+#endif /* _MSC_VER */
+
+size_t __cdecl wcslen(const wchar_t *str)
+{
+    const wchar_t *s = str;
+    unsigned __int64 mask;
+    unsigned long index;
+
+    if (str == 0) return 0;
+
+    /* Misaligned strings never put a whole character in an aligned qword */
+    if ((size_t)s & 1)
+    {
+        while (*s) s++;
+        return s - str;
+    }
+
+    for (; (size_t)s & 7; s++)
+    {
+        if (!*s)
+            return s - str;
+    }
+
+    /* Aligned reads never cross into the next page */
+    for (;; s += 4)
+    {
+        mask = __crt_zero_words(*(const unsigned __int64 *)s);
+        if (mask)
+        {
+            _BitScanForward64(&index, mask);
+            return (s + (index >> 4)) - str;
+        }
+    }
+}
+
+/* EOF */
@@ -42,6 +42,17 @@ KeGetCurrentNodeNumber()
 	return 0;
 }
 
+typedef BOOLEAN
+(NTAPI *PKE_SET_COALESCABLE_TIMER)(
+    _Inout_ PKTIMER Timer,
+    _In_ LARGE_INTEGER DueTime,
+    _In_ ULONG Period,
+    _In_ ULONG TolerableDelay,
+    _In_opt_ PKDPC Dpc);
+
+static PKE_SET_COALESCABLE_TIMER KepSetCoalescableTimer;
+static BOOLEAN KepSetCoalescableTimerLookedUp;
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 NTKRNLVISTAAPI
 BOOLEAN
@@ -53,5 +64,21 @@ KeSetCoalescableTimer(
     _In_ ULONG TolerableDelay,
     _In_opt_ PKDPC Dpc)
 {
+    static UNICODE_STRING RoutineName = RTL_CONSTANT_STRING(L"KeSetCoalescableTimer");
+    PKE_SET_COALESCABLE_TIMER SetCoalescableTimer;
+
+    /* Use the kernel's own version when it has one. It can only be looked up at PASSIVE_LEVEL */
+    if (!KepSetCoalescableTimerLookedUp && (KeGetCurrentIrql() == PASSIVE_LEVEL))
+    {
+        SetCoalescableTimer = MmGetSystemRoutineAddress(&RoutineName);
+        InterlockedExchangePointer((PVOID *)&KepSetCoalescableTimer, SetCoalescableTimer);
+        KepSetCoalescableTimerLookedUp = TRUE;
+    }
+
+    SetCoalescableTimer = KepSetCoalescableTimer;
+    if (SetCoalescableTimer)
+        return SetCoalescableTimer(Timer, DueTime, Period, TolerableDelay, Dpc);
+
+    /* Older kernels don't coalesce timers, so just ignore the tolerable delay */
     return KeSetTimerEx(Timer, DueTime, Period, Dpc);
 }
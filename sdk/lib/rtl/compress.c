@@ -270,6 +270,1109 @@ RtlpWorkSpaceSizeLZNT1(USHORT Engine,
 }
 
 
+/* XPRESS and XPRESS Huffman, see [MS-XCA] */
+
+#define XPRESS_MIN_MATCH            3
+#define XPRESS_HASH_BITS            14
+#define XPRESS_HASH_SIZE            (1 << XPRESS_HASH_BITS)
+#define XPRESS_WINDOW_SIZE          0x2000
+#define XPRESS_HUFF_WINDOW_SIZE     0x10000
+#define XPRESS_HUFF_MAX_OFFSET      0xFFFF
+#define XPRESS_HUFF_MAX_MATCH       (0x7FFF + XPRESS_MIN_MATCH)
+#define XPRESS_HUFF_BLOCK_SIZE      0x10000
+#define XPRESS_HUFF_SYMBOLS         512
+#define XPRESS_HUFF_TABLE_SIZE      (XPRESS_HUFF_SYMBOLS / 2)
+#define XPRESS_HUFF_MAX_CODE_LENGTH 15
+#define XPRESS_HUFF_END_OF_STREAM   256
+#define XPRESS_HUFF_INVALID_SYMBOL  0xFFFF
+#define XPRESS_HUFF_MATCH_TOKEN     0x8000
+
+#define TAG_XPRESS 'rpXR'
+
+/* Hash chain match finder, lives in the caller's workspace */
+typedef struct _XPRESS_MATCH_FINDER
+{
+    PUCHAR Buffer;
+    ULONG Size;
+    ULONG Inserted;
+    ULONG MaxOffset;
+    ULONG MaxLength;
+    ULONG WindowMask;
+    ULONG MaxChain;
+    ULONG NiceLength;
+    BOOLEAN Lazy;
+    ULONG NextPosition;
+    ULONG NextLength;
+    ULONG NextOffset;
+    ULONG Head[XPRESS_HASH_SIZE];
+    USHORT Chain[ANYSIZE_ARRAY];
+} XPRESS_MATCH_FINDER, *PXPRESS_MATCH_FINDER;
+
+typedef struct _XPRESS_HUFF_ENCODER
+{
+    ULONG Frequencies[XPRESS_HUFF_SYMBOLS];
+    ULONG Sorted[XPRESS_HUFF_SYMBOLS];
+    ULONG Depths[XPRESS_HUFF_SYMBOLS];
+    USHORT Codes[XPRESS_HUFF_SYMBOLS];
+    UCHAR Lengths[XPRESS_HUFF_SYMBOLS];
+    USHORT Tokens[XPRESS_HUFF_BLOCK_SIZE];
+    XPRESS_MATCH_FINDER Finder;
+} XPRESS_HUFF_ENCODER, *PXPRESS_HUFF_ENCODER;
+
+typedef struct _XPRESS_HUFF_DECODER
+{
+    USHORT Table[1 << XPRESS_HUFF_MAX_CODE_LENGTH];
+    UCHAR Lengths[XPRESS_HUFF_SYMBOLS];
+} XPRESS_HUFF_DECODER, *PXPRESS_HUFF_DECODER;
+
+typedef struct _XPRESS_BIT_WRITER
+{
+    PUCHAR Buffer;
+    ULONG Size;
+    ULONG Position;
+    ULONG Slot[2];
+    ULONG Bits;
+    ULONG BitCount;
+} XPRESS_BIT_WRITER, *PXPRESS_BIT_WRITER;
+
+#define XPRESS_WORKSPACE_SIZE \
+    FIELD_OFFSET(XPRESS_MATCH_FINDER, Chain[XPRESS_WINDOW_SIZE])
+#define XPRESS_HUFF_WORKSPACE_SIZE \
+    FIELD_OFFSET(XPRESS_HUFF_ENCODER, Finder.Chain[XPRESS_HUFF_WINDOW_SIZE])
+
+FORCEINLINE
+ULONG
+RtlpXpressLoad16(PUCHAR Buffer)
+{
+    return Buffer[0] | (Buffer[1] << 8);
+}
+
+FORCEINLINE
+ULONG
+RtlpXpressLoad32(PUCHAR Buffer)
+{
+    return Buffer[0] | (Buffer[1] << 8) | (Buffer[2] << 16) | ((ULONG)Buffer[3] << 24);
+}
+
+FORCEINLINE
+VOID
+RtlpXpressStore16(PUCHAR Buffer, ULONG Value)
+{
+    Buffer[0] = (UCHAR)Value;
+    Buffer[1] = (UCHAR)(Value >> 8);
+}
+
+FORCEINLINE
+VOID
+RtlpXpressStore32(PUCHAR Buffer, ULONG Value)
+{
+    Buffer[0] = (UCHAR)Value;
+    Buffer[1] = (UCHAR)(Value >> 8);
+    Buffer[2] = (UCHAR)(Value >> 16);
+    Buffer[3] = (UCHAR)(Value >> 24);
+}
+
+FORCEINLINE
+VOID
+RtlpXpressCopyMatch(PUCHAR Destination, ULONG Offset, ULONG Length)
+{
+    PUCHAR Source = Destination - Offset;
+
+    /* With an offset of at least 8 a qword never reads what it writes */
+    if (Offset >= sizeof(ULONGLONG))
+    {
+        while (Length >= sizeof(ULONGLONG))
+        {
+            RtlCopyMemory(Destination, Source, sizeof(ULONGLONG));
+            Destination += sizeof(ULONGLONG);
+            Source += sizeof(ULONGLONG);
+            Length -= sizeof(ULONGLONG);
+        }
+    }
+
+    while (Length--)
+        *Destination++ = *Source++;
+}
+
+FORCEINLINE
+ULONG
+RtlpXpressHash(PUCHAR Data)
+{
+    ULONG Value = (Data[0] << 16) | (Data[1] << 8) | Data[2];
+
+    return (Value * 0x9E3779B1) >> (32 - XPRESS_HASH_BITS);
+}
+
+static VOID
+RtlpXpressInitMatchFinder(PXPRESS_MATCH_FINDER Finder,
+                          PUCHAR Buffer,
+                          ULONG Size,
+                          ULONG WindowSize,
+                          ULONG MaxOffset,
+                          ULONG MaxLength,
+                          USHORT Engine)
+{
+    Finder->Buffer = Buffer;
+    Finder->Size = Size;
+    Finder->Inserted = 0;
+    Finder->MaxOffset = MaxOffset;
+    Finder->MaxLength = MaxLength;
+    Finder->WindowMask = WindowSize - 1;
+    Finder->NextPosition = MAXULONG;
+
+    /* The standard engine is tuned for speed, the maximum one for size */
+    if (Engine == COMPRESSION_ENGINE_MAXIMUM)
+    {
+        Finder->MaxChain = 256;
+        Finder->NiceLength = 258;
+        Finder->Lazy = TRUE;
+    }
+    else
+    {
+        Finder->MaxChain = 8;
+        Finder->NiceLength = 32;
+        Finder->Lazy = FALSE;
+    }
+
+    /* Chain entries are always written before they are followed */
+    RtlZeroMemory(Finder->Head, sizeof(Finder->Head));
+}
+
+/* Inserts every position before the given one into the hash chains */
+FORCEINLINE
+VOID
+RtlpXpressAdvance(PXPRESS_MATCH_FINDER Finder, ULONG Position)
+{
+    ULONG Hash, Previous, Distance;
+    ULONG Last = (Finder->Size >= XPRESS_MIN_MATCH) ? Finder->Size - XPRESS_MIN_MATCH + 1 : 0;
+
+    if (Position > Last)
+        Position = Last;
+
+    while (Finder->Inserted < Position)
+    {
+        Hash = RtlpXpressHash(Finder->Buffer + Finder->Inserted);
+        Previous = Finder->Head[Hash];
+        Distance = Finder->Inserted + 1 - Previous;
+
+        /* Heads are stored biased by one, zero means empty */
+        Finder->Chain[Finder->Inserted & Finder->WindowMask] =
+            (Previous && Distance <= Finder->MaxOffset) ? (USHORT)Distance : 0;
+        Finder->Head[Hash] = ++Finder->Inserted;
+    }
+}
+
+FORCEINLINE
+ULONG
+RtlpXpressMatchLength(PUCHAR Candidate, PUCHAR Current, ULONG MaxLength)
+{
+    ULONGLONG First, Second;
+    ULONG Length = 0;
+
+    /* Compare a qword at a time, then find the mismatch */
+    while (MaxLength - Length >= sizeof(ULONGLONG))
+    {
+        RtlCopyMemory(&First, Candidate + Length, sizeof(ULONGLONG));
+        RtlCopyMemory(&Second, Current + Length, sizeof(ULONGLONG));
+        if (First != Second)
+            break;
+
+        Length += sizeof(ULONGLONG);
+    }
+
+    while (Length < MaxLength && Candidate[Length] == Current[Length])
+        Length++;
+
+    return Length;
+}
+
+static ULONG
+RtlpXpressSearch(PXPRESS_MATCH_FINDER Finder,
+                 ULONG Position,
+                 ULONG End,
+                 PULONG Offset)
+{
+    PUCHAR Current = Finder->Buffer + Position, Candidate;
+    ULONG MaxLength = min(End - Position, Finder->MaxLength);
+    ULONG BestLength = XPRESS_MIN_MATCH - 1;
+    ULONG Chain = Finder->MaxChain;
+    ULONG Entry, Distance, Length;
+
+    if (MaxLength < XPRESS_MIN_MATCH)
+        return 0;
+
+    Entry = Finder->Head[RtlpXpressHash(Current)];
+
+    while (Entry && Chain--)
+    {
+        Distance = Position + 1 - Entry;
+        if (Distance > Finder->MaxOffset)
+            break;
+
+        /* Check the byte that would make this match longer first */
+        Candidate = Current - Distance;
+        if (Candidate[BestLength] == Current[BestLength] &&
+            Candidate[0] == Current[0] &&
+            Candidate[1] == Current[1])
+        {
+            Length = RtlpXpressMatchLength(Candidate, Current, MaxLength);
+
+            if (Length > BestLength)
+            {
+                BestLength = Length;
+                *Offset = Distance;
+
+                if (Length >= Finder->NiceLength || Length == MaxLength)
+                    break;
+            }
+        }
+
+        /* The entry is inside the window, so its chain slot is still ours */
+        Distance = Finder->Chain[(Entry - 1) & Finder->WindowMask];
+        if (!Distance)
+            break;
+
+        Entry -= Distance;
+    }
+
+    return (BestLength >= XPRESS_MIN_MATCH) ? BestLength : 0;
+}
+
+/* Returns the match to use at the given position, or 0 for a literal */
+static ULONG
+RtlpXpressFindMatch(PXPRESS_MATCH_FINDER Finder,
+                    ULONG Position,
+                    ULONG End,
+                    PULONG Offset)
+{
+    ULONG Length, NextLength, NextOffset;
+
+    RtlpXpressAdvance(Finder, Position);
+
+    if (Finder->NextPosition == Position)
+    {
+        /* Searched already while looking ahead from the previous position */
+        Length = Finder->NextLength;
+        *Offset = Finder->NextOffset;
+    }
+    else
+    {
+        Length = RtlpXpressSearch(Finder, Position, End, Offset);
+        RtlpXpressAdvance(Finder, Position + 1);
+    }
+
+    /* Lazy evaluation: prefer a literal if the next position matches longer */
+    if (Length && Finder->Lazy && Length < Finder->NiceLength && Position + 1 < End)
+    {
+        NextLength = RtlpXpressSearch(Finder, Position + 1, End, &NextOffset);
+        RtlpXpressAdvance(Finder, Position + 2);
+
+        Finder->NextPosition = Position + 1;
+        Finder->NextLength = NextLength;
+        Finder->NextOffset = NextOffset;
+
+        if (NextLength > Length)
+            return 0;
+    }
+
+    return Length;
+}
+
+static NTSTATUS
+RtlpCompressBufferXpress(PUCHAR Source,
+                         ULONG SourceSize,
+                         PUCHAR Destination,
+                         ULONG DestinationSize,
+                         USHORT Engine,
+                         PULONG FinalSize,
+                         PXPRESS_MATCH_FINDER Finder)
+{
+    ULONG Position = 0, Output = sizeof(ULONG), FlagPosition = 0;
+    ULONG Flags = 0, FlagCount = 0, HalfByte = 0;
+    ULONG Length, Offset, Needed;
+
+    if (DestinationSize < sizeof(ULONG))
+        return STATUS_BUFFER_TOO_SMALL;
+
+    RtlpXpressInitMatchFinder(Finder, Source, SourceSize, XPRESS_WINDOW_SIZE,
+                              XPRESS_WINDOW_SIZE, MAXULONG, Engine);
+
+    while (Position < SourceSize)
+    {
+        Length = RtlpXpressFindMatch(Finder, Position, SourceSize, &Offset);
+        if (Length)
+        {
+            Position += Length;
+            Length -= XPRESS_MIN_MATCH;
+
+            /* Work out the encoded size before writing anything */
+            Needed = sizeof(USHORT);
+            if (Length >= 7)
+            {
+                if (!HalfByte)
+                    Needed++;
+                if (Length >= 7 + 15)
+                    Needed += (Length < 7 + 15 + 255) ? 1 : (Length <= MAXUSHORT) ? 3 : 7;
+            }
+
+            if (DestinationSize - Output < Needed)
+                return STATUS_BUFFER_TOO_SMALL;
+
+            Offset = (Offset - 1) << 3;
+            if (Length < 7)
+            {
+                RtlpXpressStore16(Destination + Output, Offset | Length);
+                Output += sizeof(USHORT);
+            }
+            else
+            {
+                RtlpXpressStore16(Destination + Output, Offset | 7);
+                Output += sizeof(USHORT);
+
+                /* Extra lengths share a byte between two matches, a nibble each */
+                if (!HalfByte)
+                {
+                    HalfByte = Output;
+                    Destination[Output++] = (UCHAR)min(Length - 7, 15);
+                }
+                else
+                {
+                    Destination[HalfByte] |= (UCHAR)(min(Length - 7, 15) << 4);
+                    HalfByte = 0;
+                }
+
+                if (Length >= 7 + 15)
+                {
+                    if (Length < 7 + 15 + 255)
+                    {
+                        Destination[Output++] = (UCHAR)(Length - 7 - 15);
+                    }
+                    else if (Length <= MAXUSHORT)
+                    {
+                        Destination[Output++] = 255;
+                        RtlpXpressStore16(Destination + Output, Length);
+                        Output += sizeof(USHORT);
+                    }
+                    else
+                    {
+                        Destination[Output++] = 255;
+                        RtlpXpressStore16(Destination + Output, 0);
+                        RtlpXpressStore32(Destination + Output + sizeof(USHORT), Length);
+                        Output += sizeof(USHORT) + sizeof(ULONG);
+                    }
+                }
+            }
+
+            Flags = (Flags << 1) | 1;
+        }
+        else
+        {
+            if (Output >= DestinationSize)
+                return STATUS_BUFFER_TOO_SMALL;
+
+            Destination[Output++] = Source[Position++];
+            Flags <<= 1;
+        }
+
+        if (++FlagCount == 32)
+        {
+            RtlpXpressStore32(Destination + FlagPosition, Flags);
+
+            if (DestinationSize - Output < sizeof(ULONG))
+                return STATUS_BUFFER_TOO_SMALL;
+
+            FlagPosition = Output;
+            Output += sizeof(ULONG);
+            Flags = FlagCount = 0;
+        }
+    }
+
+    /* The unused flags are set, the decoder stops at a match past the end */
+    if (FlagCount)
+        Flags = (Flags << (32 - FlagCount)) | (((ULONG)1 << (32 - FlagCount)) - 1);
+    else
+        Flags = MAXULONG;
+
+    RtlpXpressStore32(Destination + FlagPosition, Flags);
+
+    if (FinalSize)
+        *FinalSize = Output;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+RtlpDecompressBufferXpress(PUCHAR Destination,
+                           ULONG DestinationSize,
+                           PUCHAR Source,
+                           ULONG SourceSize,
+                           PULONG FinalSize)
+{
+    ULONG Input = 0, Output = 0, Flags = 0, FlagCount = 0, HalfByte = 0;
+    ULONG Length, Offset;
+
+    while (Output < DestinationSize)
+    {
+        if (!FlagCount)
+        {
+            if (SourceSize - Input < sizeof(ULONG))
+                return STATUS_BAD_COMPRESSION_BUFFER;
+
+            Flags = RtlpXpressLoad32(Source + Input);
+            Input += sizeof(ULONG);
+            FlagCount = 32;
+        }
+
+        FlagCount--;
+
+        if (!(Flags & ((ULONG)1 << FlagCount)))
+        {
+            if (Input >= SourceSize)
+                return STATUS_BAD_COMPRESSION_BUFFER;
+
+            Destination[Output++] = Source[Input++];
+            continue;
+        }
+
+        /* A match flag with no input left marks the end of the stream */
+        if (Input == SourceSize)
+            break;
+
+        if (SourceSize - Input < sizeof(USHORT))
+            return STATUS_BAD_COMPRESSION_BUFFER;
+
+        Length = RtlpXpressLoad16(Source + Input);
+        Input += sizeof(USHORT);
+        Offset = (Length >> 3) + 1;
+        Length &= 7;
+
+        if (Length == 7)
+        {
+            if (!HalfByte)
+            {
+                if (Input >= SourceSize)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+
+                HalfByte = Input;
+                Length = Source[Input++] & 0x0F;
+            }
+            else
+            {
+                Length = Source[HalfByte] >> 4;
+                HalfByte = 0;
+            }
+
+            if (Length == 15)
+            {
+                if (Input >= SourceSize)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+
+                Length = Source[Input++];
+                if (Length == 255)
+                {
+                    if (SourceSize - Input < sizeof(USHORT))
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+
+                    Length = RtlpXpressLoad16(Source + Input);
+                    Input += sizeof(USHORT);
+
+                    if (!Length)
+                    {
+                        if (SourceSize - Input < sizeof(ULONG))
+                            return STATUS_BAD_COMPRESSION_BUFFER;
+
+                        Length = RtlpXpressLoad32(Source + Input);
+                        Input += sizeof(ULONG);
+                    }
+
+                    if (Length < 15 + 7 || Length > DestinationSize)
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+
+                    Length -= 15 + 7;
+                }
+
+                Length += 15;
+            }
+
+            Length += 7;
+        }
+
+        Length += XPRESS_MIN_MATCH;
+
+        if (Offset > Output)
+            return STATUS_BAD_COMPRESSION_BUFFER;
+
+        /* Like LZNT1, running out of output is no error */
+        Length = min(Length, DestinationSize - Output);
+        RtlpXpressCopyMatch(Destination + Output, Offset, Length);
+        Output += Length;
+    }
+
+    if (FinalSize)
+        *FinalSize = Output;
+
+    return STATUS_SUCCESS;
+}
+
+static VOID
+RtlpXpressSiftDown(PULONG Keys, ULONG Root, ULONG Count)
+{
+    ULONG Child, Key;
+
+    while ((Child = 2 * Root + 1) < Count)
+    {
+        if (Child + 1 < Count && Keys[Child] < Keys[Child + 1])
+            Child++;
+
+        if (Keys[Root] >= Keys[Child])
+            break;
+
+        Key = Keys[Root];
+        Keys[Root] = Keys[Child];
+        Keys[Child] = Key;
+        Root = Child;
+    }
+}
+
+/*
+ * Computes the Huffman code lengths for weights sorted in ascending order,
+ * in place (Moffat and Katajainen). The deepest leaf ends up first.
+ */
+static VOID
+RtlpXpressComputeDepths(PULONG A, LONG Count)
+{
+    LONG Root, Leaf, Next, Available, Used, Depth;
+
+    if (Count == 0)
+        return;
+
+    if (Count == 1)
+    {
+        A[0] = 1;
+        return;
+    }
+
+    /* Combine the weights, internal nodes point to their parent */
+    A[0] += A[1];
+    Root = 0;
+    Leaf = 2;
+    for (Next = 1; Next < Count - 1; Next++)
+    {
+        if (Leaf >= Count || A[Root] < A[Leaf])
+        {
+            A[Next] = A[Root];
+            A[Root++] = Next;
+        }
+        else
+        {
+            A[Next] = A[Leaf++];
+        }
+
+        if (Leaf >= Count || (Root < Next && A[Root] < A[Leaf]))
+        {
+            A[Next] += A[Root];
+            A[Root++] = Next;
+        }
+        else
+        {
+            A[Next] += A[Leaf++];
+        }
+    }
+
+    /* Depths of the internal nodes */
+    A[Count - 2] = 0;
+    for (Next = Count - 3; Next >= 0; Next--)
+        A[Next] = A[A[Next]] + 1;
+
+    /* Depths of the leaves */
+    Available = 1;
+    Used = Depth = 0;
+    Root = Count - 2;
+    Next = Count - 1;
+    while (Available > 0)
+    {
+        while (Root >= 0 && (LONG)A[Root] == Depth)
+        {
+            Used++;
+            Root--;
+        }
+
+        while (Available > Used)
+        {
+            A[Next--] = Depth;
+            Available--;
+        }
+
+        Available = 2 * Used;
+        Depth++;
+        Used = 0;
+    }
+}
+
+/* Builds length limited canonical codes from the symbol frequencies */
+static VOID
+RtlpXpressBuildCodes(PXPRESS_HUFF_ENCODER Encoder)
+{
+    ULONG Count[XPRESS_HUFF_MAX_CODE_LENGTH + 1];
+    ULONG NextCode[XPRESS_HUFF_MAX_CODE_LENGTH + 1];
+    ULONG Used = 0, Symbol, Length, Total, Code, i;
+
+    for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+    {
+        if (Encoder->Frequencies[Symbol])
+            Encoder->Sorted[Used++] = (Encoder->Frequencies[Symbol] << 9) | Symbol;
+    }
+
+    /* Heap sort by frequency, the symbol breaks ties */
+    for (i = Used / 2; i-- > 0;)
+        RtlpXpressSiftDown(Encoder->Sorted, i, Used);
+
+    for (i = Used; i-- > 1;)
+    {
+        Symbol = Encoder->Sorted[0];
+        Encoder->Sorted[0] = Encoder->Sorted[i];
+        Encoder->Sorted[i] = Symbol;
+        RtlpXpressSiftDown(Encoder->Sorted, 0, i);
+    }
+
+    for (i = 0; i < Used; i++)
+        Encoder->Depths[i] = Encoder->Sorted[i] >> 9;
+
+    RtlpXpressComputeDepths(Encoder->Depths, Used);
+
+    RtlZeroMemory(Count, sizeof(Count));
+    for (i = 0; i < Used; i++)
+        Count[min(Encoder->Depths[i], XPRESS_HUFF_MAX_CODE_LENGTH)]++;
+
+    /* Clamping overflowed the code space, lengthen shorter codes to fix it */
+    if (Used > 1)
+    {
+        Total = 0;
+        for (Length = 1; Length <= XPRESS_HUFF_MAX_CODE_LENGTH; Length++)
+            Total += Count[Length] << (XPRESS_HUFF_MAX_CODE_LENGTH - Length);
+
+        while (Total > (1 << XPRESS_HUFF_MAX_CODE_LENGTH))
+        {
+            Count[XPRESS_HUFF_MAX_CODE_LENGTH]--;
+            for (Length = XPRESS_HUFF_MAX_CODE_LENGTH - 1; Length > 0; Length--)
+            {
+                if (Count[Length])
+                {
+                    Count[Length]--;
+                    Count[Length + 1] += 2;
+                    break;
+                }
+            }
+            Total--;
+        }
+    }
+
+    /* The least frequent symbols get the longest codes */
+    RtlZeroMemory(Encoder->Lengths, sizeof(Encoder->Lengths));
+    i = 0;
+    for (Length = XPRESS_HUFF_MAX_CODE_LENGTH; Length > 0; Length--)
+    {
+        for (Code = Count[Length]; Code > 0; Code--)
+            Encoder->Lengths[Encoder->Sorted[i++] & (XPRESS_HUFF_SYMBOLS - 1)] = (UCHAR)Length;
+    }
+
+    /* Canonical codes, shorter codes and lower symbols come first */
+    Code = 0;
+    for (Length = 1; Length <= XPRESS_HUFF_MAX_CODE_LENGTH; Length++)
+    {
+        Code = (Code + Count[Length - 1]) << 1;
+        NextCode[Length] = Code;
+    }
+
+    for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+    {
+        Length = Encoder->Lengths[Symbol];
+        if (Length)
+            Encoder->Codes[Symbol] = (USHORT)NextCode[Length]++;
+    }
+}
+
+/*
+ * Bits go to 16-bit words, but the decoder always reads one word ahead,
+ * so two word slots are kept reserved and the extra length bytes of a
+ * match are written after them.
+ */
+FORCEINLINE
+VOID
+RtlpXpressStartBits(PXPRESS_BIT_WRITER Writer)
+{
+    Writer->Slot[0] = Writer->Position;
+    Writer->Slot[1] = Writer->Position + sizeof(USHORT);
+    Writer->Position += 2 * sizeof(USHORT);
+    Writer->Bits = 0;
+    Writer->BitCount = 0;
+}
+
+FORCEINLINE
+VOID
+RtlpXpressWriteBits(PXPRESS_BIT_WRITER Writer, ULONG Count, ULONG Value)
+{
+    Writer->Bits = (Writer->Bits << Count) | Value;
+    Writer->BitCount += Count;
+
+    /* Slot[0] was checked against the buffer size when it was reserved */
+    if (Writer->BitCount > 16)
+    {
+        Writer->BitCount -= 16;
+        RtlpXpressStore16(Writer->Buffer + Writer->Slot[0], Writer->Bits >> Writer->BitCount);
+        Writer->Slot[0] = Writer->Slot[1];
+        Writer->Slot[1] = Writer->Position;
+        Writer->Position += sizeof(USHORT);
+    }
+}
+
+FORCEINLINE
+VOID
+RtlpXpressFlushBits(PXPRESS_BIT_WRITER Writer)
+{
+    RtlpXpressStore16(Writer->Buffer + Writer->Slot[0], Writer->Bits << (16 - Writer->BitCount));
+    RtlpXpressStore16(Writer->Buffer + Writer->Slot[1], 0);
+}
+
+FORCEINLINE
+BOOLEAN
+RtlpXpressHasRoom(PXPRESS_BIT_WRITER Writer, ULONG Bytes)
+{
+    return (Writer->Position <= Writer->Size) && (Writer->Size - Writer->Position >= Bytes);
+}
+
+static NTSTATUS
+RtlpCompressBufferXpressHuff(PUCHAR Source,
+                             ULONG SourceSize,
+                             PUCHAR Destination,
+                             ULONG DestinationSize,
+                             USHORT Engine,
+                             PULONG FinalSize,
+                             PXPRESS_HUFF_ENCODER Encoder)
+{
+    PXPRESS_MATCH_FINDER Finder = &Encoder->Finder;
+    XPRESS_BIT_WRITER Writer;
+    ULONG BlockStart = 0, BlockEnd, Position, TokenCount, Token;
+    ULONG Length, Offset, OffsetBits, Symbol, i;
+    BOOLEAN Last;
+
+    RtlpXpressInitMatchFinder(Finder, Source, SourceSize, XPRESS_HUFF_WINDOW_SIZE,
+                              XPRESS_HUFF_MAX_OFFSET, XPRESS_HUFF_MAX_MATCH, Engine);
+
+    Writer.Buffer = Destination;
+    Writer.Size = DestinationSize;
+    Writer.Position = 0;
+
+    do
+    {
+        /* The end of stream symbol needs a block of its own if the last one is full */
+        BlockEnd = BlockStart + min(SourceSize - BlockStart, XPRESS_HUFF_BLOCK_SIZE);
+        Last = (BlockEnd - BlockStart < XPRESS_HUFF_BLOCK_SIZE);
+
+        /* Parse the block first, the code depends on the symbol statistics */
+        RtlZeroMemory(Encoder->Frequencies, sizeof(Encoder->Frequencies));
+        TokenCount = 0;
+
+        for (Position = BlockStart; Position < BlockEnd;)
+        {
+            Length = RtlpXpressFindMatch(Finder, Position, BlockEnd, &Offset);
+
+            /* This match has the same symbol as the end of stream, don't emit it */
+            if (Length == XPRESS_MIN_MATCH && Offset == 1)
+                Length = 0;
+
+            if (Length)
+            {
+                BitScanReverse(&OffsetBits, Offset);
+                Symbol = 256 + (OffsetBits << 4) + min(Length - XPRESS_MIN_MATCH, 15);
+                Encoder->Tokens[TokenCount++] = (USHORT)(XPRESS_HUFF_MATCH_TOKEN | (Length - XPRESS_MIN_MATCH));
+                Encoder->Tokens[TokenCount++] = (USHORT)Offset;
+                Position += Length;
+            }
+            else
+            {
+                Symbol = Source[Position++];
+                Encoder->Tokens[TokenCount++] = (USHORT)Symbol;
+            }
+
+            Encoder->Frequencies[Symbol]++;
+        }
+
+        if (Last)
+            Encoder->Frequencies[XPRESS_HUFF_END_OF_STREAM]++;
+
+        RtlpXpressBuildCodes(Encoder);
+
+        /* Code length table, two symbols per byte, low nibble first */
+        if (!RtlpXpressHasRoom(&Writer, XPRESS_HUFF_TABLE_SIZE + 2 * sizeof(USHORT)))
+            return STATUS_BUFFER_TOO_SMALL;
+
+        for (i = 0; i < XPRESS_HUFF_TABLE_SIZE; i++)
+        {
+            Destination[Writer.Position++] = Encoder->Lengths[2 * i] |
+                                             (Encoder->Lengths[2 * i + 1] << 4);
+        }
+
+        RtlpXpressStartBits(&Writer);
+
+        for (i = 0; i < TokenCount; i++)
+        {
+            Token = Encoder->Tokens[i];
+            if (!(Token & XPRESS_HUFF_MATCH_TOKEN))
+            {
+                RtlpXpressWriteBits(&Writer, Encoder->Lengths[Token], Encoder->Codes[Token]);
+            }
+            else
+            {
+                Length = Token & ~XPRESS_HUFF_MATCH_TOKEN;
+                Offset = Encoder->Tokens[++i];
+                BitScanReverse(&OffsetBits, Offset);
+
+                Symbol = 256 + (OffsetBits << 4) + min(Length, 15);
+                RtlpXpressWriteBits(&Writer, Encoder->Lengths[Symbol], Encoder->Codes[Symbol]);
+
+                if (Length >= 15)
+                {
+                    if (!RtlpXpressHasRoom(&Writer, (Length < 15 + 255) ? 1 : 3))
+                        return STATUS_BUFFER_TOO_SMALL;
+
+                    if (Length < 15 + 255)
+                    {
+                        Destination[Writer.Position++] = (UCHAR)(Length - 15);
+                    }
+                    else
+                    {
+                        Destination[Writer.Position++] = 255;
+                        RtlpXpressStore16(Destination + Writer.Position, Length);
+                        Writer.Position += sizeof(USHORT);
+                    }
+                }
+
+                RtlpXpressWriteBits(&Writer, OffsetBits, Offset - (1 << OffsetBits));
+            }
+
+            /* Reserved slots are only written once they passed this check */
+            if (!RtlpXpressHasRoom(&Writer, 0))
+                return STATUS_BUFFER_TOO_SMALL;
+        }
+
+        if (Last)
+        {
+            RtlpXpressWriteBits(&Writer,
+                                Encoder->Lengths[XPRESS_HUFF_END_OF_STREAM],
+                                Encoder->Codes[XPRESS_HUFF_END_OF_STREAM]);
+
+            if (!RtlpXpressHasRoom(&Writer, 0))
+                return STATUS_BUFFER_TOO_SMALL;
+        }
+
+        RtlpXpressFlushBits(&Writer);
+        BlockStart = BlockEnd;
+    } while (!Last);
+
+    if (FinalSize)
+        *FinalSize = Writer.Position;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+RtlpBuildDecodeTableXpressHuff(PXPRESS_HUFF_DECODER Decoder, PUCHAR Table)
+{
+    ULONG Symbol, Length, Entry = 0, Count, i;
+
+    for (Symbol = 0; Symbol < XPRESS_HUFF_TABLE_SIZE; Symbol++)
+    {
+        Decoder->Lengths[2 * Symbol] = Table[Symbol] & 0x0F;
+        Decoder->Lengths[2 * Symbol + 1] = Table[Symbol] >> 4;
+    }
+
+    /* Every code indexes all table entries that start with it */
+    for (Length = 1; Length <= XPRESS_HUFF_MAX_CODE_LENGTH; Length++)
+    {
+        Count = 1 << (XPRESS_HUFF_MAX_CODE_LENGTH - Length);
+
+        for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+        {
+            if (Decoder->Lengths[Symbol] != Length)
+                continue;
+
+            if (Entry + Count > RTL_NUMBER_OF(Decoder->Table))
+                return STATUS_BAD_COMPRESSION_BUFFER;
+
+            for (i = 0; i < Count; i++)
+                Decoder->Table[Entry++] = (USHORT)Symbol;
+        }
+    }
+
+    if (!Entry)
+        return STATUS_BAD_COMPRESSION_BUFFER;
+
+    /* An incomplete code is fine as long as the unused codes never show up */
+    while (Entry < RTL_NUMBER_OF(Decoder->Table))
+        Decoder->Table[Entry++] = XPRESS_HUFF_INVALID_SYMBOL;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+RtlpDecompressBufferXpressHuff(PUCHAR Destination,
+                               ULONG DestinationSize,
+                               PUCHAR Source,
+                               ULONG SourceSize,
+                               PULONG FinalSize,
+                               PXPRESS_HUFF_DECODER Decoder)
+{
+    ULONG Input = 0, Output = 0, BlockEnd, NextBits;
+    ULONG Symbol, Length, Offset, OffsetBits;
+    LONG ExtraBits;
+    NTSTATUS Status;
+
+    while (Output < DestinationSize && Input < SourceSize)
+    {
+        if (SourceSize - Input < XPRESS_HUFF_TABLE_SIZE + 2 * sizeof(USHORT))
+            return STATUS_BAD_COMPRESSION_BUFFER;
+
+        Status = RtlpBuildDecodeTableXpressHuff(Decoder, Source + Input);
+        if (!NT_SUCCESS(Status))
+            return Status;
+
+        Input += XPRESS_HUFF_TABLE_SIZE;
+        NextBits = (RtlpXpressLoad16(Source + Input) << 16) |
+                   RtlpXpressLoad16(Source + Input + sizeof(USHORT));
+        Input += 2 * sizeof(USHORT);
+        ExtraBits = 16;
+
+        BlockEnd = Output + min(DestinationSize - Output, XPRESS_HUFF_BLOCK_SIZE);
+
+        while (Output < BlockEnd)
+        {
+            Symbol = Decoder->Table[NextBits >> (32 - XPRESS_HUFF_MAX_CODE_LENGTH)];
+            if (Symbol == XPRESS_HUFF_INVALID_SYMBOL)
+                return STATUS_BAD_COMPRESSION_BUFFER;
+
+            Length = Decoder->Lengths[Symbol];
+            NextBits <<= Length;
+            ExtraBits -= Length;
+            if (ExtraBits < 0)
+            {
+                if (SourceSize - Input < sizeof(USHORT))
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+
+                NextBits |= RtlpXpressLoad16(Source + Input) << -ExtraBits;
+                Input += sizeof(USHORT);
+                ExtraBits += 16;
+            }
+
+            if (Symbol < 256)
+            {
+                Destination[Output++] = (UCHAR)Symbol;
+                continue;
+            }
+
+            if (Symbol == XPRESS_HUFF_END_OF_STREAM && Input == SourceSize)
+                goto Done;
+
+            Symbol -= 256;
+            Length = Symbol & 0x0F;
+            OffsetBits = Symbol >> 4;
+
+            /* Extra length bytes come after the words the decoder already holds */
+            if (Length == 15)
+            {
+                if (Input >= SourceSize)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+
+                Length = Source[Input++];
+                if (Length == 255)
+                {
+                    if (SourceSize - Input < sizeof(USHORT))
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+
+                    Length = RtlpXpressLoad16(Source + Input);
+                    Input += sizeof(USHORT);
+
+                    if (!Length)
+                    {
+                        if (SourceSize - Input < sizeof(ULONG))
+                            return STATUS_BAD_COMPRESSION_BUFFER;
+
+                        Length = RtlpXpressLoad32(Source + Input);
+                        Input += sizeof(ULONG);
+                    }
+
+                    if (Length < 15 || Length > DestinationSize)
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+
+                    Length -= 15;
+                }
+
+                Length += 15;
+            }
+
+            Length += XPRESS_MIN_MATCH;
+
+            Offset = 1 << OffsetBits;
+            if (OffsetBits)
+            {
+                Offset |= NextBits >> (32 - OffsetBits);
+                NextBits <<= OffsetBits;
+                ExtraBits -= OffsetBits;
+                if (ExtraBits < 0)
+                {
+                    if (SourceSize - Input < sizeof(USHORT))
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+
+                    NextBits |= RtlpXpressLoad16(Source + Input) << -ExtraBits;
+                    Input += sizeof(USHORT);
+                    ExtraBits += 16;
+                }
+            }
+
+            if (Offset > Output)
+                return STATUS_BAD_COMPRESSION_BUFFER;
+
+            Length = min(Length, DestinationSize - Output);
+            RtlpXpressCopyMatch(Destination + Output, Offset, Length);
+            Output += Length;
+        }
+    }
+
+Done:
+    if (FinalSize)
+        *FinalSize = Output;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+RtlpWorkSpaceSizeXpress(USHORT Format,
+                        USHORT Engine,
+                        PULONG BufferAndWorkSpaceSize,
+                        PULONG FragmentWorkSpaceSize)
+{
+    if (Engine != COMPRESSION_ENGINE_STANDARD &&
+        Engine != COMPRESSION_ENGINE_MAXIMUM)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    /* The fragment size is the workspace RtlDecompressBufferEx needs */
+    if (Format == COMPRESSION_FORMAT_XPRESS)
+    {
+        *BufferAndWorkSpaceSize = XPRESS_WORKSPACE_SIZE;
+        *FragmentWorkSpaceSize = 0;
+    }
+    else
+    {
+        *BufferAndWorkSpaceSize = XPRESS_HUFF_WORKSPACE_SIZE;
+        *FragmentWorkSpaceSize = sizeof(XPRESS_HUFF_DECODER);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+
 /*
  * @implemented
  */
@@ -284,7 +1387,7 @@ RtlCompressBuffer(IN USHORT CompressionFormatAndEngine,
                   IN PVOID WorkSpace)
 {
    USHORT Format = CompressionFormatAndEngine & COMPRESSION_FORMAT_MASK;
-   /* USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK; */
+   USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK;
 
    if ((Format == COMPRESSION_FORMAT_NONE) ||
          (Format == COMPRESSION_FORMAT_DEFAULT))
@@ -299,6 +1402,31 @@ RtlCompressBuffer(IN USHORT CompressionFormatAndEngine,
                                      FinalCompressedSize,
                                      WorkSpace));
 
+   /* The XPRESS match finders live in the workspace */
+   if ((Format == COMPRESSION_FORMAT_XPRESS) ||
+         (Format == COMPRESSION_FORMAT_XPRESS_HUFF))
+   {
+      if (!WorkSpace)
+         return(STATUS_INVALID_PARAMETER);
+
+      if (Format == COMPRESSION_FORMAT_XPRESS)
+         return(RtlpCompressBufferXpress(UncompressedBuffer,
+                                         UncompressedBufferSize,
+                                         CompressedBuffer,
+                                         CompressedBufferSize,
+                                         Engine,
+                                         FinalCompressedSize,
+                                         WorkSpace));
+
+      return(RtlpCompressBufferXpressHuff(UncompressedBuffer,
+                                          UncompressedBufferSize,
+                                          CompressedBuffer,
+                                          CompressedBufferSize,
+                                          Engine,
+                                          FinalCompressedSize,
+                                          WorkSpace));
+   }
+
    return(STATUS_UNSUPPORTED_COMPRESSION);
 }
 
@@ -367,6 +1495,47 @@ RtlDecompressFragment(IN USHORT format,
     }
 }
 
+/*
+ * @implemented
+ */
+NTSTATUS NTAPI
+RtlDecompressBufferEx(IN USHORT CompressionFormat,
+                      OUT PUCHAR UncompressedBuffer,
+                      IN ULONG UncompressedBufferSize,
+                      IN PUCHAR CompressedBuffer,
+                      IN ULONG CompressedBufferSize,
+                      OUT PULONG FinalUncompressedSize,
+                      IN PVOID WorkSpace)
+{
+    switch (CompressionFormat & ~COMPRESSION_ENGINE_MAXIMUM)
+    {
+        case COMPRESSION_FORMAT_LZNT1:
+            return lznt1_decompress(UncompressedBuffer, UncompressedBufferSize, CompressedBuffer,
+                                    CompressedBufferSize, 0, FinalUncompressedSize, WorkSpace);
+
+        case COMPRESSION_FORMAT_XPRESS:
+            return RtlpDecompressBufferXpress(UncompressedBuffer, UncompressedBufferSize,
+                                              CompressedBuffer, CompressedBufferSize,
+                                              FinalUncompressedSize);
+
+        case COMPRESSION_FORMAT_XPRESS_HUFF:
+            if (!WorkSpace)
+                return STATUS_INVALID_PARAMETER;
+
+            return RtlpDecompressBufferXpressHuff(UncompressedBuffer, UncompressedBufferSize,
+                                                  CompressedBuffer, CompressedBufferSize,
+                                                  FinalUncompressedSize, WorkSpace);
+
+        case COMPRESSION_FORMAT_NONE:
+        case COMPRESSION_FORMAT_DEFAULT:
+            return STATUS_INVALID_PARAMETER;
+
+        default:
+            DPRINT1("format %d not implemented\n", CompressionFormat);
+            return STATUS_UNSUPPORTED_COMPRESSION;
+    }
+}
+
 /*
  * @implemented
  */
@@ -378,8 +1547,26 @@ RtlDecompressBuffer(IN USHORT CompressionFormat,
                     IN ULONG CompressedBufferSize,
                     OUT PULONG FinalUncompressedSize)
 {
-    return RtlDecompressFragment(CompressionFormat, UncompressedBuffer, UncompressedBufferSize,
-                                 CompressedBuffer, CompressedBufferSize, 0, FinalUncompressedSize, NULL);
+    PVOID WorkSpace = NULL;
+    NTSTATUS Status;
+
+    /* Only the Huffman decoder needs a workspace, callers on hot paths
+     * should use RtlDecompressBufferEx to avoid this allocation */
+    if ((CompressionFormat & ~COMPRESSION_ENGINE_MAXIMUM) == COMPRESSION_FORMAT_XPRESS_HUFF)
+    {
+        WorkSpace = RtlpAllocateMemory(sizeof(XPRESS_HUFF_DECODER), TAG_XPRESS);
+        if (!WorkSpace)
+            return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Status = RtlDecompressBufferEx(CompressionFormat, UncompressedBuffer, UncompressedBufferSize,
+                                   CompressedBuffer, CompressedBufferSize, FinalUncompressedSize,
+                                   WorkSpace);
+
+    if (WorkSpace)
+        RtlpFreeMemory(WorkSpace, TAG_XPRESS);
+
+    return Status;
 }
 
 /*
@@ -417,6 +1604,13 @@ RtlGetCompressionWorkSpaceSize(IN USHORT CompressionFormatAndEngine,
                                     CompressBufferAndWorkSpaceSize,
                                     CompressFragmentWorkSpaceSize));
 
+   if ((Format == COMPRESSION_FORMAT_XPRESS) ||
+         (Format == COMPRESSION_FORMAT_XPRESS_HUFF))
+      return(RtlpWorkSpaceSizeXpress(Format,
+                                     Engine,
+                                     CompressBufferAndWorkSpaceSize,
+                                     CompressFragmentWorkSpaceSize));
+
    return(STATUS_UNSUPPORTED_COMPRESSION);
 }
 
@@ -16,6 +16,15 @@
 
 #define MAX_STATIC_CS_DEBUG_OBJECTS 64
 
+/*
+ * The low bits of SpinCount hold the configured spin count, the high byte is
+ * reserved for the RTL_CRITICAL_SECTION_FLAG_* flags. How far adaptive
+ * spinning currently backs off from the spin count (as a shift) is kept in
+ * the otherwise unused SpareWORD of the debug info.
+ */
+#define CS_SPIN_COUNT_MASK          0x00FFFFFF
+#define CS_SPIN_BACKOFF_MAX         8
+
 static RTL_CRITICAL_SECTION RtlCriticalSectionLock;
 static LIST_ENTRY RtlCriticalSectionList = {&RtlCriticalSectionList, &RtlCriticalSectionList};
 static BOOLEAN RtlpCritSectInitialized = FALSE;
@@ -91,6 +100,66 @@ RtlpCreateCriticalSectionSem(PRTL_CRITICAL_SECTION CriticalSection)
     return;
 }
 
+/*++
+ * RtlpSpinOnCriticalSection
+ *
+ *     Spins for a while, trying to acquire a contended critical section
+ *     without waiting in the kernel.
+ *
+ * Params:
+ *     CriticalSection - Critical section to acquire.
+ *
+ * Returns:
+ *     TRUE if the critical section was acquired, FALSE otherwise.
+ *
+ * Remarks:
+ *     The spin budget is the configured spin count, shifted right by a
+ *     per-lock backoff that grows each time spinning fails and shrinks each
+ *     time it succeeds. Spinning stops as soon as other threads are waiting.
+ *
+ *--*/
+static
+BOOLEAN
+RtlpSpinOnCriticalSection(PRTL_CRITICAL_SECTION CriticalSection)
+{
+    PRTL_CRITICAL_SECTION_DEBUG DebugInfo = CriticalSection->DebugInfo;
+    ULONG Backoff, Spins;
+    BOOLEAN Acquired = FALSE;
+
+    /* Without debug info there is nowhere to keep the backoff, spin fully */
+    Backoff = DebugInfo ? min(DebugInfo->SpareWORD, CS_SPIN_BACKOFF_MAX) : 0;
+    Spins = (ULONG)(CriticalSection->SpinCount & CS_SPIN_COUNT_MASK) >> Backoff;
+
+    for (;;)
+    {
+        /* Try to grab it if it looks free */
+        if (CriticalSection->LockCount == -1 &&
+            InterlockedCompareExchange(&CriticalSection->LockCount, 0, -1) == -1)
+        {
+            Acquired = TRUE;
+            break;
+        }
+
+        /* Don't spin past the budget, nor in front of threads already waiting */
+        if (Spins-- == 0 || CriticalSection->LockCount > 0)
+            break;
+
+        YieldProcessor();
+    }
+
+    /* Adjust the backoff to how spinning went. This is only a hint, so
+     * concurrent updates losing each other don't matter */
+    if (DebugInfo)
+    {
+        if (Acquired && Backoff > 0)
+            DebugInfo->SpareWORD = (WORD)(Backoff - 1);
+        else if (!Acquired && Backoff < CS_SPIN_BACKOFF_MAX)
+            DebugInfo->SpareWORD = (WORD)(Backoff + 1);
+    }
+
+    return Acquired;
+}
+
 /*++
  * RtlpWaitForCriticalSection
  *
@@ -453,10 +522,15 @@ NTAPI
 RtlSetCriticalSectionSpinCount(PRTL_CRITICAL_SECTION CriticalSection,
                                ULONG SpinCount)
 {
-    ULONG OldCount = (ULONG)CriticalSection->SpinCount;
+    ULONG OldCount = (ULONG)(CriticalSection->SpinCount & CS_SPIN_COUNT_MASK);
 
     /* Set to parameter if MP, or to 0 if this is Uniprocessor */
-    CriticalSection->SpinCount = (NtCurrentPeb()->NumberOfProcessors > 1) ? SpinCount : 0;
+    CriticalSection->SpinCount = (NtCurrentPeb()->NumberOfProcessors > 1) ? (SpinCount & CS_SPIN_COUNT_MASK) : 0;
+
+    /* Start spinning with the full budget again */
+    if (CriticalSection->DebugInfo)
+        CriticalSection->DebugInfo->SpareWORD = 0;
+
     return OldCount;
 }
 
@@ -473,7 +547,8 @@ RtlSetCriticalSectionSpinCount(PRTL_CRITICAL_SECTION CriticalSection,
  *     STATUS_SUCCESS.
  *
  * Remarks:
- *     Uses a fast-path unless contention happens.
+ *     Uses a fast-path unless contention happens. On contention, spins
+ *     according to the spin count before waiting.
  *
  *--*/
 NTSTATUS
@@ -482,6 +557,16 @@ RtlEnterCriticalSection(PRTL_CRITICAL_SECTION CriticalSection)
 {
     HANDLE Thread = (HANDLE)NtCurrentTeb()->ClientId.UniqueThread;
 
+    /* If we have a spin count, spin a bit before queuing up as a waiter */
+    if ((CriticalSection->SpinCount & CS_SPIN_COUNT_MASK) &&
+        Thread != CriticalSection->OwningThread &&
+        RtlpSpinOnCriticalSection(CriticalSection))
+    {
+        CriticalSection->OwningThread = Thread;
+        CriticalSection->RecursionCount = 1;
+        return STATUS_SUCCESS;
+    }
+
     /* Try to lock it */
     if (InterlockedIncrement(&CriticalSection->LockCount) != 0)
     {
@@ -572,7 +657,7 @@ RtlInitializeCriticalSectionAndSpinCount(PRTL_CRITICAL_SECTION CriticalSection,
     CriticalSection->LockCount = -1;
     CriticalSection->RecursionCount = 0;
     CriticalSection->OwningThread = 0;
-    CriticalSection->SpinCount = (NtCurrentPeb()->NumberOfProcessors > 1) ? SpinCount : 0;
+    CriticalSection->SpinCount = (NtCurrentPeb()->NumberOfProcessors > 1) ? (SpinCount & CS_SPIN_COUNT_MASK) : 0;
     CriticalSection->LockSemaphore = 0;
 
     /* Allocate the Debug Data */
@@ -594,6 +679,7 @@ RtlInitializeCriticalSectionAndSpinCount(PRTL_CRITICAL_SECTION CriticalSection,
     CritcalSectionDebugData->EntryCount = 0;
     CritcalSectionDebugData->CriticalSection = CriticalSection;
     CritcalSectionDebugData->Flags = 0;
+    CritcalSectionDebugData->SpareWORD = 0;
     CriticalSection->DebugInfo = CritcalSectionDebugData;
 
     /*
@@ -180,6 +180,11 @@ RtlpInitializeHeap(OUT PHEAP Heap,
     Heap->MaximumAllocationSize = Parameters->MaximumAllocationSize;
     Heap->CommitRoutine = Parameters->CommitRoutine;
 
+    /* The front end heap is only enabled later on */
+    Heap->FrontEndHeap = NULL;
+    Heap->FrontEndHeapType = HEAP_FRONT_END_NONE;
+    Heap->FrontEndUsage = 0;
+
     /* Initialise the Heap validation info */
     Heap->HeaderValidateCopy = NULL;
     Heap->HeaderValidateLength = (USHORT)HeaderSize;
@@ -2106,11 +2111,28 @@ RtlAllocateHeap(IN PVOID HeapPtr,
 
     Index = AllocationSize >> HEAP_ENTRY_SHIFT;
 
+    /* Small blocks come from the front end heap, if there is one */
+    if ((Heap->FrontEndHeapType == HEAP_FRONT_END_LFH) &&
+        (Index <= HEAP_LFH_MAX_BLOCK_SIZE) &&
+        !(EntryFlags & HEAP_ENTRY_EXTRA_PRESENT))
+    {
+        PVOID Block = RtlpLfhAllocate(Heap, Flags, Size, Index, EntryFlags);
+        if (Block) return Block;
+    }
+
     /* Acquire the lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
-        RtlEnterHeapLock(Heap->LockVariable, TRUE);
+        if (!RtlTryEnterHeapLock(Heap->LockVariable, TRUE))
+        {
+            RtlEnterHeapLock(Heap->LockVariable, TRUE);
+            Heap->Counters.LockCollisions++;
+        }
+        Heap->Counters.LockAcquires++;
         HeapLocked = TRUE;
+
+        /* See if this heap would be better off with a front end */
+        RtlpLfhCheckActivation(Heap, Index);
     }
 
     /* Depending on the size, the allocation is going to be done from dedicated,
@@ -2298,7 +2320,7 @@ BOOLEAN NTAPI RtlFreeHeap(
         /* Check this entry, fail if it's invalid */
         if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY) ||
             (((ULONG_PTR)Ptr & 0x7) != 0) ||
-            (HeapEntry->SegmentOffset >= HEAP_SEGMENTS))
+            (!(HeapEntry->LFHFlags & HEAP_ENTRY_LFH) && (HeapEntry->SegmentOffset >= HEAP_SEGMENTS)))
         {
             /* This is an invalid block */
             DPRINT1("HEAP: Trying to free an invalid address %p!\n", Ptr);
@@ -2315,11 +2337,23 @@ BOOLEAN NTAPI RtlFreeHeap(
     }
     _SEH2_END;
 
+    /* Blocks of the front end heap don't need the heap lock */
+    if (HeapEntry->LFHFlags & HEAP_ENTRY_LFH)
+        return RtlpLfhFree(Heap, HeapEntry);
+
     /* Lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
         RtlEnterHeapLock(Heap->LockVariable, TRUE);
         Locked = TRUE;
+
+        /* One less small block for the front end heap heuristics */
+        if ((Heap->FrontEndUsage != 0) &&
+            !(HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC) &&
+            (HeapEntry->Size <= HEAP_LFH_MAX_BLOCK_SIZE))
+        {
+            Heap->FrontEndUsage--;
+        }
     }
 
     if (HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC)
@@ -2706,6 +2740,10 @@ RtlReAllocateHeap(HANDLE HeapPtr,
         return NULL;
     }
 
+    /* Blocks of the front end heap are handled there */
+    if ((((PHEAP_ENTRY)Ptr)-1)->LFHFlags & HEAP_ENTRY_LFH)
+        return RtlpLfhReAllocate(Heap, Flags, Ptr, Size);
+
     /* Calculate allocation size and index */
     if (Size)
         AllocationSize = Size;
@@ -3279,6 +3317,9 @@ RtlpValidateHeapEntry(
     if ((ULONG_PTR)HeapEntry & (HEAP_ENTRY_SIZE - 1)) goto invalid_entry;
     if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY)) goto invalid_entry;
 
+    /* Blocks of the front end heap live in subsegments */
+    if (HeapEntry->LFHFlags & HEAP_ENTRY_LFH) return RtlpLfhValidateEntry(Heap, HeapEntry);
+
     BigAllocation = HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC;
     Segment = Heap->Segments[HeapEntry->SegmentOffset];
 
@@ -4063,6 +4104,9 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
                       IN PVOID HeapInformation,
                       IN SIZE_T HeapInformationLength)
 {
+    PHEAP Heap = (PHEAP)HeapHandle;
+    NTSTATUS Status;
+
     /* Setting heap information is not really supported except for enabling LFH */
     if (HeapInformationClass == HeapCompatibilityInformation)
     {
@@ -4074,13 +4118,24 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
         }
 
         /* Check for a special magic value for enabling LFH */
-        if (*(PULONG)HeapInformation != 2)
+        if (*(PULONG)HeapInformation != HEAP_FRONT_END_LFH)
         {
             return STATUS_UNSUCCESSFUL;
         }
 
-        DPRINT1("RtlSetHeapInformation() needs to enable LFH\n");
-        return STATUS_SUCCESS;
+        if (!Heap ||
+            (Heap->ForceFlags & HEAP_FLAG_PAGE_ALLOCS) ||
+            !RtlpLfhIsSupported(Heap))
+        {
+            return STATUS_UNSUCCESSFUL;
+        }
+
+        /* Enable the LFH, this can't be undone */
+        RtlEnterHeapLock(Heap->LockVariable, TRUE);
+        Status = RtlpActivateLowFragmentationHeap(Heap);
+        RtlLeaveHeapLock(Heap->LockVariable);
+
+        return Status;
     }
 
     return STATUS_SUCCESS;
@@ -54,6 +54,22 @@
 /* Segment flags */
 #define HEAP_USER_ALLOCATED    0x1
 
+/* Front end heap types */
+#define HEAP_FRONT_END_NONE    0
+#define HEAP_FRONT_END_LFH     2
+
+/* Low fragmentation heap */
+#define HEAP_ENTRY_LFH                  0x80    /* In LFHFlags, for the blocks of a subsegment */
+#define HEAP_LFH_BUCKETS                80
+#define HEAP_LFH_MAX_BLOCK_SIZE         256     /* In heap entries, header included */
+#define HEAP_LFH_AFFINITY_SLOTS         8
+#define HEAP_LFH_MIN_BLOCK_COUNT        16
+#define HEAP_LFH_MAX_BLOCK_COUNT        256
+#define HEAP_LFH_SUBSEGMENT_SIZE        (4 * PAGE_SIZE)
+#define HEAP_LFH_FREE_SUBSEGMENTS       1       /* Empty subsegments kept by each bucket */
+#define HEAP_LFH_CONTENTION_THRESHOLD   64      /* Heap lock collisions before enabling the LFH */
+#define HEAP_LFH_USAGE_THRESHOLD        0x800   /* Small busy blocks before enabling the LFH */
+
 /* A handy inline to distinguis normal heap, special "debug heap" and special "page heap" */
 FORCEINLINE BOOLEAN
 RtlpHeapIsSpecial(ULONG Flags)
@@ -264,6 +280,7 @@ typedef struct _HEAP
     UCHAR FrontEndHeapType;
     HEAP_COUNTERS Counters;
     HEAP_TUNING_PARAMETERS TuningParameters;
+    ULONG FrontEndUsage; // FIXME: non-Vista
     RTL_BITMAP FreeHintBitmap;  // FIXME: non-Vista
     PLIST_ENTRY FreeHints[ANYSIZE_ARRAY]; // FIXME: non-Vista
 } HEAP, *PHEAP;
@@ -313,6 +330,44 @@ typedef struct _HEAP_VIRTUAL_ALLOC_ENTRY
     HEAP_ENTRY BusyBlock;
 } HEAP_VIRTUAL_ALLOC_ENTRY, *PHEAP_VIRTUAL_ALLOC_ENTRY;
 
+typedef struct _HEAP_LFH_SUBSEGMENT
+{
+    LIST_ENTRY ListEntry;
+    struct _HEAP_LFH *FrontEndHeap;
+    USHORT BlockSize;
+    USHORT BlockCount;
+    LONG volatile FreeCount;
+    ULONG Hint;
+    LONG volatile Bitmap[HEAP_LFH_MAX_BLOCK_COUNT / 32];
+} HEAP_LFH_SUBSEGMENT, *PHEAP_LFH_SUBSEGMENT;
+
+#define HEAP_LFH_SUBSEGMENT_HEADER_SIZE ROUND_UP(sizeof(HEAP_LFH_SUBSEGMENT), HEAP_ENTRY_SIZE)
+
+typedef union _HEAP_LFH_SLOT
+{
+    struct
+    {
+        LONG volatile Busy;
+        PHEAP_LFH_SUBSEGMENT ActiveSubsegment;
+    };
+    UCHAR Alignment[SYSTEM_CACHE_ALIGNMENT_SIZE];
+} HEAP_LFH_SLOT, *PHEAP_LFH_SLOT;
+
+typedef struct _HEAP_LFH_BUCKET
+{
+    HEAP_LFH_SLOT Slots[HEAP_LFH_AFFINITY_SLOTS];
+    LIST_ENTRY Subsegments;
+    USHORT BlockSize;
+    USHORT BlockCount;
+} HEAP_LFH_BUCKET, *PHEAP_LFH_BUCKET;
+
+typedef struct _HEAP_LFH
+{
+    struct _HEAP *Heap;
+    ULONG SlotCount;
+    HEAP_LFH_BUCKET Buckets[HEAP_LFH_BUCKETS];
+} HEAP_LFH, *PHEAP_LFH;
+
 /* Global variables */
 extern RTL_CRITICAL_SECTION RtlpProcessHeapsListLock;
 extern BOOLEAN RtlpPageHeapEnabled;
@@ -392,6 +447,38 @@ RtlDebugSizeHeap(HANDLE HeapPtr,
                  ULONG Flags,
                  PVOID Ptr);
 
+/* heaplfh.c */
+BOOLEAN NTAPI
+RtlpLfhIsSupported(PHEAP Heap);
+
+NTSTATUS NTAPI
+RtlpActivateLowFragmentationHeap(PHEAP Heap);
+
+VOID NTAPI
+RtlpLfhCheckActivation(PHEAP Heap,
+                       SIZE_T Index);
+
+PVOID NTAPI
+RtlpLfhAllocate(PHEAP Heap,
+                ULONG Flags,
+                SIZE_T Size,
+                SIZE_T Index,
+                UCHAR EntryFlags);
+
+BOOLEAN NTAPI
+RtlpLfhFree(PHEAP Heap,
+            PHEAP_ENTRY HeapEntry);
+
+PVOID NTAPI
+RtlpLfhReAllocate(PHEAP Heap,
+                  ULONG Flags,
+                  PVOID Ptr,
+                  SIZE_T Size);
+
+BOOLEAN NTAPI
+RtlpLfhValidateEntry(PHEAP Heap,
+                     PHEAP_ENTRY HeapEntry);
+
 /* heappage.c */
 
 HANDLE NTAPI
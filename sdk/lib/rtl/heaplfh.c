@@ -0,0 +1,494 @@
+/*
+ * PROJECT:     ReactOS system libraries
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     RTL Heap low fragmentation front end
+ */
+
+/* Small blocks are grouped by size in buckets. Each bucket carves its blocks
+   out of subsegments, which are ordinary blocks of the back end heap holding
+   up to HEAP_LFH_MAX_BLOCK_COUNT blocks of the same size, with a bitmap of
+   the busy ones.
+
+   A bucket has several affinity slots, each one with its own active
+   subsegment. Threads start from the slot given by their thread id, and
+   move on to the next one if it's being used, so that they don't contend
+   on the same bitmap. Allocating from the active subsegment of a slot and
+   freeing to any subsegment are done with interlocked operations; the heap
+   lock is only taken when a slot needs another subsegment.
+
+   Subsegments are only handed back to the back end when they are empty and
+   not active in any slot, so freeing a block never races with its
+   subsegment going away. */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl.h>
+#include <heap.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* FUNCTIONS *****************************************************************/
+
+FORCEINLINE
+ULONG
+RtlpLfhBucketFromSize(SIZE_T Index)
+{
+    /* 1 entry granularity up to 32 entries, then 2, 4 and 8 */
+    ASSERT((Index != 0) && (Index <= HEAP_LFH_MAX_BLOCK_SIZE));
+
+    if (Index <= 32) return (ULONG)Index - 1;
+    if (Index <= 64) return 32 + (((ULONG)Index - 33) >> 1);
+    if (Index <= 128) return 48 + (((ULONG)Index - 65) >> 2);
+    return 64 + (((ULONG)Index - 129) >> 3);
+}
+
+FORCEINLINE
+USHORT
+RtlpLfhBucketBlockSize(ULONG Bucket)
+{
+    if (Bucket < 32) return (USHORT)(Bucket + 1);
+    if (Bucket < 48) return (USHORT)(32 + ((Bucket - 31) << 1));
+    if (Bucket < 64) return (USHORT)(64 + ((Bucket - 47) << 2));
+    return (USHORT)(128 + ((Bucket - 63) << 3));
+}
+
+FORCEINLINE
+PHEAP_ENTRY
+RtlpLfhGetBlock(PHEAP_LFH_SUBSEGMENT Subsegment, ULONG Index)
+{
+    PHEAP_ENTRY FirstBlock = (PHEAP_ENTRY)((PUCHAR)Subsegment + HEAP_LFH_SUBSEGMENT_HEADER_SIZE);
+
+    return FirstBlock + (SIZE_T)Index * Subsegment->BlockSize;
+}
+
+BOOLEAN NTAPI
+RtlpLfhIsSupported(PHEAP Heap)
+{
+    /* The LFH is user mode only, and has nothing to offer to non serialized or debug heaps */
+    if (RtlpGetMode() != UserMode) return FALSE;
+    if (Heap->Flags & HEAP_NO_SERIALIZE) return FALSE;
+    if (RtlpHeapIsSpecial(Heap->Flags)) return FALSE;
+    if (Heap->Flags & (HEAP_TAIL_CHECKING_ENABLED | HEAP_FREE_CHECKING_ENABLED)) return FALSE;
+
+    return TRUE;
+}
+
+/* Must be called with the heap lock held */
+NTSTATUS NTAPI
+RtlpActivateLowFragmentationHeap(PHEAP Heap)
+{
+    PHEAP_LFH FrontEndHeap;
+    PHEAP_LFH_BUCKET Bucket;
+    ULONG i, BlockCount;
+
+    if (Heap->FrontEndHeapType == HEAP_FRONT_END_LFH) return STATUS_SUCCESS;
+    if (!RtlpLfhIsSupported(Heap)) return STATUS_UNSUCCESSFUL;
+
+    FrontEndHeap = RtlAllocateHeap(Heap, HEAP_NO_SERIALIZE | HEAP_ZERO_MEMORY, sizeof(HEAP_LFH));
+    if (!FrontEndHeap)
+    {
+        DPRINT1("HEAP: Failed to allocate the LFH of heap %p\n", Heap);
+        return STATUS_NO_MEMORY;
+    }
+
+    FrontEndHeap->Heap = Heap;
+
+    /* Two slots per processor is plenty to keep threads apart */
+    FrontEndHeap->SlotCount = min(max(NtCurrentPeb()->NumberOfProcessors, 1) * 2, HEAP_LFH_AFFINITY_SLOTS);
+
+    for (i = 0; i < HEAP_LFH_BUCKETS; i++)
+    {
+        Bucket = &FrontEndHeap->Buckets[i];
+        Bucket->BlockSize = RtlpLfhBucketBlockSize(i);
+
+        BlockCount = HEAP_LFH_SUBSEGMENT_SIZE / (Bucket->BlockSize << HEAP_ENTRY_SHIFT);
+        Bucket->BlockCount = (USHORT)min(max(BlockCount, HEAP_LFH_MIN_BLOCK_COUNT), HEAP_LFH_MAX_BLOCK_COUNT);
+
+        InitializeListHead(&Bucket->Subsegments);
+    }
+
+    /* The buckets must be ready before anybody sees them */
+    InterlockedExchangePointer(&Heap->FrontEndHeap, FrontEndHeap);
+    Heap->FrontEndHeapType = HEAP_FRONT_END_LFH;
+
+    DPRINT("HEAP: Enabled the LFH of heap %p\n", Heap);
+    return STATUS_SUCCESS;
+}
+
+/* Must be called with the heap lock held, for each allocation served by the back end */
+VOID NTAPI
+RtlpLfhCheckActivation(PHEAP Heap,
+                       SIZE_T Index)
+{
+    if (Heap->FrontEndHeapType != HEAP_FRONT_END_NONE) return;
+
+    if (Index <= HEAP_LFH_MAX_BLOCK_SIZE)
+        Heap->FrontEndUsage++;
+
+    /* Enable the LFH once the heap is contended, or holds a lot of small blocks */
+    if ((Heap->Counters.LockCollisions < HEAP_LFH_CONTENTION_THRESHOLD) &&
+        (Heap->FrontEndUsage < HEAP_LFH_USAGE_THRESHOLD))
+    {
+        return;
+    }
+
+    if (!RtlpLfhIsSupported(Heap) ||
+        !NT_SUCCESS(RtlpActivateLowFragmentationHeap(Heap)))
+    {
+        /* Try again later */
+        Heap->Counters.LockCollisions = 0;
+        Heap->FrontEndUsage = 0;
+    }
+}
+
+static
+VOID
+RtlpLfhInitializeSubsegment(PHEAP_LFH FrontEndHeap,
+                            PHEAP_LFH_BUCKET Bucket,
+                            PHEAP_LFH_SUBSEGMENT Subsegment)
+{
+    ULONG i;
+
+    Subsegment->FrontEndHeap = FrontEndHeap;
+    Subsegment->BlockSize = Bucket->BlockSize;
+    Subsegment->BlockCount = Bucket->BlockCount;
+    Subsegment->FreeCount = Bucket->BlockCount;
+    Subsegment->Hint = 0;
+
+    /* The bits past the last block are busy for good */
+    for (i = 0; i < RTL_NUMBER_OF(Subsegment->Bitmap); i++)
+    {
+        if ((i + 1) * 32 <= Bucket->BlockCount)
+            Subsegment->Bitmap[i] = 0;
+        else if (i * 32 >= Bucket->BlockCount)
+            Subsegment->Bitmap[i] = ~0;
+        else
+            Subsegment->Bitmap[i] = (LONG)(~0UL << (Bucket->BlockCount % 32));
+    }
+}
+
+/* Called by the owner of the slot which holds this subsegment */
+static
+PHEAP_ENTRY
+RtlpLfhTakeBlock(PHEAP_LFH_SUBSEGMENT Subsegment)
+{
+    ULONG i, Word, Bit;
+    LONG Bits;
+
+    if (Subsegment->FreeCount == 0) return NULL;
+
+    for (i = 0; i < RTL_NUMBER_OF(Subsegment->Bitmap); i++)
+    {
+        Word = (Subsegment->Hint + i) % RTL_NUMBER_OF(Subsegment->Bitmap);
+
+        /* Frees may clear bits under our feet, but nobody else sets them */
+        Bits = Subsegment->Bitmap[Word];
+        while (Bits != ~0)
+        {
+            BitScanForward(&Bit, ~(ULONG)Bits);
+            if (InterlockedCompareExchange(&Subsegment->Bitmap[Word], Bits | (LONG)(1UL << Bit), Bits) == Bits)
+            {
+                PHEAP_ENTRY InUseEntry = RtlpLfhGetBlock(Subsegment, Word * 32 + Bit);
+
+                InterlockedDecrement(&Subsegment->FreeCount);
+                Subsegment->Hint = Word;
+
+                /* Blocks remember their index, to find their subsegment back */
+                InUseEntry->PreviousSize = (USHORT)(Word * 32 + Bit);
+                return InUseEntry;
+            }
+            Bits = Subsegment->Bitmap[Word];
+        }
+    }
+
+    /* Frees count their block after clearing its bit, so we can't get here */
+    ASSERT(FALSE);
+    return NULL;
+}
+
+/* Gives the slot a subsegment with free blocks. Called by the owner of the slot */
+static
+BOOLEAN
+RtlpLfhRefillSlot(PHEAP Heap,
+                  PHEAP_LFH FrontEndHeap,
+                  PHEAP_LFH_BUCKET Bucket,
+                  PHEAP_LFH_SLOT Slot)
+{
+    PHEAP_LFH_SUBSEGMENT Subsegment, Found = NULL;
+    PLIST_ENTRY Current;
+    ULONG EmptyCount = 0;
+    SIZE_T SubsegmentSize;
+
+    RtlEnterHeapLock(Heap->LockVariable, TRUE);
+
+    /* Retire the current subsegment, frees will make room in it again */
+    if (Slot->ActiveSubsegment)
+    {
+        InsertTailList(&Bucket->Subsegments, &Slot->ActiveSubsegment->ListEntry);
+        Slot->ActiveSubsegment = NULL;
+    }
+
+    Current = Bucket->Subsegments.Flink;
+    while (Current != &Bucket->Subsegments)
+    {
+        Subsegment = CONTAINING_RECORD(Current, HEAP_LFH_SUBSEGMENT, ListEntry);
+        Current = Current->Flink;
+
+        if (Subsegment->FreeCount == Subsegment->BlockCount)
+        {
+            /* Keep a few empty subsegments around, give the others back */
+            if (++EmptyCount > HEAP_LFH_FREE_SUBSEGMENTS)
+            {
+                RemoveEntryList(&Subsegment->ListEntry);
+                RtlFreeHeap(Heap, HEAP_NO_SERIALIZE, Subsegment);
+                continue;
+            }
+        }
+
+        /* Prefer partially used subsegments, and let the empty ones go */
+        if (Subsegment->FreeCount != 0 &&
+            (!Found || Found->FreeCount == Found->BlockCount))
+        {
+            Found = Subsegment;
+            if (Found->FreeCount != Found->BlockCount) break;
+        }
+    }
+
+    if (Found)
+    {
+        RemoveEntryList(&Found->ListEntry);
+    }
+    else
+    {
+        SubsegmentSize = HEAP_LFH_SUBSEGMENT_HEADER_SIZE +
+                         ((SIZE_T)Bucket->BlockCount * Bucket->BlockSize << HEAP_ENTRY_SHIFT);
+
+        /* This is bigger than any LFH block, so it comes from the back end */
+        ASSERT((SubsegmentSize >> HEAP_ENTRY_SHIFT) > HEAP_LFH_MAX_BLOCK_SIZE);
+        Found = RtlAllocateHeap(Heap, HEAP_NO_SERIALIZE, SubsegmentSize);
+        if (Found)
+            RtlpLfhInitializeSubsegment(FrontEndHeap, Bucket, Found);
+    }
+
+    Slot->ActiveSubsegment = Found;
+
+    RtlLeaveHeapLock(Heap->LockVariable);
+
+    return (Found != NULL);
+}
+
+/* Returns NULL when the back end must handle the allocation */
+PVOID NTAPI
+RtlpLfhAllocate(PHEAP Heap,
+                ULONG Flags,
+                SIZE_T Size,
+                SIZE_T Index,
+                UCHAR EntryFlags)
+{
+    PHEAP_LFH FrontEndHeap = Heap->FrontEndHeap;
+    PHEAP_LFH_BUCKET Bucket;
+    PHEAP_LFH_SLOT Slot = NULL;
+    PHEAP_LFH_SUBSEGMENT Subsegment;
+    PHEAP_ENTRY InUseEntry = NULL;
+    ULONG SlotIndex, i;
+
+    Bucket = &FrontEndHeap->Buckets[RtlpLfhBucketFromSize(Index)];
+
+    /* Start with the slot of this thread, and move on if someone else is using it */
+    SlotIndex = (ULONG)((ULONG_PTR)NtCurrentTeb()->ClientId.UniqueThread >> 2);
+    for (i = 0; i < FrontEndHeap->SlotCount; i++)
+    {
+        Slot = &Bucket->Slots[(SlotIndex + i) % FrontEndHeap->SlotCount];
+        if (InterlockedCompareExchange(&Slot->Busy, 1, 0) == 0)
+            break;
+        Slot = NULL;
+    }
+
+    /* All of them are busy, the back end will do */
+    if (!Slot) return NULL;
+
+    if (Slot->ActiveSubsegment)
+        InUseEntry = RtlpLfhTakeBlock(Slot->ActiveSubsegment);
+
+    if (!InUseEntry && RtlpLfhRefillSlot(Heap, FrontEndHeap, Bucket, Slot))
+        InUseEntry = RtlpLfhTakeBlock(Slot->ActiveSubsegment);
+
+    Subsegment = Slot->ActiveSubsegment;
+    InterlockedExchange(&Slot->Busy, 0);
+
+    if (!InUseEntry) return NULL;
+
+    InUseEntry->Size = Subsegment->BlockSize;
+    InUseEntry->Flags = EntryFlags;
+    InUseEntry->SmallTagIndex = 0;
+    InUseEntry->LFHFlags = HEAP_ENTRY_LFH;
+    InUseEntry->UnusedBytes = (UCHAR)((Subsegment->BlockSize << HEAP_ENTRY_SHIFT) - Size);
+
+    /* Zero memory if that was requested */
+    if (Flags & HEAP_ZERO_MEMORY)
+        RtlZeroMemory(InUseEntry + 1, Size);
+
+    return InUseEntry + 1;
+}
+
+static
+PHEAP_LFH_SUBSEGMENT
+RtlpLfhGetSubsegment(PHEAP Heap,
+                     PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH_SUBSEGMENT Subsegment;
+
+    /* Protect with SEH in case the entry is garbage */
+    _SEH2_TRY
+    {
+        Subsegment = (PHEAP_LFH_SUBSEGMENT)((PUCHAR)(HeapEntry - (SIZE_T)HeapEntry->PreviousSize * HeapEntry->Size) -
+                                            HEAP_LFH_SUBSEGMENT_HEADER_SIZE);
+
+        if ((Heap->FrontEndHeap == NULL) ||
+            (Subsegment->FrontEndHeap != Heap->FrontEndHeap) ||
+            (Subsegment->BlockSize != HeapEntry->Size) ||
+            (HeapEntry->PreviousSize >= Subsegment->BlockCount))
+        {
+            Subsegment = NULL;
+        }
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        Subsegment = NULL;
+    }
+    _SEH2_END;
+
+    return Subsegment;
+}
+
+BOOLEAN NTAPI
+RtlpLfhFree(PHEAP Heap,
+            PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH_SUBSEGMENT Subsegment;
+    ULONG Index;
+    LONG Mask;
+
+    Subsegment = RtlpLfhGetSubsegment(Heap, HeapEntry);
+    if (!Subsegment)
+    {
+        DPRINT1("HEAP: Trying to free an invalid address %p!\n", HeapEntry + 1);
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    Index = HeapEntry->PreviousSize;
+    Mask = (LONG)(1UL << (Index % 32));
+
+    /* The entry is not busy anymore, then the block is free to be taken again */
+    HeapEntry->Flags = 0;
+    if (!(InterlockedAnd(&Subsegment->Bitmap[Index / 32], ~Mask) & Mask))
+    {
+        DPRINT1("HEAP: Trying to free %p twice!\n", HeapEntry + 1);
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    /* Once the subsegment has all its blocks back, this is the last time we touch it */
+    InterlockedIncrement(&Subsegment->FreeCount);
+
+    return TRUE;
+}
+
+PVOID NTAPI
+RtlpLfhReAllocate(PHEAP Heap,
+                  ULONG Flags,
+                  PVOID Ptr,
+                  SIZE_T Size)
+{
+    PHEAP_ENTRY InUseEntry = (PHEAP_ENTRY)Ptr - 1;
+    SIZE_T AllocationSize, OldSize;
+    PVOID NewBaseAddress;
+
+    if (!(InUseEntry->Flags & HEAP_ENTRY_BUSY) ||
+        !RtlpLfhGetSubsegment(Heap, InUseEntry))
+    {
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    OldSize = (InUseEntry->Size << HEAP_ENTRY_SHIFT) - InUseEntry->UnusedBytes;
+
+    AllocationSize = Size ? Size : 1;
+    AllocationSize = (AllocationSize + Heap->AlignRound) & Heap->AlignMask;
+
+    /* Stay in place as long as the new size belongs to the same bucket */
+    if (!(Flags & HEAP_EXTRA_FLAGS_MASK) &&
+        ((AllocationSize >> HEAP_ENTRY_SHIFT) <= HEAP_LFH_MAX_BLOCK_SIZE) &&
+        (RtlpLfhBucketBlockSize(RtlpLfhBucketFromSize(AllocationSize >> HEAP_ENTRY_SHIFT)) == InUseEntry->Size))
+    {
+        if ((Flags & HEAP_ZERO_MEMORY) && (Size > OldSize))
+            RtlZeroMemory((PUCHAR)Ptr + OldSize, Size - OldSize);
+
+        InUseEntry->UnusedBytes = (UCHAR)((InUseEntry->Size << HEAP_ENTRY_SHIFT) - Size);
+        return Ptr;
+    }
+
+    if (Flags & HEAP_REALLOC_IN_PLACE_ONLY)
+    {
+        DPRINT1("Realloc in place failed, but it was the only option\n");
+        NewBaseAddress = NULL;
+    }
+    else
+    {
+        /* Preserve user settable flags */
+        Flags &= ~(HEAP_TAG_MASK | HEAP_SETTABLE_USER_FLAGS);
+        Flags |= (InUseEntry->Flags & HEAP_ENTRY_SETTABLE_FLAGS) << 4;
+
+        NewBaseAddress = RtlAllocateHeap(Heap, Flags & ~HEAP_ZERO_MEMORY, Size);
+        if (NewBaseAddress)
+        {
+            RtlMoveMemory(NewBaseAddress, Ptr, min(Size, OldSize));
+
+            /* Zero remaining part if required */
+            if ((Flags & HEAP_ZERO_MEMORY) && (Size > OldSize))
+                RtlZeroMemory((PUCHAR)NewBaseAddress + OldSize, Size - OldSize);
+
+            RtlpLfhFree(Heap, InUseEntry);
+        }
+    }
+
+    if (!NewBaseAddress && (Flags & HEAP_GENERATE_EXCEPTIONS))
+    {
+        EXCEPTION_RECORD ExceptionRecord;
+
+        ExceptionRecord.ExceptionCode = STATUS_NO_MEMORY;
+        ExceptionRecord.ExceptionRecord = NULL;
+        ExceptionRecord.NumberParameters = 1;
+        ExceptionRecord.ExceptionFlags = 0;
+        ExceptionRecord.ExceptionInformation[0] = AllocationSize;
+
+        RtlRaiseException(&ExceptionRecord);
+    }
+
+    return NewBaseAddress;
+}
+
+BOOLEAN NTAPI
+RtlpLfhValidateEntry(PHEAP Heap,
+                     PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH_SUBSEGMENT Subsegment;
+    ULONG Index;
+
+    Subsegment = RtlpLfhGetSubsegment(Heap, HeapEntry);
+    if (!Subsegment) goto invalid_entry;
+
+    Index = HeapEntry->PreviousSize;
+    if (RtlpLfhGetBlock(Subsegment, Index) != HeapEntry) goto invalid_entry;
+    if (!(Subsegment->Bitmap[Index / 32] & (1UL << (Index % 32)))) goto invalid_entry;
+
+    return TRUE;
+
+invalid_entry:
+    DPRINT1("HEAP: Invalid LFH entry %p in heap %p\n", HeapEntry, Heap);
+    return FALSE;
+}
+
+/* EOF */
@@ -0,0 +1,1896 @@
+/*
+ * PROJECT:     ReactOS system libraries
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Native thread pool (Tp*) routines
+ *
+ * NOTES:       Every pool owns an I/O completion port. Work, timer and wait
+ *              callbacks are kept in per-priority queues in the pool and the
+ *              port is only used to wake up idle workers, so a burst of posts
+ *              costs a single wake-up and the workers drain the queue without
+ *              going back to the kernel. I/O completions are delivered through
+ *              the same port, with the I/O object as completion key.
+ *
+ *              The pool grows when no worker is idle and either a processor is
+ *              left without a busy worker or the oldest queued callback waited
+ *              longer than TPP_GROWTH_LATENCY, and workers above the minimum
+ *              retire after TPP_IDLE_TIMEOUT without work.
+ *
+ *              All the timers of the process share one thread that sleeps
+ *              until the earliest end of a timer window, so timers with
+ *              overlapping windows fire together. Waits are coalesced into
+ *              buckets of up to MAXIMUM_WAIT_OBJECTS - 1 handles per thread.
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl_vista.h>
+
+#define NDEBUG
+#include <debug.h>
+
+VOID
+NTAPI
+RtlInitializeConditionVariable(OUT PRTL_CONDITION_VARIABLE ConditionVariable);
+
+VOID
+NTAPI
+RtlWakeAllConditionVariable(IN OUT PRTL_CONDITION_VARIABLE ConditionVariable);
+
+NTSTATUS
+NTAPI
+RtlSleepConditionVariableSRW(IN OUT PRTL_CONDITION_VARIABLE ConditionVariable,
+                             IN OUT PRTL_SRWLOCK SRWLock,
+                             IN const LARGE_INTEGER * TimeOut OPTIONAL,
+                             IN ULONG Flags);
+
+/* DEFINES ******************************************************************/
+
+#define TPP_DEFAULT_MAX_THREADS     500
+#define TPP_IDLE_TIMEOUT            (20 * 1000 * 10000LL)   /* 20 s */
+#define TPP_WAIT_IDLE_TIMEOUT       (5 * 1000 * 10000LL)    /* 5 s */
+#define TPP_GROWTH_LATENCY          (10 * 10000LL)          /* 10 ms */
+#define TPP_MAX_BUCKET_WAITS        (MAXIMUM_WAIT_OBJECTS - 1)
+
+/* Packets with a NULL completion key are for the pool itself */
+#define TPP_PACKET_WAKE             ((PVOID)0)
+#define TPP_PACKET_QUIT             ((PVOID)1)
+
+/* What to do once the pool lock has been released */
+#define TPP_ACTION_WAKE             0x1
+#define TPP_ACTION_SPAWN            0x2
+#define TPP_ACTION_ARM_GROWTH       0x4
+
+/* TYPES ********************************************************************/
+
+typedef enum _TPP_OBJECT_TYPE
+{
+    TppObjectSimple,
+    TppObjectWork,
+    TppObjectTimer,
+    TppObjectWait,
+    TppObjectIo
+} TPP_OBJECT_TYPE;
+
+/* Windows 7 callback environment, our headers only give us the Vista one */
+typedef struct _TPP_CALLBACK_ENVIRON_V3
+{
+    TP_VERSION Version;
+    PTP_POOL Pool;
+    PTP_CLEANUP_GROUP CleanupGroup;
+    PTP_CLEANUP_GROUP_CANCEL_CALLBACK CleanupGroupCancelCallback;
+    PVOID RaceDll;
+    struct _ACTIVATION_CONTEXT *ActivationContext;
+    PTP_SIMPLE_CALLBACK FinalizationCallback;
+    union
+    {
+        DWORD Flags;
+        struct
+        {
+            DWORD LongFunction:1;
+            DWORD Persistent:1;
+            DWORD Private:30;
+        } s;
+    } u;
+    TP_CALLBACK_PRIORITY CallbackPriority;
+    DWORD Size;
+} TPP_CALLBACK_ENVIRON_V3, *PTPP_CALLBACK_ENVIRON_V3;
+
+typedef BOOLEAN
+(NTAPI *PTPP_TIMER_ROUTINE)(
+    IN PVOID Context
+);
+
+typedef struct _TPP_TIMER_ENTRY
+{
+    LIST_ENTRY ListEntry;
+    LONGLONG DueTime;
+    LONGLONG WindowLength;
+    LONGLONG Period;
+    BOOLEAN Armed;
+    /* Internal timers run on the timer thread and return whether to re-arm */
+    PTPP_TIMER_ROUTINE Routine;
+    PVOID Context;
+} TPP_TIMER_ENTRY, *PTPP_TIMER_ENTRY;
+
+struct _TP_POOL
+{
+    LONG RefCount;
+    RTL_SRWLOCK Lock;
+    HANDLE CompletionPort;
+    LIST_ENTRY Queue[TP_CALLBACK_PRIORITY_COUNT];
+    ULONG QueueLength;
+    LONG Threads;
+    LONG IdleThreads;
+    LONG WakesPending;
+    LONG LongThreads;
+    LONG MinThreads;
+    LONG MaxThreads;
+    BOOLEAN Shutdown;
+    BOOLEAN GrowthArmed;
+    RTL_CONDITION_VARIABLE Update;
+    TPP_TIMER_ENTRY GrowthTimer;
+};
+
+struct _TP_CLEANUP_GROUP
+{
+    RTL_SRWLOCK Lock;
+    LIST_ENTRY Members;
+};
+
+typedef struct _TPP_WAIT_BUCKET
+{
+    LIST_ENTRY ListEntry;
+    LIST_ENTRY Waits;
+    ULONG Count;
+    HANDLE UpdateEvent;
+} TPP_WAIT_BUCKET, *PTPP_WAIT_BUCKET;
+
+typedef struct _TPP_OBJECT
+{
+    /* Reserved for kernel32, must stay first */
+    PVOID Win32Callback;
+    TPP_OBJECT_TYPE Type;
+    LONG RefCount;
+    PTP_POOL Pool;
+    PVOID Callback;
+    PVOID Context;
+    PVOID RaceDll;
+    HANDLE ActivationContext;
+    PTP_SIMPLE_CALLBACK FinalizationCallback;
+    TP_CALLBACK_PRIORITY Priority;
+    BOOLEAN LongFunction;
+
+    /* Protected by the cleanup group lock */
+    PTP_CLEANUP_GROUP Group;
+    PTP_CLEANUP_GROUP_CANCEL_CALLBACK GroupCancelCallback;
+    LIST_ENTRY GroupEntry;
+    BOOLEAN GroupMember;
+
+    /* Protected by the pool lock */
+    LIST_ENTRY QueueEntry;
+    LONGLONG QueueTime;
+    ULONG Pending;
+    ULONG Running;
+    ULONG Waiters;
+
+    union
+    {
+        struct
+        {
+            /* Protected by the timer lock */
+            TPP_TIMER_ENTRY Entry;
+            BOOLEAN Set;
+        } Timer;
+        struct
+        {
+            /* Protected by the wait lock */
+            PTPP_WAIT_BUCKET Bucket;
+            LIST_ENTRY BucketEntry;
+            HANDLE Handle;
+            LONGLONG Timeout;
+            ULONG Sequence;
+            TP_WAIT_RESULT Result;
+        } Wait;
+        struct
+        {
+            /* Protected by the pool lock */
+            ULONG PendingIo;
+        } Io;
+    } u;
+} TPP_OBJECT, *PTPP_OBJECT;
+
+struct _TP_CALLBACK_INSTANCE
+{
+    PTPP_OBJECT Object;
+    BOOLEAN Associated;
+    BOOLEAN MayRunLong;
+    PRTL_CRITICAL_SECTION CriticalSection;
+    HANDLE Mutex;
+    HANDLE Semaphore;
+    LONG SemaphoreCount;
+    HANDLE Event;
+    PVOID DllHandle;
+};
+
+/* GLOBALS ******************************************************************/
+
+static PTP_POOL TppDefaultPool;
+
+static RTL_SRWLOCK TppTimerLock;
+static LIST_ENTRY TppTimerList = { &TppTimerList, &TppTimerList };
+static HANDLE TppTimerEvent;
+static LONGLONG TppTimerDeadline = MAXLONGLONG;
+
+static RTL_SRWLOCK TppWaitLock;
+static LIST_ENTRY TppWaitBuckets = { &TppWaitBuckets, &TppWaitBuckets };
+
+static VOID TppArmTimerLocked(IN PTPP_TIMER_ENTRY Entry);
+static VOID TppDisarmTimerLocked(IN PTPP_TIMER_ENTRY Entry);
+
+/* TIME *********************************************************************/
+
+static
+LONGLONG
+TppGetInterruptTime(VOID)
+{
+    LARGE_INTEGER Time;
+
+    do
+    {
+        Time.HighPart = SharedUserData->InterruptTime.High1Time;
+        Time.LowPart = SharedUserData->InterruptTime.LowPart;
+    } while (Time.HighPart != SharedUserData->InterruptTime.High2Time);
+
+    return Time.QuadPart;
+}
+
+static
+LONGLONG
+TppGetSystemTime(VOID)
+{
+    LARGE_INTEGER Time;
+
+    do
+    {
+        Time.HighPart = SharedUserData->SystemTime.High1Time;
+        Time.LowPart = SharedUserData->SystemTime.LowPart;
+    } while (Time.HighPart != SharedUserData->SystemTime.High2Time);
+
+    return Time.QuadPart;
+}
+
+/* Converts a relative or absolute NT timeout into interrupt time */
+static
+LONGLONG
+TppTimeoutToInterruptTime(IN PLARGE_INTEGER Timeout,
+                          IN LONGLONG Now)
+{
+    LONGLONG Delta;
+
+    if (!Timeout)
+        return MAXLONGLONG;
+
+    if (Timeout->QuadPart <= 0)
+    {
+        Delta = -Timeout->QuadPart;
+    }
+    else
+    {
+        Delta = Timeout->QuadPart - TppGetSystemTime();
+        if (Delta < 0)
+            Delta = 0;
+    }
+
+    return Now + Delta;
+}
+
+/* POOL *********************************************************************/
+
+static
+ULONG
+NTAPI
+TppWorkerThread(IN PVOID Parameter);
+
+static
+VOID
+TppCreateWorker(IN PTP_POOL Pool)
+{
+    HANDLE ThreadHandle;
+    NTSTATUS Status;
+
+    /* The caller already accounted for the new thread */
+    Status = RtlCreateUserThread(NtCurrentProcess(),
+                                 NULL,
+                                 FALSE,
+                                 0,
+                                 0,
+                                 0,
+                                 (PTHREAD_START_ROUTINE)TppWorkerThread,
+                                 Pool,
+                                 &ThreadHandle,
+                                 NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to create a thread pool worker: 0x%lx\n", Status);
+        RtlAcquireSRWLockExclusive(&Pool->Lock);
+        Pool->Threads--;
+        RtlReleaseSRWLockExclusive(&Pool->Lock);
+        return;
+    }
+
+    NtClose(ThreadHandle);
+}
+
+static
+PTPP_OBJECT
+TppOldestQueuedLocked(IN PTP_POOL Pool)
+{
+    PTPP_OBJECT Object, Oldest = NULL;
+    ULONG Priority;
+
+    for (Priority = 0; Priority < TP_CALLBACK_PRIORITY_COUNT; Priority++)
+    {
+        if (IsListEmpty(&Pool->Queue[Priority]))
+            continue;
+
+        Object = CONTAINING_RECORD(Pool->Queue[Priority].Flink, TPP_OBJECT, QueueEntry);
+        if (!Oldest || Object->QueueTime < Oldest->QueueTime)
+            Oldest = Object;
+    }
+
+    return Oldest;
+}
+
+/* Called when there's queued work and no idle worker to take it */
+static
+BOOLEAN
+TppShouldGrowLocked(IN PTP_POOL Pool,
+                    IN LONGLONG Now)
+{
+    PTPP_OBJECT Oldest;
+    LONG Busy;
+
+    if (Pool->Threads >= Pool->MaxThreads)
+        return FALSE;
+
+    if (Pool->Threads == 0 || Pool->Threads < Pool->MinThreads)
+        return TRUE;
+
+    /* Keep every processor busy, threads running long callbacks don't count */
+    Busy = Pool->Threads - Pool->LongThreads;
+    if (Busy < (LONG)NtCurrentPeb()->NumberOfProcessors && Pool->QueueLength > (ULONG)Busy)
+        return TRUE;
+
+    /* Beyond that, only grow when the queue isn't drained fast enough */
+    Oldest = TppOldestQueuedLocked(Pool);
+    return (Oldest && Now - Oldest->QueueTime >= TPP_GROWTH_LATENCY);
+}
+
+static
+ULONG
+TppDispatchLocked(IN PTP_POOL Pool,
+                  IN LONGLONG Now)
+{
+    /* Wake up an idle worker, unless they all already have a wake-up coming */
+    if (Pool->IdleThreads > Pool->WakesPending)
+    {
+        Pool->WakesPending++;
+        return TPP_ACTION_WAKE;
+    }
+
+    if (TppShouldGrowLocked(Pool, Now))
+    {
+        Pool->Threads++;
+        return TPP_ACTION_SPAWN;
+    }
+
+    /* Check again later, in case all the workers are stuck */
+    if (!Pool->GrowthArmed && Pool->Threads < Pool->MaxThreads)
+    {
+        Pool->GrowthArmed = TRUE;
+        return TPP_ACTION_ARM_GROWTH;
+    }
+
+    return 0;
+}
+
+static
+VOID
+TppSignalPool(IN PTP_POOL Pool,
+              IN ULONG Actions,
+              IN BOOLEAN TimerLockHeld)
+{
+    if (Actions & TPP_ACTION_WAKE)
+        NtSetIoCompletion(Pool->CompletionPort, NULL, TPP_PACKET_WAKE, STATUS_SUCCESS, 0);
+
+    if (Actions & TPP_ACTION_SPAWN)
+        TppCreateWorker(Pool);
+
+    if (Actions & TPP_ACTION_ARM_GROWTH)
+    {
+        if (!TimerLockHeld)
+            RtlAcquireSRWLockExclusive(&TppTimerLock);
+
+        Pool->GrowthTimer.DueTime = TppGetInterruptTime() + TPP_GROWTH_LATENCY;
+        TppArmTimerLocked(&Pool->GrowthTimer);
+
+        if (!TimerLockHeld)
+            RtlReleaseSRWLockExclusive(&TppTimerLock);
+    }
+}
+
+static
+BOOLEAN
+NTAPI
+TppGrowthTimerRoutine(IN PVOID Context)
+{
+    PTP_POOL Pool = Context;
+    ULONG Actions = 0;
+    BOOLEAN Rearm = FALSE;
+
+    RtlAcquireSRWLockExclusive(&Pool->Lock);
+
+    /* Nobody picked up the queue meanwhile, the workers are starving it */
+    if (Pool->QueueLength && Pool->IdleThreads <= Pool->WakesPending)
+    {
+        if (TppShouldGrowLocked(Pool, TppGetInterruptTime()))
+        {
+            Pool->Threads++;
+            Actions = TPP_ACTION_SPAWN;
+        }
+        Rearm = (Pool->Threads < Pool->MaxThreads);
+    }
+    Pool->GrowthArmed = Rearm;
+
+    RtlReleaseSRWLockExclusive(&Pool->Lock);
+
+    TppSignalPool(Pool, Actions, TRUE);
+    return Rearm;
+}
+
+static
+NTSTATUS
+TppAllocPool(OUT PTP_POOL *PoolReturn)
+{
+    PTP_POOL Pool;
+    NTSTATUS Status;
+    ULONG Priority;
+
+    Pool = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Pool));
+    if (!Pool)
+        return STATUS_NO_MEMORY;
+
+    Status = NtCreateIoCompletion(&Pool->CompletionPort, IO_COMPLETION_ALL_ACCESS, NULL, 0);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+        return Status;
+    }
+
+    Pool->RefCount = 1;
+    RtlInitializeSRWLock(&Pool->Lock);
+    for (Priority = 0; Priority < TP_CALLBACK_PRIORITY_COUNT; Priority++)
+        InitializeListHead(&Pool->Queue[Priority]);
+    Pool->MaxThreads = TPP_DEFAULT_MAX_THREADS;
+    RtlInitializeConditionVariable(&Pool->Update);
+
+    Pool->GrowthTimer.WindowLength = TPP_GROWTH_LATENCY / 2;
+    Pool->GrowthTimer.Period = TPP_GROWTH_LATENCY;
+    Pool->GrowthTimer.Routine = TppGrowthTimerRoutine;
+    Pool->GrowthTimer.Context = Pool;
+
+    *PoolReturn = Pool;
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+TppFreePool(IN PTP_POOL Pool)
+{
+    NtClose(Pool->CompletionPort);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+}
+
+static
+VOID
+TppDereferencePool(IN PTP_POOL Pool)
+{
+    LONG Threads, i;
+
+    if (InterlockedDecrement(&Pool->RefCount))
+        return;
+
+    /* No object is left, so nothing can be queued anymore */
+    RtlAcquireSRWLockExclusive(&TppTimerLock);
+    TppDisarmTimerLocked(&Pool->GrowthTimer);
+    RtlReleaseSRWLockExclusive(&TppTimerLock);
+
+    RtlAcquireSRWLockExclusive(&Pool->Lock);
+    Pool->Shutdown = TRUE;
+    Threads = Pool->Threads;
+    RtlReleaseSRWLockExclusive(&Pool->Lock);
+
+    /* The last worker to leave frees the pool */
+    if (!Threads)
+    {
+        TppFreePool(Pool);
+        return;
+    }
+
+    for (i = 0; i < Threads; i++)
+        NtSetIoCompletion(Pool->CompletionPort, NULL, TPP_PACKET_QUIT, STATUS_SUCCESS, 0);
+}
+
+static
+NTSTATUS
+TppGetDefaultPool(OUT PTP_POOL *PoolReturn)
+{
+    PTP_POOL Pool;
+    NTSTATUS Status;
+
+    if (!TppDefaultPool)
+    {
+        Status = TppAllocPool(&Pool);
+        if (!NT_SUCCESS(Status))
+            return Status;
+
+        if (InterlockedCompareExchangePointer((PVOID *)&TppDefaultPool, Pool, NULL) != NULL)
+            TppFreePool(Pool);
+    }
+
+    *PoolReturn = TppDefaultPool;
+    return STATUS_SUCCESS;
+}
+
+/* OBJECTS ******************************************************************/
+
+static
+VOID
+TppDereferenceObject(IN PTPP_OBJECT Object)
+{
+    PTP_POOL Pool;
+
+    if (InterlockedDecrement(&Object->RefCount))
+        return;
+
+    if (Object->RaceDll)
+        LdrUnloadDll(Object->RaceDll);
+    if (Object->ActivationContext)
+        RtlReleaseActivationContext(Object->ActivationContext);
+
+    Pool = Object->Pool;
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Object);
+    TppDereferencePool(Pool);
+}
+
+static
+VOID
+TppLeaveGroup(IN PTPP_OBJECT Object)
+{
+    PTP_CLEANUP_GROUP Group = Object->Group;
+    BOOLEAN Dereference = FALSE;
+
+    if (!Group)
+        return;
+
+    RtlAcquireSRWLockExclusive(&Group->Lock);
+    if (Object->GroupMember)
+    {
+        RemoveEntryList(&Object->GroupEntry);
+        Object->GroupMember = FALSE;
+        Dereference = TRUE;
+    }
+    RtlReleaseSRWLockExclusive(&Group->Lock);
+
+    if (Dereference)
+        TppDereferenceObject(Object);
+}
+
+static
+NTSTATUS
+TppAllocObject(IN TPP_OBJECT_TYPE Type,
+               IN PVOID Callback,
+               IN PVOID Context,
+               IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL,
+               OUT PTPP_OBJECT *ObjectReturn)
+{
+    PTPP_CALLBACK_ENVIRON_V3 Environ = (PTPP_CALLBACK_ENVIRON_V3)CallbackEnviron;
+    PTPP_OBJECT Object;
+    PTP_POOL Pool = NULL;
+    NTSTATUS Status;
+
+    if (!Callback)
+        return STATUS_INVALID_PARAMETER;
+
+    if (Environ)
+    {
+        if (Environ->Version != 1 && Environ->Version != 3)
+            return STATUS_INVALID_PARAMETER;
+        if (Environ->Version == 3 &&
+            (ULONG)Environ->CallbackPriority >= TP_CALLBACK_PRIORITY_COUNT)
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+        Pool = Environ->Pool;
+    }
+
+    if (!Pool)
+    {
+        Status = TppGetDefaultPool(&Pool);
+        if (!NT_SUCCESS(Status))
+            return Status;
+    }
+
+    Object = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Object));
+    if (!Object)
+        return STATUS_NO_MEMORY;
+
+    Object->Type = Type;
+    Object->RefCount = 1;
+    Object->Callback = Callback;
+    Object->Context = Context;
+    Object->Priority = TP_CALLBACK_PRIORITY_NORMAL;
+
+    if (Environ)
+    {
+        if (Environ->RaceDll)
+        {
+            /* Keep the DLL of the callback loaded as long as we may call it */
+            Status = LdrAddRefDll(0, Environ->RaceDll);
+            if (!NT_SUCCESS(Status))
+            {
+                RtlFreeHeap(RtlGetProcessHeap(), 0, Object);
+                return Status;
+            }
+            Object->RaceDll = Environ->RaceDll;
+        }
+
+        if (Environ->ActivationContext &&
+            Environ->ActivationContext != (struct _ACTIVATION_CONTEXT *)(LONG_PTR)-1)
+        {
+            RtlAddRefActivationContext(Environ->ActivationContext);
+            Object->ActivationContext = Environ->ActivationContext;
+        }
+
+        Object->FinalizationCallback = Environ->FinalizationCallback;
+        Object->LongFunction = Environ->u.s.LongFunction;
+        if (Environ->Version == 3)
+            Object->Priority = Environ->CallbackPriority;
+
+        Object->Group = Environ->CleanupGroup;
+        Object->GroupCancelCallback = Environ->CleanupGroupCancelCallback;
+    }
+
+    Object->Pool = Pool;
+    InterlockedIncrement(&Pool->RefCount);
+
+    /* The cleanup group holds its own reference */
+    if (Object->Group)
+    {
+        Object->RefCount++;
+        RtlAcquireSRWLockExclusive(&Object->Group->Lock);
+        InsertTailList(&Object->Group->Members, &Object->GroupEntry);
+        Object->GroupMember = TRUE;
+        RtlReleaseSRWLockExclusive(&Object->Group->Lock);
+    }
+
+    *ObjectReturn = Object;
+    return STATUS_SUCCESS;
+}
+
+/* Called when the owner closes the object */
+static
+VOID
+TppReleaseObject(IN PTPP_OBJECT Object)
+{
+    TppLeaveGroup(Object);
+    TppDereferenceObject(Object);
+}
+
+static
+ULONG
+TppPostLocked(IN PTP_POOL Pool,
+              IN PTPP_OBJECT Object,
+              IN LONGLONG Now)
+{
+    /* The queue holds a reference for all the pending callbacks */
+    if (!Object->Pending)
+    {
+        Object->QueueTime = Now;
+        InsertTailList(&Pool->Queue[Object->Priority], &Object->QueueEntry);
+        InterlockedIncrement(&Object->RefCount);
+    }
+
+    Object->Pending++;
+    Pool->QueueLength++;
+
+    return TppDispatchLocked(Pool, Now);
+}
+
+static
+VOID
+TppPostObject(IN PTPP_OBJECT Object,
+              IN BOOLEAN TimerLockHeld)
+{
+    PTP_POOL Pool = Object->Pool;
+    ULONG Actions;
+
+    RtlAcquireSRWLockExclusive(&Pool->Lock);
+    Actions = TppPostLocked(Pool, Object, TppGetInterruptTime());
+    RtlReleaseSRWLockExclusive(&Pool->Lock);
+
+    TppSignalPool(Pool, Actions, TimerLockHeld);
+}
+
+static
+PTPP_OBJECT
+TppDequeueLocked(IN PTP_POOL Pool,
+                 OUT PULONG Actions)
+{
+    PTPP_OBJECT Object;
+    ULONG Priority;
+
+    *Actions = 0;
+
+    for (Priority = 0; Priority < TP_CALLBACK_PRIORITY_COUNT; Priority++)
+    {
+        if (IsListEmpty(&Pool->Queue[Priority]))
+            continue;
+
+        /* More work than this worker can handle, get some help */
+        if (Pool->QueueLength > 1 &&
+            Pool->IdleThreads <= Pool->WakesPending &&
+            TppShouldGrowLocked(Pool, TppGetInterruptTime()))
+        {
+            Pool->Threads++;
+            *Actions = TPP_ACTION_SPAWN;
+        }
+
+        Object = CONTAINING_RECORD(Pool->Queue[Priority].Flink, TPP_OBJECT, QueueEntry);
+        RemoveEntryList(&Object->QueueEntry);
+        Object->Pending--;
+        Object->Running++;
+        Pool->QueueLength--;
+
+        /* Posted several times, let the others go first */
+        if (Object->Pending)
+        {
+            InsertTailList(&Pool->Queue[Priority], &Object->QueueEntry);
+            InterlockedIncrement(&Object->RefCount);
+        }
+
+        return Object;
+    }
+
+    return NULL;
+}
+
+static
+VOID
+TppCallbackDoneLocked(IN PTPP_OBJECT Object)
+{
+    Object->Running--;
+
+    if (Object->Waiters && !Object->Pending && !Object->Running)
+        RtlWakeAllConditionVariable(&Object->Pool->Update);
+}
+
+static
+VOID
+TppWaitForObject(IN PTPP_OBJECT Object,
+                 IN LOGICAL CancelPendingCallbacks)
+{
+    PTP_POOL Pool = Object->Pool;
+    BOOLEAN Dereference = FALSE;
+
+    RtlAcquireSRWLockExclusive(&Pool->Lock);
+
+    if (CancelPendingCallbacks && Object->Pending)
+    {
+        RemoveEntryList(&Object->QueueEntry);
+        Pool->QueueLength -= Object->Pending;
+        Object->Pending = 0;
+        Dereference = TRUE;
+    }
+
+    Object->Waiters++;
+    while (Object->Pending || Object->Running ||
+           (!CancelPendingCallbacks && Object->Type == TppObjectIo && Object->u.Io.PendingIo))
+    {
+        RtlSleepConditionVariableSRW(&Pool->Update, &Pool->Lock, NULL, 0);
+    }
+    Object->Waiters--;
+
+    RtlReleaseSRWLockExclusive(&Pool->Lock);
+
+    if (Dereference)
+        TppDereferenceObject(Object);
+}
+
+static
+VOID
+TppRunCompletionActions(IN PTP_CALLBACK_INSTANCE Instance)
+{
+    if (Instance->CriticalSection)
+        RtlLeaveCriticalSection(Instance->CriticalSection);
+    if (Instance->Mutex)
+        NtReleaseMutant(Instance->Mutex, NULL);
+    if (Instance->Semaphore)
+        NtReleaseSemaphore(Instance->Semaphore, Instance->SemaphoreCount, NULL);
+    if (Instance->Event)
+        NtSetEvent(Instance->Event, NULL);
+    if (Instance->DllHandle)
+        LdrUnloadDll(Instance->DllHandle);
+}
+
+/* The caller already counted the callback as running */
+static
+VOID
+TppExecuteObject(IN PTPP_OBJECT Object,
+                 IN PVOID ApcContext,
+                 IN PIO_STATUS_BLOCK IoStatusBlock)
+{
+    TP_CALLBACK_INSTANCE Instance;
+    PTP_POOL Pool = Object->Pool;
+    ULONG_PTR Cookie = 0;
+
+    RtlZeroMemory(&Instance, sizeof(Instance));
+    Instance.Object = Object;
+    Instance.Associated = TRUE;
+
+    if (Object->LongFunction)
+        TpCallbackMayRunLong(&Instance);
+
+    if (Object->ActivationContext)
+        RtlActivateActivationContext(0, Object->ActivationContext, &Cookie);
+
+    switch (Object->Type)
+    {
+        case TppObjectSimple:
+            ((PTP_SIMPLE_CALLBACK)Object->Callback)(&Instance, Object->Context);
+            break;
+
+        case TppObjectWork:
+            ((PTP_WORK_CALLBACK)Object->Callback)(&Instance, Object->Context, (PTP_WORK)Object);
+            break;
+
+        case TppObjectTimer:
+            ((PTP_TIMER_CALLBACK)Object->Callback)(&Instance, Object->Context, (PTP_TIMER)Object);
+            break;
+
+        case TppObjectWait:
+            ((PTP_WAIT_CALLBACK)Object->Callback)(&Instance,
+                                                  Object->Context,
+                                                  (PTP_WAIT)Object,
+                                                  Object->u.Wait.Result);
+            break;
+
+        case TppObjectIo:
+            ((PTP_IO_CALLBACK)Object->Callback)(&Instance,
+                                                Object->Context,
+                                                ApcContext,
+                                                IoStatusBlock,
+                                                (PTP_IO)Object);
+            break;
+    }
+
+    if (Cookie)
+        RtlDeactivateActivationContext(0, Cookie);
+
+    if (Object->FinalizationCallback)
+        Object->FinalizationCallback(&Instance, Object->Context);
+
+    TppRunCompletionActions(&Instance);
+
+    RtlAcquireSRWLockExclusive(&Pool->Lock);
+    if (Instance.MayRunLong)
+        Pool->LongThreads--;
+    if (Instance.Associated)
+        TppCallbackDoneLocked(Object);
+    RtlReleaseSRWLockExclusive(&Pool->Lock);
+
+    /* Fire and forget callbacks don't stay in their cleanup group */
+    if (Object->Type == TppObjectSimple)
+        TppLeaveGroup(Object);
+
+    TppDereferenceObject(Object);
+}
+
+static
+ULONG
+NTAPI
+TppWorkerThread(IN PVOID Parameter)
+{
+    PTP_POOL Pool = Parameter;
+    IO_STATUS_BLOCK IoStatusBlock;
+    LARGE_INTEGER Timeout;
+    PTPP_OBJECT Object;
+    PVOID Key, Context;
+    NTSTATUS Status;
+    ULONG Actions;
+    BOOLEAN Retire, Free;
+
+    RtlAcquireSRWLockExclusive(&Pool->Lock);
+    for (;;)
+    {
+        /* Drain the queue before going back to the port */
+        while ((Object = TppDequeueLocked(Pool, &Actions)) != NULL)
+        {
+            RtlReleaseSRWLockExclusive(&Pool->Lock);
+            TppSignalPool(Pool, Actions, FALSE);
+            TppExecuteObject(Object, NULL, NULL);
+            RtlAcquireSRWLockExclusive(&Pool->Lock);
+        }
+
+        Pool->IdleThreads++;
+        Retire = (Pool->Threads > Pool->MinThreads);
+        RtlReleaseSRWLockExclusive(&Pool->Lock);
+
+        Timeout.QuadPart = -TPP_IDLE_TIMEOUT;
+        Status = NtRemoveIoCompletion(Pool->CompletionPort,
+                                      &Key,
+                                      &Context,
+                                      &IoStatusBlock,
+                                      Retire ? &Timeout : NULL);
+
+        RtlAcquireSRWLockExclusive(&Pool->Lock);
+        Pool->IdleThreads--;
+
+        if (Status == STATUS_TIMEOUT)
+        {
+            if (!Pool->QueueLength && Pool->Threads > Pool->MinThreads)
+                break;
+            continue;
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("NtRemoveIoCompletion failed: 0x%lx\n", Status);
+            break;
+        }
+
+        if (Key == NULL)
+        {
+            if (Context == TPP_PACKET_QUIT)
+                break;
+
+            Pool->WakesPending--;
+            continue;
+        }
+
+        /* An I/O completion, the key is the I/O object */
+        Object = Key;
+        Object->u.Io.PendingIo--;
+        Object->Running++;
+        RtlReleaseSRWLockExclusive(&Pool->Lock);
+        TppExecuteObject(Object, Context, &IoStatusBlock);
+        RtlAcquireSRWLockExclusive(&Pool->Lock);
+    }
+
+    Pool->Threads--;
+    Free = (Pool->Threads == 0 && Pool->Shutdown);
+    RtlReleaseSRWLockExclusive(&Pool->Lock);
+
+    if (Free)
+        TppFreePool(Pool);
+
+    RtlExitUserThread(STATUS_SUCCESS);
+    return 0;
+}
+
+/* TIMERS *******************************************************************/
+
+static
+VOID
+TppDisarmTimerLocked(IN PTPP_TIMER_ENTRY Entry)
+{
+    if (!Entry->Armed)
+        return;
+
+    RemoveEntryList(&Entry->ListEntry);
+    Entry->Armed = FALSE;
+}
+
+static
+VOID
+TppInsertTimerLocked(IN PTPP_TIMER_ENTRY Entry)
+{
+    PLIST_ENTRY ListEntry;
+    PTPP_TIMER_ENTRY Current;
+
+    /* Keep the list sorted by due time, new timers usually go last */
+    for (ListEntry = TppTimerList.Blink; ListEntry != &TppTimerList; ListEntry = ListEntry->Blink)
+    {
+        Current = CONTAINING_RECORD(ListEntry, TPP_TIMER_ENTRY, ListEntry);
+        if (Current->DueTime <= Entry->DueTime)
+            break;
+    }
+
+    InsertHeadList(ListEntry, &Entry->ListEntry);
+    Entry->Armed = TRUE;
+}
+
+static
+ULONG
+NTAPI
+TppTimerThread(IN PVOID Parameter);
+
+static
+VOID
+TppArmTimerLocked(IN PTPP_TIMER_ENTRY Entry)
+{
+    HANDLE ThreadHandle;
+    NTSTATUS Status;
+
+    TppDisarmTimerLocked(Entry);
+
+    if (!TppTimerEvent)
+    {
+        Status = NtCreateEvent(&TppTimerEvent, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Failed to create the timer event: 0x%lx\n", Status);
+            TppTimerEvent = NULL;
+            return;
+        }
+
+        Status = RtlCreateUserThread(NtCurrentProcess(),
+                                     NULL,
+                                     FALSE,
+                                     0,
+                                     0,
+                                     0,
+                                     (PTHREAD_START_ROUTINE)TppTimerThread,
+                                     NULL,
+                                     &ThreadHandle,
+                                     NULL);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Failed to create the timer thread: 0x%lx\n", Status);
+            NtClose(TppTimerEvent);
+            TppTimerEvent = NULL;
+            return;
+        }
+        NtClose(ThreadHandle);
+    }
+
+    TppInsertTimerLocked(Entry);
+
+    /* Only wake up the timer thread if it would sleep past this one */
+    if (Entry->DueTime + Entry->WindowLength < TppTimerDeadline)
+    {
+        TppTimerDeadline = Entry->DueTime + Entry->WindowLength;
+        NtSetEvent(TppTimerEvent, NULL);
+    }
+}
+
+static
+VOID
+TppFireTimersLocked(IN LONGLONG Now)
+{
+    PTPP_TIMER_ENTRY Entry;
+    BOOLEAN Rearm;
+
+    while (!IsListEmpty(&TppTimerList))
+    {
+        Entry = CONTAINING_RECORD(TppTimerList.Flink, TPP_TIMER_ENTRY, ListEntry);
+        if (Entry->DueTime > Now)
+            break;
+
+        RemoveEntryList(&Entry->ListEntry);
+        Entry->Armed = FALSE;
+
+        if (Entry->Routine)
+        {
+            Rearm = Entry->Routine(Entry->Context);
+        }
+        else
+        {
+            TppPostObject(CONTAINING_RECORD(Entry, TPP_OBJECT, u.Timer.Entry), TRUE);
+            Rearm = TRUE;
+        }
+
+        if (Rearm && Entry->Period)
+        {
+            /* Don't try to catch up with the periods we missed */
+            Entry->DueTime += Entry->Period;
+            if (Entry->DueTime <= Now)
+                Entry->DueTime = Now + Entry->Period;
+            TppInsertTimerLocked(Entry);
+        }
+    }
+}
+
+static
+LONGLONG
+TppNextDeadlineLocked(VOID)
+{
+    PLIST_ENTRY ListEntry;
+    PTPP_TIMER_ENTRY Entry;
+    LONGLONG Deadline = MAXLONGLONG;
+
+    /* Sleep until the earliest end of a window, all the timers due by then fire together */
+    for (ListEntry = TppTimerList.Flink; ListEntry != &TppTimerList; ListEntry = ListEntry->Flink)
+    {
+        Entry = CONTAINING_RECORD(ListEntry, TPP_TIMER_ENTRY, ListEntry);
+        if (Entry->DueTime >= Deadline)
+            break;
+
+        if (Entry->DueTime + Entry->WindowLength < Deadline)
+            Deadline = Entry->DueTime + Entry->WindowLength;
+    }
+
+    return Deadline;
+}
+
+static
+ULONG
+NTAPI
+TppTimerThread(IN PVOID Parameter)
+{
+    LARGE_INTEGER Timeout;
+    LONGLONG Now, Deadline;
+
+    for (;;)
+    {
+        RtlAcquireSRWLockExclusive(&TppTimerLock);
+        Now = TppGetInterruptTime();
+        TppFireTimersLocked(Now);
+        Deadline = TppNextDeadlineLocked();
+        TppTimerDeadline = Deadline;
+        RtlReleaseSRWLockExclusive(&TppTimerLock);
+
+        if (Deadline == MAXLONGLONG)
+        {
+            NtWaitForSingleObject(TppTimerEvent, FALSE, NULL);
+        }
+        else
+        {
+            Timeout.QuadPart = min(Now - Deadline, 0);
+            NtWaitForSingleObject(TppTimerEvent, FALSE, &Timeout);
+        }
+    }
+
+    return 0;
+}
+
+/* WAITS ********************************************************************/
+
+static
+ULONG
+NTAPI
+TppWaitThread(IN PVOID Parameter);
+
+static
+VOID
+TppUnregisterWaitLocked(IN PTPP_OBJECT Wait)
+{
+    RemoveEntryList(&Wait->u.Wait.BucketEntry);
+    Wait->u.Wait.Bucket->Count--;
+    Wait->u.Wait.Bucket = NULL;
+}
+
+static
+NTSTATUS
+TppRegisterWaitLocked(IN PTPP_OBJECT Wait,
+                      IN PTPP_WAIT_BUCKET PreferredBucket OPTIONAL)
+{
+    PTPP_WAIT_BUCKET Bucket = NULL;
+    PLIST_ENTRY ListEntry;
+    HANDLE ThreadHandle;
+    NTSTATUS Status;
+
+    if (PreferredBucket && PreferredBucket->Count < TPP_MAX_BUCKET_WAITS)
+    {
+        Bucket = PreferredBucket;
+    }
+    else
+    {
+        for (ListEntry = TppWaitBuckets.Flink; ListEntry != &TppWaitBuckets; ListEntry = ListEntry->Flink)
+        {
+            Bucket = CONTAINING_RECORD(ListEntry, TPP_WAIT_BUCKET, ListEntry);
+            if (Bucket->Count < TPP_MAX_BUCKET_WAITS)
+                break;
+            Bucket = NULL;
+        }
+    }
+
+    if (!Bucket)
+    {
+        Bucket = RtlAllocateHeap(RtlGetProcessHeap(), 0, sizeof(*Bucket));
+        if (!Bucket)
+            return STATUS_NO_MEMORY;
+
+        Status = NtCreateEvent(&Bucket->UpdateEvent, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+        if (!NT_SUCCESS(Status))
+        {
+            RtlFreeHeap(RtlGetProcessHeap(), 0, Bucket);
+            return Status;
+        }
+
+        InitializeListHead(&Bucket->Waits);
+        Bucket->Count = 0;
+
+        Status = RtlCreateUserThread(NtCurrentProcess(),
+                                     NULL,
+                                     FALSE,
+                                     0,
+                                     0,
+                                     0,
+                                     (PTHREAD_START_ROUTINE)TppWaitThread,
+                                     Bucket,
+                                     &ThreadHandle,
+                                     NULL);
+        if (!NT_SUCCESS(Status))
+        {
+            NtClose(Bucket->UpdateEvent);
+            RtlFreeHeap(RtlGetProcessHeap(), 0, Bucket);
+            return Status;
+        }
+        NtClose(ThreadHandle);
+
+        InsertTailList(&TppWaitBuckets, &Bucket->ListEntry);
+    }
+
+    InsertTailList(&Bucket->Waits, &Wait->u.Wait.BucketEntry);
+    Bucket->Count++;
+    Wait->u.Wait.Bucket = Bucket;
+
+    NtSetEvent(Bucket->UpdateEvent, NULL);
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+TppFireWaitLocked(IN PTPP_OBJECT Wait,
+                  IN TP_WAIT_RESULT Result)
+{
+    TppUnregisterWaitLocked(Wait);
+    Wait->u.Wait.Result = Result;
+    TppPostObject(Wait, FALSE);
+}
+
+/* The handle may have been changed or the wait freed while we were waiting */
+static
+BOOLEAN
+TppIsWaitRegisteredLocked(IN PTPP_WAIT_BUCKET Bucket,
+                          IN PTPP_OBJECT Wait,
+                          IN ULONG Sequence)
+{
+    PLIST_ENTRY ListEntry;
+
+    for (ListEntry = Bucket->Waits.Flink; ListEntry != &Bucket->Waits; ListEntry = ListEntry->Flink)
+    {
+        if (CONTAINING_RECORD(ListEntry, TPP_OBJECT, u.Wait.BucketEntry) == Wait)
+            return (Wait->u.Wait.Sequence == Sequence);
+    }
+
+    return FALSE;
+}
+
+/* One of the handles is bad, find out which ones and drop them */
+static
+VOID
+TppCheckWaitsLocked(IN PTPP_WAIT_BUCKET Bucket)
+{
+    PLIST_ENTRY ListEntry, NextEntry;
+    LARGE_INTEGER Timeout;
+    PTPP_OBJECT Wait;
+    NTSTATUS Status;
+
+    Timeout.QuadPart = 0;
+    for (ListEntry = Bucket->Waits.Flink; ListEntry != &Bucket->Waits; ListEntry = NextEntry)
+    {
+        NextEntry = ListEntry->Flink;
+        Wait = CONTAINING_RECORD(ListEntry, TPP_OBJECT, u.Wait.BucketEntry);
+
+        Status = NtWaitForSingleObject(Wait->u.Wait.Handle, FALSE, &Timeout);
+        if (Status == STATUS_TIMEOUT)
+            continue;
+
+        if (NT_SUCCESS(Status))
+        {
+            TppFireWaitLocked(Wait, WAIT_OBJECT_0);
+        }
+        else
+        {
+            DPRINT1("Dropping wait %p on handle %p: 0x%lx\n", Wait, Wait->u.Wait.Handle, Status);
+            TppUnregisterWaitLocked(Wait);
+        }
+    }
+}
+
+static
+ULONG
+NTAPI
+TppWaitThread(IN PVOID Parameter)
+{
+    PTPP_WAIT_BUCKET Bucket = Parameter;
+    HANDLE Handles[MAXIMUM_WAIT_OBJECTS];
+    PTPP_OBJECT Waits[MAXIMUM_WAIT_OBJECTS];
+    ULONG Sequences[MAXIMUM_WAIT_OBJECTS];
+    PLIST_ENTRY ListEntry, NextEntry;
+    LARGE_INTEGER Timeout;
+    LONGLONG Now, NextTimeout;
+    PTPP_OBJECT Wait;
+    ULONG Count, Index;
+    NTSTATUS Status;
+    BOOLEAN Idle = FALSE;
+
+    Handles[0] = Bucket->UpdateEvent;
+
+    RtlAcquireSRWLockExclusive(&TppWaitLock);
+    for (;;)
+    {
+        /* Expire the waits that timed out and take a snapshot of the others */
+        Now = TppGetInterruptTime();
+        NextTimeout = MAXLONGLONG;
+        Count = 1;
+        for (ListEntry = Bucket->Waits.Flink; ListEntry != &Bucket->Waits; ListEntry = NextEntry)
+        {
+            NextEntry = ListEntry->Flink;
+            Wait = CONTAINING_RECORD(ListEntry, TPP_OBJECT, u.Wait.BucketEntry);
+
+            if (Wait->u.Wait.Timeout <= Now)
+            {
+                TppFireWaitLocked(Wait, WAIT_TIMEOUT);
+                continue;
+            }
+
+            NextTimeout = min(NextTimeout, Wait->u.Wait.Timeout);
+            Handles[Count] = Wait->u.Wait.Handle;
+            Waits[Count] = Wait;
+            Sequences[Count] = Wait->u.Wait.Sequence;
+            Count++;
+        }
+
+        /* Nothing to wait for, leave if it stays like this */
+        if (Count == 1)
+        {
+            if (Idle)
+            {
+                RemoveEntryList(&Bucket->ListEntry);
+                break;
+            }
+            NextTimeout = Now + TPP_WAIT_IDLE_TIMEOUT;
+        }
+        RtlReleaseSRWLockExclusive(&TppWaitLock);
+
+        Timeout.QuadPart = min(Now - NextTimeout, 0);
+        Status = NtWaitForMultipleObjects(Count,
+                                          Handles,
+                                          WaitAny,
+                                          FALSE,
+                                          NextTimeout == MAXLONGLONG ? NULL : &Timeout);
+
+        RtlAcquireSRWLockExclusive(&TppWaitLock);
+        Idle = (Status == STATUS_TIMEOUT && Count == 1);
+
+        if ((ULONG)Status >= STATUS_WAIT_1 && (ULONG)Status < STATUS_WAIT_0 + Count)
+            Index = (ULONG)Status - STATUS_WAIT_0;
+        else if ((ULONG)Status > STATUS_ABANDONED_WAIT_0 && (ULONG)Status < STATUS_ABANDONED_WAIT_0 + Count)
+            Index = (ULONG)Status - STATUS_ABANDONED_WAIT_0;
+        else
+            Index = 0;
+
+        if (Index)
+        {
+            if (TppIsWaitRegisteredLocked(Bucket, Waits[Index], Sequences[Index]))
+                TppFireWaitLocked(Waits[Index], WAIT_OBJECT_0);
+        }
+        else if (!NT_SUCCESS(Status))
+        {
+            TppCheckWaitsLocked(Bucket);
+        }
+    }
+    RtlReleaseSRWLockExclusive(&TppWaitLock);
+
+    NtClose(Bucket->UpdateEvent);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Bucket);
+
+    RtlExitUserThread(STATUS_SUCCESS);
+    return 0;
+}
+
+/* PUBLIC FUNCTIONS *********************************************************/
+
+NTSTATUS
+NTAPI
+TpAllocPool(OUT PTP_POOL *PoolReturn,
+            IN PVOID Reserved)
+{
+    UNREFERENCED_PARAMETER(Reserved);
+
+    return TppAllocPool(PoolReturn);
+}
+
+VOID
+NTAPI
+TpReleasePool(IN OUT PTP_POOL Pool)
+{
+    /* The objects still using it keep it alive */
+    TppDereferencePool(Pool);
+}
+
+VOID
+NTAPI
+TpSetPoolMaxThreads(IN OUT PTP_POOL Pool,
+                    IN LONG MaxThreads)
+{
+    RtlAcquireSRWLockExclusive(&Pool->Lock);
+
+    /* Extra threads retire once they are idle */
+    Pool->MaxThreads = max(MaxThreads, 1);
+    Pool->MinThreads = min(Pool->MinThreads, Pool->MaxThreads);
+
+    RtlReleaseSRWLockExclusive(&Pool->Lock);
+}
+
+NTSTATUS
+NTAPI
+TpSetPoolMinThreads(IN OUT PTP_POOL Pool,
+                    IN LONG MinThreads)
+{
+    LONG Missing, Threads;
+
+    if (MinThreads < 0)
+        return STATUS_INVALID_PARAMETER;
+
+    RtlAcquireSRWLockExclusive(&Pool->Lock);
+    Pool->MinThreads = MinThreads;
+    Pool->MaxThreads = max(Pool->MaxThreads, MinThreads);
+    Missing = max(MinThreads - Pool->Threads, 0);
+    Pool->Threads += Missing;
+    RtlReleaseSRWLockExclusive(&Pool->Lock);
+
+    while (Missing--)
+        TppCreateWorker(Pool);
+
+    RtlAcquireSRWLockExclusive(&Pool->Lock);
+    Threads = Pool->Threads;
+    RtlReleaseSRWLockExclusive(&Pool->Lock);
+
+    return (Threads >= MinThreads) ? STATUS_SUCCESS : STATUS_INSUFFICIENT_RESOURCES;
+}
+
+NTSTATUS
+NTAPI
+TpAllocCleanupGroup(OUT PTP_CLEANUP_GROUP *CleanupGroupReturn)
+{
+    PTP_CLEANUP_GROUP Group;
+
+    Group = RtlAllocateHeap(RtlGetProcessHeap(), 0, sizeof(*Group));
+    if (!Group)
+        return STATUS_NO_MEMORY;
+
+    RtlInitializeSRWLock(&Group->Lock);
+    InitializeListHead(&Group->Members);
+
+    *CleanupGroupReturn = Group;
+    return STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+TpReleaseCleanupGroup(IN OUT PTP_CLEANUP_GROUP CleanupGroup)
+{
+    ASSERT(IsListEmpty(&CleanupGroup->Members));
+    RtlFreeHeap(RtlGetProcessHeap(), 0, CleanupGroup);
+}
+
+VOID
+NTAPI
+TpReleaseCleanupGroupMembers(IN OUT PTP_CLEANUP_GROUP CleanupGroup,
+                             IN LOGICAL CancelPendingCallbacks,
+                             IN OUT PVOID CleanupParameter OPTIONAL)
+{
+    LIST_ENTRY Members;
+    PLIST_ENTRY ListEntry;
+    PTPP_OBJECT Object;
+
+    /* Take the members over, along with the references of the group */
+    InitializeListHead(&Members);
+    RtlAcquireSRWLockExclusive(&CleanupGroup->Lock);
+    while (!IsListEmpty(&CleanupGroup->Members))
+    {
+        ListEntry = RemoveHeadList(&CleanupGroup->Members);
+        CONTAINING_RECORD(ListEntry, TPP_OBJECT, GroupEntry)->GroupMember = FALSE;
+        InsertTailList(&Members, ListEntry);
+    }
+    RtlReleaseSRWLockExclusive(&CleanupGroup->Lock);
+
+    /* Don't let the timers and waits queue anything new */
+    for (ListEntry = Members.Flink; ListEntry != &Members; ListEntry = ListEntry->Flink)
+    {
+        Object = CONTAINING_RECORD(ListEntry, TPP_OBJECT, GroupEntry);
+        if (Object->Type == TppObjectTimer)
+            TpSetTimer((PTP_TIMER)Object, NULL, 0, 0);
+        else if (Object->Type == TppObjectWait)
+            TpSetWait((PTP_WAIT)Object, NULL, NULL);
+    }
+
+    for (ListEntry = Members.Flink; ListEntry != &Members; ListEntry = ListEntry->Flink)
+    {
+        Object = CONTAINING_RECORD(ListEntry, TPP_OBJECT, GroupEntry);
+        TppWaitForObject(Object, CancelPendingCallbacks);
+
+        if (CancelPendingCallbacks && Object->GroupCancelCallback)
+            Object->GroupCancelCallback(Object->Context, CleanupParameter);
+    }
+
+    while (!IsListEmpty(&Members))
+    {
+        ListEntry = RemoveHeadList(&Members);
+        Object = CONTAINING_RECORD(ListEntry, TPP_OBJECT, GroupEntry);
+
+        /* Nobody owns the simple callbacks, the others are closed for their owner */
+        if (Object->Type != TppObjectSimple)
+            TppDereferenceObject(Object);
+        TppDereferenceObject(Object);
+    }
+}
+
+NTSTATUS
+NTAPI
+TpSimpleTryPost(IN PTP_SIMPLE_CALLBACK Callback,
+                IN OUT PVOID Context OPTIONAL,
+                IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    Status = TppAllocObject(TppObjectSimple, Callback, Context, CallbackEnviron, &Object);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    /* The queue keeps it alive until it ran */
+    TppPostObject(Object, FALSE);
+    TppDereferenceObject(Object);
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+NTAPI
+TpAllocWork(OUT PTP_WORK *WorkReturn,
+            IN PTP_WORK_CALLBACK Callback,
+            IN OUT PVOID Context OPTIONAL,
+            IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    return TppAllocObject(TppObjectWork, Callback, Context, CallbackEnviron, (PTPP_OBJECT *)WorkReturn);
+}
+
+VOID
+NTAPI
+TpPostWork(IN OUT PTP_WORK Work)
+{
+    TppPostObject((PTPP_OBJECT)Work, FALSE);
+}
+
+VOID
+NTAPI
+TpReleaseWork(IN OUT PTP_WORK Work)
+{
+    TppReleaseObject((PTPP_OBJECT)Work);
+}
+
+VOID
+NTAPI
+TpWaitForWork(IN OUT PTP_WORK Work,
+              IN LOGICAL CancelPendingCallbacks)
+{
+    TppWaitForObject((PTPP_OBJECT)Work, CancelPendingCallbacks);
+}
+
+NTSTATUS
+NTAPI
+TpAllocTimer(OUT PTP_TIMER *Timer,
+             IN PTP_TIMER_CALLBACK Callback,
+             IN OUT PVOID Context OPTIONAL,
+             IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    return TppAllocObject(TppObjectTimer, Callback, Context, CallbackEnviron, (PTPP_OBJECT *)Timer);
+}
+
+VOID
+NTAPI
+TpSetTimer(IN OUT PTP_TIMER Timer,
+           IN PLARGE_INTEGER DueTime OPTIONAL,
+           IN LONG Period,
+           IN LONG WindowLength OPTIONAL)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Timer;
+    PTPP_TIMER_ENTRY Entry = &Object->u.Timer.Entry;
+    LONGLONG Now;
+
+    RtlAcquireSRWLockExclusive(&TppTimerLock);
+
+    TppDisarmTimerLocked(Entry);
+    Object->u.Timer.Set = (DueTime != NULL);
+
+    if (DueTime)
+    {
+        Now = TppGetInterruptTime();
+        Entry->Period = (LONGLONG)max(Period, 0) * 10000;
+        Entry->WindowLength = (LONGLONG)max(WindowLength, 0) * 10000;
+
+        if (DueTime->QuadPart == 0)
+        {
+            /* Fire right away */
+            TppPostObject(Object, TRUE);
+            if (Entry->Period)
+            {
+                Entry->DueTime = Now + Entry->Period;
+                TppArmTimerLocked(Entry);
+            }
+        }
+        else
+        {
+            Entry->DueTime = TppTimeoutToInterruptTime(DueTime, Now);
+            TppArmTimerLocked(Entry);
+        }
+    }
+
+    RtlReleaseSRWLockExclusive(&TppTimerLock);
+}
+
+LOGICAL
+NTAPI
+TpIsTimerSet(IN PTP_TIMER Timer)
+{
+    return ((PTPP_OBJECT)Timer)->u.Timer.Set;
+}
+
+VOID
+NTAPI
+TpReleaseTimer(IN OUT PTP_TIMER Timer)
+{
+    RtlAcquireSRWLockExclusive(&TppTimerLock);
+    TppDisarmTimerLocked(&((PTPP_OBJECT)Timer)->u.Timer.Entry);
+    RtlReleaseSRWLockExclusive(&TppTimerLock);
+
+    TppReleaseObject((PTPP_OBJECT)Timer);
+}
+
+VOID
+NTAPI
+TpWaitForTimer(IN OUT PTP_TIMER Timer,
+               IN LOGICAL CancelPendingCallbacks)
+{
+    TppWaitForObject((PTPP_OBJECT)Timer, CancelPendingCallbacks);
+}
+
+NTSTATUS
+NTAPI
+TpAllocWait(OUT PTP_WAIT *WaitReturn,
+            IN PTP_WAIT_CALLBACK Callback,
+            IN OUT PVOID Context OPTIONAL,
+            IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    return TppAllocObject(TppObjectWait, Callback, Context, CallbackEnviron, (PTPP_OBJECT *)WaitReturn);
+}
+
+VOID
+NTAPI
+TpSetWait(IN OUT PTP_WAIT Wait,
+          IN HANDLE Handle OPTIONAL,
+          IN PLARGE_INTEGER Timeout OPTIONAL)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Wait;
+    PTPP_WAIT_BUCKET OldBucket;
+    NTSTATUS Status;
+
+    RtlAcquireSRWLockExclusive(&TppWaitLock);
+
+    /* Invalidate what the bucket thread may be waiting on */
+    Object->u.Wait.Sequence++;
+    OldBucket = Object->u.Wait.Bucket;
+    if (OldBucket)
+        TppUnregisterWaitLocked(Object);
+
+    if (Handle)
+    {
+        Object->u.Wait.Handle = Handle;
+        Object->u.Wait.Timeout = TppTimeoutToInterruptTime(Timeout, TppGetInterruptTime());
+
+        Status = TppRegisterWaitLocked(Object, OldBucket);
+        if (!NT_SUCCESS(Status))
+            DPRINT1("Failed to register wait %p: 0x%lx\n", Object, Status);
+    }
+
+    if (OldBucket && OldBucket != Object->u.Wait.Bucket)
+        NtSetEvent(OldBucket->UpdateEvent, NULL);
+
+    RtlReleaseSRWLockExclusive(&TppWaitLock);
+}
+
+VOID
+NTAPI
+TpReleaseWait(IN OUT PTP_WAIT Wait)
+{
+    TpSetWait(Wait, NULL, NULL);
+    TppReleaseObject((PTPP_OBJECT)Wait);
+}
+
+VOID
+NTAPI
+TpWaitForWait(IN OUT PTP_WAIT Wait,
+              IN LOGICAL CancelPendingCallbacks)
+{
+    TppWaitForObject((PTPP_OBJECT)Wait, CancelPendingCallbacks);
+}
+
+NTSTATUS
+NTAPI
+TpAllocIoCompletion(OUT PTP_IO *IoReturn,
+                    IN HANDLE File,
+                    IN PTP_IO_CALLBACK Callback,
+                    IN OUT PVOID Context OPTIONAL,
+                    IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    FILE_COMPLETION_INFORMATION CompletionInfo;
+    IO_STATUS_BLOCK IoStatusBlock;
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    Status = TppAllocObject(TppObjectIo, Callback, Context, CallbackEnviron, &Object);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    /* Completions go straight to the workers of the pool */
+    CompletionInfo.Port = Object->Pool->CompletionPort;
+    CompletionInfo.Key = Object;
+    Status = NtSetInformationFile(File,
+                                  &IoStatusBlock,
+                                  &CompletionInfo,
+                                  sizeof(CompletionInfo),
+                                  FileCompletionInformation);
+    if (!NT_SUCCESS(Status))
+    {
+        TppReleaseObject(Object);
+        return Status;
+    }
+
+    *IoReturn = (PTP_IO)Object;
+    return STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+TpStartAsyncIoOperation(IN OUT PTP_IO Io)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Io;
+
+    /* The completion packet holds a reference */
+    InterlockedIncrement(&Object->RefCount);
+
+    RtlAcquireSRWLockExclusive(&Object->Pool->Lock);
+    Object->u.Io.PendingIo++;
+    RtlReleaseSRWLockExclusive(&Object->Pool->Lock);
+}
+
+VOID
+NTAPI
+TpCancelAsyncIoOperation(IN OUT PTP_IO Io)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Io;
+    PTP_POOL Pool = Object->Pool;
+
+    RtlAcquireSRWLockExclusive(&Pool->Lock);
+    Object->u.Io.PendingIo--;
+    if (Object->Waiters && !Object->u.Io.PendingIo && !Object->Running)
+        RtlWakeAllConditionVariable(&Pool->Update);
+    RtlReleaseSRWLockExclusive(&Pool->Lock);
+
+    TppDereferenceObject(Object);
+}
+
+VOID
+NTAPI
+TpReleaseIoCompletion(IN OUT PTP_IO Io)
+{
+    TppReleaseObject((PTPP_OBJECT)Io);
+}
+
+VOID
+NTAPI
+TpWaitForIoCompletion(IN OUT PTP_IO Io,
+                      IN LOGICAL CancelPendingCallbacks)
+{
+    TppWaitForObject((PTPP_OBJECT)Io, CancelPendingCallbacks);
+}
+
+NTSTATUS
+NTAPI
+TpCallbackMayRunLong(IN OUT PTP_CALLBACK_INSTANCE Instance)
+{
+    PTP_POOL Pool = Instance->Object->Pool;
+    NTSTATUS Status = STATUS_SUCCESS;
+    ULONG Actions = 0;
+
+    if (Instance->MayRunLong)
+        return STATUS_SUCCESS;
+
+    RtlAcquireSRWLockExclusive(&Pool->Lock);
+
+    Instance->MayRunLong = TRUE;
+    Pool->LongThreads++;
+
+    /* Somebody else has to take care of the queue now */
+    if (Pool->IdleThreads <= Pool->WakesPending)
+    {
+        if (Pool->Threads < Pool->MaxThreads)
+        {
+            Pool->Threads++;
+            Actions = TPP_ACTION_SPAWN;
+        }
+        else
+        {
+            Status = STATUS_TOO_MANY_THREADS;
+        }
+    }
+
+    RtlReleaseSRWLockExclusive(&Pool->Lock);
+
+    TppSignalPool(Pool, Actions, FALSE);
+    return Status;
+}
+
+VOID
+NTAPI
+TpDisassociateCallback(IN OUT PTP_CALLBACK_INSTANCE Instance)
+{
+    PTP_POOL Pool = Instance->Object->Pool;
+
+    RtlAcquireSRWLockExclusive(&Pool->Lock);
+    if (Instance->Associated)
+    {
+        Instance->Associated = FALSE;
+        TppCallbackDoneLocked(Instance->Object);
+    }
+    RtlReleaseSRWLockExclusive(&Pool->Lock);
+}
+
+VOID
+NTAPI
+TpCallbackSetEventOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                               IN HANDLE Event)
+{
+    Instance->Event = Event;
+}
+
+VOID
+NTAPI
+TpCallbackReleaseSemaphoreOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                       IN HANDLE Semaphore,
+                                       IN LONG ReleaseCount)
+{
+    Instance->Semaphore = Semaphore;
+    Instance->SemaphoreCount = ReleaseCount;
+}
+
+VOID
+NTAPI
+TpCallbackReleaseMutexOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                   IN HANDLE Mutex)
+{
+    Instance->Mutex = Mutex;
+}
+
+VOID
+NTAPI
+TpCallbackLeaveCriticalSectionOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                           IN OUT PRTL_CRITICAL_SECTION CriticalSection)
+{
+    Instance->CriticalSection = CriticalSection;
+}
+
+VOID
+NTAPI
+TpCallbackUnloadDllOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                IN PVOID DllHandle)
+{
+    Instance->DllHandle = DllHandle;
+}
+
+/* EOF */
@@ -85,6 +85,41 @@ CmpFileWrite(
     return (fwrite(Buffer, 1, BufferLength, File) == BufferLength);
 }
 
+static BOOLEAN
+NTAPI
+CmpFileWriteGather(
+    IN PHHIVE RegistryHive,
+    IN ULONG FileType,
+    IN PCMP_OFFSET_ARRAY OffsetArray,
+    IN ULONG OffsetArrayCount)
+{
+    PCMHIVE CmHive = (PCMHIVE)RegistryHive;
+    FILE *File = CmHive->FileHandles[HFILE_TYPE_PRIMARY];
+    ULONG FileOffset = ~0U;
+    ULONG i;
+
+    for (i = 0; i < OffsetArrayCount; i++)
+    {
+        /* Only seek when this piece doesn't follow the previous one */
+        if (OffsetArray[i].FileOffset != FileOffset)
+        {
+            FileOffset = OffsetArray[i].FileOffset;
+            if (fseek(File, FileOffset, SEEK_SET) != 0)
+                return FALSE;
+        }
+
+        if (fwrite(OffsetArray[i].DataBuffer, 1, OffsetArray[i].DataLength, File) !=
+            OffsetArray[i].DataLength)
+        {
+            return FALSE;
+        }
+
+        FileOffset += OffsetArray[i].DataLength;
+    }
+
+    return TRUE;
+}
+
 static BOOLEAN
 NTAPI
 CmpFileSetSize(
@@ -139,6 +174,8 @@ CmiInitializeHive(
         return Status;
     }
 
+    Hive->Hive.FileWriteGather = CmpFileWriteGather;
+
     // HACK: See the HACK from r31253
     if (!CmCreateRootNode(&Hive->Hive, Name))
     {
@@ -25,10 +25,13 @@ typedef struct _FONT_ENTRY_COLL_MEM
 
 typedef struct _FONT_CACHE_ENTRY
 {
-    LIST_ENTRY ListEntry;
+    LIST_ENTRY ListEntry;       /* In the global LRU list */
+    LIST_ENTRY HashEntry;       /* In its hash bucket */
+    LIST_ENTRY FaceEntry;       /* In the glyph list of its face */
     int GlyphIndex;
-    FT_Face Face;
+    PSHARED_FACE SharedFace;
     FT_BitmapGlyph BitmapGlyph;
+    SIZE_T Size;
     int Height;
     int Width;
     int Escapement;